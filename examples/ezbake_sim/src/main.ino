@@ -1,5 +1,160 @@
 #include <Arduino.h>
 
+#include "tcode_session.h"
+
+// EZ-Bake oven simulator: one zone that only heats, behind the same T-Code
+// session as the Pico simulator (lib/tcode_protocol/tcode_session.h). Line
+// assembly, checksums, the grammar, the settings commands and every error
+// line are shared; only the commands below are this sketch's.
+
+// Oven model, in tenths of a degree C.
+static const int32_t AMBIENT_DC = 220;
+static const int32_t HEAT_DC_PER_TICK = 4; // 4 C/s with the heater on
+static const int32_t HYSTERESIS_DC = 10;
+static const uint32_t TICK_MS = 100;
+
+static int32_t g_temp_dc = AMBIENT_DC;
+static int32_t g_set_dc = AMBIENT_DC;
+static bool g_heat;
+static bool g_echo;
+static uint32_t g_last_tick_ms;
+
+static char g_line[128];
+static tcode_session_t g_session;
+
+static void oven_tick() {
+  if (g_heat) {
+    g_temp_dc += HEAT_DC_PER_TICK;
+  } else {
+    // Lose 2% of the difference to ambient per tick.
+    g_temp_dc -= (g_temp_dc - AMBIENT_DC + 49) / 50;
+  }
+  if (g_temp_dc >= g_set_dc + HYSTERESIS_DC)
+    g_heat = false;
+  else if (g_temp_dc <= g_set_dc - HYSTERESIS_DC)
+    g_heat = true;
+}
+
+// -------------------------
+// T-Code commands
+// -------------------------
+
+static void add(char *line, size_t size, const char *key, const char *value) {
+  size_t len = strlen(line);
+  snprintf(line + len, size - len, " %s=%s", key, value);
+}
+
+// Q0: fields in F (all by default), oven zone 0 only.
+static void query_status(const tcode_command_t *cmd) {
+  uint32_t fields = ((uint32_t)1 << TCODE_STATUS_FIELD_COUNT) - 1;
+  if (cmd->present & TCODE_FIELD_BIT('F'))
+    fields = (uint32_t)cmd->value['F' - 'A'];
+  bool by_zone = cmd->present & TCODE_FIELD_BIT('Z');
+  if (by_zone && cmd->range_last > 0) {
+    Serial.print(F("error:UNSUPPORTED Z"));
+    Serial.println(cmd->range_last);
+    return;
+  }
+
+  char line[96] = "data:";
+  char value[16];
+  if (by_zone)
+    add(line, sizeof(line), "ZONE", "0");
+  for (int f = 0; f < TCODE_STATUS_FIELD_COUNT; ++f) {
+    if (!(fields & ((uint32_t)1 << f)))
+      continue;
+    const char *v = value;
+    switch ((tcode_status_field_t)f) {
+    case TCODE_STATUS_TEMP:
+      tcode_format_fixed(value, sizeof(value), g_temp_dc, 1);
+      break;
+    case TCODE_STATUS_SET_TEMP:
+      tcode_format_fixed(value, sizeof(value), g_set_dc, 1);
+      break;
+    case TCODE_STATUS_RH:
+    case TCODE_STATUS_SET_RH:
+      v = "0.0";
+      break;
+    case TCODE_STATUS_HEAT:
+      v = g_heat ? "true" : "false";
+      break;
+    case TCODE_STATUS_COOL:
+      v = "false";
+      break;
+    case TCODE_STATUS_STATE:
+      v = g_heat ? "RUN" : "IDLE";
+      break;
+    default:
+      v = "0";
+      break;
+    }
+    add(line, sizeof(line), tcode_status_field_name((tcode_status_field_t)f),
+        v);
+  }
+  Serial.println(line);
+}
+
+static void session_execute(void *ctx, const tcode_command_t *cmd) {
+  (void)ctx;
+  switch (cmd->cmd) {
+  case TCODE_CMD_SETPOINT: {
+    // One oven, no humidity: check every group before applying any.
+    for (uint8_t i = 0; i < cmd->group_count; ++i) {
+      const tcode_group_t *g = &cmd->group[i];
+      if (g->value[TCODE_ZONE_Z] != 0) {
+        Serial.print(F("error:UNSUPPORTED Z"));
+        Serial.println(g->value[TCODE_ZONE_Z]);
+        return;
+      }
+      if (g->present & TCODE_FIELD_BIT('H')) {
+        Serial.println(F("error:UNSUPPORTED H"));
+        return;
+      }
+    }
+    if (cmd->group[0].present & TCODE_FIELD_BIT('T'))
+      g_set_dc = cmd->group[0].value[TCODE_ZONE_T] / 10;
+    break;
+  }
+  case TCODE_CMD_Q0:
+    query_status(cmd);
+    break;
+  case TCODE_CMD_M999:
+    break; // nothing latches
+  default:
+    Serial.print(F("error:UNSUPPORTED "));
+    Serial.println(tcode_cmd_name(cmd->cmd));
+    break;
+  }
+}
+
+static int32_t setting_get(void *ctx, tcode_setting_t s) {
+  (void)ctx;
+  return s == TCODE_SETTING_ECHO ? g_echo : 0;
+}
+
+static void setting_set(void *ctx, tcode_setting_t s, int32_t v) {
+  (void)ctx;
+  if (s == TCODE_SETTING_ECHO) {
+    g_echo = v != 0;
+  } else {
+    Serial.print(F("error:UNSUPPORTED "));
+    Serial.println(tcode_setting_info(s)->key);
+  }
+}
+
+static void session_write(void *ctx, const char *text, size_t len) {
+  (void)ctx;
+  Serial.write((const uint8_t *)text, len);
+}
+
+static const tcode_session_ops_t SESSION_OPS = {
+    session_write, session_execute, setting_get, setting_set, NULL,
+};
+
+// -------------------------
+// Arduino
+// -------------------------
+
 void setup() {
   delay(1500);
 
@@ -18,18 +173,31 @@ void setup() {
     delay(100);
     digitalWrite(LED_BUILTIN, HIGH);
   }
-  
+
   Serial.flush();
+  tcode_session_init(&g_session, g_line, sizeof(g_line), &SESSION_OPS, NULL);
+  g_last_tick_ms = millis();
 }
 
 void loop() {
-  if (Serial.available()) {
-    int c = Serial.read();
-    // Test: send ? and we reply "OK" (no echo). If "OK" is clean, the bug is in webserial.io send/echo path.
-    if (c == '?' || c == 'Q') {
-      Serial.println(F("OK"));
-    } else {
-      Serial.write((uint8_t)c);
-    }
+  // Hand everything already received to the session in chunks, without
+  // waiting for more: a slow host never stalls the oven.
+  char chunk[32];
+  int pending = Serial.available();
+  while (pending > 0) {
+    int n = pending < (int)sizeof(chunk) ? pending : (int)sizeof(chunk);
+    n = Serial.readBytes(chunk, n);
+    if (n <= 0)
+      break;
+    if (g_echo)
+      Serial.write((const uint8_t *)chunk, n);
+    tcode_session_feed(&g_session, chunk, (size_t)n);
+    pending -= n;
+  }
+
+  if (millis() - g_last_tick_ms >= TICK_MS) {
+    g_last_tick_ms += TICK_MS;
+    oven_tick();
+    digitalWrite(LED_BUILTIN, g_heat ? HIGH : LOW);
   }
 }
@@ -0,0 +1,209 @@
+// The sketch's receive path on the host: `pio test -e native`.
+//
+// Feeds the line set of `tcode_grammar -b` (tools/grammar/grammar.c), plus a
+// settings line, through a tcode_session, one line per fresh session. Checks
+// that it runs exactly the command the generated decoder makes of each line
+// (a setting through the setting hook), stamps the line's stages, and
+// rejects with an error line each one the decoder rejects. Then times the
+// whole set through one session, as the grammar benchmark's "session" path
+// does.
+
+#include "tcode_grammar.h"
+#include "tcode_protocol.h"
+#include "tcode_session.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+// The traffic a host sends, plus malformed lines. "*" gets the line's XOR
+// checksum.
+static const char *const LINES[] = {
+    "Q0",         "Q0",          "Q0",          "Q0",         "T-10",
+    "H35",        "N12 T25",     "Z0 T25",      "Z0 H50",     "Q1 BUILD",
+    "Q1 BUILDER", "Q2",          "Q3",          "Q4",         "Q5",
+    "M30",        "M 31",        "M32 S1",      "M33 S=2",    "M999",
+    "T120",       "H-5",         "Z1 T5",       "Q9",         "Q1 NOPE",
+    "M33 S7",     "M32",         "Qx",          "N100 Q0*",   "M22 K=ECHO V1",
+};
+static const int LINE_COUNT = (int)(sizeof(LINES) / sizeof(LINES[0]));
+
+#define LINE_BYTES 72
+static char g_lines[LINE_COUNT][LINE_BYTES];
+static char g_transcript[LINE_COUNT * LINE_BYTES];
+static size_t g_transcript_len;
+
+// A device that only records what the session hands it.
+struct Device {
+  int executed;
+  tcode_command_t last;
+  int settings_set;
+  tcode_setting_t setting;
+  int32_t setting_value;
+  uint32_t ticks; // the clock
+  char out[256];
+  size_t out_len;
+  uint32_t oks;
+};
+
+static void dev_write(void *ctx, const char *text, size_t len) {
+  Device *d = (Device *)ctx;
+  if (len == 3 && memcmp(text, "ok\n", 3) == 0)
+    d->oks++;
+  size_t room = sizeof(d->out) - 1 - d->out_len;
+  if (len > room)
+    len = room;
+  memcpy(d->out + d->out_len, text, len);
+  d->out_len += len;
+  d->out[d->out_len] = '\0';
+}
+
+static void dev_execute(void *ctx, const tcode_command_t *cmd) {
+  Device *d = (Device *)ctx;
+  d->executed++;
+  d->last = *cmd;
+}
+
+static int32_t dev_setting_get(void *ctx, tcode_setting_t s) {
+  (void)ctx;
+  (void)s;
+  return 0;
+}
+
+static void dev_setting_set(void *ctx, tcode_setting_t s, int32_t value) {
+  Device *d = (Device *)ctx;
+  d->settings_set++;
+  d->setting = s;
+  d->setting_value = value;
+}
+
+static uint32_t dev_clock(void *ctx) { return ++((Device *)ctx)->ticks; }
+
+static const tcode_session_ops_t DEV_OPS = {
+    dev_write,       dev_execute, dev_setting_get,
+    dev_setting_set, nullptr,     dev_clock,
+};
+
+static bool is_setting(const tcode_command_t &cmd) {
+  return cmd.cmd == TCODE_CMD_M20 || cmd.cmd == TCODE_CMD_M21 ||
+         cmd.cmd == TCODE_CMD_M22;
+}
+
+static char g_session_buf[256];
+
+static void prepare_lines() {
+  g_transcript_len = 0;
+  for (int i = 0; i < LINE_COUNT; ++i) {
+    const char *star = strchr(LINES[i], '*');
+    if (star) {
+      char body[LINE_BYTES - 4]; // room for "*XX"
+      snprintf(body, sizeof(body), "%.*s", (int)(star - LINES[i]), LINES[i]);
+      snprintf(g_lines[i], LINE_BYTES, "%s*%02X", body,
+               tcode_checksum_xor(body));
+    } else {
+      snprintf(g_lines[i], LINE_BYTES, "%s", LINES[i]);
+    }
+    g_transcript_len += (size_t)snprintf(g_transcript + g_transcript_len,
+                                         sizeof(g_transcript) -
+                                             g_transcript_len,
+                                         "%s\n", g_lines[i]);
+  }
+}
+
+// Only the fields in `present` and the groups below group_count are set.
+static void assert_same_command(const tcode_command_t &want,
+                                const tcode_command_t &got, const char *line) {
+  TEST_ASSERT_EQUAL_INT_MESSAGE(want.cmd, got.cmd, line);
+  TEST_ASSERT_EQUAL_MESSAGE(want.has_line_number, got.has_line_number, line);
+  TEST_ASSERT_EQUAL_INT32_MESSAGE(want.line_number, got.line_number, line);
+  TEST_ASSERT_EQUAL_HEX32_MESSAGE(want.present, got.present, line);
+  for (int f = 0; f < 26; ++f) {
+    if (want.present & ((uint32_t)1 << f))
+      TEST_ASSERT_EQUAL_INT32_MESSAGE(want.value[f], got.value[f], line);
+  }
+  TEST_ASSERT_EQUAL_INT16_MESSAGE(want.key, got.key, line);
+  TEST_ASSERT_EQUAL_INT32_MESSAGE(want.range_last, got.range_last, line);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(want.group_count, got.group_count, line);
+  for (int g = 0; g < want.group_count; ++g) {
+    const tcode_group_t &a = want.group[g];
+    const tcode_group_t &b = got.group[g];
+    TEST_ASSERT_EQUAL_HEX32_MESSAGE(a.present, b.present, line);
+    for (int f = 0; f < TCODE_ZONE_FIELD_COUNT; ++f)
+      TEST_ASSERT_EQUAL_INT32_MESSAGE(a.value[f], b.value[f], line);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_session_matches_decoder() {
+  for (int i = 0; i < LINE_COUNT; ++i) {
+    const char *line = g_lines[i];
+    char buf[LINE_BYTES];
+    memcpy(buf, line, sizeof(buf));
+    tcode_parsed_line_t parsed;
+    tcode_command_t want;
+    tcode_decode_status_t st = TCODE_DECODE_BAD_VALUE;
+    if (tcode_parse_inplace(buf, &parsed) == TCODE_OK)
+      st = tcode_decode(&parsed, &want);
+
+    Device dev = {};
+    tcode_session_t session;
+    tcode_session_init(&session, g_session_buf, sizeof(g_session_buf),
+                       &DEV_OPS, &dev);
+    tcode_session_feed(&session, line, strlen(line));
+    tcode_session_feed(&session, "\n", 1);
+
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(1, dev.oks, line);
+    if (st == TCODE_DECODE_OK && is_setting(want)) {
+      TEST_ASSERT_EQUAL_INT_MESSAGE(0, dev.executed, line);
+      TEST_ASSERT_EQUAL_INT_MESSAGE(1, dev.settings_set, line);
+      TEST_ASSERT_EQUAL_INT_MESSAGE(want.key, dev.setting, line);
+      TEST_ASSERT_EQUAL_INT32_MESSAGE(want.value['V' - 'A'], dev.setting_value,
+                                      line);
+      TEST_ASSERT_EQUAL_STRING_MESSAGE("ok\n", dev.out, line);
+    } else if (st == TCODE_DECODE_OK) {
+      TEST_ASSERT_EQUAL_INT_MESSAGE(1, dev.executed, line);
+      TEST_ASSERT_EQUAL_STRING_MESSAGE("ok\n", dev.out, line);
+      assert_same_command(want, dev.last, line);
+    } else {
+      TEST_ASSERT_EQUAL_INT_MESSAGE(0, dev.executed, line);
+      TEST_ASSERT_EQUAL_INT_MESSAGE(0, strncmp(dev.out, "error:", 6), line);
+    }
+    // Every line that ran has this line's stages, in order.
+    if (st == TCODE_DECODE_OK) {
+      TEST_ASSERT_EQUAL_UINT32_MESSAGE(1, session.t_parsed, line);
+      TEST_ASSERT_EQUAL_UINT32_MESSAGE(2, session.t_dispatched, line);
+    }
+  }
+}
+
+void test_session_timing() {
+  const long iterations = 20000;
+  Device dev = {};
+  tcode_session_t session;
+  tcode_session_init(&session, g_session_buf, sizeof(g_session_buf), &DEV_OPS,
+                     &dev);
+  auto start = std::chrono::steady_clock::now();
+  for (long it = 0; it < iterations; ++it) {
+    dev.out_len = 0;
+    tcode_session_feed(&session, g_transcript, g_transcript_len);
+  }
+  std::chrono::duration<double, std::nano> took =
+      std::chrono::steady_clock::now() - start;
+
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)(iterations * LINE_COUNT), dev.oks);
+  char msg[64];
+  snprintf(msg, sizeof(msg), "session: %.1f ns/line",
+           took.count() / ((double)iterations * LINE_COUNT));
+  TEST_MESSAGE(msg);
+}
+
+int main() {
+  prepare_lines();
+  UNITY_BEGIN();
+  RUN_TEST(test_session_matches_decoder);
+  RUN_TEST(test_session_timing);
+  return UNITY_END();
+}
@@ -0,0 +1,143 @@
+cmake_minimum_required(VERSION 3.13)
+
+# Summarise a GNU ld map file into per-subsystem flash/RAM usage.
+#
+# Inputs (passed via -D):
+# - TCODE_MAP_FILE        linker map (tcode_simulator.elf.map)
+# - TCODE_MEMORY_REPORT   output text file
+# - TCODE_RAM_BUDGET      optional, bytes, listed in the report
+# - TCODE_FLASH_BUDGET    optional, bytes, listed in the report
+#
+# The budgets are enforced at link time (tcode_budget.ld.in). The report only
+# shows them, so that an image over budget is never left on disk.
+#
+# Input sections are attributed to a subsystem from the object file that
+# contributed them. Sections linked at 0x2xxxxxxx count as RAM, 0x10xxxxxx as
+# flash; initialised data (.data) costs both.
+
+if(NOT DEFINED TCODE_MAP_FILE OR NOT EXISTS "${TCODE_MAP_FILE}")
+  message(FATAL_ERROR "TCODE_MAP_FILE not set or missing")
+endif()
+if(NOT DEFINED TCODE_MEMORY_REPORT OR TCODE_MEMORY_REPORT STREQUAL "")
+  message(FATAL_ERROR "TCODE_MEMORY_REPORT not set")
+endif()
+if(NOT DEFINED TCODE_RAM_BUDGET OR TCODE_RAM_BUDGET STREQUAL "")
+  set(TCODE_RAM_BUDGET 0)
+endif()
+if(NOT DEFINED TCODE_FLASH_BUDGET OR TCODE_FLASH_BUDGET STREQUAL "")
+  set(TCODE_FLASH_BUDGET 0)
+endif()
+
+# Maps an object/archive path to a subsystem name.
+function(tcode_subsystem_of path out_var)
+  if(path MATCHES "/tasks/([a-z0-9_]+)\\.c")
+    set(_sub "${CMAKE_MATCH_1}")
+  elseif(path MATCHES "/lib/freertos_support\\.c")
+    set(_sub "freertos_support")
+  elseif(path MATCHES "libfreertos_kernel\\.a")
+    set(_sub "freertos_kernel")
+  elseif(path MATCHES "tcode_simulator\\.dir/lib/([a-z0-9_]+)/")
+    set(_sub "${CMAKE_MATCH_1}")
+  elseif(path MATCHES "tcode_simulator\\.dir/main\\.c")
+    set(_sub "main")
+  elseif(path MATCHES "lib(c|c_nano|m|g|gcc|nosys|stdc\\+\\+)\\.a")
+    set(_sub "libc")
+  elseif(path MATCHES "pico")
+    set(_sub "pico_sdk")
+  else()
+    set(_sub "other")
+  endif()
+  set(${out_var} "${_sub}" PARENT_SCOPE)
+endfunction()
+
+# Input section lines either fit on one line:
+#   " .text.foo  0x10000340  0x1c path/obj.o"
+# or wrap when the section name is long:
+#   " .text.some_long_name"
+#   "                0x10000340       0x1c path/obj.o"
+file(STRINGS "${TCODE_MAP_FILE}" _lines
+     REGEX "^Linker script and memory map|^ \\.[^ ]+|^ +0x[0-9a-fA-F]+ +0x[0-9a-fA-F]+ ")
+
+set(_in_map FALSE)
+set(_pending "")
+set(_subsystems "")
+foreach(_line IN LISTS _lines)
+  if(_line MATCHES "^Linker script and memory map")
+    set(_in_map TRUE)
+    continue()
+  endif()
+  if(NOT _in_map)
+    continue()
+  endif()
+
+  if(_line MATCHES "^ (\\.[^ ]+) +0x([0-9a-fA-F]+) +0x([0-9a-fA-F]+) +(.+)$")
+    set(_section "${CMAKE_MATCH_1}")
+    set(_addr "${CMAKE_MATCH_2}")
+    set(_size "${CMAKE_MATCH_3}")
+    set(_file "${CMAKE_MATCH_4}")
+  elseif(_line MATCHES "^ (\\.[^ ]+)$")
+    set(_pending "${CMAKE_MATCH_1}")
+    continue()
+  elseif(NOT _pending STREQUAL "" AND
+         _line MATCHES "^ +0x([0-9a-fA-F]+) +0x([0-9a-fA-F]+) +(.+)$")
+    set(_section "${_pending}")
+    set(_addr "${CMAKE_MATCH_1}")
+    set(_size "${CMAKE_MATCH_2}")
+    set(_file "${CMAKE_MATCH_3}")
+  else()
+    set(_pending "")
+    continue()
+  endif()
+  set(_pending "")
+
+  math(EXPR _size_dec "0x${_size}")
+  if(_size_dec EQUAL 0)
+    continue()
+  endif()
+
+  math(EXPR _addr_dec "0x${_addr}")
+
+  set(_is_ram FALSE)
+  set(_is_flash FALSE)
+  if(_addr_dec GREATER_EQUAL 536870912 AND _addr_dec LESS 805306368) # 0x2xxxxxxx
+    set(_is_ram TRUE)
+    if(_section MATCHES "^\\.data|^\\.time_critical|^\\.ram_vector")
+      set(_is_flash TRUE) # load image lives in flash
+    endif()
+  elseif(_addr_dec GREATER_EQUAL 268435456 AND _addr_dec LESS 536870912) # 0x1xxxxxxx
+    set(_is_flash TRUE)
+  else()
+    continue()
+  endif()
+
+  tcode_subsystem_of("${_file}" _sub)
+  if(NOT _sub IN_LIST _subsystems)
+    list(APPEND _subsystems "${_sub}")
+    set(_ram_${_sub} 0)
+    set(_flash_${_sub} 0)
+  endif()
+  if(_is_ram)
+    math(EXPR _ram_${_sub} "${_ram_${_sub}} + ${_size_dec}")
+  endif()
+  if(_is_flash)
+    math(EXPR _flash_${_sub} "${_flash_${_sub}} + ${_size_dec}")
+  endif()
+endforeach()
+
+list(SORT _subsystems)
+
+set(_total_ram 0)
+set(_total_flash 0)
+set(_report "# Memory report (bytes), generated from ${TCODE_MAP_FILE}\n")
+string(APPEND _report "# SUBSYSTEM FLASH RAM\n")
+foreach(_sub IN LISTS _subsystems)
+  string(APPEND _report "${_sub} ${_flash_${_sub}} ${_ram_${_sub}}\n")
+  math(EXPR _total_ram "${_total_ram} + ${_ram_${_sub}}")
+  math(EXPR _total_flash "${_total_flash} + ${_flash_${_sub}}")
+endforeach()
+string(APPEND _report "TOTAL ${_total_flash} ${_total_ram}\n")
+string(APPEND _report "BUDGET ${TCODE_FLASH_BUDGET} ${TCODE_RAM_BUDGET}\n")
+
+file(WRITE "${TCODE_MEMORY_REPORT}" "${_report}")
+message(STATUS "Memory report: ${TCODE_MEMORY_REPORT} "
+               "(flash ${_total_flash} B, RAM ${_total_ram} B)")
@@ -12,13 +12,23 @@
 // Provided by the application (see `lib/freertos_support.c`)
 void vAssertCalled(const char *file, int line);
 
+// Provided by the application (see `lib/rtos_stats/rtos_stats.c`)
+uint64_t rtos_stats_time_us(void);
+void rtos_stats_on_switch_in(uint32_t tcb_number);
+
 // -----------------------------
 // Scheduler / core configuration
 // -----------------------------
 
 #define configUSE_PREEMPTION 1
 #define configUSE_TIME_SLICING 1
-#define configUSE_TICKLESS_IDLE 0
+// Set by CMake (-DTCODE_TICKLESS_IDLE=ON). The tasks block on notifications
+// and timers rather than polling, so the idle task can stop the SysTick and
+// sleep until the next timeout or interrupt.
+#ifndef TCODE_TICKLESS_IDLE
+#define TCODE_TICKLESS_IDLE 0
+#endif
+#define configUSE_TICKLESS_IDLE TCODE_TICKLESS_IDLE
 
 // RP2040 default clk_sys is 125 MHz unless you change it.
 #define configCPU_CLOCK_HZ ( ( unsigned long ) 125000000UL )
@@ -34,8 +44,24 @@ void vAssertCalled(const char *file, int line);
 // Memory allocation
 // -----------------------------
 
+// Set by CMake (-DTCODE_STATIC_ALLOCATION=ON). In static builds every task,
+// queue and buffer comes from statically declared storage and heap_4 is not
+// linked at all, so running out of RAM is a link error instead of a blink code.
+#ifndef TCODE_STATIC_ALLOCATION
+#define TCODE_STATIC_ALLOCATION 0
+#endif
+
+#if TCODE_STATIC_ALLOCATION
+#define configSUPPORT_STATIC_ALLOCATION 1
+#define configSUPPORT_DYNAMIC_ALLOCATION 0
+#else
 #define configSUPPORT_STATIC_ALLOCATION 0
 #define configSUPPORT_DYNAMIC_ALLOCATION 1
+#endif
+
+// Matches the stack size argument of vApplicationGet*TaskMemory across
+// kernel versions (StackType_t is 32-bit on this port).
+#define configSTACK_DEPTH_TYPE uint32_t
 
 // heap_4.c uses this as the heap size (bytes).
 // Tune this as you add tasks/queues/etc.
@@ -66,19 +92,34 @@ void vAssertCalled(const char *file, int line);
 
 #define configUSE_IDLE_HOOK 0
 #define configUSE_TICK_HOOK 0
-#define configUSE_MALLOC_FAILED_HOOK 1
+#define configUSE_MALLOC_FAILED_HOOK configSUPPORT_DYNAMIC_ALLOCATION
 #define configCHECK_FOR_STACK_OVERFLOW 2
 
-#define configUSE_TRACE_FACILITY 0
-#define configGENERATE_RUN_TIME_STATS 0
-#define configUSE_STATS_FORMATTING_FUNCTIONS 0
-
 #define configASSERT( x )                                                        \
   if ( ( x ) == 0 ) {                                                            \
     portDISABLE_INTERRUPTS();                                                    \
     vAssertCalled(__FILE__, __LINE__);                                           \
   }
 
+// -----------------------------
+// Runtime statistics (Q2)
+// -----------------------------
+
+#define configUSE_TRACE_FACILITY 1
+#define configGENERATE_RUN_TIME_STATS 1
+#define configUSE_STATS_FORMATTING_FUNCTIONS configSUPPORT_DYNAMIC_ALLOCATION
+
+// 64-bit microsecond counter from the RP2040 timer; it is already running
+// so there is nothing to configure, and it won't wrap like a 32-bit count.
+#define configRUN_TIME_COUNTER_TYPE uint64_t
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE() rtos_stats_time_us()
+
+// Count context switches per task. Expands inside tasks.c, where
+// pxCurrentTCB is visible; uxTCBNumber exists with the trace facility.
+#define traceTASK_SWITCHED_IN()                                                  \
+  rtos_stats_on_switch_in((uint32_t)pxCurrentTCB->uxTCBNumber)
+
 // -----------------------------
 // RP2040 / Cortex-M0+ specifics
 // -----------------------------
@@ -106,7 +147,7 @@ void vAssertCalled(const char *file, int line);
 #define INCLUDE_vTaskCleanUpResources 0
 #define INCLUDE_xTaskGetIdleTaskHandle 0
 #define INCLUDE_eTaskGetState 0
-#define INCLUDE_uxTaskGetStackHighWaterMark 0
+#define INCLUDE_uxTaskGetStackHighWaterMark 1
 #define INCLUDE_xTaskAbortDelay 0
 #define INCLUDE_xTaskGetHandle 0
 
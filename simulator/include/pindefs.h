@@ -4,4 +4,12 @@
 #define STAT_LED_PIN 25
 
 // Neopixel driver (Devboard needs R68 soldered)
-#define NEOPIXEL_PIN 23
\ No newline at end of file
+#define NEOPIXEL_PIN 23
+// Pixels on the NeoPixel chain (one status pixel per zone)
+#define NEOPIXEL_NUM_PIXELS 1
+
+// T-Code UART (the second serial port, next to USB)
+#define TCODE_UART uart0
+#define TCODE_UART_TX_PIN 0
+#define TCODE_UART_RX_PIN 1
+#define TCODE_UART_BAUD 115200
@@ -0,0 +1,45 @@
+#pragma once
+
+// Task and software-timer creation that works in both heap (xTaskCreate) and
+// static-allocation (xTaskCreateStatic) builds. Declare storage once at file scope and pass it
+// to task_alloc_create():
+//
+//   TASK_ALLOC_STORAGE(serial, SERIAL_TASK_STACK_WORDS);
+//   ...
+//   return task_alloc_create(serial_task, "serial", SERIAL_TASK_STACK_WORDS,
+//                            cfg, priority, TASK_ALLOC_STACK(serial),
+//                            TASK_ALLOC_TCB(serial), out_handle);
+//
+// In heap builds the storage macros expand to nothing and NULL.
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+
+#if configSUPPORT_STATIC_ALLOCATION
+#define TASK_ALLOC_STORAGE(name, stack_words)                                    \
+  static StackType_t name##_task_stack[stack_words];                             \
+  static StaticTask_t name##_task_tcb
+#define TASK_ALLOC_STACK(name) (name##_task_stack)
+#define TASK_ALLOC_TCB(name) (&name##_task_tcb)
+#define TIMER_ALLOC_STORAGE(name) static StaticTimer_t name##_timer_buf
+#define TIMER_ALLOC_BUF(name) (&name##_timer_buf)
+#else
+#define TASK_ALLOC_STORAGE(name, stack_words) struct name##_task_alloc_unused
+#define TASK_ALLOC_STACK(name) NULL
+#define TASK_ALLOC_TCB(name) NULL
+#define TIMER_ALLOC_STORAGE(name) struct name##_timer_alloc_unused
+#define TIMER_ALLOC_BUF(name) NULL
+#endif
+
+// Defined in lib/freertos_support.c.
+BaseType_t task_alloc_create(TaskFunction_t fn, const char *name,
+                             uint32_t stack_words, void *param,
+                             UBaseType_t priority, StackType_t *stack,
+                             StaticTask_t *tcb, TaskHandle_t *out_handle);
+
+// Same idea for software timers (TIMER_ALLOC_STORAGE / TIMER_ALLOC_BUF).
+TimerHandle_t timer_alloc_create(const char *name, TickType_t period,
+                                 UBaseType_t auto_reload, void *id,
+                                 TimerCallbackFunction_t cb,
+                                 StaticTimer_t *buf);
@@ -0,0 +1,265 @@
+#include "alarm_rules.h"
+
+#include <string.h>
+
+// Low-pass time constant for the RATE signals, so one noisy sample does not
+// look like a runaway.
+#define RATE_TAU_MS 2000
+
+static int32_t to_milli(float x) {
+  return (int32_t)(x * 1000.0f + (x >= 0.0f ? 0.5f : -0.5f));
+}
+
+static int32_t abs32(int32_t x) { return x < 0 ? -x : x; }
+
+static bool spec_valid(const alarm_rule_spec_t *s) {
+  if (s->code == 0 || s->hold_s < 0.0f || s->kind >= ALARM_KIND_COUNT)
+    return false;
+  if (s->severity != ALARM_SEVERITY_WARN && s->severity != ALARM_SEVERITY_FAULT)
+    return false;
+  switch (s->kind) {
+  case ALARM_KIND_ABOVE:
+  case ALARM_KIND_BELOW:
+    return s->signal < ALARM_SIGNAL_COUNT;
+  case ALARM_KIND_RATE:
+    return s->signal < ALARM_SIGNAL_COUNT && s->threshold >= 0.0f;
+  case ALARM_KIND_STUCK:
+    return (s->signal == ALARM_SIGNAL_HEATER ||
+            s->signal == ALARM_SIGNAL_COOLER) &&
+           s->threshold > 0.0f;
+  case ALARM_KIND_TIMEOUT:
+    return s->threshold >= 0.0f;
+  default:
+    return false;
+  }
+}
+
+int alarm_rules_compile(alarm_rules_t *ar, const alarm_rule_spec_t *specs,
+                        int n) {
+  memset(ar, 0, sizeof(*ar));
+  ar->specs = specs;
+  if (n < 0 || n > ALARM_RULES_MAX)
+    return n < 0 ? 0 : n;
+
+  uint16_t per_kind[ALARM_KIND_COUNT] = {0};
+  for (int i = 0; i < n; ++i) {
+    if (!spec_valid(&specs[i]))
+      return i;
+    per_kind[specs[i].kind]++;
+  }
+
+  // Stable counting sort by kind.
+  uint16_t next[ALARM_KIND_COUNT];
+  uint16_t start = 0;
+  for (int k = 0; k < ALARM_KIND_COUNT; ++k) {
+    ar->kind_start[k] = start;
+    next[k] = start;
+    start += per_kind[k];
+  }
+  ar->kind_start[ALARM_KIND_COUNT] = start;
+
+  for (int i = 0; i < n; ++i) {
+    const alarm_rule_spec_t *s = &specs[i];
+    alarm_rule_t *r = &ar->rules[next[s->kind]++];
+    r->threshold = to_milli(s->threshold);
+    r->hold_ms = (uint32_t)(s->hold_s * 1000.0f + 0.5f);
+    r->code = s->code;
+    r->signal = (uint8_t)s->signal;
+    r->severity = (uint8_t)s->severity;
+    r->spec_index = (uint16_t)i;
+  }
+  ar->count = (uint16_t)n;
+  return -1;
+}
+
+static void push_event(alarm_rules_t *ar, uint16_t rule, bool raised) {
+  if (ar->event_count >= ALARM_RULES_EVENT_QUEUE) {
+    ar->events_dropped++;
+    return;
+  }
+  uint8_t slot =
+      (uint8_t)((ar->event_head + ar->event_count) % ALARM_RULES_EVENT_QUEUE);
+  ar->events[slot].rule = rule;
+  ar->events[slot].raised = raised;
+  ar->event_count++;
+}
+
+// Applies the rule's condition for this tick. Returns true on an edge.
+static bool set_active(alarm_rules_t *ar, uint16_t i, bool active) {
+  alarm_rule_state_t *st = &ar->state[i];
+  if (st->active == active)
+    return false;
+  st->active = active;
+  if (active) {
+    ar->active_count++;
+    if (ar->rules[i].severity == ALARM_SEVERITY_FAULT && !ar->fault_latched) {
+      ar->fault_latched = true;
+      ar->fault_code = ar->rules[i].code;
+    }
+  } else {
+    ar->active_count--;
+  }
+  push_event(ar, i, active);
+  return true;
+}
+
+// Condition must hold continuously for hold_ms before the rule activates.
+static bool hold(alarm_rule_state_t *st, const alarm_rule_t *r, bool cond,
+                 uint32_t now_ms) {
+  if (!cond) {
+    st->pending = false;
+    return false;
+  }
+  if (!st->pending) {
+    st->pending = true;
+    st->since_ms = now_ms;
+  }
+  return now_ms - st->since_ms >= r->hold_ms;
+}
+
+// Highest severity wins, then the earliest rule in the spec table.
+static void update_alarm_code(alarm_rules_t *ar) {
+  uint16_t code = 0;
+  int best_sev = -1;
+  uint16_t best_index = 0xFFFF;
+  for (uint16_t i = 0; i < ar->count && ar->active_count; ++i) {
+    if (!ar->state[i].active)
+      continue;
+    const alarm_rule_t *r = &ar->rules[i];
+    if (r->severity > best_sev ||
+        (r->severity == best_sev && r->spec_index < best_index)) {
+      best_sev = r->severity;
+      best_index = r->spec_index;
+      code = r->code;
+    }
+  }
+  ar->alarm_code = code;
+}
+
+static void update_signals(alarm_rules_t *ar, const alarm_inputs_t *in) {
+  int32_t sig[ALARM_SIGNAL_COUNT];
+  int32_t sp = to_milli(in->setpoint_c);
+  sig[ALARM_SIGNAL_TEMP] = to_milli(in->temperature_c);
+  sig[ALARM_SIGNAL_RH] = to_milli(in->humidity);
+  sig[ALARM_SIGNAL_TEMP_ERROR] = sig[ALARM_SIGNAL_TEMP] - sp;
+  sig[ALARM_SIGNAL_TEMP_ERROR_ABS] = abs32(sig[ALARM_SIGNAL_TEMP_ERROR]);
+
+  if (!ar->primed) {
+    ar->primed = true;
+    ar->setpoint_mc = sp;
+    ar->setpoint_changed_ms = in->now_ms;
+  } else {
+    uint32_t dt = in->now_ms - ar->last_ms;
+    if (dt > 0) {
+      for (int s = 0; s < ALARM_SIGNAL_COUNT; ++s) {
+        int64_t raw = ((int64_t)(sig[s] - ar->signal[s]) * 1000) / dt;
+        int64_t delta =
+            ((raw - ar->rate[s]) * (int64_t)dt) / (RATE_TAU_MS + (int64_t)dt);
+        ar->rate[s] += (int32_t)delta;
+      }
+    }
+    if (sp != ar->setpoint_mc) {
+      ar->setpoint_mc = sp;
+      ar->setpoint_changed_ms = in->now_ms;
+    }
+  }
+  memcpy(ar->signal, sig, sizeof(sig));
+  ar->last_ms = in->now_ms;
+}
+
+void alarm_rules_eval(alarm_rules_t *ar, const alarm_inputs_t *in) {
+  const uint32_t now = in->now_ms;
+  const uint16_t *ks = ar->kind_start;
+  bool edges = false;
+
+  update_signals(ar, in);
+
+  for (uint16_t i = ks[ALARM_KIND_ABOVE]; i < ks[ALARM_KIND_ABOVE + 1]; ++i) {
+    const alarm_rule_t *r = &ar->rules[i];
+    bool cond = ar->signal[r->signal] > r->threshold;
+    edges |= set_active(ar, i, hold(&ar->state[i], r, cond, now));
+  }
+
+  for (uint16_t i = ks[ALARM_KIND_BELOW]; i < ks[ALARM_KIND_BELOW + 1]; ++i) {
+    const alarm_rule_t *r = &ar->rules[i];
+    bool cond = ar->signal[r->signal] < r->threshold;
+    edges |= set_active(ar, i, hold(&ar->state[i], r, cond, now));
+  }
+
+  for (uint16_t i = ks[ALARM_KIND_RATE]; i < ks[ALARM_KIND_RATE + 1]; ++i) {
+    const alarm_rule_t *r = &ar->rules[i];
+    bool cond = abs32(ar->rate[r->signal]) > r->threshold;
+    edges |= set_active(ar, i, hold(&ar->state[i], r, cond, now));
+  }
+
+  // Stuck actuator: while it is on, the temperature must move `threshold`
+  // in its direction at least every hold_ms. Each time it does, the window
+  // restarts from there.
+  const int32_t temp = ar->signal[ALARM_SIGNAL_TEMP];
+  for (uint16_t i = ks[ALARM_KIND_STUCK]; i < ks[ALARM_KIND_STUCK + 1]; ++i) {
+    const alarm_rule_t *r = &ar->rules[i];
+    alarm_rule_state_t *st = &ar->state[i];
+    bool heater = r->signal == ALARM_SIGNAL_HEATER;
+    bool on = heater ? in->heater_on : in->cooler_on;
+    bool cond = false;
+    if (!on) {
+      st->pending = false;
+    } else {
+      if (!st->pending) {
+        st->pending = true;
+        st->since_ms = now;
+        st->ref = temp;
+      }
+      int32_t progress = heater ? temp - st->ref : st->ref - temp;
+      if (progress >= r->threshold) {
+        st->since_ms = now;
+        st->ref = temp;
+      }
+      cond = now - st->since_ms >= r->hold_ms;
+    }
+    edges |= set_active(ar, i, cond);
+  }
+
+  // Setpoint timeout: after each setpoint change the temperature must get
+  // within `threshold` of it within hold_ms. `ref` records that it did.
+  const int32_t abs_err = ar->signal[ALARM_SIGNAL_TEMP_ERROR_ABS];
+  for (uint16_t i = ks[ALARM_KIND_TIMEOUT]; i < ks[ALARM_KIND_TIMEOUT + 1];
+       ++i) {
+    const alarm_rule_t *r = &ar->rules[i];
+    alarm_rule_state_t *st = &ar->state[i];
+    if (!st->pending || st->since_ms != ar->setpoint_changed_ms) {
+      st->pending = true;
+      st->since_ms = ar->setpoint_changed_ms;
+      st->ref = 0;
+    }
+    if (abs_err <= r->threshold)
+      st->ref = 1;
+    bool cond = !st->ref && now - st->since_ms >= r->hold_ms;
+    edges |= set_active(ar, i, cond);
+  }
+
+  if (edges)
+    update_alarm_code(ar);
+}
+
+bool alarm_rules_pop_event(alarm_rules_t *ar, alarm_event_t *out) {
+  if (ar->event_count == 0)
+    return false;
+  *out = ar->events[ar->event_head];
+  ar->event_head = (uint8_t)((ar->event_head + 1) % ALARM_RULES_EVENT_QUEUE);
+  ar->event_count--;
+  return true;
+}
+
+void alarm_rules_clear_fault(alarm_rules_t *ar) {
+  ar->fault_latched = false;
+  ar->fault_code = 0;
+  // A fault whose condition persists cannot be acknowledged away.
+  for (uint16_t i = 0; i < ar->count; ++i) {
+    if (ar->state[i].active && ar->rules[i].severity == ALARM_SEVERITY_FAULT) {
+      ar->fault_latched = true;
+      ar->fault_code = ar->rules[i].code;
+      break;
+    }
+  }
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+// Alarm/fault rule engine.
+//
+// Rules are written as alarm_rule_spec_t (floats, seconds, names) and
+// compiled once into a flat table: integer thresholds in milli-units and
+// milliseconds, grouped by kind so each kind is evaluated in its own tight
+// loop. alarm_rules_eval() then runs once per sim tick with incremental
+// per-rule state; it never allocates and never touches strings, and its cost
+// is a handful of integer compares per rule.
+//
+// Raised/cleared alarms are queued as events for the caller to report.
+// Rules with ALARM_SEVERITY_FAULT latch a fault that stays set until
+// alarm_rules_clear_fault().
+//
+// Plain C with no RTOS dependencies; the host tools link it.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Capacity of a compiled table. Override with -DALARM_RULES_MAX=n.
+#ifndef ALARM_RULES_MAX
+#define ALARM_RULES_MAX 32
+#endif
+
+// Pending raise/clear events between two drains.
+#define ALARM_RULES_EVENT_QUEUE 8
+
+typedef enum alarm_kind {
+  ALARM_KIND_ABOVE = 0, // signal > threshold for hold_s
+  ALARM_KIND_BELOW,     // signal < threshold for hold_s
+  ALARM_KIND_RATE,      // |d(signal)/dt| > threshold (units/s) for hold_s
+  ALARM_KIND_STUCK,     // actuator on for hold_s without threshold progress
+  ALARM_KIND_TIMEOUT,   // not within threshold of setpoint hold_s after change
+  ALARM_KIND_COUNT,
+} alarm_kind_t;
+
+typedef enum alarm_signal {
+  ALARM_SIGNAL_TEMP = 0,      // degC
+  ALARM_SIGNAL_RH,            // %RH
+  ALARM_SIGNAL_TEMP_ERROR,    // temperature - setpoint, degC
+  ALARM_SIGNAL_TEMP_ERROR_ABS,
+  ALARM_SIGNAL_COUNT,
+
+  // Actuators, for ALARM_KIND_STUCK
+  ALARM_SIGNAL_HEATER = ALARM_SIGNAL_COUNT, // expects temperature to rise
+  ALARM_SIGNAL_COOLER,                      // expects temperature to fall
+} alarm_signal_t;
+
+typedef enum alarm_severity {
+  ALARM_SEVERITY_WARN = 0,  // reported while active
+  ALARM_SEVERITY_FAULT = 1, // also latches the fault
+} alarm_severity_t;
+
+typedef struct alarm_rule_spec {
+  uint16_t code; // reported as Q0 ALARM, must be nonzero
+  const char *name;
+  alarm_kind_t kind;
+  alarm_signal_t signal;
+  float threshold; // STUCK: minimum progress; TIMEOUT: band around setpoint
+  float hold_s;
+  alarm_severity_t severity;
+} alarm_rule_spec_t;
+
+// Sampled once per tick by the caller.
+typedef struct alarm_inputs {
+  uint32_t now_ms;
+  float temperature_c;
+  float humidity;
+  float setpoint_c;
+  bool heater_on;
+  bool cooler_on;
+} alarm_inputs_t;
+
+// Compiled rule. Thresholds are in milli-units of the signal.
+typedef struct alarm_rule {
+  int32_t threshold;
+  uint32_t hold_ms;
+  uint16_t code;
+  uint8_t signal;
+  uint8_t severity;
+  uint16_t spec_index; // back to the spec, for names in reports
+} alarm_rule_t;
+
+// Incremental per-rule state.
+typedef struct alarm_rule_state {
+  uint32_t since_ms; // when the condition (or the current stretch) began
+  int32_t ref;       // STUCK: temperature at since_ms; TIMEOUT: band reached
+  bool pending;      // condition true, hold time running
+  bool active;
+} alarm_rule_state_t;
+
+typedef struct alarm_event {
+  uint16_t rule; // index into the compiled table
+  bool raised;   // false = cleared
+} alarm_event_t;
+
+typedef struct alarm_rules {
+  const alarm_rule_spec_t *specs;
+
+  // Rules of kind k are rules[kind_start[k] .. kind_start[k + 1]).
+  uint16_t count;
+  uint16_t kind_start[ALARM_KIND_COUNT + 1];
+  alarm_rule_t rules[ALARM_RULES_MAX];
+  alarm_rule_state_t state[ALARM_RULES_MAX];
+
+  // Signals in milli-units, this tick and last tick, and filtered rates.
+  bool primed;
+  uint32_t last_ms;
+  int32_t signal[ALARM_SIGNAL_COUNT];
+  int32_t rate[ALARM_SIGNAL_COUNT]; // milli-units per second
+  int32_t setpoint_mc;
+  uint32_t setpoint_changed_ms;
+
+  uint16_t active_count;
+  uint16_t alarm_code; // highest-severity active rule, first in spec order
+  bool fault_latched;
+  uint16_t fault_code; // rule that latched the fault
+
+  alarm_event_t events[ALARM_RULES_EVENT_QUEUE];
+  uint8_t event_head;
+  uint8_t event_count;
+  uint16_t events_dropped;
+} alarm_rules_t;
+
+// Compile `n` specs. Returns -1 on success, otherwise the index of the first
+// invalid spec (or `n` if there are more than ALARM_RULES_MAX). The specs
+// must outlive `ar` (names are looked up from them).
+int alarm_rules_compile(alarm_rules_t *ar, const alarm_rule_spec_t *specs,
+                        int n);
+
+// Evaluate every rule against one tick of inputs.
+void alarm_rules_eval(alarm_rules_t *ar, const alarm_inputs_t *in);
+
+// Pop the oldest raise/clear event. Returns false if none are queued.
+bool alarm_rules_pop_event(alarm_rules_t *ar, alarm_event_t *out);
+
+// Acknowledge a latched fault. If a FAULT rule is still active the fault
+// stays latched, now attributed to that rule.
+void alarm_rules_clear_fault(alarm_rules_t *ar);
+
+static inline const alarm_rule_spec_t *
+alarm_rules_spec(const alarm_rules_t *ar, uint16_t rule) {
+  return &ar->specs[ar->rules[rule].spec_index];
+}
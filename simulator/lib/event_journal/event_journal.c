@@ -0,0 +1,134 @@
+#include "event_journal.h"
+
+#include <string.h>
+
+// Bytes a record with `len` payload bytes takes in the ring.
+static inline uint32_t record_bytes(uint8_t len) {
+  return (EVENT_JOURNAL_HEADER_BYTES + (uint32_t)len + 3u) & ~3u;
+}
+
+static inline event_journal_header_t header_at(const event_journal_t *j,
+                                               uint32_t pos) {
+  event_journal_header_t h;
+  memcpy(&h, j->buf + (pos & j->mask), sizeof(h));
+  return h;
+}
+
+// Bytes from `pos` to the end of the buffer.
+static inline uint32_t to_end(const event_journal_t *j, uint32_t pos) {
+  return j->mask + 1u - (pos & j->mask);
+}
+
+// True if `pos` is padding up to the end of the buffer: a PAD record, or
+// less than a header's worth of space.
+static inline bool at_pad(const event_journal_t *j, uint32_t pos) {
+  return to_end(j, pos) < EVENT_JOURNAL_HEADER_BYTES ||
+         header_at(j, pos).type == EVENT_JOURNAL_TYPE_PAD;
+}
+
+// Drops records at the tail until `need` bytes are free.
+static void make_room(event_journal_t *j, uint32_t need) {
+  while (j->mask + 1u - (j->head - j->tail) < need) {
+    if (at_pad(j, j->tail)) {
+      j->tail += to_end(j, j->tail);
+      continue;
+    }
+    j->tail += record_bytes(header_at(j, j->tail).len);
+    j->tail_seq++;
+    j->dropped++;
+  }
+}
+
+bool event_journal_init(event_journal_t *j, void *buf, uint32_t size) {
+  if (!j || !buf || size < 2u * EVENT_JOURNAL_MAX_RECORD ||
+      (size & (size - 1u)) || ((uintptr_t)buf & 3u))
+    return false;
+  memset(j, 0, sizeof(*j));
+  j->buf = (uint8_t *)buf;
+  j->mask = size - 1u;
+  return true;
+}
+
+void event_journal_append(event_journal_t *j, uint8_t type, uint32_t tick,
+                          const void *payload, uint8_t len) {
+  uint32_t need = record_bytes(len);
+  uint32_t room = to_end(j, j->head);
+  if (j->lock)
+    j->lock();
+  if (room < need) {
+    // Records are never split: pad out the end of the buffer and wrap.
+    make_room(j, room);
+    if (room >= EVENT_JOURNAL_HEADER_BYTES) {
+      event_journal_header_t pad = {0, 0, EVENT_JOURNAL_TYPE_PAD, 0};
+      memcpy(j->buf + (j->head & j->mask), &pad, sizeof(pad));
+    }
+    j->head += room;
+  }
+  make_room(j, need);
+
+  uint8_t *p = j->buf + (j->head & j->mask);
+  event_journal_header_t h = {tick, (uint16_t)j->seq, type, len};
+  memcpy(p, &h, sizeof(h));
+  if (len)
+    memcpy(p + EVENT_JOURNAL_HEADER_BYTES, payload, len);
+  j->head += need;
+  j->seq++;
+  if (j->unlock)
+    j->unlock();
+}
+
+void event_journal_cursor_init(const event_journal_t *j,
+                               event_journal_cursor_t *cur) {
+  cur->pos = j->tail;
+  cur->seq = j->tail_seq;
+  cur->lost = 0;
+}
+
+bool event_journal_next(const event_journal_t *j, event_journal_cursor_t *cur,
+                        event_journal_record_t *out) {
+  // Resume at the oldest record left if ours were overwritten (and skip any
+  // padding before it).
+  if ((int32_t)(cur->seq - j->tail_seq) <= 0) {
+    cur->lost += j->tail_seq - cur->seq;
+    cur->pos = j->tail;
+    cur->seq = j->tail_seq;
+  }
+  while (cur->pos != j->head) {
+    if (at_pad(j, cur->pos)) {
+      cur->pos += to_end(j, cur->pos);
+      continue;
+    }
+    event_journal_header_t h = header_at(j, cur->pos);
+    out->hdr = h;
+    out->seq = cur->seq;
+    out->payload = j->buf + (cur->pos & j->mask) + EVENT_JOURNAL_HEADER_BYTES;
+    cur->pos += record_bytes(h.len);
+    cur->seq++;
+    return true;
+  }
+  return false;
+}
+
+size_t event_journal_export(const event_journal_record_t *rec, void *buf,
+                            size_t size) {
+  size_t n = EVENT_JOURNAL_HEADER_BYTES + rec->hdr.len;
+  if (size < n)
+    return 0;
+  memcpy(buf, &rec->hdr, EVENT_JOURNAL_HEADER_BYTES);
+  memcpy((uint8_t *)buf + EVENT_JOURNAL_HEADER_BYTES, rec->payload,
+         rec->hdr.len);
+  return n;
+}
+
+size_t event_journal_import(const void *buf, size_t size,
+                            event_journal_record_t *out) {
+  if (size < EVENT_JOURNAL_HEADER_BYTES)
+    return 0;
+  memcpy(&out->hdr, buf, EVENT_JOURNAL_HEADER_BYTES);
+  size_t n = EVENT_JOURNAL_HEADER_BYTES + out->hdr.len;
+  if (size < n)
+    return 0;
+  out->seq = out->hdr.seq;
+  out->payload = (const uint8_t *)buf + EVENT_JOURNAL_HEADER_BYTES;
+  return n;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// Binary event journal: a ring of small typed records in RAM.
+//
+// Each record is an 8-byte header (tick, sequence number, type, payload
+// length) and up to 255 payload bytes, stored whole (never split across the
+// end of the buffer) and padded to 4 bytes. When the ring is full the oldest
+// records are dropped, so it always holds the most recent history. Appending
+// is a header store and a memcpy.
+//
+// Pure C, no FreeRTOS: a writer in one task and a reader in another share
+// the ring through the lock hooks (appends) and their own lock (reads).
+// Records are also the unit of the exported form (Q6, journal files):
+// header plus `len` payload bytes, little endian.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define EVENT_JOURNAL_HEADER_BYTES 8
+#define EVENT_JOURNAL_MAX_PAYLOAD 255
+#define EVENT_JOURNAL_MAX_RECORD \
+  (EVENT_JOURNAL_HEADER_BYTES + EVENT_JOURNAL_MAX_PAYLOAD)
+
+// Record types below this are reserved for the journal itself.
+#define EVENT_JOURNAL_TYPE_PAD 0
+#define EVENT_JOURNAL_TYPE_USER 1
+
+typedef struct event_journal_header {
+  uint32_t tick;
+  uint16_t seq; // low bits of the record's sequence number
+  uint8_t type;
+  uint8_t len; // payload bytes
+} event_journal_header_t;
+
+typedef struct event_journal {
+  uint8_t *buf;
+  uint32_t mask; // size - 1; size is a power of two
+  // Free-running byte positions: records live in [tail, head).
+  uint32_t head;
+  uint32_t tail;
+  uint32_t seq;      // of the next record
+  uint32_t tail_seq; // of the record at tail
+  uint32_t dropped;  // records overwritten so far
+
+  // Optional, called around each append, e.g. to enter and leave a
+  // critical section when another task reads the ring. NULL by default.
+  void (*lock)(void);
+  void (*unlock)(void);
+} event_journal_t;
+
+// A reader's position. Starts at the oldest record; `lost` counts records
+// that were overwritten before this reader got to them.
+typedef struct event_journal_cursor {
+  uint32_t pos;
+  uint32_t seq;
+  uint32_t lost;
+} event_journal_cursor_t;
+
+typedef struct event_journal_record {
+  event_journal_header_t hdr;
+  uint32_t seq;
+  const uint8_t *payload; // points into the ring: copy before unlocking
+} event_journal_record_t;
+
+// `size` must be a power of two of at least 2 * EVENT_JOURNAL_MAX_RECORD
+// bytes, and `buf` 4-byte aligned. Returns false otherwise. Set the lock
+// hooks after this.
+bool event_journal_init(event_journal_t *j, void *buf, uint32_t size);
+
+// Append a record, dropping the oldest ones to make room. `type` must be
+// EVENT_JOURNAL_TYPE_USER or above.
+void event_journal_append(event_journal_t *j, uint8_t type, uint32_t tick,
+                          const void *payload, uint8_t len);
+
+void event_journal_cursor_init(const event_journal_t *j,
+                               event_journal_cursor_t *cur);
+
+// Next record at `cur`, advancing it. Returns false when the reader has
+// caught up with the writer. A reader in another task than the writer holds
+// the writer's lock from this call until it is done with `out->payload`.
+bool event_journal_next(const event_journal_t *j, event_journal_cursor_t *cur,
+                        event_journal_record_t *out);
+
+// Exported form of a record: header then payload, EVENT_JOURNAL_HEADER_BYTES
+// + rec->hdr.len bytes. Returns that length, or 0 if `size` is too small.
+size_t event_journal_export(const event_journal_record_t *rec, void *buf,
+                            size_t size);
+
+// Parses one exported record from `buf`. Returns the bytes it took, or 0 if
+// `size` does not hold a whole record. `out->payload` points into `buf`.
+size_t event_journal_import(const void *buf, size_t size,
+                            event_journal_record_t *out);
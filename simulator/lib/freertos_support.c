@@ -4,6 +4,7 @@
 #include "hardware/gpio.h"
 #include "pico/stdlib.h"
 #include "pindefs.h"
+#include "task_alloc.h"
 
 // Some Pico SDK builds keep the vector table entries as `isr_*` symbols rather
 // than CMSIS names. Provide minimal wrappers that branch straight into the
@@ -76,3 +77,53 @@ void vApplicationStackOverflowHook(TaskHandle_t xTask, char *pcTaskName) {
   fatal_blink(600, 200);
 }
 
+
+BaseType_t task_alloc_create(TaskFunction_t fn, const char *name,
+                             uint32_t stack_words, void *param,
+                             UBaseType_t priority, StackType_t *stack,
+                             StaticTask_t *tcb, TaskHandle_t *out_handle) {
+#if configSUPPORT_STATIC_ALLOCATION
+  TaskHandle_t handle =
+      xTaskCreateStatic(fn, name, stack_words, param, priority, stack, tcb);
+  if (out_handle)
+    *out_handle = handle;
+  return handle ? pdPASS : pdFAIL;
+#else
+  (void)stack;
+  (void)tcb;
+  return xTaskCreate(fn, name, stack_words, param, priority, out_handle);
+#endif
+}
+
+TimerHandle_t timer_alloc_create(const char *name, TickType_t period,
+                                 UBaseType_t auto_reload, void *id,
+                                 TimerCallbackFunction_t cb,
+                                 StaticTimer_t *buf) {
+#if configSUPPORT_STATIC_ALLOCATION
+  return xTimerCreateStatic(name, period, auto_reload, id, cb, buf);
+#else
+  (void)buf;
+  return xTimerCreate(name, period, auto_reload, id, cb);
+#endif
+}
+
+#if configSUPPORT_STATIC_ALLOCATION
+// Kernel-owned tasks need their storage supplied by the application too.
+void vApplicationGetIdleTaskMemory(StaticTask_t **tcb, StackType_t **stack,
+                                   configSTACK_DEPTH_TYPE *stack_words) {
+  static StaticTask_t idle_tcb;
+  static StackType_t idle_stack[configMINIMAL_STACK_SIZE];
+  *tcb = &idle_tcb;
+  *stack = idle_stack;
+  *stack_words = configMINIMAL_STACK_SIZE;
+}
+
+void vApplicationGetTimerTaskMemory(StaticTask_t **tcb, StackType_t **stack,
+                                    configSTACK_DEPTH_TYPE *stack_words) {
+  static StaticTask_t timer_tcb;
+  static StackType_t timer_stack[configTIMER_TASK_STACK_DEPTH];
+  *tcb = &timer_tcb;
+  *stack = timer_stack;
+  *stack_words = configTIMER_TASK_STACK_DEPTH;
+}
+#endif
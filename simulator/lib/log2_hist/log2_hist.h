@@ -0,0 +1,47 @@
+#pragma once
+
+// Fixed-bucket log2 histogram for latency-style samples (usually microseconds).
+//
+// Bucket 0 holds zero samples, bucket i (i >= 1) holds [2^(i-1), 2^i).
+// The last bucket also collects everything larger. Adding a sample is a
+// count-leading-zeros plus a handful of increments, so it is cheap enough to
+// leave enabled on the hot path.
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef LOG2_HIST_BUCKETS
+#define LOG2_HIST_BUCKETS 16
+#endif
+
+typedef struct log2_hist {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint32_t buckets[LOG2_HIST_BUCKETS];
+} log2_hist_t;
+
+static inline void log2_hist_reset(log2_hist_t *h) {
+  memset(h, 0, sizeof(*h));
+  h->min = UINT32_MAX;
+}
+
+static inline uint32_t log2_hist_bucket(uint32_t v) {
+  uint32_t b = v ? (uint32_t)(32 - __builtin_clz(v)) : 0u;
+  return b < LOG2_HIST_BUCKETS ? b : LOG2_HIST_BUCKETS - 1u;
+}
+
+static inline void log2_hist_add(log2_hist_t *h, uint32_t v) {
+  h->buckets[log2_hist_bucket(v)]++;
+  h->count++;
+  h->sum += v;
+  if (v < h->min)
+    h->min = v;
+  if (v > h->max)
+    h->max = v;
+}
+
+static inline uint32_t log2_hist_mean(const log2_hist_t *h) {
+  return h->count ? (uint32_t)(h->sum / h->count) : 0u;
+}
@@ -0,0 +1,54 @@
+#include "loop_monitor.h"
+
+void loop_monitor_init(loop_monitor_t *m, uint32_t nominal_period_us,
+                       uint32_t late_tolerance_us) {
+  if (!m)
+    return;
+  m->nominal_period_us = nominal_period_us;
+  m->late_tolerance_us = late_tolerance_us;
+  loop_monitor_reset(m);
+}
+
+void loop_monitor_reset(loop_monitor_t *m) {
+  if (!m)
+    return;
+  m->started = false;
+  m->last_start_us = 0;
+  m->ticks = 0;
+  m->deadline_misses = 0;
+  m->overruns = 0;
+  log2_hist_reset(&m->period);
+  log2_hist_reset(&m->jitter);
+  log2_hist_reset(&m->exec);
+}
+
+void loop_monitor_set_period(loop_monitor_t *m, uint32_t nominal_period_us) {
+  if (m)
+    m->nominal_period_us = nominal_period_us;
+}
+
+uint32_t loop_monitor_begin(loop_monitor_t *m, uint32_t now_us) {
+  uint32_t period = 0;
+  if (m->started) {
+    period = now_us - m->last_start_us; // wrap-safe on uint32_t
+    uint32_t nominal = m->nominal_period_us;
+    uint32_t jitter = period > nominal ? period - nominal : nominal - period;
+    log2_hist_add(&m->period, period);
+    log2_hist_add(&m->jitter, jitter);
+    if (period > nominal + m->late_tolerance_us)
+      m->deadline_misses++;
+  }
+  m->started = true;
+  m->last_start_us = now_us;
+  m->ticks++;
+  return period;
+}
+
+void loop_monitor_end(loop_monitor_t *m, uint32_t now_us) {
+  if (!m->started)
+    return; // reset since begin(): this tick has no start time
+  uint32_t exec = now_us - m->last_start_us;
+  log2_hist_add(&m->exec, exec);
+  if (exec > m->nominal_period_us)
+    m->overruns++;
+}
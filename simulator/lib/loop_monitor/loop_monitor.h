@@ -0,0 +1,47 @@
+#pragma once
+
+// Periodic loop timing monitor.
+//
+// Call loop_monitor_begin() when a periodic tick wakes up and
+// loop_monitor_end() when its work is done, both with a free-running
+// microsecond timestamp. The monitor tracks the real period, the jitter
+// against the nominal period, the execution time, and counts late wakeups
+// (deadline misses) and ticks whose work took longer than the period
+// (overruns).
+
+#include "log2_hist.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct loop_monitor {
+  uint32_t nominal_period_us;
+  uint32_t late_tolerance_us; // wakeups later than nominal + this are misses
+
+  bool started;
+  uint32_t last_start_us;
+  uint32_t ticks;
+  uint32_t deadline_misses;
+  uint32_t overruns;
+
+  log2_hist_t period; // measured start-to-start time
+  log2_hist_t jitter; // |measured period - nominal period|
+  log2_hist_t exec; // begin -> end
+} loop_monitor_t;
+
+void loop_monitor_init(loop_monitor_t *m, uint32_t nominal_period_us,
+                       uint32_t late_tolerance_us);
+
+// Clear all statistics but keep the configuration. The next begin() starts a
+// fresh period measurement.
+void loop_monitor_reset(loop_monitor_t *m);
+
+// Change the nominal period, e.g. when the loop rate is adapted at runtime.
+void loop_monitor_set_period(loop_monitor_t *m, uint32_t nominal_period_us);
+
+// Mark the start of a tick. Returns the measured period in microseconds, or 0
+// on the first tick after init/reset.
+uint32_t loop_monitor_begin(loop_monitor_t *m, uint32_t now_us);
+
+// Mark the end of the current tick. Ignored if the monitor was reset since
+// the tick's begin(), e.g. by another task.
+void loop_monitor_end(loop_monitor_t *m, uint32_t now_us);
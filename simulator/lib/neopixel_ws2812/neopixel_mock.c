@@ -0,0 +1,37 @@
+#include "neopixel_mock.h"
+
+#include <string.h>
+
+#define WS2812_RESET_US 300u // matches neopixel_ws2812.c
+
+static bool mock_busy(void *ctx) {
+  neopixel_mock_t *m = (neopixel_mock_t *)ctx;
+  m->busy_calls++;
+  return m->now_us < m->idle_at_us;
+}
+
+static void mock_start(void *ctx, const uint32_t *words, uint16_t count) {
+  neopixel_mock_t *m = (neopixel_mock_t *)ctx;
+  if (m->now_us < m->idle_at_us)
+    m->overlapped_starts++;
+  m->dma_starts++;
+  m->words_sent += count;
+  if (count > NEOPIXEL_STRIP_MAX_PIXELS)
+    count = NEOPIXEL_STRIP_MAX_PIXELS;
+  memcpy(m->wire, words, count * sizeof(words[0]));
+  m->wire_count = count;
+  m->idle_at_us =
+      m->now_us + ((uint64_t)m->pixel_us_x16 * count) / 16u + m->reset_us;
+}
+
+const neopixel_backend_ops_t NEOPIXEL_MOCK_OPS = {
+    .busy = mock_busy,
+    .start = mock_start,
+};
+
+void neopixel_mock_init(neopixel_mock_t *m, float freq_hz, bool is_rgbw) {
+  memset(m, 0, sizeof(*m));
+  m->pixel_us_x16 =
+      (uint32_t)((is_rgbw ? 32.0f : 24.0f) * 16.0e6f / freq_hz + 0.5f);
+  m->reset_us = WS2812_RESET_US;
+}
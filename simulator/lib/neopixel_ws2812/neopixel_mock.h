@@ -0,0 +1,33 @@
+#pragma once
+
+// Host stand-in for the RP2040 PIO + DMA backend of neopixel_strip.
+//
+// Models the wire timing (a frame is busy for its shift time plus the reset
+// gap, against a clock the caller advances) and records what was sent and
+// how often, so strip behaviour can be checked off-target.
+
+#include "neopixel_strip.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct neopixel_mock {
+  uint64_t now_us; // advanced by the caller
+  uint64_t idle_at_us;
+  uint32_t pixel_us_x16;
+  uint32_t reset_us;
+
+  // Call counts
+  uint32_t busy_calls;
+  uint32_t dma_starts;
+  uint64_t words_sent;
+  uint32_t overlapped_starts; // start() while still busy: a driver bug
+
+  // Last frame "on the wire"
+  uint32_t wire[NEOPIXEL_STRIP_MAX_PIXELS];
+  uint16_t wire_count;
+} neopixel_mock_t;
+
+extern const neopixel_backend_ops_t NEOPIXEL_MOCK_OPS;
+
+// Same frame timing as the RP2040 backend (see neopixel_ws2812.c).
+void neopixel_mock_init(neopixel_mock_t *m, float freq_hz, bool is_rgbw);
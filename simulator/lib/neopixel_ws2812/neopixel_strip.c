@@ -0,0 +1,46 @@
+#include "neopixel_strip.h"
+
+#include <string.h>
+
+void neopixel_strip_init(neopixel_strip_t *s, const neopixel_backend_ops_t *ops,
+                         void *ctx, uint16_t count) {
+  memset(s, 0, sizeof(*s));
+  s->ops = ops;
+  s->ctx = ctx;
+  s->count = count > NEOPIXEL_STRIP_MAX_PIXELS ? NEOPIXEL_STRIP_MAX_PIXELS
+                                                : count;
+  s->dirty = true;
+}
+
+void neopixel_strip_set_rgb(neopixel_strip_t *s, uint16_t index, uint8_t r,
+                            uint8_t g, uint8_t b) {
+  if (index >= s->count)
+    return;
+  uint32_t word = neopixel_strip_word(r, g, b);
+  if (s->frame[index] != word) {
+    s->frame[index] = word;
+    s->dirty = true;
+  }
+}
+
+void neopixel_strip_fill_rgb(neopixel_strip_t *s, uint16_t first,
+                             uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+  for (uint16_t i = 0; i < n; ++i)
+    neopixel_strip_set_rgb(s, (uint16_t)(first + i), r, g, b);
+}
+
+neopixel_commit_result_t neopixel_strip_commit(neopixel_strip_t *s) {
+  if (!s->dirty) {
+    s->stats.clean++;
+    return NEOPIXEL_COMMIT_CLEAN;
+  }
+  if (s->ops->busy(s->ctx)) {
+    s->stats.busy++;
+    return NEOPIXEL_COMMIT_BUSY;
+  }
+  memcpy(s->tx, s->frame, s->count * sizeof(s->tx[0]));
+  s->dirty = false;
+  s->ops->start(s->ctx, s->tx, s->count);
+  s->stats.sent++;
+  return NEOPIXEL_COMMIT_SENT;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// WS2812 strip framebuffer with dirty tracking and non-blocking commit.
+//
+// Pixels are kept as ready-to-send PIO FIFO words. Setting a pixel to the
+// colour it already has does not dirty the frame, and committing a clean
+// frame costs nothing, so callers can "set" every tick. A dirty commit copies
+// the frame into a transmit buffer and hands it to the backend (DMA on the
+// RP2040, see neopixel_ws2812.h; a mock on the host, see neopixel_mock.h).
+// If the previous frame is still being shifted out the commit returns BUSY
+// and the frame stays dirty for the next attempt; it never waits.
+//
+// Plain C with no Pico SDK dependencies.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef NEOPIXEL_STRIP_MAX_PIXELS
+#define NEOPIXEL_STRIP_MAX_PIXELS 16
+#endif
+
+typedef struct neopixel_backend_ops {
+  // True while a previous frame is still going out (transfer running, FIFO
+  // draining or the WS2812 reset/latch time not yet over).
+  bool (*busy)(void *ctx);
+  // Start sending `count` FIFO words. `words` stays valid and unmodified
+  // until busy() returns false. Must not block.
+  void (*start)(void *ctx, const uint32_t *words, uint16_t count);
+} neopixel_backend_ops_t;
+
+typedef enum neopixel_commit_result {
+  NEOPIXEL_COMMIT_SENT = 0,
+  NEOPIXEL_COMMIT_CLEAN, // nothing changed since the last frame sent
+  NEOPIXEL_COMMIT_BUSY,  // previous frame still in flight; still dirty
+} neopixel_commit_result_t;
+
+typedef struct neopixel_strip_stats {
+  uint32_t sent;
+  uint32_t clean;
+  uint32_t busy;
+} neopixel_strip_stats_t;
+
+typedef struct neopixel_strip {
+  const neopixel_backend_ops_t *ops;
+  void *ctx;
+  uint16_t count;
+  bool dirty;
+  uint32_t frame[NEOPIXEL_STRIP_MAX_PIXELS]; // being edited
+  uint32_t tx[NEOPIXEL_STRIP_MAX_PIXELS];    // owned by the backend in flight
+  neopixel_strip_stats_t stats;
+} neopixel_strip_t;
+
+// `count` is clamped to NEOPIXEL_STRIP_MAX_PIXELS. All pixels start off and
+// the first commit sends them.
+void neopixel_strip_init(neopixel_strip_t *s, const neopixel_backend_ops_t *ops,
+                         void *ctx, uint16_t count);
+
+// Out-of-range indices are ignored.
+void neopixel_strip_set_rgb(neopixel_strip_t *s, uint16_t index, uint8_t r,
+                            uint8_t g, uint8_t b);
+void neopixel_strip_fill_rgb(neopixel_strip_t *s, uint16_t first,
+                             uint16_t n, uint8_t r, uint8_t g, uint8_t b);
+
+// Send the frame if it changed and the backend is idle.
+neopixel_commit_result_t neopixel_strip_commit(neopixel_strip_t *s);
+
+// FIFO word for a pixel. The PIO program shifts out MSB-first, so GRB goes
+// in bits 31:8 (for RGBW strips the white byte in bits 7:0 stays 0).
+static inline uint32_t neopixel_strip_word(uint8_t r, uint8_t g, uint8_t b) {
+  return (((uint32_t)g << 16) | ((uint32_t)r << 8) | (uint32_t)b) << 8u;
+}
@@ -1,20 +1,14 @@
 #include "neopixel_ws2812.h"
 
 #include "hardware/clocks.h"
+#include "hardware/dma.h"
 #include "pico/time.h"
 #include "ws2812.pio.h"
+#include <stddef.h>
 
-static inline uint32_t urgb_u32(uint8_t r, uint8_t g, uint8_t b) {
-  // WS2812 expects GRB byte order
-  return ((uint32_t)g << 16) | ((uint32_t)r << 8) | (uint32_t)b;
-}
-
-static inline void neopixel_ws2812_put_pixel(neopixel_ws2812_t *np,
-                                             uint32_t pixel_grb) {
-  // The WS2812 program shifts out MSB-first, with data in bits 23:0.
-  // Shift left 8 so the top 24 bits of the FIFO word are used.
-  pio_sm_put_blocking(np->pio, np->sm, pixel_grb << 8u);
-}
+// WS2812 latches after the line is held low for >50 us (>280 us on newer
+// parts); wait this long after the last bit before starting a new frame.
+#define WS2812_RESET_US 300u
 
 static void ws2812_sm_init(PIO pio, uint sm, uint offset, uint pin,
                            float freq_hz, bool rgbw) {
@@ -34,8 +28,32 @@ static void ws2812_sm_init(PIO pio, uint sm, uint offset, uint pin,
   pio_sm_set_enabled(pio, sm, true);
 }
 
+static bool ws2812_busy(void *ctx) {
+  neopixel_ws2812_t *np = (neopixel_ws2812_t *)ctx;
+  if (np->dma_chan >= 0 && dma_channel_is_busy((uint)np->dma_chan))
+    return true;
+  return time_us_64() < np->idle_at_us;
+}
+
+static void ws2812_start(void *ctx, const uint32_t *words, uint16_t count) {
+  neopixel_ws2812_t *np = (neopixel_ws2812_t *)ctx;
+  np->idle_at_us = time_us_64() + ((uint64_t)np->pixel_us_x16 * count) / 16u +
+                   WS2812_RESET_US;
+  if (np->dma_chan >= 0) {
+    dma_channel_transfer_from_buffer_now((uint)np->dma_chan, words, count);
+    return;
+  }
+  for (uint16_t i = 0; i < count; ++i)
+    pio_sm_put_blocking(np->pio, np->sm, words[i]);
+}
+
+static const neopixel_backend_ops_t WS2812_OPS = {
+    .busy = ws2812_busy,
+    .start = ws2812_start,
+};
+
 void neopixel_ws2812_init(neopixel_ws2812_t *np, PIO pio, uint pin,
-                          float freq_hz, bool is_rgbw) {
+                          float freq_hz, bool is_rgbw, uint16_t num_pixels) {
   if (!np) {
     return;
   }
@@ -43,14 +61,31 @@ void neopixel_ws2812_init(neopixel_ws2812_t *np, PIO pio, uint pin,
   np->pio = pio;
   np->pin = pin;
   np->is_rgbw = is_rgbw;
+  np->idle_at_us = 0;
+  np->pixel_us_x16 =
+      (uint32_t)((is_rgbw ? 32.0f : 24.0f) * 16.0e6f / freq_hz + 0.5f);
 
   uint offset = pio_add_program(pio, &ws2812_program);
   np->sm = pio_claim_unused_sm(pio, true);
 
   ws2812_sm_init(pio, np->sm, offset, pin, freq_hz, is_rgbw);
 
+  // DMA feeds the TX FIFO at the state machine's pace (DREQ).
+  np->dma_chan = dma_claim_unused_channel(false);
+  if (np->dma_chan >= 0) {
+    dma_channel_config c = dma_channel_get_default_config((uint)np->dma_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(pio, np->sm, true));
+    dma_channel_configure((uint)np->dma_chan, &c, &pio->txf[np->sm], NULL, 0,
+                          false);
+  }
+
+  neopixel_strip_init(&np->strip, &WS2812_OPS, np, num_pixels);
+
   // Start "off"
-  neopixel_ws2812_put_pixel(np, urgb_u32(0, 0, 0));
+  neopixel_strip_commit(&np->strip);
   sleep_ms(10);
 }
 
@@ -59,13 +94,6 @@ void neopixel_ws2812_put_rgb(neopixel_ws2812_t *np, uint8_t r, uint8_t g,
   if (!np) {
     return;
   }
-  neopixel_ws2812_put_pixel(np, urgb_u32(r, g, b));
+  neopixel_strip_set_rgb(&np->strip, 0, r, g, b);
+  neopixel_strip_commit(&np->strip);
 }
-
-void neopixel_ws2812_put_grb_u32(neopixel_ws2812_t *np, uint32_t grb) {
-  if (!np) {
-    return;
-  }
-  neopixel_ws2812_put_pixel(np, grb);
-}
-
@@ -1,28 +1,39 @@
 #pragma once
 
 #include "hardware/pio.h"
+#include "neopixel_strip.h"
 #include <stdbool.h>
 #include <stdint.h>
 
-// Minimal WS2812 (NeoPixel) driver for RP2040 using PIO.
+// WS2812 (NeoPixel) strip driver for RP2040 using PIO + DMA.
 // - Uses the `ws2812.pio` program (header generated by CMake)
-// - Writes pixels in GRB order (standard WS2812)
+// - Pixels live in `strip` (see neopixel_strip.h); a commit DMAs the frame
+//   into the PIO TX FIFO and returns immediately
+// - Falls back to blocking FIFO writes if no DMA channel is free
 
 typedef struct neopixel_ws2812 {
   PIO pio;
   uint sm;
   uint pin;
   bool is_rgbw;
+  int dma_chan; // -1 if none could be claimed
+
+  // Shift time of one pixel, and when the current frame (plus the WS2812
+  // reset/latch gap) is done.
+  uint32_t pixel_us_x16;
+  uint64_t idle_at_us;
+
+  neopixel_strip_t strip;
 } neopixel_ws2812_t;
 
-// Initialize a WS2812 output on `pin` at `freq_hz` (normally 800000).
-// Claims an unused state machine on the provided PIO block.
+// Initialize a WS2812 strip of `num_pixels` on `pin` at `freq_hz` (normally
+// 800000). Claims an unused state machine on the provided PIO block and a DMA
+// channel, then sends an all-off frame.
 void neopixel_ws2812_init(neopixel_ws2812_t *np, PIO pio, uint pin,
-                          float freq_hz, bool is_rgbw);
+                          float freq_hz, bool is_rgbw, uint16_t num_pixels);
 
-// Set the first pixel to an RGB value (0-255 per channel).
+// Set the first pixel to an RGB value (0-255 per channel) and commit.
+// Non-blocking; if a frame is in flight the change goes out on the next
+// commit.
 void neopixel_ws2812_put_rgb(neopixel_ws2812_t *np, uint8_t r, uint8_t g,
                              uint8_t b);
-
-// Set the first pixel to a raw GRB value (24-bit).
-void neopixel_ws2812_put_grb_u32(neopixel_ws2812_t *np, uint32_t grb);
@@ -0,0 +1,52 @@
+#include "rtos_stats.h"
+
+#include "pico/time.h"
+#include <string.h>
+
+// Indexed by FreeRTOS TCB number (1-based, assigned in creation order).
+// Slot 0 collects any task past RTOS_STATS_MAX_TASKS.
+static volatile uint32_t g_switch_counts[RTOS_STATS_MAX_TASKS + 1];
+static volatile uint32_t g_switch_total;
+
+static TaskStatus_t g_task_status[RTOS_STATS_MAX_TASKS];
+
+uint64_t rtos_stats_time_us(void) { return time_us_64(); }
+
+void rtos_stats_on_switch_in(uint32_t tcb_number) {
+  if (tcb_number > RTOS_STATS_MAX_TASKS)
+    tcb_number = 0;
+  g_switch_counts[tcb_number]++;
+  g_switch_total++;
+}
+
+void rtos_stats_snapshot(rtos_stats_snapshot_t *out) {
+  if (!out)
+    return;
+  memset(out, 0, sizeof(*out));
+
+  configRUN_TIME_COUNTER_TYPE total_runtime = 0;
+  UBaseType_t n = uxTaskGetSystemState(g_task_status, RTOS_STATS_MAX_TASKS,
+                                       &total_runtime);
+
+  out->uptime_us = rtos_stats_time_us();
+#if configSUPPORT_DYNAMIC_ALLOCATION
+  out->heap_total = configTOTAL_HEAP_SIZE;
+  out->heap_free = xPortGetFreeHeapSize();
+  out->heap_min_free = xPortGetMinimumEverFreeHeapSize();
+#endif
+  out->switches_total = g_switch_total;
+
+  for (UBaseType_t i = 0; i < n; ++i) {
+    const TaskStatus_t *ts = &g_task_status[i];
+    rtos_stats_task_t *t = &out->tasks[i];
+    t->name = ts->pcTaskName;
+    t->priority = ts->uxCurrentPriority;
+    t->stack_hwm_words = ts->usStackHighWaterMark;
+    if (total_runtime > 0)
+      t->cpu_permille =
+          (uint32_t)(((uint64_t)ts->ulRunTimeCounter * 1000u) / total_runtime);
+    if (ts->xTaskNumber <= RTOS_STATS_MAX_TASKS)
+      t->switches = g_switch_counts[ts->xTaskNumber];
+  }
+  out->task_count = (uint8_t)n;
+}
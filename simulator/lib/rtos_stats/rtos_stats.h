@@ -0,0 +1,45 @@
+#pragma once
+
+// FreeRTOS runtime instrumentation.
+//
+// Backs configGENERATE_RUN_TIME_STATS with the RP2040 1 MHz timer and counts
+// context switches per task (via traceTASK_SWITCHED_IN in FreeRTOSConfig.h).
+// Snapshots are taken on demand, e.g. by the Q2 query in serial_task.
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef RTOS_STATS_MAX_TASKS
+#define RTOS_STATS_MAX_TASKS 10
+#endif
+
+typedef struct rtos_stats_task {
+  const char *name;
+  UBaseType_t priority;
+  uint32_t cpu_permille; // share of total runtime since boot (0-1000)
+  uint32_t stack_hwm_words; // minimum free stack ever seen, in words
+  uint32_t switches; // number of times the task was switched in
+} rtos_stats_task_t;
+
+typedef struct rtos_stats_snapshot {
+  uint64_t uptime_us;
+  size_t heap_total; // heap fields stay 0 in static-allocation builds
+  size_t heap_free;
+  size_t heap_min_free;
+  uint32_t switches_total;
+
+  uint8_t task_count;
+  rtos_stats_task_t tasks[RTOS_STATS_MAX_TASKS];
+} rtos_stats_snapshot_t;
+
+// Runtime counter source for portGET_RUN_TIME_COUNTER_VALUE (microseconds).
+uint64_t rtos_stats_time_us(void);
+
+// Called from traceTASK_SWITCHED_IN with the TCB number of the incoming task.
+// Runs inside the context switch, keep it tiny.
+void rtos_stats_on_switch_in(uint32_t tcb_number);
+
+// Fill `out` with the current per-task and heap statistics.
+void rtos_stats_snapshot(rtos_stats_snapshot_t *out);
@@ -0,0 +1,234 @@
+#include "sensor_pipeline.h"
+
+#include <string.h>
+
+const sensor_pipeline_config_t SENSOR_PIPELINE_BENCH_CHAMBER = {
+    .temperature =
+        {
+            .lag_s = 1.0f, // bare bead in moving air
+            .noise_sd = 0.1f,
+            .quantum = 0.25f, // MAX31855 LSB
+            .dropout_rate = 0.002f,
+            .median_window = 5,
+            .iir_tau_s = 1.0f,
+            .max_rate_per_s = 1.0f, // twice what the heater can do
+        },
+    .humidity =
+        {
+            .lag_s = 4.0f, // behind its filter cap
+            .noise_sd = 0.4f,
+            .quantum = 0.1f,
+            .dropout_rate = 0.002f,
+            .median_window = 5,
+            .iir_tau_s = 4.0f,
+            .max_rate_per_s = 2.0f,
+        },
+    .seed = 0x5EED5EEDu,
+};
+
+// -----------
+// Median
+// -----------
+
+// First index of `a[0..n)` (sorted) whose value is >= x.
+static uint8_t lower_bound(const sensor_milli_t *a, uint8_t n,
+                           sensor_milli_t x) {
+  uint8_t lo = 0, hi = n;
+  while (lo < hi) {
+    uint8_t mid = (uint8_t)((lo + hi) / 2);
+    if (a[mid] < x)
+      lo = (uint8_t)(mid + 1);
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+void sensor_median_init(sensor_median_t *m, uint8_t window) {
+  memset(m, 0, sizeof(*m));
+  if (window > SENSOR_MEDIAN_MAX)
+    window = SENSOR_MEDIAN_MAX;
+  if (window % 2 == 0)
+    window = window ? (uint8_t)(window - 1) : 1;
+  m->window = window;
+}
+
+sensor_milli_t sensor_median_update(sensor_median_t *m, sensor_milli_t x) {
+  uint8_t n = m->count, i;
+  if (n == m->window) {
+    // Full: the new sample takes the oldest one's place, in the ring and in
+    // the sorted copy, then moves to where it sorts. On a smooth signal that
+    // is a step or two.
+    i = lower_bound(m->sorted, n, m->ring[m->head]);
+    m->ring[m->head] = x;
+    m->head = (uint8_t)(m->head + 1 == n ? 0 : m->head + 1);
+  } else {
+    m->ring[n] = x; // head stays at 0 until the ring fills
+    i = n++;
+    m->count = n;
+  }
+  sensor_milli_t *s = m->sorted;
+  for (; i > 0 && s[i - 1] > x; --i)
+    s[i] = s[i - 1];
+  for (; i + 1 < n && s[i + 1] < x; ++i)
+    s[i] = s[i + 1];
+  s[i] = x;
+  return s[n / 2];
+}
+
+// -----------
+// IIR
+// -----------
+
+void sensor_iir_init(sensor_iir_t *f, uint32_t tau_ms) {
+  memset(f, 0, sizeof(*f));
+  f->tau_ms = tau_ms;
+}
+
+sensor_milli_t sensor_iir_update(sensor_iir_t *f, sensor_milli_t x,
+                                 uint32_t dt_ms) {
+  if (!f->primed || f->tau_ms == 0) {
+    f->y_q8 = x * 256;
+    f->primed = true;
+    return x;
+  }
+  if (dt_ms != f->dt_ms) {
+    f->dt_ms = dt_ms;
+    f->alpha_q16 =
+        (int32_t)(((uint64_t)dt_ms << 16) / ((uint64_t)f->tau_ms + dt_ms));
+  }
+  int64_t err = (int64_t)x * 256 - f->y_q8;
+  f->y_q8 += (int32_t)((err * f->alpha_q16) >> 16);
+  return (f->y_q8 + 128) >> 8;
+}
+
+// -----------
+// Rate limit
+// -----------
+
+void sensor_rate_limit_init(sensor_rate_limit_t *f, int32_t max_per_s) {
+  memset(f, 0, sizeof(*f));
+  f->max_per_s = max_per_s;
+}
+
+sensor_milli_t sensor_rate_limit_update(sensor_rate_limit_t *f,
+                                        sensor_milli_t x, uint32_t dt_ms,
+                                        bool *limited) {
+  bool cut = false;
+  if (!f->primed || f->max_per_s <= 0) {
+    f->y = x;
+    f->primed = true;
+  } else {
+    // Rounded up, so a slow limit at short ticks still moves.
+    int64_t step = ((int64_t)f->max_per_s * dt_ms + 999) / 1000;
+    int64_t d = (int64_t)x - f->y;
+    if (d > step) {
+      d = step;
+      cut = true;
+    } else if (d < -step) {
+      d = -step;
+      cut = true;
+    }
+    f->y += (sensor_milli_t)d;
+  }
+  if (limited)
+    *limited = cut;
+  return f->y;
+}
+
+// -----------
+// Channel
+// -----------
+
+static uint32_t xorshift32(uint32_t *s) {
+  uint32_t x = *s;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *s = x;
+}
+
+// The sum of four uniform 16-bit numbers, centred: close enough to a
+// Gaussian for sensor noise, with a standard deviation of NOISE_SUM_SD.
+#define NOISE_SUM_SD 37837.0f // 65536 * sqrt(4 / 12)
+
+static int32_t noise_sum(uint32_t *s) {
+  uint32_t a = xorshift32(s), b = xorshift32(s);
+  return (int32_t)((a & 0xFFFF) + (a >> 16) + (b & 0xFFFF) + (b >> 16)) -
+         2 * 0xFFFF;
+}
+
+static sensor_milli_t to_milli(float v) {
+  return (sensor_milli_t)(v * 1000.0f + (v < 0.0f ? -0.5f : 0.5f));
+}
+
+// To the nearest multiple of `q`, halves up.
+static sensor_milli_t quantize(sensor_milli_t v, sensor_milli_t q) {
+  if (q <= 1)
+    return v;
+  int32_t k = (v + q / 2) / q;
+  if ((v + q / 2) % q < 0)
+    k--; // floor, not truncation
+  return k * q;
+}
+
+static uint32_t to_ms(float s) { return (uint32_t)(s * 1000.0f + 0.5f); }
+
+static sensor_milli_t filter(sensor_channel_t *ch, sensor_milli_t x,
+                             uint32_t dt_ms) {
+  if (ch->median.window > 1)
+    x = sensor_median_update(&ch->median, x);
+  if (ch->iir.tau_ms)
+    x = sensor_iir_update(&ch->iir, x, dt_ms);
+  if (ch->rate.max_per_s > 0) {
+    bool limited;
+    x = sensor_rate_limit_update(&ch->rate, x, dt_ms, &limited);
+    ch->stats.rate_limited += limited;
+  }
+  return x;
+}
+
+void sensor_channel_init(sensor_channel_t *ch,
+                         const sensor_channel_config_t *cfg, uint32_t seed,
+                         float initial) {
+  memset(ch, 0, sizeof(*ch));
+  ch->cfg = cfg;
+  ch->rng = seed ? seed : 0x9E3779B9u; // xorshift stays at 0 forever
+  ch->noise_q16 = (int32_t)(cfg->noise_sd * 1000.0f * 65536.0f / NOISE_SUM_SD);
+  ch->quantum = to_milli(cfg->quantum);
+  ch->dropout_below = (uint32_t)(cfg->dropout_rate * 4294967295.0f);
+  ch->lagged = initial;
+  sensor_median_init(&ch->median, cfg->median_window);
+  sensor_iir_init(&ch->iir, to_ms(cfg->iir_tau_s));
+  sensor_rate_limit_init(&ch->rate, to_milli(cfg->max_rate_per_s));
+  ch->raw = quantize(to_milli(initial), ch->quantum);
+  ch->out = filter(ch, ch->raw, 0);
+}
+
+float sensor_channel_sample(sensor_channel_t *ch, float value, float dt_s) {
+  const sensor_channel_config_t *cfg = ch->cfg;
+  uint32_t dt_ms = to_ms(dt_s);
+  ch->stats.samples++;
+
+  if (cfg->lag_s > 0.0f) {
+    if (dt_ms != ch->lag_dt_ms) {
+      ch->lag_dt_ms = dt_ms;
+      ch->lag_gain = dt_s / (cfg->lag_s + dt_s);
+    }
+    ch->lagged += (value - ch->lagged) * ch->lag_gain;
+  } else {
+    ch->lagged = value;
+  }
+  sensor_milli_t v = to_milli(ch->lagged);
+  if (ch->noise_q16)
+    v += (sensor_milli_t)(((int64_t)noise_sum(&ch->rng) * ch->noise_q16) >>
+                          16);
+  if (ch->dropout_below && xorshift32(&ch->rng) < ch->dropout_below) {
+    ch->stats.dropouts++;
+    return sensor_channel_value(ch);
+  }
+
+  ch->raw = quantize(v, ch->quantum);
+  ch->out = filter(ch, ch->raw, dt_ms);
+  return sensor_channel_value(ch);
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+// Simulated sensor between the plant and the published readings.
+//
+// Each channel (temperature, humidity) turns the model's exact value into
+// what a real probe and its ADC deliver, then filters it the way the
+// firmware would filter a real probe:
+//
+//   model -> lag -> noise -> dropout -> quantization   (injection)
+//         -> moving median -> IIR low-pass -> rate limit (filters)
+//
+// The probe lag is float, like the plant. From there on everything is
+// integer milli-units (as in alarm_rules), the form an ADC reading has on the
+// device, so a sample needs only a few float operations, which matters
+// without an FPU. Every filter keeps
+// its state in a fixed ring or a single accumulator, so a sample costs the
+// same whatever the history: O(1) for the IIR and the rate limiter, and for
+// the median a binary search plus an insertion step that, on a smooth
+// signal, moves one or two words. A dropped sample does not reach the
+// filters; the output holds.
+//
+// Noise comes from a per-channel xorshift generator, so a run (and a replay
+// of it) is repeatable.
+//
+// Plain C with no RTOS dependencies; the host tools link it.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Longest moving-median window. Override with -DSENSOR_MEDIAN_MAX=n.
+#ifndef SENSOR_MEDIAN_MAX
+#define SENSOR_MEDIAN_MAX 9
+#endif
+
+// Units of the filters: thousandths of a degC or of a %RH.
+typedef int32_t sensor_milli_t;
+
+// ---------------------------------
+// Filters (usable on their own)
+// ---------------------------------
+
+// Median of the last `window` samples: the ring keeps arrival order, the
+// sorted copy the order statistics.
+typedef struct sensor_median {
+  uint8_t window; // odd, 1..SENSOR_MEDIAN_MAX
+  uint8_t count;  // samples held, up to window
+  uint8_t head;   // ring slot of the oldest sample
+  sensor_milli_t ring[SENSOR_MEDIAN_MAX];
+  sensor_milli_t sorted[SENSOR_MEDIAN_MAX];
+} sensor_median_t;
+
+// An even or out-of-range window is rounded down to the nearest valid one.
+void sensor_median_init(sensor_median_t *m, uint8_t window);
+// Returns the median of the window, which until it fills is the samples so
+// far (the upper middle one for an even count).
+sensor_milli_t sensor_median_update(sensor_median_t *m, sensor_milli_t x);
+
+// First-order low-pass, y += (x - y) * dt / (tau + dt). The state keeps 8
+// bits below the milli-unit so slow filters still settle exactly.
+typedef struct sensor_iir {
+  uint32_t tau_ms;
+  uint32_t dt_ms;   // of the cached gain
+  int32_t alpha_q16; // dt / (tau + dt)
+  int32_t y_q8;
+  bool primed;
+} sensor_iir_t;
+
+void sensor_iir_init(sensor_iir_t *f, uint32_t tau_ms);
+// The gain is recomputed (one division) only when dt_ms changes.
+sensor_milli_t sensor_iir_update(sensor_iir_t *f, sensor_milli_t x,
+                                 uint32_t dt_ms);
+
+// Follows the input at most `max_per_s` milli-units per second.
+typedef struct sensor_rate_limit {
+  int32_t max_per_s;
+  sensor_milli_t y;
+  bool primed;
+} sensor_rate_limit_t;
+
+void sensor_rate_limit_init(sensor_rate_limit_t *f, int32_t max_per_s);
+// Sets *limited when the step was cut (may be NULL).
+sensor_milli_t sensor_rate_limit_update(sensor_rate_limit_t *f,
+                                        sensor_milli_t x, uint32_t dt_ms,
+                                        bool *limited);
+
+// ---------------------------------
+// Channel: injection then filters
+// ---------------------------------
+
+typedef struct sensor_channel_config {
+  // Injection. Zero turns a stage off.
+  float lag_s;        // first-order time constant of the probe
+  float noise_sd;     // units (degC, %RH), about Gaussian
+  float quantum;      // reading resolution, e.g. 0.25 degC
+  float dropout_rate; // fraction of samples lost (0..1)
+
+  // Filters. Zero (or a median window of 1) turns a stage off.
+  uint8_t median_window;
+  float iir_tau_s;
+  float max_rate_per_s; // units per second
+} sensor_channel_config_t;
+
+typedef struct sensor_channel_stats {
+  uint32_t samples;
+  uint32_t dropouts;
+  uint32_t rate_limited;
+} sensor_channel_stats_t;
+
+typedef struct sensor_channel {
+  const sensor_channel_config_t *cfg;
+  uint32_t rng;
+  // The config in integer form.
+  int32_t noise_q16;      // milli-units per unit of the noise sum
+  sensor_milli_t quantum;
+  uint32_t dropout_below; // of a 32-bit random number
+  uint32_t lag_dt_ms;     // of the cached lag gain
+  float lag_gain;
+
+  float lagged;      // the probe's own temperature (or RH)
+  sensor_milli_t raw; // last reading delivered, before the filters
+  sensor_milli_t out;
+  sensor_median_t median;
+  sensor_iir_t iir;
+  sensor_rate_limit_t rate;
+  sensor_channel_stats_t stats;
+} sensor_channel_t;
+
+// Starts settled at `initial`: the probe, the raw reading and the output.
+void sensor_channel_init(sensor_channel_t *ch,
+                         const sensor_channel_config_t *cfg, uint32_t seed,
+                         float initial);
+
+// One sample of the true value `value`, `dt_s` after the last one. Returns
+// the filtered reading.
+float sensor_channel_sample(sensor_channel_t *ch, float value, float dt_s);
+
+static inline float sensor_channel_value(const sensor_channel_t *ch) {
+  return (float)ch->out / 1000.0f;
+}
+
+static inline float sensor_channel_raw(const sensor_channel_t *ch) {
+  return (float)ch->raw / 1000.0f;
+}
+
+// ---------------------------------
+// A chamber's probes
+// ---------------------------------
+
+typedef struct sensor_pipeline_config {
+  sensor_channel_config_t temperature;
+  sensor_channel_config_t humidity;
+  uint32_t seed; // mixed with each zone's own seed
+} sensor_pipeline_config_t;
+
+// A thermocouple on a MAX31855-class converter and a capacitive RH sensor,
+// with the filters the firmware runs on them.
+extern const sensor_pipeline_config_t SENSOR_PIPELINE_BENCH_CHAMBER;
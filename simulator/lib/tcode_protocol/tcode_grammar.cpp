@@ -0,0 +1,110 @@
+// C API for the T-Code grammar (see tcode_grammar.hpp).
+
+#include "tcode_grammar.hpp"
+
+using tcode::spec::TCode;
+
+namespace {
+
+template <typename... C>
+const char *const *command_names(tcode::Grammar<C...> *) {
+  static constexpr const char *const names[] = {C::name()...};
+  return names;
+}
+
+template <typename... S>
+const tcode_setting_info_t *setting_infos(tcode::KeySet<S...> *) {
+  static constexpr tcode_setting_info_t infos[] = {
+      tcode::detail::setting_info<S>()...};
+  return infos;
+}
+
+template <typename... K>
+const char *const *key_names(tcode::KeySet<K...> *) {
+  static constexpr const char *const names[] = {K::name...};
+  return names;
+}
+
+} // namespace
+
+extern "C" {
+
+tcode_decode_status_t tcode_decode(const tcode_parsed_line_t *line,
+                                   tcode_command_t *out) {
+  return tcode::decode((TCode *)nullptr, line, out);
+}
+
+const char *tcode_decode_status_str(tcode_decode_status_t st) {
+  switch (st) {
+  case TCODE_DECODE_OK:
+    return "OK";
+  case TCODE_DECODE_EMPTY:
+    return "EMPTY";
+  case TCODE_DECODE_UNKNOWN_COMMAND:
+    return "UNKNOWN_COMMAND";
+  case TCODE_DECODE_UNKNOWN_FIELD:
+    return "UNKNOWN_FIELD";
+  case TCODE_DECODE_DUPLICATE_FIELD:
+    return "DUPLICATE";
+  case TCODE_DECODE_MISSING_FIELD:
+    return "MISSING";
+  case TCODE_DECODE_BAD_VALUE:
+    return "BAD_VALUE";
+  case TCODE_DECODE_RANGE:
+    return "RANGE";
+  case TCODE_DECODE_UNKNOWN_KEY:
+    return "UNKNOWN_KEY";
+  case TCODE_DECODE_TOO_MANY_GROUPS:
+    return "TOO_MANY_GROUPS";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+const char *tcode_cmd_name(tcode_cmd_t cmd) {
+  if ((unsigned)cmd >= TCODE_CMD_COUNT)
+    return "?";
+  return command_names((TCode *)nullptr)[cmd];
+}
+
+const char *tcode_info_key_name(tcode_info_key_t key) {
+  if ((unsigned)key >= TCODE_INFO_COUNT)
+    return "?";
+  return key_names((tcode::spec::InfoKeys *)nullptr)[key];
+}
+
+const char *tcode_status_field_name(tcode_status_field_t field) {
+  if ((unsigned)field >= TCODE_STATUS_FIELD_COUNT)
+    return "?";
+  return key_names((tcode::spec::StatusFields *)nullptr)[field];
+}
+
+const tcode_setting_info_t *tcode_setting_info(tcode_setting_t s) {
+  if ((unsigned)s >= TCODE_SETTING_COUNT)
+    return nullptr;
+  return &setting_infos((tcode::spec::Settings *)nullptr)[s];
+}
+
+int tcode_format_fixed(char *buf, size_t size, int32_t value,
+                       uint8_t decimals) {
+  // Integer arithmetic only: no float printf on the firmware.
+  if (decimals > TCODE_FIXED_MAX_DECIMALS)
+    decimals = TCODE_FIXED_MAX_DECIMALS;
+  uint32_t mag = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+  uint32_t scale = (uint32_t)tcode::pow10(decimals);
+  const char *sign = value < 0 ? "-" : "";
+  if (decimals == 0)
+    return snprintf(buf, size, "%s%lu", sign, (unsigned long)mag);
+  return snprintf(buf, size, "%s%lu.%0*lu", sign, (unsigned long)(mag / scale),
+                  (int)decimals, (unsigned long)(mag % scale));
+}
+
+void tcode_help(tcode_help_emit_fn emit, void *ctx) {
+  tcode::help((TCode *)nullptr, emit, ctx);
+  emit(ctx, "");
+  emit(ctx, "Settings (M20 lists, M21 K<key> reads, M22 K<key> V<value> "
+            "writes):");
+  tcode::detail::help_settings((tcode::spec::Settings *)nullptr, emit, ctx);
+}
+
+} // extern "C"
@@ -0,0 +1,176 @@
+#pragma once
+
+// Decoded T-Code commands.
+//
+// The command grammar (every command, its fields, their types, ranges and
+// units) is declared once in tcode_grammar.hpp. The decoder, the range
+// checks, the help text and the setting metadata below are all generated
+// from it, and this header is the C view of the result. The same grammar is
+// compiled into the firmware and the host tools.
+
+#include "tcode_protocol.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum tcode_cmd {
+  TCODE_CMD_SETPOINT = 0, // ([Z<zone>] T<temp> and/or H<rh>)...
+  TCODE_CMD_Q0,           // status [F<fields>] [Z<zone>[-<zone>]]
+  TCODE_CMD_Q1,           // machine information
+  TCODE_CMD_Q2,           // RTOS runtime stats
+  TCODE_CMD_Q3,           // command-path latency
+  TCODE_CMD_Q4,           // sim control-loop timing
+  TCODE_CMD_Q5,           // controller
+  TCODE_CMD_Q6,           // event journal
+  TCODE_CMD_M20,          // list settings
+  TCODE_CMD_M21,          // read setting
+  TCODE_CMD_M22,          // write setting (volatile)
+  TCODE_CMD_M30,          // reset command-path stats
+  TCODE_CMD_M31,          // reset loop stats
+  TCODE_CMD_M32,          // measured/nominal dt
+  TCODE_CMD_M33,          // select controller
+  TCODE_CMD_M999,         // clear latched fault
+  TCODE_CMD_COUNT,
+} tcode_cmd_t;
+
+// Q1 keys
+typedef enum tcode_info_key {
+  TCODE_INFO_BUILD = 0,
+  TCODE_INFO_BUILDER,
+  TCODE_INFO_BUILD_DATE,
+  TCODE_INFO_COUNT,
+} tcode_info_key_t;
+
+// Q0 fields (F=TEMP,HEAT)
+typedef enum tcode_status_field {
+  TCODE_STATUS_TEMP = 0,
+  TCODE_STATUS_RH,
+  TCODE_STATUS_HEAT,
+  TCODE_STATUS_COOL,
+  TCODE_STATUS_STATE,
+  TCODE_STATUS_SET_TEMP,
+  TCODE_STATUS_SET_RH,
+  TCODE_STATUS_ALARM,
+  TCODE_STATUS_FIELD_COUNT,
+} tcode_status_field_t;
+
+// M20/M21/M22 settings
+typedef enum tcode_setting {
+  TCODE_SETTING_ECHO = 0,
+  TCODE_SETTING_MEASURED_DT,
+  TCODE_SETTING_CTRL,
+  TCODE_SETTING_KP,
+  TCODE_SETTING_KI,
+  TCODE_SETTING_KD,
+  TCODE_SETTING_CRC,
+  TCODE_SETTING_COUNT,
+} tcode_setting_t;
+
+// Fields of a setpoint group, by position in tcode_group_t.value[].
+typedef enum tcode_zone_field {
+  TCODE_ZONE_Z = 0,
+  TCODE_ZONE_T,
+  TCODE_ZONE_H,
+  TCODE_ZONE_FIELD_COUNT,
+} tcode_zone_field_t;
+
+typedef enum tcode_decode_status {
+  TCODE_DECODE_OK = 0,
+  TCODE_DECODE_EMPTY,           // nothing to do (line number only, keepalive)
+  TCODE_DECODE_UNKNOWN_COMMAND, // no such command word
+  TCODE_DECODE_UNKNOWN_FIELD,   // field not accepted by this command
+  TCODE_DECODE_DUPLICATE_FIELD,
+  TCODE_DECODE_MISSING_FIELD, // a required field is absent
+  TCODE_DECODE_BAD_VALUE,     // not a number of the field's type
+  TCODE_DECODE_RANGE,         // number outside the field's range
+  TCODE_DECODE_UNKNOWN_KEY,   // K/Q1 key not in the grammar
+  TCODE_DECODE_TOO_MANY_GROUPS,
+} tcode_decode_status_t;
+
+// Bit for a field letter in tcode_command_t.present.
+#define TCODE_FIELD_BIT(letter) ((uint32_t)1 << ((letter) - 'A'))
+
+// Repeated field groups per line (setpoints: one per zone). The tokenizer
+// has room for this many groups of three fields.
+#define TCODE_MAX_GROUPS 16
+
+// One group of a line such as "Z0 T-10 H35 Z1 T20". Each lead field (Z)
+// starts a group; fields before the first one form a group whose lead is
+// absent from `present` and has its minimum value (zone 0).
+typedef struct tcode_group {
+  uint32_t present; // TCODE_FIELD_BIT() of each field given
+  int32_t value[TCODE_ZONE_FIELD_COUNT];
+} tcode_group_t;
+
+typedef struct tcode_command {
+  tcode_cmd_t cmd;
+  bool has_line_number;
+  int32_t line_number;
+
+  // Fields by letter: value['T' - 'A'] etc. Fractional fields are fixed
+  // point with the field's decimals (T-10.5 with 3 decimals is -10500). A
+  // key list (Q0 F) has a bit per key id.
+  uint32_t present; // TCODE_FIELD_BIT() of each field given
+  int32_t value[26];
+  int16_t key; // tcode_setting_t (K) or tcode_info_key_t (Q1); -1 if none
+  int32_t range_last; // range field (Q0 Z): last value, value[] has the first
+
+  // Grouped fields (setpoints) are only here, not in value[]. Leads are
+  // unique within a line.
+  uint8_t group_count;
+  tcode_group_t group[TCODE_MAX_GROUPS];
+
+  // On error: the command word and token at fault, and for RANGE the
+  // allowed range (scaled like value[]).
+  const char *error_cmd;
+  const char *error_token;
+  char error_field;
+  uint8_t error_decimals;
+  int32_t error_min;
+  int32_t error_max;
+} tcode_command_t;
+
+// Decode a tokenized line (see tcode_parse_inplace). Every field is range
+// checked; on success `out` only holds valid values.
+tcode_decode_status_t tcode_decode(const tcode_parsed_line_t *line,
+                                   tcode_command_t *out);
+
+const char *tcode_decode_status_str(tcode_decode_status_t st);
+
+// Command word, e.g. "M22" ("T/H" for setpoints).
+const char *tcode_cmd_name(tcode_cmd_t cmd);
+
+const char *tcode_info_key_name(tcode_info_key_t key);
+
+const char *tcode_status_field_name(tcode_status_field_t field);
+
+typedef struct tcode_setting_info {
+  const char *key;
+  uint8_t decimals; // M22 V is fixed point with this many decimals
+  int32_t min;      // scaled like the value
+  int32_t max;
+  const char *units;
+  const char *help;
+} tcode_setting_info_t;
+
+const tcode_setting_info_t *tcode_setting_info(tcode_setting_t s);
+
+// Format a fixed-point value ("-10.500" for -10500 with 3 decimals). Returns
+// the length written, like snprintf. More than TCODE_FIXED_MAX_DECIMALS
+// decimals (an int32 has 10 digits) are taken as that many.
+#define TCODE_FIXED_MAX_DECIMALS 9
+int tcode_format_fixed(char *buf, size_t size, int32_t value,
+                       uint8_t decimals);
+
+// Help text: the command reference, one line per command, field and
+// setting, each passed to `emit` without a trailing newline.
+typedef void (*tcode_help_emit_fn)(void *ctx, const char *line);
+void tcode_help(tcode_help_emit_fn emit, void *ctx);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
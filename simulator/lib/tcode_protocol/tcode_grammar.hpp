@@ -0,0 +1,942 @@
+#pragma once
+
+// T-Code command grammar.
+//
+// Every command and field is declared once, at the bottom of this file, as
+// types: letter, number type and decimals, range, units, required/optional.
+// From that declaration the templates generate:
+//
+// - decode<G>(): the command word picks one command through a chain of
+//   constant compares, then each token is matched against that command's
+//   field letters and parsed and range checked with the limits as
+//   immediates. There is no runtime table of rules to walk.
+// - help<G>(): the command reference (tcode_grammar -r, simulator README).
+// - the M20/M21/M22 setting metadata.
+//
+// Header-only and freestanding (no exceptions, RTTI or allocation), so it
+// builds with the Pico SDK as well as on the host. C code uses it through
+// tcode_grammar.h; tcode_grammar.cpp is the only instantiation.
+
+#include "tcode_grammar.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace tcode {
+
+// ---------------
+// Building blocks
+// ---------------
+
+constexpr int32_t pow10(int n) { return n <= 0 ? 1 : 10 * pow10(n - 1); }
+
+// A numeric field: `Letter`, an optional '=', then a decimal number with at
+// most `Decimals` fractional digits (0 = integers only). The decoded value
+// is fixed point, scaled by 10^Decimals. Min/Max are in whole units.
+//
+// Declare a field by deriving from this and adding `units` and `help`.
+template <char Letter, int Decimals, int32_t Min, int32_t Max,
+          bool Required = false>
+struct Number {
+  static_assert(Letter >= 'A' && Letter <= 'Z', "field letters are A-Z");
+  static_assert(Decimals >= 0 && Decimals <= 6, "too many decimals");
+  static_assert(Min <= Max, "empty range");
+
+  static constexpr char letter = Letter;
+  static constexpr bool required = Required;
+  static constexpr int decimals = Decimals;
+  static constexpr int32_t min = Min * pow10(Decimals);
+  static constexpr int32_t max = Max * pow10(Decimals);
+};
+
+template <typename... Keys> struct KeySet {};
+
+// One word out of `Keys`, given as K<key> or K=<key>, or with Letter 0 as a
+// bare positional word (Q1 BUILD). Each key type has `name` and `id`.
+template <char Letter, typename Keys, bool Required = true> struct Key {
+  static constexpr char letter = Letter;
+  static constexpr bool required = Required;
+};
+
+// A comma-separated list of words out of `Keys` (F=TEMP,HEAT), stored as a
+// bit per key id.
+template <char Letter, typename Keys, bool Required = false> struct KeyList {
+  static constexpr char letter = Letter;
+  static constexpr bool required = Required;
+};
+
+// A whole number or an inclusive range of them ("Z3", "Z0-7"). The first is
+// stored in value[] and the last in tcode_command_t.range_last, so a
+// command has at most one. Non-negative, since '-' separates the ends.
+template <char Letter, int32_t Min, int32_t Max, bool Required = false>
+struct Range {
+  static_assert(Letter >= 'A' && Letter <= 'Z', "field letters are A-Z");
+  static_assert(0 <= Min && Min <= Max, "ranges are non-negative");
+
+  static constexpr char letter = Letter;
+  static constexpr bool required = Required;
+  static constexpr int decimals = 0;
+  static constexpr int32_t min = Min;
+  static constexpr int32_t max = Max;
+};
+
+// The value of the setting picked by the command's Key field (M22 V). It
+// is parsed and range checked with that setting's own Number rules once the
+// whole line has been read, so V may come before K.
+template <char Letter, typename Settings, bool Required = true>
+struct SettingValue {
+  static constexpr char letter = Letter;
+  static constexpr bool required = Required;
+};
+
+// Number fields that repeat as a group, one group per `Lead` field
+// ("Z1 T20 Z2 T25 H40"). Fields before the first lead form a group of their
+// own. Each field type adds an `id`, its index in tcode_group_t.value[], and
+// every group must set at least one field besides its lead.
+template <typename Lead, typename... Fields> struct Group {
+  static constexpr char letter = Lead::letter;
+  static constexpr bool required = false;
+};
+
+// A setting: its value rules plus `name`, `units` and `help` in the derived
+// type. `Id` is its tcode_setting_t.
+template <int Id, int Decimals, int32_t Min, int32_t Max>
+struct Setting : Number<'V', Decimals, Min, Max, true> {
+  static constexpr int id = Id;
+};
+
+// Command word: letter and number ("M22").
+struct CommandName {
+  char s[8];
+};
+
+constexpr CommandName make_command_name(char letter, int number) {
+  CommandName n{};
+  int i = 0;
+  n.s[i++] = letter;
+  int div = 1;
+  while (number / div >= 10)
+    div *= 10;
+  for (; div > 0; div /= 10)
+    n.s[i++] = (char)('0' + (number / div) % 10);
+  return n;
+}
+
+// A command. Letter 0 means the line has no command word and starts
+// directly with one of its fields (setpoints: "T15 H40"). The derived type
+// adds `help`, and may set `require_any` to field bits of which at least
+// one must be given.
+template <tcode_cmd_t Id, char Letter, int Num, typename... Fields>
+struct Command {
+  static constexpr tcode_cmd_t id = Id;
+  static constexpr char letter = Letter;
+  static constexpr int number = Num;
+  static constexpr uint32_t require_any = 0;
+  static constexpr CommandName word = make_command_name(Letter, Num);
+  static constexpr const char *name() { return word.s; }
+};
+
+template <typename... Commands> struct Grammar {};
+
+// ---------------
+// Decoder
+// ---------------
+
+namespace detail {
+
+struct Ctx {
+  tcode_command_t *out;
+  const char *deferred; // SettingValue token, checked after the whole line
+};
+
+inline tcode_decode_status_t fail(Ctx &c, tcode_decode_status_t st,
+                                  const char *token, char field) {
+  c.out->error_token = token;
+  c.out->error_field = field;
+  return st;
+}
+
+inline tcode_decode_status_t fail_range(Ctx &c, const char *token, char field,
+                                        int decimals, int32_t min,
+                                        int32_t max) {
+  c.out->error_decimals = (uint8_t)decimals;
+  c.out->error_min = min;
+  c.out->error_max = max;
+  return fail(c, TCODE_DECODE_RANGE, token, field);
+}
+
+// Text after the field letter, skipping an optional '=' ("S1" or "S=1").
+inline const char *field_text(const char *token) {
+  return token[1] == '=' ? token + 2 : token + 1;
+}
+
+// [+-]digits[.digits], at most D fractional digits. Out-of-int32 values
+// saturate so the range check rejects them.
+template <int D>
+inline tcode_decode_status_t parse_fixed(const char *s, int32_t *out) {
+  bool neg = false;
+  if (*s == '-' || *s == '+')
+    neg = *s++ == '-';
+
+  int64_t v = 0;
+  int digits = 0;
+  int frac = -1; // fractional digits seen, -1 before the point
+  for (;; ++s) {
+    if (*s >= '0' && *s <= '9') {
+      if (frac >= 0 && ++frac > D)
+        return TCODE_DECODE_BAD_VALUE;
+      if (v < INT64_C(100000000000))
+        v = v * 10 + (*s - '0');
+      digits++;
+    } else if (*s == '.' && frac < 0 && D > 0) {
+      frac = 0;
+    } else {
+      break;
+    }
+  }
+  if (*s != '\0' || digits == 0)
+    return TCODE_DECODE_BAD_VALUE;
+
+  for (int f = frac < 0 ? 0 : frac; f < D; ++f)
+    v *= 10;
+  if (neg)
+    v = -v;
+  *out = v > INT32_MAX ? INT32_MAX : v < INT32_MIN ? INT32_MIN : (int32_t)v;
+  return TCODE_DECODE_OK;
+}
+
+template <typename N>
+inline tcode_decode_status_t parse_checked(const char *token, char letter,
+                                           Ctx &c, int32_t *v) {
+  if (parse_fixed<N::decimals>(field_text(token), v) != TCODE_DECODE_OK)
+    return fail(c, TCODE_DECODE_BAD_VALUE, token, letter);
+  if (*v < N::min || *v > N::max)
+    return fail_range(c, token, letter, N::decimals, N::min, N::max);
+  return TCODE_DECODE_OK;
+}
+
+template <typename N>
+inline tcode_decode_status_t parse_number(const char *token, char letter,
+                                          Ctx &c) {
+  int32_t v;
+  tcode_decode_status_t st = parse_checked<N>(token, letter, c, &v);
+  if (st != TCODE_DECODE_OK)
+    return st;
+  c.out->value[letter - 'A'] = v;
+  c.out->present |= TCODE_FIELD_BIT(letter);
+  return TCODE_DECODE_OK;
+}
+
+template <typename... K> inline int match_key(const char *s, KeySet<K...> *) {
+  int id = -1;
+  (void)((strcmp(s, K::name) == 0 && (id = K::id, true)) || ...);
+  return id;
+}
+
+// Same for the first `n` characters of `s`.
+template <typename... K>
+inline int match_key_n(const char *s, size_t n, KeySet<K...> *) {
+  int id = -1;
+  (void)((strncmp(s, K::name, n) == 0 && K::name[n] == '\0' &&
+          (id = K::id, true)) ||
+         ...);
+  return id;
+}
+
+// One overload per field kind; the derived field type converts to its base.
+template <char L, int D, int32_t Min, int32_t Max, bool R>
+inline tcode_decode_status_t parse_field(const Number<L, D, Min, Max, R> *,
+                                         const char *token, Ctx &c) {
+  return parse_number<Number<L, D, Min, Max, R>>(token, L, c);
+}
+
+template <char L, typename Keys, bool R>
+inline tcode_decode_status_t parse_field(const Key<L, Keys, R> *,
+                                         const char *token, Ctx &c) {
+  int id = match_key(L ? field_text(token) : token, (Keys *)nullptr);
+  if (id < 0)
+    return fail(c, TCODE_DECODE_UNKNOWN_KEY, token, L);
+  c.out->key = (int16_t)id;
+  if (L)
+    c.out->present |= TCODE_FIELD_BIT(L);
+  return TCODE_DECODE_OK;
+}
+
+template <char L, typename Keys, bool R>
+inline tcode_decode_status_t parse_field(const KeyList<L, Keys, R> *,
+                                         const char *token, Ctx &c) {
+  uint32_t set = 0;
+  for (const char *s = field_text(token);;) {
+    const char *comma = strchr(s, ',');
+    size_t n = comma ? (size_t)(comma - s) : strlen(s);
+    int id = n ? match_key_n(s, n, (Keys *)nullptr) : -1;
+    if (id < 0)
+      return fail(c, TCODE_DECODE_UNKNOWN_KEY, token, L);
+    set |= 1u << id;
+    if (!comma)
+      break;
+    s = comma + 1;
+  }
+  c.out->value[L - 'A'] = (int32_t)set;
+  c.out->present |= TCODE_FIELD_BIT(L);
+  return TCODE_DECODE_OK;
+}
+
+template <char L, int32_t Min, int32_t Max, bool R>
+inline tcode_decode_status_t parse_field(const Range<L, Min, Max, R> *,
+                                         const char *token, Ctx &c) {
+  const char *text = field_text(token);
+  const char *dash = strchr(text, '-');
+  char first_text[12];
+  size_t n = dash ? (size_t)(dash - text) : strlen(text);
+  if (n >= sizeof(first_text))
+    return fail(c, TCODE_DECODE_BAD_VALUE, token, L);
+  memcpy(first_text, text, n);
+  first_text[n] = '\0';
+
+  int32_t first, last;
+  if (parse_fixed<0>(first_text, &first) != TCODE_DECODE_OK ||
+      (dash && parse_fixed<0>(dash + 1, &last) != TCODE_DECODE_OK))
+    return fail(c, TCODE_DECODE_BAD_VALUE, token, L);
+  if (!dash)
+    last = first;
+  if (first < Min || first > Max || last < Min || last > Max)
+    return fail_range(c, token, L, 0, Min, Max);
+  if (first > last)
+    return fail(c, TCODE_DECODE_BAD_VALUE, token, L);
+  c.out->value[L - 'A'] = first;
+  c.out->range_last = last;
+  c.out->present |= TCODE_FIELD_BIT(L);
+  return TCODE_DECODE_OK;
+}
+
+template <char L, typename S, bool R>
+inline tcode_decode_status_t parse_field(const SettingValue<L, S, R> *,
+                                         const char *token, Ctx &c) {
+  c.deferred = token;
+  c.out->present |= TCODE_FIELD_BIT(L);
+  return TCODE_DECODE_OK;
+}
+
+// Checks done after the whole line was read.
+inline tcode_decode_status_t finish_field(const void *, Ctx &) {
+  return TCODE_DECODE_OK;
+}
+
+template <typename Lead, typename... G>
+inline tcode_decode_status_t finish_field(const Group<Lead, G...> *, Ctx &c) {
+  for (uint8_t i = 0; i < c.out->group_count; ++i) {
+    if (!(c.out->group[i].present & ~TCODE_FIELD_BIT(Lead::letter)))
+      return fail(c, TCODE_DECODE_MISSING_FIELD, nullptr, 0);
+  }
+  return TCODE_DECODE_OK;
+}
+
+template <char L, typename... S, bool R>
+inline tcode_decode_status_t
+finish_field(const SettingValue<L, KeySet<S...>, R> *, Ctx &c) {
+  if (!c.deferred || c.out->key < 0)
+    return TCODE_DECODE_OK; // missing fields are reported before this
+  tcode_decode_status_t st = TCODE_DECODE_OK;
+  (void)((c.out->key == S::id && (st = parse_number<S>(c.deferred, L, c), true)) ||
+         ...);
+  return st;
+}
+
+template <typename F> inline bool is_present(const Ctx &c) {
+  if constexpr (F::letter == 0)
+    return c.out->key >= 0;
+  else
+    return (c.out->present & TCODE_FIELD_BIT(F::letter)) != 0;
+}
+
+template <typename F>
+inline tcode_decode_status_t parse_group_field(const char *token, Ctx &c,
+                                               tcode_group_t &g) {
+  if (g.present & TCODE_FIELD_BIT(F::letter))
+    return fail(c, TCODE_DECODE_DUPLICATE_FIELD, token, F::letter);
+  tcode_decode_status_t st =
+      parse_checked<F>(token, F::letter, c, &g.value[F::id]);
+  g.present |= TCODE_FIELD_BIT(F::letter);
+  return st;
+}
+
+// Opens the next group, led by `lead`.
+inline tcode_group_t *open_group(Ctx &c, int id, int32_t lead) {
+  tcode_command_t *out = c.out;
+  if (out->group_count == TCODE_MAX_GROUPS)
+    return nullptr;
+  tcode_group_t *g = &out->group[out->group_count++];
+  g->present = 0;
+  g->value[id] = lead;
+  return g;
+}
+
+// Tries `token` as field F. Returns false if it is not an F.
+template <typename F>
+inline bool match_field(const void *, const char *token, Ctx &c,
+                        tcode_decode_status_t &st) {
+  if constexpr (F::letter == 0) {
+    if (is_present<F>(c))
+      return false; // one positional word per command
+  } else {
+    if (token[0] != F::letter)
+      return false;
+    if (is_present<F>(c)) {
+      st = fail(c, TCODE_DECODE_DUPLICATE_FIELD, token, F::letter);
+      return true;
+    }
+  }
+  st = parse_field((const F *)nullptr, token, c);
+  return true;
+}
+
+template <typename F, typename Lead, typename... G>
+inline bool match_field(const Group<Lead, G...> *, const char *token, Ctx &c,
+                        tcode_decode_status_t &st) {
+  tcode_command_t *out = c.out;
+  if (token[0] == Lead::letter) {
+    int32_t lead;
+    if ((st = parse_checked<Lead>(token, Lead::letter, c, &lead)) !=
+        TCODE_DECODE_OK)
+      return true;
+    for (uint8_t i = 0; i < out->group_count; ++i) {
+      if (out->group[i].value[Lead::id] == lead) {
+        st = fail(c, TCODE_DECODE_DUPLICATE_FIELD, token, Lead::letter);
+        return true;
+      }
+    }
+    tcode_group_t *g = open_group(c, Lead::id, lead);
+    if (!g) {
+      st = fail(c, TCODE_DECODE_TOO_MANY_GROUPS, token, Lead::letter);
+      return true;
+    }
+    g->present = TCODE_FIELD_BIT(Lead::letter);
+    return true;
+  }
+  if (!((token[0] == G::letter) || ...))
+    return false;
+
+  // A field before the first lead: the group of the lead's minimum.
+  if (out->group_count == 0)
+    open_group(c, Lead::id, Lead::min);
+  tcode_group_t &g = out->group[out->group_count - 1];
+  (void)((token[0] == G::letter && (st = parse_group_field<G>(token, c, g),
+                                    true)) ||
+         ...);
+  return true;
+}
+
+template <typename F> inline bool check_required(Ctx &c) {
+  if (!F::required || is_present<F>(c))
+    return true;
+  fail(c, TCODE_DECODE_MISSING_FIELD, nullptr, F::letter);
+  return false;
+}
+
+template <typename C, tcode_cmd_t Id, char L, int N, typename... F>
+inline tcode_decode_status_t decode_command(const Command<Id, L, N, F...> *,
+                                            char *const *tokens, int first,
+                                            int count, Ctx &c) {
+  c.out->cmd = Id;
+  c.out->error_cmd = C::name();
+
+  for (int i = first; i < count; ++i) {
+    const char *token = tokens[i];
+    tcode_decode_status_t st = TCODE_DECODE_OK;
+    if (!(match_field<F>((const F *)nullptr, token, c, st) || ...))
+      return fail(c, TCODE_DECODE_UNKNOWN_FIELD, token, token[0]);
+    if (st != TCODE_DECODE_OK)
+      return st;
+  }
+
+  if (!(check_required<F>(c) && ...))
+    return TCODE_DECODE_MISSING_FIELD;
+  if (C::require_any && !(c.out->present & C::require_any))
+    return fail(c, TCODE_DECODE_MISSING_FIELD, nullptr, 0);
+
+  tcode_decode_status_t st = TCODE_DECODE_OK;
+  (void)(((st = finish_field((const F *)nullptr, c)) == TCODE_DECODE_OK) &&
+         ...);
+  return st;
+}
+
+template <typename F> constexpr bool has_letter(const void *, char c) {
+  return F::letter != 0 && F::letter == c;
+}
+
+template <typename F, typename Lead, typename... G>
+constexpr bool has_letter(const Group<Lead, G...> *, char c) {
+  return c == Lead::letter || ((c == G::letter) || ...);
+}
+
+// Commands without a word start with one of their own fields.
+template <tcode_cmd_t Id, char L, int N, typename... F>
+constexpr bool starts_with_field(const Command<Id, L, N, F...> *, char c) {
+  return (has_letter<F>((const F *)nullptr, c) || ...);
+}
+
+template <typename C>
+inline bool try_command(char letter, int32_t number, char *const *tokens,
+                        int word, int first, int count, Ctx &c,
+                        tcode_decode_status_t &st) {
+  if constexpr (C::letter == 0) {
+    if (!starts_with_field((const C *)nullptr, letter))
+      return false;
+    first = word; // the "word" is already a field
+  } else {
+    if (letter != C::letter || number != C::number)
+      return false;
+  }
+  st = decode_command<C>((const C *)nullptr, tokens, first, count, c);
+  return true;
+}
+
+template <typename... C> constexpr bool is_command_letter(char letter) {
+  return ((C::letter != 0 && C::letter == letter) || ...);
+}
+
+} // namespace detail
+
+template <typename... C>
+inline tcode_decode_status_t decode(Grammar<C...> *,
+                                    const tcode_parsed_line_t *line,
+                                    tcode_command_t *out) {
+  // value[] and group[] are only meaningful for fields in `present` and
+  // groups below `group_count`, so they are not cleared.
+  out->cmd = TCODE_CMD_SETPOINT;
+  out->has_line_number = false;
+  out->line_number = 0;
+  out->present = 0;
+  out->key = -1;
+  out->range_last = 0;
+  out->group_count = 0;
+  out->error_cmd = nullptr;
+  out->error_token = nullptr;
+  out->error_field = 0;
+  out->error_decimals = 0;
+  out->error_min = 0;
+  out->error_max = 0;
+  detail::Ctx c{out, nullptr};
+  char *const *tokens = line->tokens;
+  int count = line->token_count;
+  int i = 0;
+
+  // Optional line number
+  if (i < count && tokens[i][0] == 'N') {
+    if (detail::parse_fixed<0>(tokens[i] + 1, &out->line_number) !=
+        TCODE_DECODE_OK)
+      return detail::fail(c, TCODE_DECODE_BAD_VALUE, tokens[i], 'N');
+    out->has_line_number = true;
+    i++;
+  }
+  // Nothing left, or a keepalive
+  if (i == count || (count - i == 1 && strcmp(tokens[i], ".") == 0))
+    return TCODE_DECODE_EMPTY;
+
+  // Command word: "M22", or "M 22" split over two tokens.
+  const char *word = tokens[i];
+  char letter = word[0];
+  int32_t number = -1;
+  int first = i + 1;
+  if (detail::is_command_letter<C...>(letter)) {
+    const char *digits = word + 1;
+    if (*digits == '\0' && first < count)
+      digits = tokens[first++];
+    if (detail::parse_fixed<0>(digits, &number) != TCODE_DECODE_OK ||
+        number < 0)
+      number = -1;
+  }
+
+  tcode_decode_status_t st = TCODE_DECODE_OK;
+  if (!(detail::try_command<C>(letter, number, tokens, i, first, count, c, st) ||
+        ...))
+    return detail::fail(c, TCODE_DECODE_UNKNOWN_COMMAND, word, letter);
+  return st;
+}
+
+// ---------------
+// Help text
+// ---------------
+
+namespace detail {
+
+struct Line {
+  char buf[160];
+  size_t len;
+
+  void add(const char *s) {
+    int n = snprintf(buf + len, sizeof(buf) - len, "%s", s);
+    if (n > 0)
+      len += (size_t)n < sizeof(buf) - len ? (size_t)n : sizeof(buf) - 1 - len;
+  }
+  void add_char(char ch) {
+    char s[2] = {ch, '\0'};
+    add(s);
+  }
+  void add_fixed(int32_t v, int decimals) {
+    char s[24];
+    tcode_format_fixed(s, sizeof(s), v, (uint8_t)decimals);
+    add(s);
+  }
+};
+
+template <typename... K> inline void add_keys(Line &l, KeySet<K...> *) {
+  bool first = true;
+  ((l.add(first ? "" : "|"), l.add(K::name), first = false), ...);
+}
+
+template <char L, int D, int32_t Min, int32_t Max, bool R>
+inline void add_syntax(Line &l, const Number<L, D, Min, Max, R> *,
+                       const char *units) {
+  using N = Number<L, D, Min, Max, R>;
+  l.add_char(L);
+  l.add("<");
+  l.add_fixed(N::min, D);
+  l.add("..");
+  l.add_fixed(N::max, D);
+  if (units[0]) {
+    l.add(" ");
+    l.add(units);
+  }
+  l.add(">");
+}
+
+template <char L, typename Keys, bool R>
+inline void add_syntax(Line &l, const Key<L, Keys, R> *, const char *) {
+  if (L)
+    l.add_char(L);
+  l.add("<");
+  add_keys(l, (Keys *)nullptr);
+  l.add(">");
+}
+
+template <char L, typename Keys, bool R>
+inline void add_syntax(Line &l, const KeyList<L, Keys, R> *, const char *) {
+  l.add_char(L);
+  l.add("<");
+  add_keys(l, (Keys *)nullptr);
+  l.add(">,...");
+}
+
+template <char L, int32_t Min, int32_t Max, bool R>
+inline void add_syntax(Line &l, const Range<L, Min, Max, R> *,
+                       const char *units) {
+  l.add_char(L);
+  l.add("<");
+  l.add_fixed(Min, 0);
+  l.add("..");
+  l.add_fixed(Max, 0);
+  if (units[0]) {
+    l.add(" ");
+    l.add(units);
+  }
+  l.add(">[-<last>]");
+}
+
+template <char L, typename S, bool R>
+inline void add_syntax(Line &l, const SettingValue<L, S, R> *, const char *) {
+  l.add_char(L);
+  l.add("<value>");
+}
+
+template <typename F> inline void add_field(Line &l, const void *) {
+  l.add(" ");
+  if (!F::required)
+    l.add("[");
+  add_syntax(l, (const F *)nullptr, F::units);
+  if (!F::required)
+    l.add("]");
+}
+
+template <typename F, typename Lead, typename... G>
+inline void add_field(Line &l, const Group<Lead, G...> *) {
+  add_field<Lead>(l, (const Lead *)nullptr);
+  (add_field<G>(l, (const G *)nullptr), ...);
+  l.add(" ...");
+}
+
+template <typename C, tcode_cmd_t Id, char L, int N, typename... F>
+inline void help_command(const Command<Id, L, N, F...> *,
+                         tcode_help_emit_fn emit, void *ctx) {
+  Line l{};
+  l.add(C::name());
+  (add_field<F>(l, (const F *)nullptr), ...);
+  l.add("  ; ");
+  l.add(C::help);
+  emit(ctx, l.buf);
+}
+
+template <typename S>
+inline void help_setting(tcode_help_emit_fn emit, void *ctx) {
+  Line l{};
+  l.add("K=");
+  l.add(S::name);
+  l.add(" V<");
+  l.add_fixed(S::min, S::decimals);
+  l.add("..");
+  l.add_fixed(S::max, S::decimals);
+  if (S::units[0]) {
+    l.add(" ");
+    l.add(S::units);
+  }
+  l.add(">  ; ");
+  l.add(S::help);
+  emit(ctx, l.buf);
+}
+
+template <typename... S>
+inline void help_settings(KeySet<S...> *, tcode_help_emit_fn emit, void *ctx) {
+  (help_setting<S>(emit, ctx), ...);
+}
+
+template <typename S> constexpr tcode_setting_info_t setting_info() {
+  return tcode_setting_info_t{S::name, (uint8_t)S::decimals, S::min,
+                              S::max,  S::units,           S::help};
+}
+
+// Ids must be the positions in their list, so the C enums can index the
+// generated tables.
+template <typename... T> constexpr bool ids_in_order() {
+  int ids[] = {(int)T::id...};
+  for (int i = 0; i < (int)sizeof...(T); ++i)
+    if (ids[i] != i)
+      return false;
+  return true;
+}
+
+} // namespace detail
+
+// ---------------------------------------------------------------------------
+// The T-Code grammar
+// ---------------------------------------------------------------------------
+
+namespace spec {
+
+// Setpoint fields
+struct Zone : Number<'Z', 0, 0, 255> {
+  static constexpr int id = TCODE_ZONE_Z;
+  static constexpr const char *units = "";
+  static constexpr const char *help = "zone";
+};
+struct Temp : Number<'T', 2, -45, 90> {
+  static constexpr int id = TCODE_ZONE_T;
+  static constexpr const char *units = "C";
+  static constexpr const char *help = "temperature setpoint";
+};
+struct Humidity : Number<'H', 1, 0, 100> {
+  static constexpr int id = TCODE_ZONE_H;
+  static constexpr const char *units = "%RH";
+  static constexpr const char *help = "humidity setpoint";
+};
+struct ZoneSetpoints : Group<Zone, Temp, Humidity> {};
+
+// Q1 keys
+struct InfoBuild {
+  static constexpr const char *name = "BUILD";
+  static constexpr int id = TCODE_INFO_BUILD;
+};
+struct InfoBuilder {
+  static constexpr const char *name = "BUILDER";
+  static constexpr int id = TCODE_INFO_BUILDER;
+};
+struct InfoBuildDate {
+  static constexpr const char *name = "BUILD_DATE";
+  static constexpr int id = TCODE_INFO_BUILD_DATE;
+};
+using InfoKeys = KeySet<InfoBuild, InfoBuilder, InfoBuildDate>;
+
+struct InfoKey : Key<0, InfoKeys> {
+  static constexpr const char *units = "";
+  static constexpr const char *help = "information key";
+};
+
+// Q0 fields and zones
+struct StatusTemp {
+  static constexpr const char *name = "TEMP";
+  static constexpr int id = TCODE_STATUS_TEMP;
+};
+struct StatusRh {
+  static constexpr const char *name = "RH";
+  static constexpr int id = TCODE_STATUS_RH;
+};
+struct StatusHeat {
+  static constexpr const char *name = "HEAT";
+  static constexpr int id = TCODE_STATUS_HEAT;
+};
+struct StatusCool {
+  static constexpr const char *name = "COOL";
+  static constexpr int id = TCODE_STATUS_COOL;
+};
+struct StatusState {
+  static constexpr const char *name = "STATE";
+  static constexpr int id = TCODE_STATUS_STATE;
+};
+struct StatusSetTemp {
+  static constexpr const char *name = "SET_TEMP";
+  static constexpr int id = TCODE_STATUS_SET_TEMP;
+};
+struct StatusSetRh {
+  static constexpr const char *name = "SET_RH";
+  static constexpr int id = TCODE_STATUS_SET_RH;
+};
+struct StatusAlarm {
+  static constexpr const char *name = "ALARM";
+  static constexpr int id = TCODE_STATUS_ALARM;
+};
+using StatusFields = KeySet<StatusTemp, StatusRh, StatusHeat, StatusCool,
+                            StatusState, StatusSetTemp, StatusSetRh,
+                            StatusAlarm>;
+
+struct StatusFieldList : KeyList<'F', StatusFields> {
+  static constexpr const char *units = "";
+  static constexpr const char *help = "fields to report";
+};
+struct ZoneRange : Range<'Z', 0, 255> {
+  static constexpr const char *units = "";
+  static constexpr const char *help = "zones to report";
+};
+
+// Settings (M20/M21/M22)
+struct SetEcho : Setting<TCODE_SETTING_ECHO, 0, 0, 1> {
+  static constexpr const char *name = "ECHO";
+  static constexpr const char *units = "";
+  static constexpr const char *help = "echo received characters";
+};
+struct SetMeasuredDt : Setting<TCODE_SETTING_MEASURED_DT, 0, 0, 1> {
+  static constexpr const char *name = "MEASURED_DT";
+  static constexpr const char *units = "";
+  static constexpr const char *help = "integrate with the measured period (M32)";
+};
+struct SetCtrl : Setting<TCODE_SETTING_CTRL, 0, 0, 2> {
+  static constexpr const char *name = "CTRL";
+  static constexpr const char *units = "";
+  static constexpr const char *help = "0 bang-bang, 1 PID, 2 autotune (M33)";
+};
+struct SetKp : Setting<TCODE_SETTING_KP, 4, 0, 100> {
+  static constexpr const char *name = "KP";
+  static constexpr const char *units = "1/C";
+  static constexpr const char *help = "PID proportional gain";
+};
+struct SetKi : Setting<TCODE_SETTING_KI, 6, 0, 10> {
+  static constexpr const char *name = "KI";
+  static constexpr const char *units = "1/(C*s)";
+  static constexpr const char *help = "PID integral gain";
+};
+struct SetKd : Setting<TCODE_SETTING_KD, 3, 0, 1000> {
+  static constexpr const char *name = "KD";
+  static constexpr const char *units = "s/C";
+  static constexpr const char *help = "PID derivative gain";
+};
+struct SetCrc : Setting<TCODE_SETTING_CRC, 0, 0, 1> {
+  static constexpr const char *name = "CRC";
+  static constexpr const char *units = "";
+  static constexpr const char *help = "require a CRC-16 (*XXXX) on every line";
+};
+using Settings =
+    KeySet<SetEcho, SetMeasuredDt, SetCtrl, SetKp, SetKi, SetKd, SetCrc>;
+
+struct SettingKey : Key<'K', Settings> {
+  static constexpr const char *units = "";
+  static constexpr const char *help = "setting";
+};
+struct SettingVal : SettingValue<'V', Settings> {
+  static constexpr const char *units = "";
+  static constexpr const char *help = "value, in the setting's range";
+};
+
+// M32/M33 selector
+struct Select01 : Number<'S', 0, 0, 1, true> {
+  static constexpr const char *units = "";
+  static constexpr const char *help = "selector";
+};
+struct Select012 : Number<'S', 0, 0, 2, true> {
+  static constexpr const char *units = "";
+  static constexpr const char *help = "selector";
+};
+
+// Commands
+struct Setpoint : Command<TCODE_CMD_SETPOINT, 0, 0, ZoneSetpoints> {
+  static constexpr const char *name() { return "T/H"; }
+  static constexpr const char *help =
+      "set temperature and/or humidity, for one or more zones at once";
+};
+struct Q0 : Command<TCODE_CMD_Q0, 'Q', 0, StatusFieldList, ZoneRange> {
+  static constexpr const char *help = "status, of the given fields and zones";
+};
+struct Q1 : Command<TCODE_CMD_Q1, 'Q', 1, InfoKey> {
+  static constexpr const char *help = "machine information";
+};
+struct Q2 : Command<TCODE_CMD_Q2, 'Q', 2> {
+  static constexpr const char *help = "RTOS runtime stats";
+};
+struct Q3 : Command<TCODE_CMD_Q3, 'Q', 3> {
+  static constexpr const char *help = "command-path latency";
+};
+struct Q4 : Command<TCODE_CMD_Q4, 'Q', 4> {
+  static constexpr const char *help = "sim control-loop timing";
+};
+struct Q5 : Command<TCODE_CMD_Q5, 'Q', 5> {
+  static constexpr const char *help = "controller";
+};
+struct Q6 : Command<TCODE_CMD_Q6, 'Q', 6> {
+  static constexpr const char *help =
+      "event journal, records since the last Q6";
+};
+struct M20 : Command<TCODE_CMD_M20, 'M', 20> {
+  static constexpr const char *help = "list settings";
+};
+struct M21 : Command<TCODE_CMD_M21, 'M', 21, SettingKey> {
+  static constexpr const char *help = "read setting";
+};
+struct M22 : Command<TCODE_CMD_M22, 'M', 22, SettingKey, SettingVal> {
+  static constexpr const char *help = "write setting (volatile)";
+};
+struct M30 : Command<TCODE_CMD_M30, 'M', 30> {
+  static constexpr const char *help = "reset command-path latency stats";
+};
+struct M31 : Command<TCODE_CMD_M31, 'M', 31> {
+  static constexpr const char *help = "reset control-loop timing stats";
+};
+struct M32 : Command<TCODE_CMD_M32, 'M', 32, Select01> {
+  static constexpr const char *help = "S1 measured dt, S0 nominal dt";
+};
+struct M33 : Command<TCODE_CMD_M33, 'M', 33, Select012> {
+  static constexpr const char *help =
+      "controller: S0 bang-bang, S1 PID, S2 autotune";
+};
+struct M999 : Command<TCODE_CMD_M999, 'M', 999> {
+  static constexpr const char *help = "clear latched fault";
+};
+
+using TCode = Grammar<Setpoint, Q0, Q1, Q2, Q3, Q4, Q5, Q6, M20, M21, M22,
+                      M30, M31, M32, M33, M999>;
+
+static_assert(detail::ids_in_order<Setpoint, Q0, Q1, Q2, Q3, Q4, Q5, Q6, M20,
+                                   M21, M22, M30, M31, M32, M33, M999>() &&
+                  TCODE_CMD_COUNT == 16,
+              "commands must be listed in tcode_cmd_t order");
+static_assert(detail::ids_in_order<InfoBuild, InfoBuilder, InfoBuildDate>() &&
+                  TCODE_INFO_COUNT == 3,
+              "Q1 keys must be listed in tcode_info_key_t order");
+static_assert(detail::ids_in_order<SetEcho, SetMeasuredDt, SetCtrl, SetKp,
+                                   SetKi, SetKd, SetCrc>() &&
+                  TCODE_SETTING_COUNT == 7,
+              "settings must be listed in tcode_setting_t order");
+static_assert(detail::ids_in_order<StatusTemp, StatusRh, StatusHeat, StatusCool,
+                                   StatusState, StatusSetTemp, StatusSetRh,
+                                   StatusAlarm>() &&
+                  TCODE_STATUS_FIELD_COUNT == 8,
+              "Q0 fields must be listed in tcode_status_field_t order");
+static_assert(detail::ids_in_order<Zone, Temp, Humidity>() &&
+                  TCODE_ZONE_FIELD_COUNT == 3,
+              "setpoint fields must be listed in tcode_zone_field_t order");
+
+} // namespace spec
+
+template <typename... C>
+inline void help(Grammar<C...> *, tcode_help_emit_fn emit, void *ctx) {
+  (detail::help_command<C>((const C *)nullptr, emit, ctx), ...);
+}
+
+} // namespace tcode
@@ -0,0 +1,268 @@
+#include "tcode_mux.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TX_MASK (TCODE_PORT_TX_BYTES - 1u)
+
+// Hands the transport as much of the TX ring as it takes. Returns the bytes
+// it took; closes the port if the peer is gone.
+static size_t port_flush(tcode_port_t *p) {
+  size_t sent = 0;
+  while (p->open && tcode_port_tx_queued(p)) {
+    uint32_t tail = p->tx_tail & TX_MASK;
+    uint32_t n = tcode_port_tx_queued(p);
+    if (n > TCODE_PORT_TX_BYTES - tail)
+      n = TCODE_PORT_TX_BYTES - tail;
+    int w = p->transport.write(p->transport.ctx, p->tx + tail, n);
+    if (w < 0) {
+      tcode_mux_close(p);
+      break;
+    }
+    if (w == 0)
+      break;
+    p->tx_tail += (uint32_t)w;
+    sent += (size_t)w;
+  }
+  return sent;
+}
+
+// Queues one piece of a line: the text up to and including its '\n', or the
+// start of a line the next write goes on with.
+static void port_queue(tcode_port_t *p, const char *text, size_t len) {
+  bool ends = text[len - 1] == '\n';
+  if (p->tx_skip) {
+    p->tx_skip = !ends;
+    return;
+  }
+  if (len > TCODE_PORT_TX_BYTES - tcode_port_tx_queued(p)) {
+    // Take back what the ring holds of the line and drop the rest as it
+    // comes. Only a piece already sent (an echoed partial line) stays out.
+    if ((int32_t)(p->tx_tail - p->tx_line) > 0)
+      p->tx_line = p->tx_tail;
+    p->tx_head = p->tx_line;
+    p->tx_dropped++;
+    p->tx_skip = !ends;
+    return;
+  }
+  uint32_t head = p->tx_head & TX_MASK;
+  size_t first = TCODE_PORT_TX_BYTES - head;
+  if (first > len)
+    first = len;
+  memcpy(p->tx + head, text, first);
+  memcpy(p->tx, text + first, len - first);
+  p->tx_head += (uint32_t)len;
+  if (ends)
+    p->tx_line = p->tx_head;
+}
+
+void tcode_port_write(tcode_port_t *p, const char *text, size_t len) {
+  while (len && p->open) {
+    const char *nl = memchr(text, '\n', len);
+    size_t n = nl ? (size_t)(nl - text) + 1 : len;
+    port_queue(p, text, n);
+    text += n;
+    len -= n;
+  }
+}
+
+void tcode_port_vprintf(tcode_port_t *p, const char *fmt, va_list ap) {
+  char line[192];
+  int n = vsnprintf(line, sizeof(line), fmt, ap);
+  if (n < 0)
+    return;
+  if ((size_t)n >= sizeof(line))
+    n = sizeof(line) - 1;
+  tcode_port_write(p, line, (size_t)n);
+}
+
+void tcode_port_printf(tcode_port_t *p, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  tcode_port_vprintf(p, fmt, ap);
+  va_end(ap);
+}
+
+// -------------------------
+// Session callbacks
+// -------------------------
+//
+// Every port's session has the port as its context and forwards to the
+// mux's device with the port added.
+
+static void port_session_write(void *ctx, const char *text, size_t len) {
+  tcode_port_t *p = (tcode_port_t *)ctx;
+  if (p->more) {
+    // The line's "ok", the one write after execute: it follows the rest of
+    // the response.
+    p->ok_held = true;
+    return;
+  }
+  tcode_port_write(p, text, len);
+}
+
+static void port_execute(void *ctx, const tcode_command_t *cmd) {
+  tcode_port_t *p = (tcode_port_t *)ctx;
+  p->mux->ops->execute(p->mux->ctx, p, cmd);
+}
+
+static int32_t port_setting_get(void *ctx, tcode_setting_t s) {
+  tcode_port_t *p = (tcode_port_t *)ctx;
+  return p->mux->ops->setting_get(p->mux->ctx, p, s);
+}
+
+static void port_setting_set(void *ctx, tcode_setting_t s, int32_t v) {
+  tcode_port_t *p = (tcode_port_t *)ctx;
+  p->mux->ops->setting_set(p->mux->ctx, p, s, v);
+}
+
+static void port_line_done(void *ctx, const tcode_command_t *cmd) {
+  tcode_port_t *p = (tcode_port_t *)ctx;
+  p->mux->ops->line_done(p->mux->ctx, p, cmd);
+}
+
+static uint32_t port_clock(void *ctx) {
+  tcode_port_t *p = (tcode_port_t *)ctx;
+  return p->mux->ops->clock(p->mux->ctx);
+}
+
+// -------------------------
+// Mux
+// -------------------------
+
+void tcode_port_continue(tcode_port_t *p, tcode_port_more_fn more) {
+  p->more = more;
+  p->more_waited = false;
+  p->ok_held = false;
+}
+
+// Runs a continued response while the ring has room. Returns true if it
+// wrote anything.
+static bool port_more(tcode_port_t *p) {
+  bool moved = false;
+  while (p->open && p->more && !tcode_port_tx_full(p)) {
+    moved = true;
+    if (!p->more(p->mux->ctx, p))
+      continue;
+    p->more = NULL;
+    if (p->ok_held)
+      tcode_port_write(p, "ok\n", 3);
+    p->ok_held = false;
+  }
+  if (p->more && !p->more_waited) {
+    p->more_waited = true;
+    p->tx_waits++;
+  }
+  return moved;
+}
+
+// Runs the input held for the port a line at a time, while its responses
+// have room. Returns true if it ran any.
+static bool port_run(tcode_port_t *p) {
+  bool moved = false;
+  while (p->open && p->rx_pos < p->rx_len && !p->more &&
+         !tcode_port_tx_full(p)) {
+    const char *start = p->rx + p->rx_pos;
+    size_t n = 0;
+    while (p->rx_pos + n < p->rx_len) {
+      char c = start[n++];
+      if (c == '\n' || c == '\r')
+        break;
+    }
+    p->rx_pos += (uint8_t)n;
+    tcode_session_feed(&p->session, start, n);
+    port_more(p);
+    moved = true;
+  }
+  return moved;
+}
+
+void tcode_mux_init(tcode_mux_t *mux, const tcode_mux_ops_t *ops, void *ctx) {
+  memset(mux, 0, sizeof(*mux));
+  mux->ops = ops;
+  mux->ctx = ctx;
+  mux->session_ops.write = port_session_write;
+  mux->session_ops.execute = port_execute;
+  mux->session_ops.setting_get = ops->setting_get ? port_setting_get : NULL;
+  mux->session_ops.setting_set = ops->setting_set ? port_setting_set : NULL;
+  mux->session_ops.line_done = ops->line_done ? port_line_done : NULL;
+  mux->session_ops.clock = ops->clock ? port_clock : NULL;
+}
+
+tcode_port_t *tcode_mux_open(tcode_mux_t *mux,
+                             const tcode_transport_t *transport) {
+  for (int i = 0; i < TCODE_MUX_MAX_PORTS; ++i) {
+    tcode_port_t *p = &mux->ports[i];
+    if (p->open)
+      continue;
+    memset(p, 0, sizeof(*p));
+    p->mux = mux;
+    p->transport = *transport;
+    p->open = true;
+    tcode_session_init(&p->session, p->line, sizeof(p->line),
+                       &mux->session_ops, p);
+    return p;
+  }
+  return NULL;
+}
+
+void tcode_mux_close(tcode_port_t *p) {
+  if (!p->open)
+    return;
+  p->open = false;
+  p->tx_tail = p->tx_head;
+  p->rx_pos = p->rx_len = 0;
+  p->more = NULL;
+  if (p->mux->ops->closed)
+    p->mux->ops->closed(p->mux->ctx, p);
+}
+
+// Reads the next chunk once the last one has run. Leaves the input of a
+// peer that is not reading its responses where it is, in the transport.
+static bool port_read(tcode_port_t *p) {
+  if (!p->open || p->rx_pos < p->rx_len || p->more || tcode_port_tx_full(p))
+    return false;
+  int n = p->transport.read(p->transport.ctx, p->rx, sizeof(p->rx));
+  if (n < 0)
+    tcode_mux_close(p);
+  if (n <= 0)
+    return false;
+  p->rx_pos = 0;
+  p->rx_len = (uint8_t)n;
+  if (p->mux->ops->clock)
+    p->rx_time = p->mux->ops->clock(p->mux->ctx);
+  if (p->mux->ops->received)
+    p->mux->ops->received(p->mux->ctx, p, p->rx, (size_t)n);
+  port_run(p);
+  return true;
+}
+
+bool tcode_mux_poll(tcode_mux_t *mux) {
+  bool moved = false;
+  for (int i = 0; i < TCODE_MUX_MAX_PORTS; ++i) {
+    tcode_port_t *p = &mux->ports[i];
+    if (!p->open)
+      continue;
+    moved |= port_flush(p) > 0;
+    moved |= port_more(p);
+    moved |= port_run(p);
+    moved |= port_read(p);
+    moved |= port_flush(p) > 0;
+  }
+  return moved;
+}
+
+bool tcode_mux_tx_pending(const tcode_mux_t *mux) {
+  for (int i = 0; i < TCODE_MUX_MAX_PORTS; ++i) {
+    if (mux->ports[i].open && tcode_port_tx_queued(&mux->ports[i]))
+      return true;
+  }
+  return false;
+}
+
+void tcode_mux_broadcast(tcode_mux_t *mux, const char *text, size_t len) {
+  for (int i = 0; i < TCODE_MUX_MAX_PORTS; ++i) {
+    if (mux->ports[i].open)
+      tcode_port_write(&mux->ports[i], text, len);
+  }
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+// Several T-Code sessions served by one dispatcher.
+//
+// Each port is one connection: a transport (USB CDC, a UART, a TCP client)
+// with its own tcode_session (line buffer, checksums, CRC setting, N count)
+// and its own TX ring. tcode_mux_poll() moves whatever each transport has
+// ready in both directions and never waits on any of them, so a slow or
+// silent peer does not hold up the others.
+//
+// Nothing waits for room in a TX ring either. A port's input is run one line
+// at a time, and only while its ring is at most TCODE_PORT_TX_HIGH_WATER, so
+// every response starts with the headroom above it free. A response longer
+// than that headroom is continued (tcode_port_continue): the device writes
+// it a part at a time on later polls, as the transport drains the ring, and
+// the port's next lines wait for it. Text that still finds no room (a
+// broadcast to a peer that stopped reading) is dropped a whole line at a
+// time and counted, so a peer never sees a line cut short.
+//
+// Pure C, no allocation and no RTOS: the firmware's serial task and the host
+// tools poll it from a single thread.
+
+#include "tcode_session.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef TCODE_MUX_MAX_PORTS
+#define TCODE_MUX_MAX_PORTS 2
+#endif
+
+#define TCODE_PORT_LINE_BYTES 256
+// Power of two. Holds a typical response (Q0 of every zone) whole.
+#define TCODE_PORT_TX_BYTES 2048
+// A port is not read while more than this is waiting to go out: its peer
+// sends faster than it reads.
+#define TCODE_PORT_TX_HIGH_WATER (TCODE_PORT_TX_BYTES / 2)
+// Bytes a port reads per poll, so a busy peer cannot starve the others.
+#define TCODE_PORT_RX_CHUNK 64
+
+// Both calls are non-blocking. They return the number of bytes moved (0 when
+// there is nothing to read or no room to write), or -1 once the peer is gone.
+typedef struct tcode_transport {
+  const char *name; // "USB", "UART", "TCP"...
+  int (*read)(void *ctx, char *buf, size_t size);
+  int (*write)(void *ctx, const char *buf, size_t len);
+  void *ctx;
+} tcode_transport_t;
+
+typedef struct tcode_mux tcode_mux_t;
+typedef struct tcode_port tcode_port_t;
+
+// Writes the next part of a continued response, at most
+// TCODE_PORT_TX_BYTES - TCODE_PORT_TX_HIGH_WATER bytes (a line, say), from
+// the device's place in port->more_state. Returns true once the response is
+// complete.
+typedef bool (*tcode_port_more_fn)(void *ctx, tcode_port_t *port);
+
+struct tcode_port {
+  tcode_mux_t *mux;
+  tcode_transport_t transport;
+  bool open;
+  tcode_session_t session;
+  char line[TCODE_PORT_LINE_BYTES];
+
+  // Input read but not run yet: bytes [rx_pos, rx_len), read at rx_time
+  // (ops->clock). A line runs once its end has arrived, so this is when it
+  // was received, even if it runs on a later poll.
+  char rx[TCODE_PORT_RX_CHUNK];
+  uint8_t rx_pos;
+  uint8_t rx_len;
+  uint32_t rx_time;
+
+  // Responses waiting for the transport: bytes [tx_tail, tx_head). The line
+  // being written starts at tx_line.
+  char tx[TCODE_PORT_TX_BYTES];
+  uint32_t tx_head;
+  uint32_t tx_tail;
+  uint32_t tx_line;
+  bool tx_skip;        // dropping the rest of a line that found no room
+  uint32_t tx_waits;   // responses that waited for room in the ring
+  uint32_t tx_dropped; // lines dropped for want of room
+
+  // The response in progress, if it is continued, and the device's place
+  // in it.
+  tcode_port_more_fn more;
+  uint32_t more_state[4];
+  bool more_waited; // counted in tx_waits
+  bool ok_held;     // the session's "ok", sent once more() is done
+};
+
+// The device behind every port. As in tcode_session_ops_t, with the port
+// the line came in on: responses go to it with tcode_port_write/printf.
+typedef struct tcode_mux_ops {
+  void (*execute)(void *ctx, tcode_port_t *port, const tcode_command_t *cmd);
+  int32_t (*setting_get)(void *ctx, tcode_port_t *port, tcode_setting_t s);
+  void (*setting_set)(void *ctx, tcode_port_t *port, tcode_setting_t s,
+                      int32_t value);
+  void (*line_done)(void *ctx, tcode_port_t *port,
+                    const tcode_command_t *cmd);
+  // Received bytes, before they reach the session (e.g. to echo them).
+  void (*received)(void *ctx, tcode_port_t *port, const char *data,
+                   size_t len);
+  // After a port closed, e.g. to release its transport.
+  void (*closed)(void *ctx, tcode_port_t *port);
+  // Clock for rx_time and the sessions' stage timestamps.
+  uint32_t (*clock)(void *ctx);
+} tcode_mux_ops_t;
+
+struct tcode_mux {
+  const tcode_mux_ops_t *ops;
+  void *ctx;
+  tcode_session_ops_t session_ops;
+  tcode_port_t ports[TCODE_MUX_MAX_PORTS];
+};
+
+// Every callback but execute is optional.
+void tcode_mux_init(tcode_mux_t *mux, const tcode_mux_ops_t *ops, void *ctx);
+
+// Starts a session on `transport` (copied). Returns NULL if every port is
+// taken.
+tcode_port_t *tcode_mux_open(tcode_mux_t *mux,
+                             const tcode_transport_t *transport);
+
+// Ends the session; unsent responses and unread input are dropped. A
+// transport that reports its peer gone is closed by tcode_mux_poll().
+void tcode_mux_close(tcode_port_t *port);
+
+// Sends what every TX ring holds, as far as the transports take it, then
+// reads and runs what every transport received. Returns true if any bytes
+// moved, false when every port is idle.
+bool tcode_mux_poll(tcode_mux_t *mux);
+
+// True while some port still has responses to send.
+bool tcode_mux_tx_pending(const tcode_mux_t *mux);
+
+// Queues whole lines (an unsolicited line, say) on every open port. They go
+// between lines, but may land between those of a continued response.
+void tcode_mux_broadcast(tcode_mux_t *mux, const char *text, size_t len);
+
+// Bytes waiting in the port's TX ring. A poll()-based caller watches for
+// output while this is nonzero, and for input only while the ring is not
+// tcode_port_tx_full().
+static inline uint32_t tcode_port_tx_queued(const tcode_port_t *port) {
+  return port->tx_head - port->tx_tail;
+}
+
+// True while the port's ring is above TCODE_PORT_TX_HIGH_WATER: its input
+// and a continued response wait for the transport to drain it.
+static inline bool tcode_port_tx_full(const tcode_port_t *port) {
+  return tcode_port_tx_queued(port) > TCODE_PORT_TX_HIGH_WATER;
+}
+
+// From execute, once port->more_state is set: the response goes on with
+// `more`, called whenever the ring has room until it returns true. The
+// line's "ok" and the port's next lines come after it.
+void tcode_port_continue(tcode_port_t *port, tcode_port_more_fn more);
+
+// Response text for one port. A line (up to its '\n', possibly written in
+// pieces) is queued whole or, if the ring has no room for it, dropped whole
+// and counted in tx_dropped. printf output is cut at 191 characters; write
+// longer lines in pieces.
+void tcode_port_write(tcode_port_t *port, const char *text, size_t len);
+void tcode_port_printf(tcode_port_t *port, const char *fmt, ...);
+void tcode_port_vprintf(tcode_port_t *port, const char *fmt, va_list ap);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -24,6 +24,95 @@ uint8_t tcode_checksum_xor(const char *s) {
   return x;
 }
 
+// -------------
+// CRC-16
+// -------------
+
+#define CRC16_POLY 0x1021u
+
+#ifdef TCODE_CRC16_SLICE_BY_8
+
+// crc16_table[k][b] is the CRC of byte `b` followed by `k` zero bytes, so
+// eight input bytes fold into the CRC with eight independent lookups.
+static uint16_t crc16_table[8][256];
+
+// Built before main(); every caller after that only reads the tables.
+__attribute__((constructor)) static void crc16_build_tables(void) {
+  for (unsigned b = 0; b < 256; ++b) {
+    uint16_t c = (uint16_t)(b << 8);
+    for (int i = 0; i < 8; ++i)
+      c = (uint16_t)((c << 1) ^ (c & 0x8000u ? CRC16_POLY : 0u));
+    crc16_table[0][b] = c;
+  }
+  for (int k = 1; k < 8; ++k) {
+    for (unsigned b = 0; b < 256; ++b) {
+      uint16_t c = crc16_table[k - 1][b];
+      crc16_table[k][b] = (uint16_t)((c << 8) ^ crc16_table[0][c >> 8]);
+    }
+  }
+}
+
+static inline uint16_t crc16_byte(uint16_t crc, uint8_t b) {
+  return (uint16_t)((crc << 8) ^ crc16_table[0][(crc >> 8) ^ b]);
+}
+
+uint16_t tcode_crc16_update(uint16_t crc, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  for (; len >= 8; len -= 8, p += 8) {
+    crc = (uint16_t)(crc16_table[7][p[0] ^ (crc >> 8)] ^
+                     crc16_table[6][p[1] ^ (crc & 0xFFu)] ^
+                     crc16_table[5][p[2]] ^ crc16_table[4][p[3]] ^
+                     crc16_table[3][p[4]] ^ crc16_table[2][p[5]] ^
+                     crc16_table[1][p[6]] ^ crc16_table[0][p[7]]);
+  }
+  while (len--)
+    crc = crc16_byte(crc, *p++);
+  return crc;
+}
+
+#else
+
+// CRC of each nibble value in the top four bits.
+static const uint16_t crc16_nibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+static inline uint16_t crc16_byte(uint16_t crc, uint8_t b) {
+  crc = (uint16_t)((crc << 4) ^ crc16_nibble[(crc >> 12) ^ (b >> 4)]);
+  return (uint16_t)((crc << 4) ^ crc16_nibble[(crc >> 12) ^ (b & 0x0Fu)]);
+}
+
+uint16_t tcode_crc16_update(uint16_t crc, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  while (len--)
+    crc = crc16_byte(crc, *p++);
+  return crc;
+}
+
+#endif
+
+uint16_t tcode_checksum_crc16(const char *s) {
+  if (!s)
+    return TCODE_CRC16_INIT;
+  return tcode_crc16_update(TCODE_CRC16_INIT, s, strlen(s));
+}
+
+void tcode_line_sum_reset(tcode_line_sum_t *sum) {
+  memset(sum, 0, sizeof(*sum));
+  sum->crc = TCODE_CRC16_INIT;
+}
+
+void tcode_line_sum_feed(tcode_line_sum_t *sum, char c) {
+  if (c == '*') {
+    sum->star = true;
+    sum->crc_at_star = sum->crc;
+    sum->xor_at_star = sum->xor_sum;
+  }
+  sum->crc = crc16_byte(sum->crc, (uint8_t)c);
+  sum->xor_sum ^= (uint8_t)c;
+}
+
 // parse two hex chars into a byte. Returns true on success.
 bool tcode_parse_hex_u8(const char *hex2, uint8_t *out) {
   if (!hex2 || !out)
@@ -73,6 +162,12 @@ static void rstrip(char *s) {
 // @param out - the parsed line
 // @return the status of the parse (tcode_status_t)
 tcode_status_t tcode_parse_inplace(char *line, tcode_parsed_line_t *out) {
+  return tcode_parse_inplace_summed(line, NULL, out);
+}
+
+tcode_status_t tcode_parse_inplace_summed(char *line,
+                                          const tcode_line_sum_t *sum,
+                                          tcode_parsed_line_t *out) {
   if (!out)
     // Need to have somewhere to put the line into.
     return TCODE_ERR_EMPTY;
@@ -91,16 +186,24 @@ tcode_status_t tcode_parse_inplace(char *line, tcode_parsed_line_t *out) {
   char *star = strrchr(line, '*');
   // Find the * checksum delim
   if (star) {
-    if (!star[1] || !star[2])
-      return TCODE_ERR_CHECKSUM_FORMAT;
-    uint8_t given = 0;
-    if (!tcode_parse_hex_u8(star + 1, &given))
+    // Two hex digits are the XOR, four the CRC-16.
+    size_t digits = strlen(star + 1);
+    uint8_t hi = 0, lo = 0;
+    if ((digits != 2 && digits != 4) || !tcode_parse_hex_u8(star + 1, &hi) ||
+        (digits == 4 && !tcode_parse_hex_u8(star + 3, &lo)))
       return TCODE_ERR_CHECKSUM_FORMAT;
+    bool crc = digits == 4;
+    uint16_t given = crc ? (uint16_t)((hi << 8) | lo) : hi;
 
     *star = '\0'; // strip checksum from string before calculating
-    uint8_t calc = tcode_checksum_xor(line);
+    uint16_t calc;
+    if (sum && sum->star)
+      calc = crc ? sum->crc_at_star : sum->xor_at_star;
+    else
+      calc = crc ? tcode_checksum_crc16(line) : tcode_checksum_xor(line);
 
     out->has_checksum = true;
+    out->checksum_kind = crc ? TCODE_CHECKSUM_CRC16 : TCODE_CHECKSUM_XOR;
     out->given_checksum = given;
     out->calculated_checksum = calc;
 
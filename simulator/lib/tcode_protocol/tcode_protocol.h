@@ -13,8 +13,9 @@
 extern "C" {
 #endif
 
+// Room for N plus 16 setpoint groups of Z, T and H.
 #ifndef TCODE_MAX_TOKENS
-#define TCODE_MAX_TOKENS 32
+#define TCODE_MAX_TOKENS 52
 #endif
 
 typedef enum tcode_status {
@@ -25,10 +26,20 @@ typedef enum tcode_status {
   TCODE_ERR_CHECKSUM_MISMATCH = 4,
 } tcode_status_t;
 
+// Line integrity check, chosen by the sender with the length of the
+// suffix: `*XX` is the 8-bit XOR, `*XXXX` a CRC-16. Peers that only know the
+// XOR never send four digits, so both work side by side.
+typedef enum tcode_checksum_kind {
+  TCODE_CHECKSUM_NONE = 0,
+  TCODE_CHECKSUM_XOR,
+  TCODE_CHECKSUM_CRC16,
+} tcode_checksum_kind_t;
+
 typedef struct tcode_parsed_line {
   bool has_checksum;
-  uint8_t given_checksum;
-  uint8_t calculated_checksum;
+  tcode_checksum_kind_t checksum_kind;
+  uint16_t given_checksum;
+  uint16_t calculated_checksum;
 
   uint8_t token_count;
   char *tokens[TCODE_MAX_TOKENS]; // pointers into the caller's buffer
@@ -42,9 +53,43 @@ typedef struct tcode_parsed_line {
 // The input buffer will be modified (spaces and '*' replaced with '\0').
 tcode_status_t tcode_parse_inplace(char *line, tcode_parsed_line_t *out);
 
+// Running checksums of a line as it is received, so that checking it costs
+// nothing once the line is complete. Feed it every byte before the line
+// terminator; it keeps both sums as they were at the last '*'.
+typedef struct tcode_line_sum {
+  uint16_t crc;
+  uint8_t xor_sum;
+  bool star;
+  uint16_t crc_at_star;
+  uint8_t xor_at_star;
+} tcode_line_sum_t;
+
+void tcode_line_sum_reset(tcode_line_sum_t *sum);
+void tcode_line_sum_feed(tcode_line_sum_t *sum, char c);
+
+// tcode_parse_inplace() with the checksums taken from `sum`, which must have
+// been fed exactly the bytes of `line`. A NULL `sum` computes them.
+tcode_status_t tcode_parse_inplace_summed(char *line,
+                                          const tcode_line_sum_t *sum,
+                                          tcode_parsed_line_t *out);
+
 // XOR checksum of a null-terminated string.
 uint8_t tcode_checksum_xor(const char *s);
 
+// CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF, no
+// reflection, no final XOR): the CRC of "123456789" is 0x29B1.
+//
+// Table driven. By default a 16-entry nibble table (32 bytes of flash, two
+// lookups per byte) for the firmware; hosts define TCODE_CRC16_SLICE_BY_8
+// for eight 256-entry tables that take eight bytes per step.
+#define TCODE_CRC16_INIT 0xFFFFu
+
+// Continue `crc` over `len` more bytes. Start from TCODE_CRC16_INIT.
+uint16_t tcode_crc16_update(uint16_t crc, const void *data, size_t len);
+
+// CRC-16 of a null-terminated string.
+uint16_t tcode_checksum_crc16(const char *s);
+
 // parse two hex chars into a byte. Returns true on success.
 bool tcode_parse_hex_u8(const char *hex2, uint8_t *out);
 
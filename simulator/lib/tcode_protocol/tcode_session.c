@@ -0,0 +1,200 @@
+#include "tcode_session.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Formats one response line and writes it.
+static void reply(tcode_session_t *s, const char *fmt, ...) {
+  char line[96];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  if (n < 0)
+    return;
+  if ((size_t)n >= sizeof(line))
+    n = sizeof(line) - 1;
+  s->ops->write(s->ctx, line, (size_t)n);
+}
+
+// Reports a line the grammar rejected.
+static void reply_decode_error(tcode_session_t *s, tcode_decode_status_t st,
+                               const tcode_command_t *cmd) {
+  const char *token = cmd->error_token ? cmd->error_token : "";
+  switch (st) {
+  case TCODE_DECODE_RANGE: {
+    char lo[16], hi[16];
+    tcode_format_fixed(lo, sizeof(lo), cmd->error_min, cmd->error_decimals);
+    tcode_format_fixed(hi, sizeof(hi), cmd->error_max, cmd->error_decimals);
+    reply(s, "error:RANGE %s exceeds %s..%s\n", token, lo, hi);
+    break;
+  }
+  case TCODE_DECODE_MISSING_FIELD:
+    if (cmd->error_field)
+      reply(s, "error:MISSING %c for %s\n", cmd->error_field, cmd->error_cmd);
+    else
+      reply(s, "error:MISSING argument for %s\n", cmd->error_cmd);
+    break;
+  case TCODE_DECODE_UNKNOWN_FIELD:
+    reply(s, "error:UNKNOWN_FIELD %s for %s\n", token, cmd->error_cmd);
+    break;
+  default:
+    reply(s, "error:%s %s\n", tcode_decode_status_str(st), token);
+    break;
+  }
+}
+
+// -------------------------
+// Settings (M20/M21/M22)
+// -------------------------
+
+static bool setting_supported(const tcode_session_t *s, tcode_setting_t key) {
+  return key == TCODE_SETTING_CRC || s->ops->setting_get;
+}
+
+// Prints "data: KEY=value".
+static void reply_setting(tcode_session_t *s, tcode_setting_t key) {
+  const tcode_setting_info_t *info = tcode_setting_info(key);
+  int32_t v = key == TCODE_SETTING_CRC ? s->require_crc
+                                       : s->ops->setting_get(s->ctx, key);
+  char value[16];
+  tcode_format_fixed(value, sizeof(value), v, info->decimals);
+  reply(s, "data: %s=%s\n", info->key, value);
+}
+
+static void run_settings(tcode_session_t *s, const tcode_command_t *cmd) {
+  tcode_setting_t key = (tcode_setting_t)cmd->key;
+  if (cmd->cmd == TCODE_CMD_M20) {
+    for (int k = 0; k < TCODE_SETTING_COUNT; ++k) {
+      if (setting_supported(s, (tcode_setting_t)k))
+        reply_setting(s, (tcode_setting_t)k);
+    }
+  } else if (!setting_supported(s, key) ||
+             (cmd->cmd == TCODE_CMD_M22 && key != TCODE_SETTING_CRC &&
+              !s->ops->setting_set)) {
+    reply(s, "error:UNSUPPORTED %s\n", tcode_setting_info(key)->key);
+  } else if (cmd->cmd == TCODE_CMD_M21) {
+    reply_setting(s, key);
+  } else if (key == TCODE_SETTING_CRC) {
+    s->require_crc = cmd->value['V' - 'A'] != 0;
+  } else {
+    s->ops->setting_set(s->ctx, key, cmd->value['V' - 'A']);
+  }
+}
+
+// -------------------------
+// Lines
+// -------------------------
+
+// Parses, checks and runs the line in `s->buf`. Returns the executed
+// command, or NULL.
+static const tcode_command_t *run_line(tcode_session_t *s,
+                                       tcode_command_t *cmd) {
+  tcode_parsed_line_t parsed;
+  tcode_status_t st = tcode_parse_inplace_summed(s->buf, &s->sum, &parsed);
+  if (st != TCODE_OK) {
+    if (st == TCODE_ERR_CHECKSUM_MISMATCH) {
+      int digits = parsed.checksum_kind == TCODE_CHECKSUM_CRC16 ? 4 : 2;
+      s->stats.checksum_errors++;
+      reply(s, "ERROR: Wrong checksum! (got %0*X, expected %0*X)\n", digits,
+            (unsigned)parsed.calculated_checksum, digits,
+            (unsigned)parsed.given_checksum);
+    } else if (st != TCODE_ERR_EMPTY) {
+      s->stats.parse_errors++;
+      reply(s, "ERROR: Parse error (%s)\n", tcode_status_str(st));
+    }
+    return NULL;
+  }
+
+  tcode_decode_status_t dst = tcode_decode(&parsed, cmd);
+  if (dst == TCODE_DECODE_EMPTY)
+    return NULL;
+  if (s->require_crc && parsed.checksum_kind != TCODE_CHECKSUM_CRC16) {
+    s->stats.checksum_errors++;
+    reply(s, "error:CRC_REQUIRED\n");
+    return NULL;
+  }
+  if (dst != TCODE_DECODE_OK) {
+    s->stats.parse_errors++;
+    reply_decode_error(s, dst, cmd);
+    return NULL;
+  }
+  if (cmd->has_line_number && s->numbered && cmd->line_number > 1) {
+    if (cmd->line_number == s->last_line_number)
+      return NULL; // a resend of what already ran
+    if (cmd->line_number != s->last_line_number + 1) {
+      s->stats.line_number_errors++;
+      reply(s, "error:LINE_NUMBER expected N%ld\n",
+            (long)s->last_line_number + 1);
+      return NULL;
+    }
+  }
+  if (cmd->has_line_number) {
+    s->numbered = true;
+    s->last_line_number = cmd->line_number;
+  }
+
+  if (s->ops->clock)
+    s->t_parsed = s->ops->clock(s->ctx);
+  if (cmd->cmd == TCODE_CMD_M20 || cmd->cmd == TCODE_CMD_M21 ||
+      cmd->cmd == TCODE_CMD_M22)
+    run_settings(s, cmd);
+  else
+    s->ops->execute(s->ctx, cmd);
+  if (s->ops->clock)
+    s->t_dispatched = s->ops->clock(s->ctx);
+  return cmd;
+}
+
+static void end_line(tcode_session_t *s) {
+  const tcode_command_t *done = NULL;
+  tcode_command_t cmd;
+  if (s->overflow) {
+    // Never execute a truncated command; drop the whole line instead.
+    s->stats.overflows++;
+    reply(s, "error:OVERFLOW line exceeds %u bytes\n",
+          (unsigned)(s->size - 1));
+  } else if (s->len > 0) {
+    s->buf[s->len] = '\0';
+    s->stats.lines++;
+    done = run_line(s, &cmd);
+  } else {
+    return; // blank line: no "ok"
+  }
+  s->ops->write(s->ctx, "ok\n", 3);
+  if (s->ops->line_done)
+    s->ops->line_done(s->ctx, done);
+
+  s->len = 0;
+  s->overflow = false;
+  tcode_line_sum_reset(&s->sum);
+}
+
+void tcode_session_init(tcode_session_t *s, char *buf, size_t size,
+                        const tcode_session_ops_t *ops, void *ctx) {
+  memset(s, 0, sizeof(*s));
+  s->ops = ops;
+  s->ctx = ctx;
+  s->buf = buf;
+  s->size = size;
+  tcode_line_sum_reset(&s->sum);
+}
+
+void tcode_session_feed(tcode_session_t *s, const char *data, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    char c = data[i];
+    if (c == '\n' || c == '\r') {
+      end_line(s);
+    } else if (s->len < s->size - 1) {
+      s->buf[s->len++] = c;
+      tcode_line_sum_feed(&s->sum, c);
+    } else {
+      s->overflow = true;
+    }
+  }
+}
+
+void tcode_session_reset_stats(tcode_session_t *s) {
+  memset(&s->stats, 0, sizeof(s->stats));
+}
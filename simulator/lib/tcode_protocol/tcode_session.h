@@ -0,0 +1,93 @@
+#pragma once
+
+// One T-Code connection, device side: everything between the bytes a host
+// sends and the device's command handlers.
+//
+// Received bytes are assembled into lines, with their checksums summed as
+// they arrive (tcode_line_sum_t). Complete lines are parsed, checked and
+// decoded; a rejected line gets its error line here, and a valid command
+// goes to the device. The settings commands (M20/M21/M22) are answered here
+// through the device's setting hooks. Every line ends with its "ok".
+//
+// Numbered lines (N<n>) must count up by one: a line out of sequence is
+// rejected with the number expected, so the host can resend from there. A
+// repeat of the last executed number is answered but not run again, and N0
+// or N1 starts the count over.
+//
+// Pure C with no allocation: the caller owns the line buffer. The Pico
+// simulator's serial task and the Arduino examples both run this, so they
+// accept and reject exactly the same lines.
+
+#include "tcode_grammar.h"
+#include "tcode_protocol.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tcode_session_ops {
+  // Response text, one or more whole lines. Required.
+  void (*write)(void *ctx, const char *text, size_t len);
+  // A valid command other than M20/M21/M22. Required.
+  void (*execute)(void *ctx, const tcode_command_t *cmd);
+
+  // Device settings: every tcode_setting_t but CRC, which the session keeps
+  // itself. Values are in the grammar's fixed point and already range
+  // checked. Optional: without them, device settings are unsupported.
+  int32_t (*setting_get)(void *ctx, tcode_setting_t s);
+  void (*setting_set)(void *ctx, tcode_setting_t s, int32_t value);
+
+  // Optional, after each line's "ok". `cmd` is the command that ran
+  // (execute or a settings command), or NULL if the line was rejected or
+  // empty.
+  void (*line_done)(void *ctx, const tcode_command_t *cmd);
+
+  // Optional clock (microseconds, say) for the stage timestamps below.
+  uint32_t (*clock)(void *ctx);
+} tcode_session_ops_t;
+
+typedef struct tcode_session_stats {
+  uint32_t lines; // complete lines, not counting blank or overflowed ones
+  uint32_t checksum_errors;
+  uint32_t parse_errors;
+  uint32_t overflows;
+  uint32_t line_number_errors; // N out of sequence
+} tcode_session_stats_t;
+
+typedef struct tcode_session {
+  const tcode_session_ops_t *ops;
+  void *ctx;
+
+  char *buf;
+  size_t size;
+  size_t len;
+  bool overflow; // the current line no longer fits: drop it at its end
+  tcode_line_sum_t sum;
+
+  bool require_crc; // M22 K=CRC
+  bool numbered;    // a numbered line has been executed
+  int32_t last_line_number;
+  tcode_session_stats_t stats;
+
+  // With ops->clock, stamped for each line that runs: once it is parsed and
+  // decoded, and once its command has run. Valid in line_done.
+  uint32_t t_parsed;
+  uint32_t t_dispatched;
+} tcode_session_t;
+
+// `buf` holds one line: lines of `size` bytes or more are rejected whole.
+void tcode_session_init(tcode_session_t *s, char *buf, size_t size,
+                        const tcode_session_ops_t *ops, void *ctx);
+
+// Feed received bytes, any number at a time. Each LF or CR ends a line,
+// which is handled (executed and answered) before this returns.
+void tcode_session_feed(tcode_session_t *s, const char *data, size_t len);
+
+void tcode_session_reset_stats(tcode_session_t *s);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,170 @@
+#include "thermal_model.h"
+
+#include <math.h>
+#include <string.h>
+
+// Augmented system size: [A B; 0 0] so exp() yields Ad and Bd together.
+#define AUG_MAX (THERMAL_MODEL_MAX_NODES + THERMAL_MODEL_INPUTS)
+#define TAYLOR_TERMS 12
+
+const thermal_model_config_t THERMAL_MODEL_BENCH_CHAMBER = {
+    .node_count = 4,
+    .nodes =
+        {
+            {"air", 1500.0f, 0.0f, 1.0f, 0.0f},
+            {"walls", 20000.0f, 4.0f, 0.0f, 0.0f},
+            {"load", 8000.0f, 0.0f, 0.0f, 0.0f},
+            {"evap", 2000.0f, 0.0f, 0.0f, 1.0f},
+        },
+    .link_count = 3,
+    .links =
+        {
+            {0, 1, 15.0f}, // air <-> walls
+            {0, 2, 10.0f}, // air <-> load
+            {0, 3, 40.0f}, // air <-> evaporator (fan on)
+        },
+    .heater_w = 800.0f,
+    .cooler_w = 900.0f,
+    .sensor_node = 0,
+};
+
+// out = a * b for k x k matrices stored with stride AUG_MAX.
+static void mat_mul(double out[AUG_MAX][AUG_MAX], double a[AUG_MAX][AUG_MAX],
+                    double b[AUG_MAX][AUG_MAX], int k) {
+  for (int i = 0; i < k; ++i) {
+    for (int j = 0; j < k; ++j) {
+      double acc = 0.0;
+      for (int l = 0; l < k; ++l)
+        acc += a[i][l] * b[l][j];
+      out[i][j] = acc;
+    }
+  }
+}
+
+// exp(m) via scaling and squaring with a truncated Taylor series. Only runs
+// at init, so clarity beats speed here.
+static void mat_exp(double out[AUG_MAX][AUG_MAX], double m[AUG_MAX][AUG_MAX],
+                    int k) {
+  static double term[AUG_MAX][AUG_MAX];
+  static double tmp[AUG_MAX][AUG_MAX];
+  static double scaled[AUG_MAX][AUG_MAX];
+
+  double norm = 0.0;
+  for (int i = 0; i < k; ++i) {
+    double row = 0.0;
+    for (int j = 0; j < k; ++j)
+      row += fabs(m[i][j]);
+    if (row > norm)
+      norm = row;
+  }
+  int squarings = 0;
+  while (norm > 0.5 && squarings < 30) {
+    norm *= 0.5;
+    squarings++;
+  }
+  double scale = ldexp(1.0, -squarings);
+
+  for (int i = 0; i < k; ++i) {
+    for (int j = 0; j < k; ++j) {
+      scaled[i][j] = m[i][j] * scale;
+      out[i][j] = (i == j) ? 1.0 : 0.0;
+      term[i][j] = out[i][j];
+    }
+  }
+  for (int n = 1; n <= TAYLOR_TERMS; ++n) {
+    mat_mul(tmp, term, scaled, k);
+    for (int i = 0; i < k; ++i) {
+      for (int j = 0; j < k; ++j) {
+        term[i][j] = tmp[i][j] / n;
+        out[i][j] += term[i][j];
+      }
+    }
+  }
+  for (int s = 0; s < squarings; ++s) {
+    mat_mul(tmp, out, out, k);
+    memcpy(out, tmp, sizeof(tmp));
+  }
+}
+
+bool thermal_model_init(thermal_model_t *m, const thermal_model_config_t *cfg,
+                        float dt_s, float initial_c) {
+  static double aug[AUG_MAX][AUG_MAX];
+  static double e[AUG_MAX][AUG_MAX];
+
+  if (!m || !cfg || dt_s <= 0.0f || cfg->node_count == 0 ||
+      cfg->node_count > THERMAL_MODEL_MAX_NODES ||
+      cfg->link_count > THERMAL_MODEL_MAX_LINKS ||
+      cfg->sensor_node >= cfg->node_count)
+    return false;
+
+  const int n = cfg->node_count;
+  const int k = n + THERMAL_MODEL_INPUTS;
+  memset(aug, 0, sizeof(aug));
+
+  for (int i = 0; i < n; ++i) {
+    const thermal_node_config_t *node = &cfg->nodes[i];
+    if (node->capacity_j_per_k <= 0.0f)
+      return false;
+    double c = node->capacity_j_per_k;
+    aug[i][i] -= node->ambient_w_per_k / c;
+    aug[i][n + 0] = node->ambient_w_per_k / c;
+    aug[i][n + 1] = node->heater_share * cfg->heater_w / c;
+    aug[i][n + 2] = -node->cooler_share * cfg->cooler_w / c;
+  }
+  for (int l = 0; l < cfg->link_count; ++l) {
+    const thermal_link_config_t *link = &cfg->links[l];
+    if (link->a >= n || link->b >= n || link->a == link->b)
+      return false;
+    double g = link->w_per_k;
+    aug[link->a][link->a] -= g / cfg->nodes[link->a].capacity_j_per_k;
+    aug[link->a][link->b] += g / cfg->nodes[link->a].capacity_j_per_k;
+    aug[link->b][link->b] -= g / cfg->nodes[link->b].capacity_j_per_k;
+    aug[link->b][link->a] += g / cfg->nodes[link->b].capacity_j_per_k;
+  }
+  for (int i = 0; i < k; ++i)
+    for (int j = 0; j < k; ++j)
+      aug[i][j] *= dt_s;
+
+  mat_exp(e, aug, k);
+
+  memset(m, 0, sizeof(*m));
+  m->n = (uint8_t)n;
+  m->sensor_node = cfg->sensor_node;
+  m->dt_s = dt_s;
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < n; ++j)
+      m->ad[i][j] = (float)e[i][j];
+    for (int u = 0; u < THERMAL_MODEL_INPUTS; ++u)
+      m->bd[i][u] = (float)e[i][n + u];
+    m->x[i] = initial_c;
+  }
+  return true;
+}
+
+void thermal_model_step(thermal_model_t *m, float ambient_c, float heat_duty,
+                        float cool_duty) {
+  float next[THERMAL_MODEL_MAX_NODES];
+  const int n = m->n;
+  for (int i = 0; i < n; ++i) {
+    const float *ad = m->ad[i];
+    const float *bd = m->bd[i];
+    float acc = bd[0] * ambient_c + bd[1] * heat_duty + bd[2] * cool_duty;
+    for (int j = 0; j < n; ++j)
+      acc += ad[j] * m->x[j];
+    next[i] = acc;
+  }
+  memcpy(m->x, next, (size_t)n * sizeof(float));
+}
+
+uint32_t thermal_model_advance(thermal_model_t *m, float elapsed_s,
+                               float ambient_c, float heat_duty,
+                               float cool_duty) {
+  uint32_t steps = 0;
+  m->acc_s += elapsed_s;
+  while (m->acc_s >= m->dt_s) {
+    thermal_model_step(m, ambient_c, heat_duty, cool_duty);
+    m->acc_s -= m->dt_s;
+    steps++;
+  }
+  return steps;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+// Multi-node lumped RC thermal network.
+//
+// Each node i has a heat capacity C_i and conducts to ambient (G_amb_i) and to
+// other nodes (links, G_ij). The heater and cooler inject/remove power into
+// nodes according to their shares:
+//
+//   C_i dT_i/dt = sum_j G_ij (T_j - T_i) + G_amb_i (T_amb - T_i)
+//                 + share_heat_i * P_heat * u_heat - share_cool_i * P_cool * u_cool
+//
+// i.e. x' = A x + B u with u = [T_amb, u_heat, u_cool] (u_heat/u_cool are the
+// actuator duty in 0..1). thermal_model_init() discretizes this once with a
+// matrix exponential (zero-order hold), so each step is just
+//
+//   x[k+1] = Ad x[k] + Bd u[k]
+//
+// a fixed-size matrix-vector product with no exp/log per tick. Each step is
+// exact for inputs held over dt_s, and stable for any dt_s. Other elapsed
+// times go through thermal_model_advance() in whole dt_s steps: the model
+// runs up to one step behind the caller's clock, and a slow idle tick costs
+// as many steps as it spans.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef THERMAL_MODEL_MAX_NODES
+#define THERMAL_MODEL_MAX_NODES 6
+#endif
+#ifndef THERMAL_MODEL_MAX_LINKS
+#define THERMAL_MODEL_MAX_LINKS 8
+#endif
+
+#define THERMAL_MODEL_INPUTS 3 // ambient temperature, heater duty, cooler duty
+
+typedef struct thermal_node_config {
+  const char *name;
+  float capacity_j_per_k; // heat capacity, must be > 0
+  float ambient_w_per_k; // conductance to ambient
+  float heater_share; // fraction of heater power delivered here (0..1)
+  float cooler_share; // fraction of cooling power removed here (0..1)
+} thermal_node_config_t;
+
+typedef struct thermal_link_config {
+  uint8_t a;
+  uint8_t b;
+  float w_per_k; // conductance between nodes a and b
+} thermal_link_config_t;
+
+typedef struct thermal_model_config {
+  uint8_t node_count;
+  thermal_node_config_t nodes[THERMAL_MODEL_MAX_NODES];
+  uint8_t link_count;
+  thermal_link_config_t links[THERMAL_MODEL_MAX_LINKS];
+
+  float heater_w; // heater power at 100% duty
+  float cooler_w; // cooling power at 100% duty
+  uint8_t sensor_node; // node reported as the chamber temperature (air)
+} thermal_model_config_t;
+
+typedef struct thermal_model {
+  uint8_t n;
+  uint8_t sensor_node;
+  float dt_s; // discretization step
+  float acc_s; // time not yet stepped (see thermal_model_advance)
+  float ad[THERMAL_MODEL_MAX_NODES][THERMAL_MODEL_MAX_NODES];
+  float bd[THERMAL_MODEL_MAX_NODES][THERMAL_MODEL_INPUTS];
+  float x[THERMAL_MODEL_MAX_NODES]; // node temperatures (C)
+} thermal_model_t;
+
+// Benchtop chamber: air, walls, product load and evaporator.
+extern const thermal_model_config_t THERMAL_MODEL_BENCH_CHAMBER;
+
+// Discretize `cfg` at step `dt_s` and set every node to `initial_c`.
+// Returns false if the configuration is invalid.
+bool thermal_model_init(thermal_model_t *m, const thermal_model_config_t *cfg,
+                        float dt_s, float initial_c);
+
+// One discrete step of dt_s.
+void thermal_model_step(thermal_model_t *m, float ambient_c, float heat_duty,
+                        float cool_duty);
+
+// Advance by an arbitrary elapsed time using whole dt_s steps; the remainder
+// is carried into the next call. Returns the number of steps taken.
+uint32_t thermal_model_advance(thermal_model_t *m, float elapsed_s,
+                               float ambient_c, float heat_duty,
+                               float cool_duty);
+
+// Temperature of the sensor node (normally the chamber air).
+static inline float thermal_model_sensor_c(const thermal_model_t *m) {
+  return m->x[m->sensor_node];
+}
@@ -0,0 +1,288 @@
+#include "thermo_control.h"
+
+#include <math.h>
+#include <string.h>
+
+// Checks if a tick has reached a target
+static bool tick_reached(uint32_t now, uint32_t target) {
+  // wrap-safe check for "now >= target" on unsigned tick counters
+  return (uint32_t)(now - target) < 0x80000000u;
+}
+
+static q16_t q16_mul(q16_t a, q16_t b) {
+  return (q16_t)(((int64_t)a * b) >> 16);
+}
+
+static q16_t q16_clamp64(int64_t x, q16_t lo, q16_t hi) {
+  if (x < lo)
+    return lo;
+  if (x > hi)
+    return hi;
+  return (q16_t)x;
+}
+
+// -----------------------------
+// PID
+// -----------------------------
+
+void thermo_pid_init(thermo_pid_t *pid, const thermo_pid_config_t *cfg) {
+  memset(pid, 0, sizeof(*pid));
+  pid->cfg = cfg;
+  pid->gains = cfg->gains;
+}
+
+void thermo_pid_set_gains(thermo_pid_t *pid, const thermo_pid_gains_t *gains) {
+  pid->gains = *gains;
+}
+
+q16_t thermo_pid_compute(thermo_pid_t *pid, q16_t setpoint, q16_t meas,
+                         q16_t dt) {
+  const thermo_pid_gains_t *g = &pid->gains;
+  q16_t lo = pid->cfg->enable_cooling ? -Q16_ONE : 0;
+  q16_t err = setpoint - meas;
+
+  q16_t p = q16_mul(g->kp, err);
+
+  // Derivative on measurement: no kick when the setpoint steps.
+  if (pid->has_prev && dt > 0) {
+    int64_t raw = ((int64_t)(meas - pid->prev_meas) << 16) / dt;
+    q16_t tau = pid->cfg->d_filter_s;
+    if (tau > 0)
+      raw = pid->meas_rate + ((raw - pid->meas_rate) * dt) / ((int64_t)tau + dt);
+    pid->meas_rate = q16_clamp64(raw, INT32_MIN, INT32_MAX);
+  }
+  q16_t d = -q16_mul(g->kd, pid->meas_rate);
+  pid->prev_meas = meas;
+  pid->has_prev = true;
+
+  // Anti-windup: don't integrate further into a saturated output, and keep
+  // the integral term itself within the output range.
+  int64_t di = (int64_t)q16_mul(g->ki, err) * dt; // Q32
+  int64_t unsat = (int64_t)p + (pid->integ >> 16) + d;
+  bool push_hi = unsat >= Q16_ONE && di > 0;
+  bool push_lo = unsat <= lo && di < 0;
+  if (!push_hi && !push_lo) {
+    int64_t integ = pid->integ + di;
+    if (integ > (int64_t)Q16_ONE << 16)
+      integ = (int64_t)Q16_ONE << 16;
+    else if (integ < (int64_t)lo << 16)
+      integ = (int64_t)lo << 16;
+    pid->integ = integ;
+  }
+
+  pid->output = q16_clamp64((int64_t)p + (pid->integ >> 16) + d, lo, Q16_ONE);
+  return pid->output;
+}
+
+// Ticks from `now` until `mode`'s actuator may start (0 = now, or running).
+static uint32_t pid_lockout(const thermo_pid_t *pid, thermo_sim_mode_t mode,
+                            uint32_t now) {
+  uint32_t min_off = mode == THERMO_SIM_MODE_COOL
+                         ? pid->cfg->min_cool_off_ticks
+                         : pid->cfg->min_heat_off_ticks;
+  if (pid->mode == mode || !pid->switched_off ||
+      now - pid->off_ticks >= min_off)
+    return 0;
+  return min_off - (now - pid->off_ticks);
+}
+
+// Records what the controller now asks for, and when an actuator stopped.
+static void pid_set_mode(thermo_pid_t *pid, thermo_sim_mode_t mode,
+                         uint32_t now) {
+  if (pid->mode != THERMO_SIM_MODE_IDLE && mode != pid->mode) {
+    pid->switched_off = true;
+    pid->off_ticks = now;
+  }
+  pid->mode = mode;
+}
+
+// Latches the output for a new proportioning window.
+static void pid_open_window(thermo_pid_t *pid, uint32_t start) {
+  const thermo_pid_config_t *cfg = pid->cfg;
+  uint32_t window = cfg->window_ticks;
+  q16_t out = pid->output;
+
+  thermo_sim_mode_t mode = THERMO_SIM_MODE_HEAT;
+  uint32_t min_on = cfg->min_heat_on_ticks;
+  if (out < 0) {
+    out = -out;
+    mode = THERMO_SIM_MODE_COOL;
+    min_on = cfg->min_cool_on_ticks;
+  }
+  uint32_t on = (uint32_t)(((uint64_t)(uint32_t)out * window) >> 16);
+  if (on < min_on)
+    on = 0;
+  else if (window - on < min_on)
+    on = window;
+
+  // Anti-short-cycle: start late, with what is left of the window.
+  uint32_t wait = on ? pid_lockout(pid, mode, start) : 0;
+  if (wait >= window || window - wait < min_on)
+    on = 0;
+  else if (on > window - wait)
+    on = window - wait;
+
+  pid->window_open = true;
+  pid->window_start = start;
+  pid->on_start = on ? wait : 0;
+  pid->on_ticks = on;
+  pid->window_mode = mode;
+}
+
+static void pid_reset(void *ctx) {
+  thermo_pid_t *pid = (thermo_pid_t *)ctx;
+  pid->integ = 0;
+  pid->has_prev = false;
+  pid->meas_rate = 0;
+  pid->output = 0;
+  pid->window_open = false;
+  pid->mode = THERMO_SIM_MODE_IDLE;
+  pid->switched_off = false;
+}
+
+static thermo_sim_mode_t pid_update(void *ctx,
+                                    const thermo_control_input_t *in) {
+  thermo_pid_t *pid = (thermo_pid_t *)ctx;
+  uint32_t window = pid->cfg->window_ticks ? pid->cfg->window_ticks : 1;
+
+  // Anti-windup for the lockout too: while the actuator the output asks
+  // for may not start, integrating would only wind up.
+  int64_t integ = pid->integ;
+  q16_t out = thermo_pid_compute(pid, Q16_FROM_FLOAT(in->setpoint_c),
+                                 Q16_FROM_FLOAT(in->temperature_c),
+                                 Q16_FROM_FLOAT(in->dt_s));
+  thermo_sim_mode_t want =
+      out < 0 ? THERMO_SIM_MODE_COOL : THERMO_SIM_MODE_HEAT;
+  if (out != 0 && pid_lockout(pid, want, in->now_ticks))
+    pid->integ = integ;
+
+  if (!pid->window_open) {
+    pid_open_window(pid, in->now_ticks);
+  } else if (tick_reached(in->now_ticks, pid->window_start + window)) {
+    // Keep the window phase unless we fell more than a window behind.
+    uint32_t next = pid->window_start + window;
+    if (tick_reached(in->now_ticks, next + window))
+      next = in->now_ticks;
+    pid_open_window(pid, next);
+  }
+
+  thermo_sim_mode_t mode = THERMO_SIM_MODE_IDLE;
+  uint32_t elapsed = in->now_ticks - pid->window_start;
+  if (elapsed >= pid->on_start && elapsed - pid->on_start < pid->on_ticks)
+    mode = pid->window_mode;
+  pid_set_mode(pid, mode, in->now_ticks);
+  return mode;
+}
+
+const thermo_controller_ops_t THERMO_PID_OPS = {
+    .name = "PID",
+    .reset = pid_reset,
+    .update = pid_update,
+};
+
+// -----------------------------
+// Relay autotune
+// -----------------------------
+
+void thermo_autotune_init(thermo_autotune_t *at,
+                          const thermo_autotune_config_t *cfg) {
+  memset(at, 0, sizeof(*at));
+  at->cfg = cfg;
+}
+
+// Derives gains from the averaged limit cycle. Returns false if the
+// oscillation was too small to measure.
+static bool autotune_finish(thermo_autotune_t *at) {
+  const thermo_autotune_config_t *cfg = at->cfg;
+  float a = at->sum_amplitude / (float)at->measured;
+  float pu = at->sum_period_s / (float)at->measured;
+  float h = cfg->hysteresis_c;
+  if (a <= h || pu <= 0.0f)
+    return false;
+
+  // Relay amplitude: heat/cool swings the output -1..1, heat/idle 0..1.
+  float d = cfg->enable_cooling ? 1.0f : 0.5f;
+  // Describing function of a relay with hysteresis.
+  float ku = 4.0f * d / (3.14159265f * sqrtf(a * a - h * h));
+
+  // Tyreus-Luyben PI. Derivative action is left off: with the actuator
+  // time-proportioned over a window it mostly amplifies the window ripple.
+  float kp = ku / 3.2f;
+  float ti = 2.2f * pu;
+
+  at->ku = ku;
+  at->pu_s = pu;
+  at->gains.kp = Q16_FROM_FLOAT(kp);
+  at->gains.ki = Q16_FROM_FLOAT(kp / ti);
+  at->gains.kd = 0;
+  return true;
+}
+
+static void autotune_reset(void *ctx) {
+  thermo_autotune_t *at = (thermo_autotune_t *)ctx;
+  thermo_autotune_init(at, at->cfg);
+  at->state = THERMO_AUTOTUNE_RUNNING;
+}
+
+static thermo_sim_mode_t autotune_update(void *ctx,
+                                         const thermo_control_input_t *in) {
+  thermo_autotune_t *at = (thermo_autotune_t *)ctx;
+  const thermo_autotune_config_t *cfg = at->cfg;
+  if (at->state != THERMO_AUTOTUNE_RUNNING)
+    return THERMO_SIM_MODE_IDLE;
+
+  float t = in->temperature_c;
+  float sp = in->setpoint_c;
+  float h = cfg->hysteresis_c;
+  uint32_t rate = in->tick_rate_hz ? in->tick_rate_hz : 1000u;
+
+  if (!at->started) {
+    at->started = true;
+    at->start_ticks = in->now_ticks;
+    at->relay_high = t < sp;
+    at->peak_hi = at->peak_lo = t;
+  }
+  if (cfg->timeout_ticks &&
+      tick_reached(in->now_ticks, at->start_ticks + cfg->timeout_ticks)) {
+    at->state = THERMO_AUTOTUNE_FAILED;
+    return THERMO_SIM_MODE_IDLE;
+  }
+
+  if (t > at->peak_hi)
+    at->peak_hi = t;
+  if (t < at->peak_lo)
+    at->peak_lo = t;
+
+  if (at->relay_high && t > sp + h) {
+    at->relay_high = false;
+  } else if (!at->relay_high && t < sp - h) {
+    // Each upward switch closes one full cycle. The first cycle includes
+    // the approach to the setpoint, so it is not measured.
+    at->relay_high = true;
+    if (at->rises >= 2) {
+      at->sum_amplitude += (at->peak_hi - at->peak_lo) / 2.0f;
+      at->sum_period_s +=
+          (float)(in->now_ticks - at->last_rise_ticks) / (float)rate;
+      at->measured++;
+    }
+    at->rises++;
+    at->last_rise_ticks = in->now_ticks;
+    at->peak_hi = at->peak_lo = t;
+
+    if (at->measured >= (cfg->cycles ? cfg->cycles : 1)) {
+      at->state =
+          autotune_finish(at) ? THERMO_AUTOTUNE_DONE : THERMO_AUTOTUNE_FAILED;
+      return THERMO_SIM_MODE_IDLE;
+    }
+  }
+
+  if (at->relay_high)
+    return THERMO_SIM_MODE_HEAT;
+  return cfg->enable_cooling ? THERMO_SIM_MODE_COOL : THERMO_SIM_MODE_IDLE;
+}
+
+const thermo_controller_ops_t THERMO_AUTOTUNE_OPS = {
+    .name = "AUTOTUNE",
+    .reset = autotune_reset,
+    .update = autotune_update,
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+// Controllers for thermo_sim (see thermo_controller_ops_t in thermo_sim.h).
+//
+// - PID: Q16.16 fixed point, derivative on measurement, integrator clamped
+//   and frozen while the output is saturated (anti-windup). The signed output
+//   (-1..1, >0 heat, <0 cool) is time-proportioned over a fixed window into
+//   HEAT/COOL/IDLE, with pulses shorter than the actuator on-delay dropped
+//   and a minimum off time before each start (anti-short-cycle).
+// - Relay autotune: Astrom-Hagglund relay experiment around the setpoint.
+//   Measures ultimate gain/period from the limit cycle and derives PI gains
+//   (Tyreus-Luyben, which overshoots less than Ziegler-Nichols on slow plants).
+//
+// Everything here is plain C with no RTOS dependencies; the host tools link it.
+
+#include "thermo_sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef int32_t q16_t;
+
+#define Q16_ONE ((q16_t)65536)
+#define Q16_FROM_FLOAT(x) ((q16_t)((x) * 65536.0f))
+#define Q16_TO_FLOAT(x) ((float)(x) / 65536.0f)
+
+// -----------------------------
+// PID
+// -----------------------------
+
+typedef struct thermo_pid_gains {
+  q16_t kp; // output per degC
+  q16_t ki; // output per degC*s
+  q16_t kd; // output per degC/s
+} thermo_pid_gains_t;
+
+typedef struct thermo_pid_config {
+  thermo_pid_gains_t gains;
+  bool enable_cooling; // negative output drives the compressor
+
+  // Low-pass time constant on the derivative, in seconds (Q16, 0 = none).
+  // Needed when the loop runs faster than the plant updates: the
+  // measurement then moves in steps, and an unfiltered derivative spikes.
+  q16_t d_filter_s;
+
+  // Time-proportioning window, in ticks. Must be comfortably longer than the
+  // actuator on/off delays or the duty resolution suffers.
+  uint32_t window_ticks;
+  // Pulses shorter than these are dropped (the actuator would barely have
+  // switched on); remainders shorter than these become full-on windows.
+  uint32_t min_heat_on_ticks;
+  uint32_t min_cool_on_ticks;
+  // Anti-short-cycle: an actuator starts only this long after the last one
+  // (either) switched off; 0 = no limit. A window that would start it sooner
+  // starts it when the lockout ends if the minimum on time is still left,
+  // else not at all. A compressor needs minutes for its pressures to
+  // equalize; waiting on the other actuator too keeps heat and cool from
+  // chasing each other's overshoot.
+  uint32_t min_heat_off_ticks;
+  uint32_t min_cool_off_ticks;
+} thermo_pid_config_t;
+
+typedef struct thermo_pid {
+  const thermo_pid_config_t *cfg;
+  thermo_pid_gains_t gains; // live gains, initialised from cfg
+
+  // Integral term in output units, kept with 16 extra fractional bits: at
+  // millisecond ticks a single ki*err*dt step is far below one Q16 LSB.
+  int64_t integ;
+  q16_t prev_meas; // for derivative on measurement
+  q16_t meas_rate; // filtered d(meas)/dt, degC/s
+  bool has_prev;
+  q16_t output; // last controller output, -1..1
+
+  // Current proportioning window
+  bool window_open;
+  uint32_t window_start;
+  uint32_t on_start; // into the window, past a lockout
+  uint32_t on_ticks;
+  thermo_sim_mode_t window_mode;
+
+  // What the last update returned, and when an actuator last switched off
+  // (once one has).
+  thermo_sim_mode_t mode;
+  bool switched_off;
+  uint32_t off_ticks;
+} thermo_pid_t;
+
+extern const thermo_controller_ops_t THERMO_PID_OPS;
+
+void thermo_pid_init(thermo_pid_t *pid, const thermo_pid_config_t *cfg);
+void thermo_pid_set_gains(thermo_pid_t *pid, const thermo_pid_gains_t *gains);
+
+// One controller update (fixed point). Returns the output in -1..1.
+q16_t thermo_pid_compute(thermo_pid_t *pid, q16_t setpoint, q16_t meas,
+                         q16_t dt);
+
+// -----------------------------
+// Relay autotune
+// -----------------------------
+
+typedef enum thermo_autotune_state {
+  THERMO_AUTOTUNE_IDLE = 0,
+  THERMO_AUTOTUNE_RUNNING,
+  THERMO_AUTOTUNE_DONE,
+  THERMO_AUTOTUNE_FAILED,
+} thermo_autotune_state_t;
+
+typedef struct thermo_autotune_config {
+  bool enable_cooling; // relay between heat and cool, else heat and idle
+  float hysteresis_c;  // relay switching band around the setpoint
+  uint8_t cycles;      // full oscillations to average (after one settling)
+  uint32_t timeout_ticks;
+} thermo_autotune_config_t;
+
+typedef struct thermo_autotune {
+  const thermo_autotune_config_t *cfg;
+  thermo_autotune_state_t state;
+
+  bool relay_high;
+  bool started;
+  uint32_t start_ticks;
+  uint32_t last_rise_ticks; // previous upward switch
+  uint8_t rises;
+
+  float peak_hi; // extremes of the current cycle
+  float peak_lo;
+  float sum_amplitude;
+  float sum_period_s;
+  uint8_t measured;
+
+  // Results
+  float ku; // ultimate gain, output per degC
+  float pu_s; // ultimate period
+  thermo_pid_gains_t gains;
+} thermo_autotune_t;
+
+extern const thermo_controller_ops_t THERMO_AUTOTUNE_OPS;
+
+void thermo_autotune_init(thermo_autotune_t *at,
+                          const thermo_autotune_config_t *cfg);
+
+static inline bool thermo_autotune_finished(const thermo_autotune_t *at) {
+  return at->state == THERMO_AUTOTUNE_DONE ||
+         at->state == THERMO_AUTOTUNE_FAILED;
+}
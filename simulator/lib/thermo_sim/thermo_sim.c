@@ -0,0 +1,236 @@
+#include "thermo_sim.h"
+
+#include <math.h>
+#include <string.h>
+
+// Clamps a float between lo and hi
+static float clampf(float x, float lo, float hi) {
+  if (x < lo)
+    return lo;
+  if (x > hi)
+    return hi;
+  return x;
+}
+
+// Checks if a tick has reached a target
+static bool tick_reached(uint32_t now, uint32_t target) {
+  // wrap-safe check for "now >= target" on unsigned tick counters
+  return (uint32_t)(now - target) < 0x80000000u;
+}
+
+// Determines the desired mode based on the current temperature, setpoint, and hysteresis
+static thermo_sim_mode_t desired_mode(const thermo_sim_config_t *cfg, float t,
+                                      float sp, thermo_sim_mode_t current) {
+  float h = cfg->temp_hysteresis_c;
+  if (t < sp - h)
+    return THERMO_SIM_MODE_HEAT;
+  if (cfg->enable_active_cooling && t > sp + h)
+    return THERMO_SIM_MODE_COOL;
+  // stay in current mode inside band, otherwise idle
+  if (t >= sp - h && t <= sp + h)
+    return current;
+  return THERMO_SIM_MODE_IDLE;
+}
+
+// Calculates the delay before a transition can occur
+static uint32_t transition_delay_ticks(const thermo_sim_config_t *cfg,
+                                       thermo_sim_mode_t from,
+                                       thermo_sim_mode_t to) {
+  if (from == to)
+    return 0;
+  if (to == THERMO_SIM_MODE_HEAT)
+    return cfg->heat_on_delay_ticks;
+  if (to == THERMO_SIM_MODE_COOL)
+    return cfg->cool_on_delay_ticks;
+  // to IDLE
+  if (from == THERMO_SIM_MODE_HEAT)
+    return cfg->heat_off_delay_ticks;
+  if (from == THERMO_SIM_MODE_COOL)
+    return cfg->cool_off_delay_ticks;
+  return 0;
+}
+
+// Constant-ramp plant: fixed heat/cool rates, passive drift toward ambient.
+static void ramp_model_step(thermo_sim_t *sim, float dt_s) {
+  const thermo_sim_config_t *cfg = sim->cfg;
+  float t = sim->plant_c;
+  if (sim->mode == THERMO_SIM_MODE_HEAT) {
+    t += cfg->heat_ramp_c_per_s * dt_s;
+  } else if (sim->mode == THERMO_SIM_MODE_COOL) {
+    t -= cfg->cool_ramp_c_per_s * dt_s;
+  } else {
+    // drift toward ambient
+    float step = cfg->passive_ramp_c_per_s * dt_s;
+    if (t < cfg->ambient_temp_c) {
+      t += step;
+      if (t > cfg->ambient_temp_c)
+        t = cfg->ambient_temp_c;
+    } else if (t > cfg->ambient_temp_c) {
+      t -= step;
+      if (t < cfg->ambient_temp_c)
+        t = cfg->ambient_temp_c;
+    }
+  }
+  sim->plant_c = clampf(t, cfg->min_temp_c, cfg->max_temp_c);
+}
+
+// Humidity mapping (log-based):
+// At 0°C => 100%, at >=20°C => ~50%, falling quickly from 0 to 20°C.
+// Uses a natural log profile.
+static float humidity_curve(float temperature_c) {
+  if (temperature_c <= 0.0f)
+    return 100.0f;
+  if (temperature_c >= 20.0f)
+    return 50.0f;
+  // Scale so log curve passes through (0,100) and (20,50)
+  // ln(temp + 1) is always defined for temp >= 0
+  float min_hum = 50.0f, max_hum = 100.0f, t_cutoff = 20.0f;
+  float log_min = logf(1.0f);            // ln(1) = 0
+  float log_max = logf(t_cutoff + 1.0f); // ln(21)
+  float factor = (max_hum - min_hum) / (log_max - log_min);
+  float humidity = max_hum - factor * (logf(temperature_c + 1.0f) - log_min);
+  return clampf(humidity, 50.0f, 100.0f);
+}
+
+// The curve sampled every 1/8 C over 0..20 C by thermo_sim_init, so a step
+// interpolates instead of calling logf. Off by at most 0.03 %RH (near 0 C,
+// where it bends most), under the humidity probe's 0.1 %RH resolution.
+#define RH_TABLE_PER_C 8
+#define RH_TABLE_SIZE (20 * RH_TABLE_PER_C + 1)
+static float g_rh_table[RH_TABLE_SIZE];
+static bool g_rh_table_ready;
+
+static void rh_table_init(void) {
+  if (g_rh_table_ready)
+    return;
+  for (int i = 0; i < RH_TABLE_SIZE; ++i)
+    g_rh_table[i] = humidity_curve((float)i / RH_TABLE_PER_C);
+  g_rh_table_ready = true;
+}
+
+static float humidity_for(float temperature_c) {
+  if (temperature_c <= 0.0f)
+    return 100.0f;
+  float x = temperature_c * RH_TABLE_PER_C;
+  int i = (int)x;
+  if (i >= RH_TABLE_SIZE - 1)
+    return g_rh_table[RH_TABLE_SIZE - 1];
+  return g_rh_table[i] + (g_rh_table[i + 1] - g_rh_table[i]) * (x - (float)i);
+}
+
+bool thermo_sim_init(thermo_sim_t *sim, const thermo_sim_config_t *cfg,
+                     float initial_c, thermo_sim_mode_t initial_mode) {
+  if (!sim || !cfg)
+    return false;
+  memset(sim, 0, sizeof(*sim));
+  sim->cfg = cfg;
+  rh_table_init();
+  sim->mode = initial_mode;
+  sim->plant_c = sim->temperature_c = initial_c;
+  sim->plant_rh = sim->humidity = cfg->ambient_rh;
+  if (cfg->sensor)
+    thermo_sim_seed_sensor(sim, 0);
+
+  if (cfg->model) {
+    if (!thermal_model_init(&sim->model, cfg->model, cfg->model_dt_s,
+                            initial_c))
+      return false;
+    sim->use_model = true;
+  }
+  return true;
+}
+
+void thermo_sim_seed_sensor(thermo_sim_t *sim, uint32_t seed) {
+  const sensor_pipeline_config_t *sc = sim->cfg->sensor;
+  if (!sc)
+    return;
+  // Distinct, nonzero streams for the two probes.
+  uint32_t s = sc->seed ^ (seed * 0x9E3779B9u);
+  sensor_channel_init(&sim->temperature_sensor, &sc->temperature, s | 1u,
+                      sim->plant_c);
+  sensor_channel_init(&sim->humidity_sensor, &sc->humidity,
+                      (s ^ 0xA5A5A5A5u) | 1u, sim->plant_rh);
+  sim->temperature_c = sensor_channel_value(&sim->temperature_sensor);
+  sim->humidity = sensor_channel_value(&sim->humidity_sensor);
+}
+
+void thermo_sim_set_controller(thermo_sim_t *sim,
+                               const thermo_controller_ops_t *ops, void *ctx) {
+  sim->ctrl_ops = ops;
+  sim->ctrl_ctx = ctx;
+  sim->cooling_rest = false;
+  if (ops && ops->reset)
+    ops->reset(ctx);
+}
+
+void thermo_sim_step(thermo_sim_t *sim, uint32_t now_ticks, float dt_s,
+                     float setpoint_c) {
+  const thermo_sim_config_t *cfg = sim->cfg;
+  float sp = setpoint_c;
+  float t = sim->temperature_c;
+  float h = cfg->temp_hysteresis_c;
+
+  // Cooling undershoot: when cooling drops temp to sp - h/2, stop and rest
+  // until we passively drift up to sp + h/2
+  if (sim->mode == THERMO_SIM_MODE_COOL && t <= sp - h / 2.0f)
+    sim->cooling_rest = true;
+  if (sim->cooling_rest && t >= sp + h / 2.0f)
+    sim->cooling_rest = false;
+  // Above ambient, drift goes the wrong way: resting would never end, so
+  // hand back to the heater once we fall out of the band.
+  if (sim->cooling_rest && sp > cfg->ambient_temp_c && t < sp - h)
+    sim->cooling_rest = false;
+
+  thermo_sim_mode_t want;
+  if (sim->ctrl_ops) {
+    thermo_control_input_t in = {
+        .now_ticks = now_ticks,
+        .tick_rate_hz = cfg->tick_rate_hz,
+        .dt_s = dt_s,
+        .temperature_c = t,
+        .setpoint_c = sp,
+        .mode = sim->mode,
+    };
+    want = sim->ctrl_ops->update(sim->ctrl_ctx, &in);
+    if (want == THERMO_SIM_MODE_COOL && !cfg->enable_active_cooling)
+      want = THERMO_SIM_MODE_IDLE;
+  } else {
+    want = sim->cooling_rest ? THERMO_SIM_MODE_IDLE
+                             : desired_mode(cfg, t, sp, sim->mode);
+  }
+  if (sim->inhibit)
+    want = THERMO_SIM_MODE_IDLE;
+
+  if (!sim->pending && want != sim->mode) {
+    sim->pending = true;
+    sim->pending_mode = want;
+    sim->pending_until =
+        now_ticks + transition_delay_ticks(cfg, sim->mode, want);
+  }
+  if (sim->pending && tick_reached(now_ticks, sim->pending_until)) {
+    sim->mode = sim->pending_mode;
+    sim->pending = false;
+  }
+
+  // Update temperature.
+  if (sim->use_model) {
+    thermal_model_advance(&sim->model, dt_s, cfg->ambient_temp_c,
+                          sim->mode == THERMO_SIM_MODE_HEAT ? 1.0f : 0.0f,
+                          sim->mode == THERMO_SIM_MODE_COOL ? 1.0f : 0.0f);
+    sim->plant_c = clampf(thermal_model_sensor_c(&sim->model),
+                          cfg->min_temp_c, cfg->max_temp_c);
+  } else {
+    ramp_model_step(sim, dt_s);
+  }
+  sim->plant_rh = humidity_for(sim->plant_c);
+
+  if (cfg->sensor) {
+    sim->temperature_c =
+        sensor_channel_sample(&sim->temperature_sensor, sim->plant_c, dt_s);
+    sim->humidity =
+        sensor_channel_sample(&sim->humidity_sensor, sim->plant_rh, dt_s);
+  } else {
+    sim->temperature_c = sim->plant_c;
+    sim->humidity = sim->plant_rh;
+  }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+// Simulated chamber: plant model + bang-bang controller, one step per tick.
+//
+// This is the pure-C core of sim_thermo_system_task. It has no FreeRTOS or
+// Pico dependencies so the same code runs on the host (tools/sim_host) and
+// can be stepped much faster than real time.
+
+#include "sensor_pipeline.h"
+#include "thermal_model.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum thermo_sim_mode {
+  THERMO_SIM_MODE_IDLE = 0,
+  THERMO_SIM_MODE_HEAT = 1,
+  THERMO_SIM_MODE_COOL = 2,
+} thermo_sim_mode_t;
+
+// Pluggable controller. The sim calls update() every step with the current
+// measurement and applies the returned mode through the usual actuator
+// on/off delays. See lib/thermo_control for PID and relay autotune.
+typedef struct thermo_control_input {
+  uint32_t now_ticks;
+  uint32_t tick_rate_hz;
+  float dt_s;
+  float temperature_c;
+  float setpoint_c;
+  thermo_sim_mode_t mode; // what the actuators are doing right now
+} thermo_control_input_t;
+
+typedef struct thermo_controller_ops {
+  const char *name;
+  void (*reset)(void *ctx);
+  thermo_sim_mode_t (*update)(void *ctx, const thermo_control_input_t *in);
+} thermo_controller_ops_t;
+
+typedef struct thermo_sim_config {
+  float ambient_temp_c;
+  float ambient_rh;
+
+  float heat_ramp_c_per_s; // temperature rise rate when heater is on
+  float passive_ramp_c_per_s; // drift rate toward ambient when idle
+  float cool_ramp_c_per_s; // temperature fall rate when compressor is on
+
+  // Actuator delays, in ticks of the caller's tick clock.
+  uint32_t heat_on_delay_ticks;   // delay before heater turns on after request
+  uint32_t heat_off_delay_ticks;  // delay before heater turns off after request
+  uint32_t cool_on_delay_ticks;  // delay before compressor turns on
+  uint32_t cool_off_delay_ticks; // delay before compressor turns off
+  bool enable_active_cooling;
+
+  float temp_hysteresis_c; // bang-bang hysteresis around setpoint
+
+  float min_temp_c;
+  float max_temp_c;
+
+  uint32_t tick_rate_hz; // rate of the caller's tick clock (for controllers)
+
+  // Optional multi-node RC plant (see thermal_model.h), discretized at
+  // model_dt_s. If NULL the constant ramp rates above are used instead.
+  const thermal_model_config_t *model;
+  float model_dt_s;
+
+  // Optional simulated probes (see sensor_pipeline.h): noise, quantization,
+  // dropouts and lag, then the firmware's filters. If NULL the readings are
+  // the plant's exact values.
+  const sensor_pipeline_config_t *sensor;
+} thermo_sim_config_t;
+
+typedef struct thermo_sim {
+  const thermo_sim_config_t *cfg;
+
+  thermo_sim_mode_t mode;
+  bool pending;
+  thermo_sim_mode_t pending_mode;
+  uint32_t pending_until;
+
+  // When cooling undershoots to sp - h/2, we stop and rest until drift to sp + h/2
+  bool cooling_rest;
+
+  // NULL selects the built-in bang-bang controller above.
+  const thermo_controller_ops_t *ctrl_ops;
+  void *ctrl_ctx;
+
+  // Forces both actuators off (through their off-delays), e.g. on a fault.
+  bool inhibit;
+
+  bool use_model;
+  thermal_model_t model;
+
+  float plant_c;  // the plant's own temperature
+  float plant_rh; // and relative humidity
+  sensor_channel_t temperature_sensor;
+  sensor_channel_t humidity_sensor;
+
+  float temperature_c; // reported (sensor) temperature
+  float humidity; // reported relative humidity
+} thermo_sim_t;
+
+// Initialize at `initial_c` in `initial_mode`. Returns false if the optional
+// RC model configuration is invalid.
+bool thermo_sim_init(thermo_sim_t *sim, const thermo_sim_config_t *cfg,
+                     float initial_c, thermo_sim_mode_t initial_mode);
+
+// Gives the probes their own noise: zones with the same config otherwise
+// see the same sequence. Restarts them settled at the plant's values.
+void thermo_sim_seed_sensor(thermo_sim_t *sim, uint32_t seed);
+
+// Advance by `dt_s` seconds. `now_ticks` is the caller's tick clock, used for
+// the actuator delays.
+void thermo_sim_step(thermo_sim_t *sim, uint32_t now_ticks, float dt_s,
+                     float setpoint_c);
+
+// Swap the controller (NULL = built-in bang-bang). Calls ops->reset(ctx).
+void thermo_sim_set_controller(thermo_sim_t *sim,
+                               const thermo_controller_ops_t *ops, void *ctx);
+
+// True while the bang-bang controller is idle with no transition pending:
+// nothing but slow drift happens, so the caller may tick less often. Other
+// controllers need their full rate for time-proportioned output.
+static inline bool thermo_sim_settled(const thermo_sim_t *sim) {
+  return !sim->ctrl_ops && sim->mode == THERMO_SIM_MODE_IDLE && !sim->pending;
+}
+
+// The probe's readings before the filters (the plant's values without a
+// sensor). Alarm rules watch these: the rate limiter would hold a fast
+// change below their rate thresholds, and the filters delay a limit.
+static inline float thermo_sim_probe_temperature(const thermo_sim_t *sim) {
+  return sim->cfg->sensor ? sensor_channel_raw(&sim->temperature_sensor)
+                          : sim->temperature_c;
+}
+
+static inline float thermo_sim_probe_humidity(const thermo_sim_t *sim) {
+  return sim->cfg->sensor ? sensor_channel_raw(&sim->humidity_sensor)
+                          : sim->humidity;
+}
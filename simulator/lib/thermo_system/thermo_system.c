@@ -0,0 +1,726 @@
+#include "thermo_system.h"
+
+#include <string.h>
+
+#define SETPOINT_ENTRY_BYTES 9   // u8 zone, f32 temperature, f32 humidity
+#define CHECKPOINT_HEAD_BYTES 4  // u16 alarm, u8 fault, u8 zones
+#define CHECKPOINT_ZONE_BYTES 9  // f32 temperature, f32 humidity, u8 mode
+#define INIT_BYTES 15
+#define STEP_BYTES 10           // u16 count, u32 period, f32 dt_s
+#define STATE_HEAD_BYTES 4      // u16 total, u16 offset
+#define STATE_PART_BYTES (EVENT_JOURNAL_MAX_PAYLOAD - STATE_HEAD_BYTES)
+
+_Static_assert(THERMO_SYSTEM_MAX_ZONES * CHECKPOINT_ZONE_BYTES +
+                       CHECKPOINT_HEAD_BYTES <=
+                   EVENT_JOURNAL_MAX_PAYLOAD,
+               "a checkpoint must fit one journal record");
+
+// --------------------
+// Bench chamber preset
+// --------------------
+
+const alarm_rule_spec_t THERMO_SYSTEM_BENCH_ALARM_RULES[] = {
+    {101, "OVER_TEMP", ALARM_KIND_ABOVE, ALARM_SIGNAL_TEMP, 88.0f, 2.0f,
+     ALARM_SEVERITY_FAULT},
+    {102, "UNDER_TEMP", ALARM_KIND_BELOW, ALARM_SIGNAL_TEMP, -39.5f, 2.0f,
+     ALARM_SEVERITY_FAULT},
+    // Faster than either actuator can move the air: a sensor glitch.
+    {110, "TEMP_RATE", ALARM_KIND_RATE, ALARM_SIGNAL_TEMP, 2.0f, 5.0f,
+     ALARM_SEVERITY_WARN},
+    {120, "HEATER_STUCK", ALARM_KIND_STUCK, ALARM_SIGNAL_HEATER, 0.5f, 120.0f,
+     ALARM_SEVERITY_FAULT},
+    {121, "COOLER_STUCK", ALARM_KIND_STUCK, ALARM_SIGNAL_COOLER, 0.5f, 300.0f,
+     ALARM_SEVERITY_FAULT},
+    {130, "SETPOINT_TIMEOUT", ALARM_KIND_TIMEOUT, ALARM_SIGNAL_TEMP_ERROR_ABS,
+     3.0f, 3600.0f, ALARM_SEVERITY_WARN},
+};
+const uint16_t THERMO_SYSTEM_BENCH_ALARM_RULE_COUNT =
+    sizeof(THERMO_SYSTEM_BENCH_ALARM_RULES) /
+    sizeof(THERMO_SYSTEM_BENCH_ALARM_RULES[0]);
+
+void thermo_system_bench_config(thermo_system_config_t *cfg,
+                                uint32_t tick_rate_hz) {
+#define MS(ms) ((uint32_t)((uint64_t)(ms) * tick_rate_hz / 1000u))
+  *cfg = (thermo_system_config_t){
+      .sim =
+          {
+              .ambient_temp_c = 22.0f,
+              .ambient_rh = 45.0f,
+              .heat_ramp_c_per_s = 0.30f,
+              .passive_ramp_c_per_s = 0.05f,
+              .cool_ramp_c_per_s = 0.40f,
+              .heat_on_delay_ticks = MS(500),
+              .heat_off_delay_ticks = MS(500),
+              .cool_on_delay_ticks = MS(500),
+              .cool_off_delay_ticks = MS(500),
+              .enable_active_cooling = true,
+              .temp_hysteresis_c = 3.0f,
+              .min_temp_c = -40.0f,
+              .max_temp_c = 90.0f,
+              .tick_rate_hz = tick_rate_hz,
+              // Air/walls/load/evaporator network instead of fixed ramps.
+              .model = &THERMAL_MODEL_BENCH_CHAMBER,
+              .model_dt_s = 0.1f,
+              // Noisy, quantized probes behind the firmware's
+              // median/IIR/rate-limit filters.
+              .sensor = &SENSOR_PIPELINE_BENCH_CHAMBER,
+          },
+      .zone_count = THERMO_SYSTEM_MAX_ZONES,
+      .setpoint_c = 20.0f,
+      .setpoint_rh = 100.0f,
+      // Bang-bang by default; M33 S1 selects PID, M33 S2 autotunes it.
+      .controller = THERMO_SYSTEM_CTRL_HYSTERESIS,
+      .pid =
+          {
+              .gains = {.kp = Q16_FROM_FLOAT(1.0f),
+                        .ki = Q16_FROM_FLOAT(0.02f),
+                        .kd = 0},
+              .enable_cooling = true,
+              .d_filter_s = Q16_FROM_FLOAT(2.0f),
+              .window_ticks = MS(3000),
+              .min_heat_on_ticks = MS(500),
+              .min_cool_on_ticks = MS(500),
+              // Anti-short-cycle. Without it, PID starts the compressor
+              // about every other window (see `tcode_sim_host -B`).
+              .min_heat_off_ticks = MS(120000),
+              .min_cool_off_ticks = MS(300000),
+          },
+      .autotune =
+          {
+              .enable_cooling = true,
+              .hysteresis_c = 0.5f,
+              .cycles = 3,
+              .timeout_ticks = MS(4u * 3600u * 1000u), // 4 h
+          },
+      .alarm_rules = THERMO_SYSTEM_BENCH_ALARM_RULES,
+      .alarm_rule_count = THERMO_SYSTEM_BENCH_ALARM_RULE_COUNT,
+  };
+#undef MS
+}
+
+// Little-endian packing (both the RP2040 and the host tools are LE).
+static inline uint8_t *put_u8(uint8_t *p, uint8_t v) {
+  *p = v;
+  return p + 1;
+}
+
+static inline uint8_t *put_u16(uint8_t *p, uint16_t v) {
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
+
+static inline uint8_t *put_32(uint8_t *p, const void *v) {
+  memcpy(p, v, 4);
+  return p + 4;
+}
+
+static inline float get_f32(const uint8_t *p) {
+  float v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline int32_t get_i32(const uint8_t *p) {
+  int32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint16_t get_u16(const uint8_t *p) {
+  uint16_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// Records the pending run of steps, which ends here.
+static void record_steps(thermo_system_t *sys) {
+  if (!sys->run_count)
+    return;
+  uint8_t buf[STEP_BYTES], *p = buf;
+  p = put_u16(p, sys->run_count);
+  p = put_32(p, &sys->run_period);
+  p = put_32(p, &sys->run_dt_s);
+  if (sys->journal)
+    event_journal_append(sys->journal, (uint8_t)THERMO_SYSTEM_REC_STEP,
+                         sys->now_ticks, buf, STEP_BYTES);
+  sys->run_count = 0;
+}
+
+// Any record other than a step ends the run, which goes first.
+static void record(thermo_system_t *sys, thermo_system_record_t type,
+                   const uint8_t *payload, size_t len) {
+  if (!sys->journal)
+    return;
+  record_steps(sys);
+  event_journal_append(sys->journal, (uint8_t)type, sys->now_ticks, payload,
+                       (uint8_t)len);
+}
+
+// Extends the run with a step to `now_ticks`, or ends it and starts another.
+// Called before sys->now_ticks moves on.
+static void record_step(thermo_system_t *sys, uint32_t now_ticks,
+                        float dt_s) {
+  uint32_t period = now_ticks - sys->now_ticks;
+  if (sys->run_count && sys->run_count < UINT16_MAX &&
+      memcmp(&dt_s, &sys->run_dt_s, sizeof(dt_s)) == 0 &&
+      (sys->run_count == 1 || period == sys->run_period)) {
+    sys->run_period = period;
+  } else {
+    record_steps(sys);
+    sys->run_period = 0;
+    sys->run_dt_s = dt_s;
+  }
+  sys->run_count++;
+}
+
+static void apply_controller(thermo_system_t *sys, thermo_system_ctrl_t ctrl) {
+  switch (ctrl) {
+  case THERMO_SYSTEM_CTRL_PID:
+    thermo_sim_set_controller(&sys->zones[0], &THERMO_PID_OPS, &sys->pid);
+    break;
+  case THERMO_SYSTEM_CTRL_AUTOTUNE:
+    thermo_sim_set_controller(&sys->zones[0], &THERMO_AUTOTUNE_OPS,
+                              &sys->autotune);
+    break;
+  default:
+    ctrl = THERMO_SYSTEM_CTRL_HYSTERESIS;
+    thermo_sim_set_controller(&sys->zones[0], NULL, NULL);
+    break;
+  }
+  sys->ctrl = ctrl;
+}
+
+bool thermo_system_init(thermo_system_t *sys, const thermo_system_config_t *cfg,
+                        float initial_c, thermo_sim_mode_t initial_mode) {
+  memset(sys, 0, sizeof(*sys));
+  sys->cfg = cfg;
+  sys->zone_count = cfg->zone_count == 0 ? 1
+                    : cfg->zone_count > THERMO_SYSTEM_MAX_ZONES
+                        ? THERMO_SYSTEM_MAX_ZONES
+                        : cfg->zone_count;
+  sys->initial_c = initial_c;
+  sys->initial_mode = initial_mode;
+
+  for (uint8_t z = 0; z < sys->zone_count; ++z) {
+    float t = z == 0 ? initial_c : cfg->sim.ambient_temp_c;
+    thermo_sim_mode_t mode = z == 0 ? initial_mode : THERMO_SIM_MODE_IDLE;
+    if (!thermo_sim_init(&sys->zones[z], &cfg->sim, t, mode))
+      return false;
+    thermo_sim_seed_sensor(&sys->zones[z], z);
+    sys->setpoints[z].temperature_c = cfg->setpoint_c;
+    sys->setpoints[z].humidity = cfg->setpoint_rh;
+  }
+  for (uint8_t z = 0; z < sys->zone_count; ++z) {
+    if (alarm_rules_compile(&sys->alarms[z], cfg->alarm_rules,
+                            cfg->alarm_rule_count) >= 0)
+      return false;
+  }
+  thermo_pid_init(&sys->pid, &cfg->pid);
+  thermo_autotune_init(&sys->autotune, &cfg->autotune);
+  apply_controller(sys, cfg->controller);
+  return true;
+}
+
+// ----------------------------------------
+// Checkpoint state: one field list (state_control, state_zone) both writes
+// and reads it, so the two cannot drift apart.
+// ----------------------------------------
+
+typedef struct state_io {
+  bool load;
+  const uint8_t *in; // loading: the state left to read
+  const uint8_t *end;
+  bool ok;
+
+  thermo_system_t *sys; // writing: records through it (NULL only counts)
+  uint32_t count;       // bytes written
+  uint16_t total;
+  uint16_t sent;        // in recorded parts
+  uint8_t len;          // in `part`, after its head
+  uint8_t part[EVENT_JOURNAL_MAX_PAYLOAD];
+} state_io_t;
+
+static void state_flush(state_io_t *io) {
+  if (!io->sys || !io->len)
+    return;
+  put_u16(put_u16(io->part, io->total), io->sent);
+  record(io->sys, THERMO_SYSTEM_REC_CHECKPOINT_STATE, io->part,
+         STATE_HEAD_BYTES + io->len);
+  io->sent = (uint16_t)(io->sent + io->len);
+  io->len = 0;
+}
+
+static void state_bytes(state_io_t *io, void *v, size_t n) {
+  uint8_t *b = v;
+  if (io->load) {
+    if ((size_t)(io->end - io->in) < n) {
+      io->ok = false;
+      return;
+    }
+    memcpy(b, io->in, n);
+    io->in += n;
+    return;
+  }
+  io->count += (uint32_t)n;
+  while (io->sys && n) {
+    size_t k = STATE_PART_BYTES - io->len;
+    if (k > n)
+      k = n;
+    memcpy(io->part + STATE_HEAD_BYTES + io->len, b, k);
+    io->len = (uint8_t)(io->len + k);
+    b += k;
+    n -= k;
+    if (io->len == STATE_PART_BYTES)
+      state_flush(io);
+  }
+}
+
+// Fixed-size fields as they are (both ends are little endian), enums as u8.
+#define STATE(io, x) state_bytes((io), &(x), sizeof(x))
+#define STATE_ENUM(io, x)                                                     \
+  do {                                                                         \
+    uint8_t v_ = (uint8_t)(x);                                                 \
+    state_bytes((io), &v_, 1);                                                 \
+    (x) = v_;                                                                  \
+  } while (0)
+
+static void state_control(state_io_t *io, thermo_system_t *sys) {
+  STATE_ENUM(io, sys->ctrl);
+  if (io->load)
+    apply_controller(sys, sys->ctrl); // resets what follows
+
+  thermo_pid_t *pid = &sys->pid;
+  STATE(io, pid->gains);
+  STATE(io, pid->integ);
+  STATE(io, pid->prev_meas);
+  STATE(io, pid->meas_rate);
+  STATE(io, pid->has_prev);
+  STATE(io, pid->output);
+  STATE(io, pid->window_open);
+  STATE(io, pid->window_start);
+  STATE(io, pid->on_start);
+  STATE(io, pid->on_ticks);
+  STATE_ENUM(io, pid->window_mode);
+  STATE_ENUM(io, pid->mode);
+  STATE(io, pid->switched_off);
+  STATE(io, pid->off_ticks);
+
+  thermo_autotune_t *at = &sys->autotune;
+  STATE_ENUM(io, at->state);
+  STATE(io, at->relay_high);
+  STATE(io, at->started);
+  STATE(io, at->start_ticks);
+  STATE(io, at->last_rise_ticks);
+  STATE(io, at->rises);
+  STATE(io, at->peak_hi);
+  STATE(io, at->peak_lo);
+  STATE(io, at->sum_amplitude);
+  STATE(io, at->sum_period_s);
+  STATE(io, at->measured);
+  STATE(io, at->ku);
+  STATE(io, at->pu_s);
+  STATE(io, at->gains);
+}
+
+static void state_channel(state_io_t *io, sensor_channel_t *ch) {
+  sensor_median_t *m = &ch->median;
+  STATE(io, ch->rng);
+  STATE(io, ch->lag_dt_ms);
+  STATE(io, ch->lag_gain);
+  STATE(io, ch->lagged);
+  STATE(io, ch->raw);
+  STATE(io, ch->out);
+  STATE(io, m->count);
+  STATE(io, m->head);
+  if (m->count > m->window || m->head >= m->window)
+    io->ok = false;
+  state_bytes(io, m->ring, m->window * sizeof(m->ring[0]));
+  state_bytes(io, m->sorted, m->window * sizeof(m->sorted[0]));
+  STATE(io, ch->iir.dt_ms);
+  STATE(io, ch->iir.alpha_q16);
+  STATE(io, ch->iir.y_q8);
+  STATE(io, ch->iir.primed);
+  STATE(io, ch->rate.y);
+  STATE(io, ch->rate.primed);
+  STATE(io, ch->stats);
+}
+
+static void state_zone(state_io_t *io, thermo_system_t *sys, uint8_t z) {
+  thermo_sim_t *zone = &sys->zones[z];
+  STATE(io, sys->setpoints[z]);
+  STATE_ENUM(io, zone->mode);
+  STATE(io, zone->pending);
+  STATE_ENUM(io, zone->pending_mode);
+  STATE(io, zone->pending_until);
+  STATE(io, zone->cooling_rest);
+  STATE(io, zone->inhibit);
+  STATE(io, zone->plant_c);
+  STATE(io, zone->plant_rh);
+  STATE(io, zone->temperature_c);
+  STATE(io, zone->humidity);
+  if (zone->use_model) {
+    STATE(io, zone->model.acc_s);
+    state_bytes(io, zone->model.x, zone->model.n * sizeof(zone->model.x[0]));
+  }
+  if (zone->cfg->sensor) {
+    state_channel(io, &zone->temperature_sensor);
+    state_channel(io, &zone->humidity_sensor);
+  }
+
+  alarm_rules_t *ar = &sys->alarms[z];
+  STATE(io, ar->primed);
+  STATE(io, ar->last_ms);
+  STATE(io, ar->signal);
+  STATE(io, ar->rate);
+  STATE(io, ar->setpoint_mc);
+  STATE(io, ar->setpoint_changed_ms);
+  STATE(io, ar->active_count);
+  STATE(io, ar->alarm_code);
+  STATE(io, ar->fault_latched);
+  STATE(io, ar->fault_code);
+  STATE(io, ar->events_dropped);
+  for (uint16_t i = 0; i < ar->count; ++i) {
+    alarm_rule_state_t *st = &ar->state[i];
+    STATE(io, st->since_ms);
+    STATE(io, st->ref);
+    STATE(io, st->pending);
+    STATE(io, st->active);
+  }
+}
+
+static void state_all(state_io_t *io, thermo_system_t *sys) {
+  state_control(io, sys);
+  for (uint8_t z = 0; z < sys->zone_count; ++z)
+    state_zone(io, sys, z);
+}
+
+// The summary, then the state in as many parts as it takes.
+static void record_checkpoint(thermo_system_t *sys) {
+  uint8_t buf[CHECKPOINT_HEAD_BYTES +
+              THERMO_SYSTEM_MAX_ZONES * CHECKPOINT_ZONE_BYTES];
+  uint8_t *p = buf;
+  thermo_system_alarm_t alarm =
+      thermo_system_alarm(sys, THERMO_SYSTEM_ALL_ZONES);
+  p = put_u16(p, alarm.code);
+  p = put_u8(p, alarm.faulted);
+  p = put_u8(p, sys->zone_count);
+  for (uint8_t z = 0; z < sys->zone_count; ++z) {
+    p = put_32(p, &sys->zones[z].temperature_c);
+    p = put_32(p, &sys->zones[z].humidity);
+    p = put_u8(p, (uint8_t)sys->zones[z].mode);
+  }
+  record(sys, THERMO_SYSTEM_REC_CHECKPOINT, buf, (size_t)(p - buf));
+
+  state_io_t io = {0};
+  state_all(&io, sys);
+  if (io.count > UINT16_MAX)
+    return; // only with far more alarm rules than the firmware has
+  io = (state_io_t){.sys = sys, .total = (uint16_t)io.count};
+  state_all(&io, sys);
+  state_flush(&io);
+}
+
+void thermo_system_attach_journal(thermo_system_t *sys,
+                                  event_journal_t *journal,
+                                  uint32_t checkpoint_ticks) {
+  record_steps(sys);
+  sys->journal = journal;
+  sys->checkpoint_ticks = checkpoint_ticks;
+  sys->last_checkpoint = sys->now_ticks;
+  if (sys->restored) {
+    record_checkpoint(sys);
+    return;
+  }
+
+  uint8_t buf[INIT_BYTES], *p = buf;
+  float sp_c = sys->cfg->setpoint_c, sp_rh = sys->cfg->setpoint_rh;
+  p = put_u8(p, sys->zone_count);
+  p = put_u8(p, (uint8_t)sys->cfg->controller);
+  p = put_32(p, &sys->initial_c);
+  p = put_u8(p, (uint8_t)sys->initial_mode);
+  p = put_32(p, &sp_c);
+  p = put_32(p, &sp_rh);
+  record(sys, THERMO_SYSTEM_REC_INIT, buf, (size_t)(p - buf));
+}
+
+void thermo_system_set_setpoints(thermo_system_t *sys,
+                                 const thermo_system_setpoint_t *setpoints) {
+  uint8_t buf[THERMO_SYSTEM_MAX_ZONES * SETPOINT_ENTRY_BYTES], *p = buf;
+  for (uint8_t z = 0; z < sys->zone_count; ++z) {
+    const thermo_system_setpoint_t *sp = &setpoints[z];
+    if (memcmp(sp, &sys->setpoints[z], sizeof(*sp)) == 0)
+      continue;
+    sys->setpoints[z] = *sp;
+    p = put_u8(p, z);
+    p = put_32(p, &sp->temperature_c);
+    p = put_32(p, &sp->humidity);
+  }
+  if (p != buf)
+    record(sys, THERMO_SYSTEM_REC_SETPOINTS, buf, (size_t)(p - buf));
+}
+
+void thermo_system_set_controller(thermo_system_t *sys,
+                                  thermo_system_ctrl_t ctrl) {
+  uint8_t v = (uint8_t)ctrl;
+  record(sys, THERMO_SYSTEM_REC_CONTROLLER, &v, 1);
+  apply_controller(sys, ctrl);
+}
+
+void thermo_system_set_pid_gains(thermo_system_t *sys,
+                                 const thermo_pid_gains_t *gains) {
+  uint8_t buf[12], *p = buf;
+  p = put_32(p, &gains->kp);
+  p = put_32(p, &gains->ki);
+  p = put_32(p, &gains->kd);
+  record(sys, THERMO_SYSTEM_REC_GAINS, buf, sizeof(buf));
+  thermo_pid_set_gains(&sys->pid, gains);
+}
+
+void thermo_system_clear_fault(thermo_system_t *sys) {
+  record(sys, THERMO_SYSTEM_REC_CLEAR_FAULT, NULL, 0);
+  for (uint8_t z = 0; z < sys->zone_count; ++z)
+    alarm_rules_clear_fault(&sys->alarms[z]);
+}
+
+void thermo_system_step(thermo_system_t *sys, uint32_t now_ticks, float dt_s) {
+  if (sys->journal)
+    record_step(sys, now_ticks, dt_s);
+  sys->now_ticks = now_ticks;
+
+  if (sys->ctrl == THERMO_SYSTEM_CTRL_AUTOTUNE &&
+      thermo_autotune_finished(&sys->autotune)) {
+    if (sys->autotune.state == THERMO_AUTOTUNE_DONE) {
+      thermo_pid_set_gains(&sys->pid, &sys->autotune.gains);
+      apply_controller(sys, THERMO_SYSTEM_CTRL_PID);
+    } else {
+      apply_controller(sys, THERMO_SYSTEM_CTRL_HYSTERESIS);
+    }
+  }
+
+  const uint32_t now_ms =
+      (uint32_t)(((uint64_t)now_ticks * 1000u) / sys->cfg->sim.tick_rate_hz);
+  for (uint8_t z = 0; z < sys->zone_count; ++z) {
+    thermo_sim_t *zone = &sys->zones[z];
+    thermo_sim_step(zone, now_ticks, dt_s, sys->setpoints[z].temperature_c);
+
+    alarm_inputs_t in = {
+        .now_ms = now_ms,
+        .temperature_c = thermo_sim_probe_temperature(zone),
+        .humidity = thermo_sim_probe_humidity(zone),
+        .setpoint_c = sys->setpoints[z].temperature_c,
+        .heater_on = zone->mode == THERMO_SIM_MODE_HEAT,
+        .cooler_on = zone->mode == THERMO_SIM_MODE_COOL,
+    };
+    alarm_rules_eval(&sys->alarms[z], &in);
+    // A faulted zone's actuators stay off.
+    zone->inhibit = sys->alarms[z].fault_latched;
+  }
+
+  if (sys->journal && sys->checkpoint_ticks &&
+      now_ticks - sys->last_checkpoint >= sys->checkpoint_ticks) {
+    sys->last_checkpoint = now_ticks;
+    record_checkpoint(sys);
+  }
+}
+
+void thermo_system_flush_journal(thermo_system_t *sys) { record_steps(sys); }
+
+thermo_system_alarm_t thermo_system_alarm(const thermo_system_t *sys,
+                                          int zone) {
+  thermo_system_alarm_t out = {0};
+  uint8_t first = 0, last = sys->zone_count;
+  if (zone != THERMO_SYSTEM_ALL_ZONES) {
+    if (zone < 0 || zone >= sys->zone_count)
+      return out;
+    first = (uint8_t)zone;
+    last = (uint8_t)(zone + 1);
+  }
+  for (uint8_t z = first; z < last; ++z) {
+    const alarm_rules_t *ar = &sys->alarms[z];
+    if (ar->fault_latched)
+      return (thermo_system_alarm_t){true, ar->fault_code, z};
+    if (ar->alarm_code && !out.code)
+      out = (thermo_system_alarm_t){false, ar->alarm_code, z};
+  }
+  return out;
+}
+
+bool thermo_system_pop_alarm_event(thermo_system_t *sys, uint8_t *zone,
+                                   alarm_event_t *out) {
+  for (uint8_t z = 0; z < sys->zone_count; ++z) {
+    if (alarm_rules_pop_event(&sys->alarms[z], out)) {
+      if (zone)
+        *zone = z;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool thermo_system_settled(const thermo_system_t *sys) {
+  for (uint8_t z = 0; z < sys->zone_count; ++z) {
+    if (!thermo_sim_settled(&sys->zones[z]))
+      return false;
+  }
+  return true;
+}
+
+uint32_t thermo_system_next_period(const thermo_system_t *sys,
+                                   uint32_t update_ticks, uint32_t idle_ticks,
+                                   uint32_t control_ticks) {
+  if (sys->ctrl != THERMO_SYSTEM_CTRL_HYSTERESIS && control_ticks)
+    return control_ticks;
+  if (idle_ticks > update_ticks && thermo_system_settled(sys))
+    return idle_ticks;
+  return update_ticks;
+}
+
+bool thermo_system_decode_init(const event_journal_record_t *rec,
+                               thermo_system_init_record_t *out) {
+  const uint8_t *p = rec->payload;
+  if (rec->hdr.type != THERMO_SYSTEM_REC_INIT || rec->hdr.len != INIT_BYTES)
+    return false;
+  out->zone_count = p[0];
+  out->controller = (thermo_system_ctrl_t)p[1];
+  out->initial_c = get_f32(p + 2);
+  out->initial_mode = (thermo_sim_mode_t)p[6];
+  out->setpoint_c = get_f32(p + 7);
+  out->setpoint_rh = get_f32(p + 11);
+  return true;
+}
+
+bool thermo_system_decode_checkpoint(const event_journal_record_t *rec,
+                                     thermo_system_checkpoint_t *out) {
+  const uint8_t *p = rec->payload;
+  if (rec->hdr.type != THERMO_SYSTEM_REC_CHECKPOINT ||
+      rec->hdr.len < CHECKPOINT_HEAD_BYTES)
+    return false;
+  memcpy(&out->alarm_code, p, sizeof(out->alarm_code));
+  out->fault_latched = p[2] != 0;
+  out->zone_count = p[3];
+  if (out->zone_count > THERMO_SYSTEM_MAX_ZONES ||
+      rec->hdr.len !=
+          CHECKPOINT_HEAD_BYTES + out->zone_count * CHECKPOINT_ZONE_BYTES)
+    return false;
+  p += CHECKPOINT_HEAD_BYTES;
+  for (uint8_t z = 0; z < out->zone_count; ++z, p += CHECKPOINT_ZONE_BYTES) {
+    out->zone[z].temperature_c = get_f32(p);
+    out->zone[z].humidity = get_f32(p + 4);
+    out->zone[z].mode = (thermo_sim_mode_t)p[8];
+  }
+  return true;
+}
+
+void thermo_system_checkpoint(const thermo_system_t *sys,
+                              thermo_system_checkpoint_t *out) {
+  thermo_system_alarm_t alarm =
+      thermo_system_alarm(sys, THERMO_SYSTEM_ALL_ZONES);
+  out->alarm_code = alarm.code;
+  out->fault_latched = alarm.faulted;
+  out->zone_count = sys->zone_count;
+  for (uint8_t z = 0; z < sys->zone_count; ++z) {
+    out->zone[z].temperature_c = sys->zones[z].temperature_c;
+    out->zone[z].humidity = sys->zones[z].humidity;
+    out->zone[z].mode = sys->zones[z].mode;
+  }
+}
+
+bool thermo_system_replay(thermo_system_t *sys,
+                          const event_journal_record_t *rec) {
+  const uint8_t *p = rec->payload;
+  uint8_t len = rec->hdr.len;
+  switch ((thermo_system_record_t)rec->hdr.type) {
+  case THERMO_SYSTEM_REC_SETPOINTS: {
+    if (len % SETPOINT_ENTRY_BYTES)
+      return false;
+    thermo_system_setpoint_t sp[THERMO_SYSTEM_MAX_ZONES];
+    memcpy(sp, sys->setpoints, sizeof(sp));
+    for (; len; len -= SETPOINT_ENTRY_BYTES, p += SETPOINT_ENTRY_BYTES) {
+      if (p[0] >= sys->zone_count)
+        return false;
+      sp[p[0]].temperature_c = get_f32(p + 1);
+      sp[p[0]].humidity = get_f32(p + 5);
+    }
+    thermo_system_set_setpoints(sys, sp);
+    return true;
+  }
+  case THERMO_SYSTEM_REC_CONTROLLER:
+    if (len != 1)
+      return false;
+    thermo_system_set_controller(sys, (thermo_system_ctrl_t)p[0]);
+    return true;
+  case THERMO_SYSTEM_REC_GAINS: {
+    if (len != 12)
+      return false;
+    thermo_pid_gains_t g = {get_i32(p), get_i32(p + 4), get_i32(p + 8)};
+    thermo_system_set_pid_gains(sys, &g);
+    return true;
+  }
+  case THERMO_SYSTEM_REC_CLEAR_FAULT:
+    thermo_system_clear_fault(sys);
+    return true;
+  case THERMO_SYSTEM_REC_STEP: {
+    if (len != STEP_BYTES)
+      return false;
+    uint16_t count = get_u16(p);
+    uint32_t period = (uint32_t)get_i32(p + 2);
+    float dt_s = get_f32(p + 6);
+    uint32_t tick = rec->hdr.tick - (uint32_t)(count ? count - 1 : 0) * period;
+    for (uint16_t i = 0; i < count; ++i, tick += period)
+      thermo_system_step(sys, tick, dt_s);
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+bool thermo_system_restore_begin(thermo_system_restore_t *r, void *buf,
+                                 uint32_t size,
+                                 const event_journal_record_t *rec) {
+  if (rec->hdr.type != THERMO_SYSTEM_REC_CHECKPOINT ||
+      rec->hdr.len < CHECKPOINT_HEAD_BYTES)
+    return false;
+  *r = (thermo_system_restore_t){
+      .buf = buf,
+      .size = size,
+      .tick = rec->hdr.tick,
+      .zone_count = rec->payload[3],
+  };
+  return true;
+}
+
+int thermo_system_restore_add(thermo_system_restore_t *r,
+                              const event_journal_record_t *rec) {
+  const uint8_t *p = rec->payload;
+  if (rec->hdr.type != THERMO_SYSTEM_REC_CHECKPOINT_STATE ||
+      rec->hdr.tick != r->tick || rec->hdr.len <= STATE_HEAD_BYTES)
+    return -1;
+  uint16_t total = get_u16(p), offset = get_u16(p + 2);
+  uint16_t n = (uint16_t)(rec->hdr.len - STATE_HEAD_BYTES);
+  if (offset != r->len || (r->len && total != r->total) || total > r->size ||
+      n > total - offset)
+    return -1;
+  r->total = total;
+  memcpy(r->buf + offset, p + STATE_HEAD_BYTES, n);
+  r->len = (uint16_t)(r->len + n);
+  return r->len == r->total;
+}
+
+bool thermo_system_restore(thermo_system_t *sys,
+                           const thermo_system_config_t *cfg,
+                           const thermo_system_restore_t *r) {
+  if (!r->total || r->len != r->total ||
+      !thermo_system_init(sys, cfg, cfg->sim.ambient_temp_c,
+                          THERMO_SIM_MODE_IDLE) ||
+      sys->zone_count != r->zone_count)
+    return false;
+  state_io_t io = {
+      .load = true, .in = r->buf, .end = r->buf + r->len, .ok = true};
+  state_all(&io, sys);
+  if (!io.ok || io.in != io.end)
+    return false;
+  sys->now_ticks = sys->last_checkpoint = r->tick;
+  sys->restored = true;
+  return true;
+}
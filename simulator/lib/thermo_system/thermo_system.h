@@ -0,0 +1,260 @@
+#pragma once
+
+// The simulated chamber as a whole: every zone's plant and alarm rules, the
+// controller of zone 0 and the setpoints, advanced one tick at a time.
+//
+// This is the tick of sim_thermo_system_task without FreeRTOS: the task
+// feeds it inputs (setpoints, controller, gains, fault clears) between
+// ticks, and the host tools run the same code. With a journal attached,
+// every input and tick is recorded (see event_journal.h), and
+// thermo_system_replay() applies those records to reproduce the run. A
+// replay can also start from a checkpoint, which holds the whole state
+// (thermo_system_restore), so a journal whose start was overwritten still
+// replays.
+
+#include "alarm_rules.h"
+#include "event_journal.h"
+#include "thermo_control.h"
+#include "thermo_sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef THERMO_SYSTEM_MAX_ZONES
+#define THERMO_SYSTEM_MAX_ZONES 16
+#endif
+
+typedef enum thermo_system_ctrl {
+  THERMO_SYSTEM_CTRL_HYSTERESIS = 0, // built-in bang-bang
+  THERMO_SYSTEM_CTRL_PID = 1,
+  THERMO_SYSTEM_CTRL_AUTOTUNE = 2, // relay autotune, then PID with the result
+} thermo_system_ctrl_t;
+
+typedef struct thermo_system_config {
+  // Plant and controller of every zone (see thermo_sim.h).
+  thermo_sim_config_t sim;
+
+  // Zones (1..THERMO_SYSTEM_MAX_ZONES, 0 = 1), each its own plant with the
+  // `sim` configuration and its own alarm rules. Zone 0 runs the selected
+  // controller; the others the built-in bang-bang.
+  uint8_t zone_count;
+  // Initial setpoints of every zone.
+  float setpoint_c;
+  float setpoint_rh;
+
+  thermo_system_ctrl_t controller;
+  thermo_pid_config_t pid;
+  thermo_autotune_config_t autotune;
+
+  // Alarm/fault rules, evaluated every tick on every zone. A FAULT rule
+  // latches and turns that zone's actuators off until cleared.
+  const alarm_rule_spec_t *alarm_rules;
+  uint16_t alarm_rule_count;
+} thermo_system_config_t;
+
+// Benchtop chamber, as the firmware runs it: the RC model and probes of
+// THERMAL_MODEL_BENCH_CHAMBER and SENSOR_PIPELINE_BENCH_CHAMBER, every zone,
+// bang-bang control at 20 C, and the alarm rules below. The host tools start
+// from the same configuration, so their runs and replays match the device.
+// Delays and windows are set in ticks of `tick_rate_hz`.
+void thermo_system_bench_config(thermo_system_config_t *cfg,
+                                uint32_t tick_rate_hz);
+
+// The bench chamber's alarm rules. Codes are reported as Q0 ALARM.
+extern const alarm_rule_spec_t THERMO_SYSTEM_BENCH_ALARM_RULES[];
+extern const uint16_t THERMO_SYSTEM_BENCH_ALARM_RULE_COUNT;
+
+// The firmware's sim task periods for it, in ms: the update rate while
+// anything changes, the idle rate, the PID control loop and journal
+// checkpoints.
+#define THERMO_SYSTEM_BENCH_UPDATE_MS 100
+#define THERMO_SYSTEM_BENCH_IDLE_UPDATE_MS 1000
+#define THERMO_SYSTEM_BENCH_CONTROL_MS 20
+#define THERMO_SYSTEM_BENCH_CHECKPOINT_MS 60000
+
+typedef struct thermo_system_setpoint {
+  float temperature_c;
+  float humidity;
+} thermo_system_setpoint_t;
+
+typedef struct thermo_system {
+  const thermo_system_config_t *cfg;
+  uint8_t zone_count;
+  thermo_sim_t zones[THERMO_SYSTEM_MAX_ZONES];
+  thermo_system_setpoint_t setpoints[THERMO_SYSTEM_MAX_ZONES];
+
+  thermo_system_ctrl_t ctrl;
+  thermo_pid_t pid;
+  thermo_autotune_t autotune;
+
+  // Per zone. Events are left queued for the caller
+  // (thermo_system_pop_alarm_event).
+  alarm_rules_t alarms[THERMO_SYSTEM_MAX_ZONES];
+
+  uint32_t now_ticks; // of the last step
+  float initial_c;
+  thermo_sim_mode_t initial_mode;
+
+  event_journal_t *journal;
+  uint32_t checkpoint_ticks;
+  uint32_t last_checkpoint;
+  bool restored; // from a checkpoint, so a journal starts with one
+
+  // Steps not recorded yet: a run with the same dt and spacing is recorded
+  // as one STEP record when it ends (a different step, any other record).
+  uint16_t run_count;
+  uint32_t run_period;
+  float run_dt_s;
+} thermo_system_t;
+
+// Journal records (payloads little endian, packed).
+typedef enum thermo_system_record {
+  // Start of a run: u8 zones, u8 controller, f32 initial_c, u8 initial_mode,
+  // f32 setpoint_c, f32 setpoint_rh.
+  THERMO_SYSTEM_REC_INIT = EVENT_JOURNAL_TYPE_USER,
+  // Changed setpoints: (u8 zone, f32 temperature_c, f32 humidity)...
+  THERMO_SYSTEM_REC_SETPOINTS,
+  THERMO_SYSTEM_REC_CONTROLLER, // u8 controller
+  THERMO_SYSTEM_REC_GAINS,      // q16 kp, ki, kd
+  THERMO_SYSTEM_REC_CLEAR_FAULT,
+  // A run of steps: u16 count, u32 period (ticks between them), f32 dt_s.
+  // The header tick is now_ticks of the last one.
+  THERMO_SYSTEM_REC_STEP,
+  // Observed state, for checking a replay: u16 alarm_code, u8 fault (of
+  // THERMO_SYSTEM_ALL_ZONES), u8 zones, then (f32 temperature_c, f32
+  // humidity, u8 mode) per zone. The CHECKPOINT_STATE records that follow
+  // complete it.
+  THERMO_SYSTEM_REC_CHECKPOINT,
+  // The whole state at the checkpoint, for restoring: u16 total bytes, u16
+  // offset, then that part of the state. The state is the controller (PID,
+  // autotune), then per zone the setpoints, the plant and its RC nodes, both
+  // sensor channels (generator, filters) and the alarm rules.
+  THERMO_SYSTEM_REC_CHECKPOINT_STATE,
+} thermo_system_record_t;
+
+// Zone 0 starts at `initial_c` in `initial_mode`, the others at ambient and
+// idle. Returns false if the RC model or the alarm rules are invalid.
+bool thermo_system_init(thermo_system_t *sys, const thermo_system_config_t *cfg,
+                        float initial_c, thermo_sim_mode_t initial_mode);
+
+// Record from now on into `journal` (NULL stops), with a checkpoint every
+// `checkpoint_ticks` (0 = none). Starts with an INIT record, or with a
+// checkpoint when the state was restored from one.
+void thermo_system_attach_journal(thermo_system_t *sys,
+                                  event_journal_t *journal,
+                                  uint32_t checkpoint_ticks);
+
+// Inputs, applied from the next step on.
+
+// Takes the setpoints of every zone; only changed ones are recorded.
+void thermo_system_set_setpoints(thermo_system_t *sys,
+                                 const thermo_system_setpoint_t *setpoints);
+// Selecting autotune starts a new run, which switches to PID with the tuned
+// gains when it completes (or back to hysteresis if it fails).
+void thermo_system_set_controller(thermo_system_t *sys,
+                                  thermo_system_ctrl_t ctrl);
+void thermo_system_set_pid_gains(thermo_system_t *sys,
+                                 const thermo_pid_gains_t *gains);
+// Clears the latched fault of every zone. A zone's fault stays latched while
+// one of its FAULT rules is still active.
+void thermo_system_clear_fault(thermo_system_t *sys);
+
+// Advance every zone by `dt_s` to `now_ticks` (sim.tick_rate_hz clock),
+// then evaluate its alarm rules.
+void thermo_system_step(thermo_system_t *sys, uint32_t now_ticks, float dt_s);
+
+// Record the steps of the current run now rather than when it ends.
+void thermo_system_flush_journal(thermo_system_t *sys);
+
+// Alarm state of one zone, or with THERMO_SYSTEM_ALL_ZONES the worst zone:
+// the lowest one with a latched fault, else the lowest with an active alarm.
+#define THERMO_SYSTEM_ALL_ZONES (-1)
+
+typedef struct thermo_system_alarm {
+  bool faulted;
+  uint16_t code; // the rule that latched the fault, else the most severe
+                 // active one; 0 = none
+  uint8_t zone;
+} thermo_system_alarm_t;
+
+thermo_system_alarm_t thermo_system_alarm(const thermo_system_t *sys,
+                                          int zone);
+
+// Pops the oldest queued alarm event of the lowest zone that has one.
+// Returns false when no zone has any.
+bool thermo_system_pop_alarm_event(thermo_system_t *sys, uint8_t *zone,
+                                   alarm_event_t *out);
+
+// True while every zone is settled (see thermo_sim_settled).
+bool thermo_system_settled(const thermo_system_t *sys);
+
+// The sim task's adaptive rate: ticks until the next step. `control_ticks`
+// while PID or autotune run (if nonzero), `idle_ticks` once every zone is
+// settled (if longer than `update_ticks`), else `update_ticks`.
+uint32_t thermo_system_next_period(const thermo_system_t *sys,
+                                   uint32_t update_ticks, uint32_t idle_ticks,
+                                   uint32_t control_ticks);
+
+// -------------
+// Replay
+// -------------
+
+typedef struct thermo_system_init_record {
+  uint8_t zone_count;
+  thermo_system_ctrl_t controller;
+  float initial_c;
+  thermo_sim_mode_t initial_mode;
+  float setpoint_c;
+  float setpoint_rh;
+} thermo_system_init_record_t;
+
+typedef struct thermo_system_checkpoint {
+  uint16_t alarm_code;
+  bool fault_latched;
+  uint8_t zone_count;
+  struct {
+    float temperature_c;
+    float humidity;
+    thermo_sim_mode_t mode;
+  } zone[THERMO_SYSTEM_MAX_ZONES];
+} thermo_system_checkpoint_t;
+
+bool thermo_system_decode_init(const event_journal_record_t *rec,
+                               thermo_system_init_record_t *out);
+bool thermo_system_decode_checkpoint(const event_journal_record_t *rec,
+                                     thermo_system_checkpoint_t *out);
+
+// Current state in checkpoint form.
+void thermo_system_checkpoint(const thermo_system_t *sys,
+                              thermo_system_checkpoint_t *out);
+
+// Apply an input or step record with the call that recorded it. INIT and
+// CHECKPOINT records are the caller's (decode them); returns false for those
+// and for unknown or malformed records.
+bool thermo_system_replay(thermo_system_t *sys,
+                          const event_journal_record_t *rec);
+
+// A checkpoint's state, collected from its records. `buf` holds the state
+// (a few hundred bytes per zone).
+typedef struct thermo_system_restore {
+  uint8_t *buf;
+  uint32_t size;
+  uint32_t tick;      // of the checkpoint
+  uint8_t zone_count;
+  uint16_t total;     // state bytes
+  uint16_t len;       // collected so far
+} thermo_system_restore_t;
+
+// Starts collecting at a CHECKPOINT record. Returns false if it is not one.
+bool thermo_system_restore_begin(thermo_system_restore_t *r, void *buf,
+                                 uint32_t size,
+                                 const event_journal_record_t *rec);
+// Adds the next record. Returns 1 once the state is complete, 0 while
+// parts are missing and -1 if `rec` does not continue the checkpoint.
+int thermo_system_restore_add(thermo_system_restore_t *r,
+                              const event_journal_record_t *rec);
+// Sets `sys` to the collected state, with `cfg` (whose zone_count must be
+// the checkpoint's) for everything else. Returns false if the state does
+// not fit `cfg`. Alarm events queued at the checkpoint are not restored.
+bool thermo_system_restore(thermo_system_t *sys,
+                           const thermo_system_config_t *cfg,
+                           const thermo_system_restore_t *r);
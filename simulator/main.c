@@ -9,6 +9,8 @@
 #include "sim_thermo_system_task.h"
 #include "status_led_task.h"
 #include "task.h"
+#include "task_alloc.h"
+#include "timers.h"
 #include <stdio.h>
 
 bool ENABLE_ECHO = false;
@@ -18,24 +20,21 @@ static const float NEOPIXEL_FREQ_HZ = 800000.0f;
 
 static neopixel_ws2812_t g_neopixel;
 
-// Global, overall setpoint and currentvariables
-float current_temperature_setpoint = 20.0f; // Current temperature setpoint in Celsius
-float current_humidity_setpoint = 100.0f; // Current humidity setpoint in %
+// Global, overall current variables (zone 0). Setpoints live in the sim
+// task, per zone (sim_thermo_system_commit_setpoints).
 float current_temperature; // Current temperature in Celsius
 float current_humidity; // Current humidity in %
 bool heater_on; // Heater on/off
 bool compressor_on; // Compressor on/off (active cooling)
 int current_state; // Current state (0=IDLE, 1=RUN, 2=STOP, 3=FAULT) TODO: use an enum
-int alarm_state; // Alarm state (0=OK, 1=ERROR) TODO: use an enum
+int alarm_state; // Alarm code of the worst zone (0=OK)
 
+TIMER_ALLOC_STORAGE(heartbeat);
 
-static void heartbeat_task(void *pvParameters) {
-  (void)pvParameters;
-  while (true) {
-    printf(".\n");
-    fflush(stdout);
-    vTaskDelay(pdMS_TO_TICKS(5000));
-  }
+// Keepalive; the serial task writes it out between command responses.
+static void heartbeat_timer_cb(TimerHandle_t timer) {
+  (void)timer;
+  serial_task_post_line(".\n");
 }
 
 int main() {
@@ -49,7 +48,7 @@ int main() {
   gpio_put(STAT_LED_PIN, 0);
 
   neopixel_ws2812_init(&g_neopixel, pio0, NEOPIXEL_PIN, NEOPIXEL_FREQ_HZ,
-                       false);
+                       false, NEOPIXEL_NUM_PIXELS);
   neopixel_ws2812_put_rgb(&g_neopixel, 2, 2, 2); // Dim white light on startup.
 
   fflush(stdout);
@@ -60,35 +59,41 @@ int main() {
 
   static const serial_task_config_t serial_cfg = {
       .enable_echo = &ENABLE_ECHO,
+      .uart = TCODE_UART,
+      .uart_tx_pin = TCODE_UART_TX_PIN,
+      .uart_rx_pin = TCODE_UART_RX_PIN,
+      .uart_baud = TCODE_UART_BAUD,
   };
-  static const sim_thermo_system_config_t thermo_cfg = {
-      .ambient_temp_c = 22.0f,
-      .ambient_rh = 45.0f,
-      .heat_ramp_c_per_s = 0.30f,
-      .passive_ramp_c_per_s = 0.05f,
-      .cool_ramp_c_per_s = 0.40f,
-      .heat_on_delay_ticks = pdMS_TO_TICKS(500),
-      .heat_off_delay_ticks = pdMS_TO_TICKS(500),
-      .cool_on_delay_ticks = pdMS_TO_TICKS(500),
-      .cool_off_delay_ticks = pdMS_TO_TICKS(500),
-      .enable_active_cooling = true,
-      .temp_hysteresis_c = 3.0f,
-      .min_temp_c = -40.0f,
-      .max_temp_c = 90.0f,
-      .status_pixel = &g_neopixel,
+  // The bench chamber (thermo_system_bench_config), shared with the host
+  // tools.
+  static sim_thermo_system_config_t thermo_cfg = {
+      .status_strip = &g_neopixel.strip,
+      .status_first = 0,
+      .status_count = 1,
       .color_idle = {2, 2, 2},
       .color_heat = {16, 2, 0},
       .color_cool = {0, 2, 16},
-      .update_period_ticks = pdMS_TO_TICKS(100),
+      .update_period_ticks = pdMS_TO_TICKS(THERMO_SYSTEM_BENCH_UPDATE_MS),
+      .idle_update_period_ticks =
+          pdMS_TO_TICKS(THERMO_SYSTEM_BENCH_IDLE_UPDATE_MS),
+      .deadline_tolerance_us = 2000,
+      .integrate_measured_dt = false,
+      .control_period_ticks = pdMS_TO_TICKS(THERMO_SYSTEM_BENCH_CONTROL_MS),
+      .journal_checkpoint_ticks =
+          pdMS_TO_TICKS(THERMO_SYSTEM_BENCH_CHECKPOINT_MS),
   };
+  thermo_system_bench_config(&thermo_cfg.system, configTICK_RATE_HZ);
 
   if (serial_task_create(&serial_cfg, 2, NULL) != pdPASS)
     vApplicationMallocFailedHook();
-  if (status_led_task_create(1, NULL) != pdPASS)
+  if (status_led_start() != pdPASS)
     vApplicationMallocFailedHook();
   if (sim_thermo_system_task_create(&thermo_cfg, 1, NULL) != pdPASS)
     vApplicationMallocFailedHook();
-  if (xTaskCreate(heartbeat_task, "heartbeat", 512, NULL, 1, NULL) != pdPASS)
+  TimerHandle_t heartbeat =
+      timer_alloc_create("heartbeat", pdMS_TO_TICKS(5000), pdTRUE, NULL,
+                         heartbeat_timer_cb, TIMER_ALLOC_BUF(heartbeat));
+  if (!heartbeat || xTimerStart(heartbeat, 0) != pdPASS)
     vApplicationMallocFailedHook();
 
   vTaskStartScheduler();
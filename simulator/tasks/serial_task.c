@@ -1,176 +1,570 @@
 #include "serial_task.h"
 
+#include "log2_hist.h"
+#include "rtos_stats.h"
+#include "sim_thermo_system_task.h"
+#include "task_alloc.h"
 #include "tcode_build_info.h"
+#include "tcode_grammar.h"
 #include "tcode_protocol.h"
+#include "tcode_mux.h"
+#include "tcode_session.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/uart.h"
 #include "pico/error.h"
 #include "pico/stdio.h"
+#include "pico/time.h"
+#include "stream_buffer.h"
+#include "tusb.h"
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
 // ------------------------
 // TCode command processing
 // ------------------------
 
-extern float current_temperature_setpoint;
-extern float current_humidity_setpoint;
-extern float current_temperature;
-extern float current_humidity;
-extern bool heater_on;
-extern bool compressor_on;
 extern int current_state;
 extern int alarm_state;
 
-static bool is_unsigned_int_token(const char *s) {
-  if (!s || !*s)
+// -------------------------
+// Command-path instrumentation
+// -------------------------
+//
+// Each accepted line is timestamped at RX-complete (newline seen), parse-done,
+// dispatch-done and TX-enqueued ("ok" written). The stage deltas go into log2
+// histograms per command class, next to each port's line counters. Only the
+// serial task touches these, so no locking is needed; Q3 reports them and M30
+// resets them. Lines from every port share the histograms: the task handles
+// one line at a time whichever port it came from.
+
+typedef enum cmd_class {
+  CMD_CLASS_NONE = -1, // rejected before dispatch (parse/checksum error)
+  CMD_CLASS_SETPOINT = 0, // T/H (optionally with Z)
+  CMD_CLASS_Q0,
+  CMD_CLASS_Q1,
+  CMD_CLASS_Q_OTHER,
+  CMD_CLASS_M,
+  CMD_CLASS_COUNT,
+} cmd_class_t;
+
+typedef enum cmd_stage {
+  CMD_STAGE_PARSE = 0, // RX-complete -> parse-done
+  CMD_STAGE_DISPATCH, // parse-done -> dispatch-done
+  CMD_STAGE_TX, // dispatch-done -> "ok" enqueued
+  CMD_STAGE_TOTAL, // RX-complete -> "ok" enqueued
+  CMD_STAGE_COUNT,
+} cmd_stage_t;
+
+static const char *const CMD_CLASS_NAMES[CMD_CLASS_COUNT] = {
+    "TH", "Q0", "Q1", "Q", "M",
+};
+static const char *const CMD_STAGE_NAMES[CMD_STAGE_COUNT] = {
+    "PARSE", "DISPATCH", "TX", "TOTAL",
+};
+
+typedef struct cmd_stats {
+  log2_hist_t hist[CMD_CLASS_COUNT][CMD_STAGE_COUNT];
+} cmd_stats_t;
+
+static cmd_stats_t g_cmd_stats;
+static tcode_mux_t g_mux;
+
+// The port of the line being handled: every response goes back to it.
+static tcode_port_t *g_port;
+
+static void reply(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  tcode_port_vprintf(g_port, fmt, ap);
+  va_end(ap);
+}
+
+// Prints "N=.. MIN_US=.. MEAN_US=.. MAX_US=.. LOG2=b0,b1,..\n".
+static void print_log2_hist(const log2_hist_t *h) {
+  reply("N=%lu MIN_US=%lu MEAN_US=%lu MAX_US=%lu LOG2=",
+         (unsigned long)h->count, (unsigned long)(h->count ? h->min : 0),
+         (unsigned long)log2_hist_mean(h), (unsigned long)h->max);
+  for (int b = 0; b < LOG2_HIST_BUCKETS; ++b)
+    reply(b ? ",%lu" : "%lu", (unsigned long)h->buckets[b]);
+  reply("\n");
+}
+
+static void cmd_stats_reset(void) {
+  for (int i = 0; i < TCODE_MUX_MAX_PORTS; ++i)
+    tcode_session_reset_stats(&g_mux.ports[i].session);
+  for (int c = 0; c < CMD_CLASS_COUNT; ++c)
+    for (int st = 0; st < CMD_STAGE_COUNT; ++st)
+      log2_hist_reset(&g_cmd_stats.hist[c][st]);
+}
+
+static void cmd_stats_record(cmd_class_t cls, uint32_t t_rx, uint32_t t_parsed,
+                             uint32_t t_dispatched, uint32_t t_tx) {
+  log2_hist_t *h = g_cmd_stats.hist[cls];
+  log2_hist_add(&h[CMD_STAGE_PARSE], t_parsed - t_rx);
+  log2_hist_add(&h[CMD_STAGE_DISPATCH], t_dispatched - t_parsed);
+  log2_hist_add(&h[CMD_STAGE_TX], t_tx - t_dispatched);
+  log2_hist_add(&h[CMD_STAGE_TOTAL], t_tx - t_rx);
+}
+
+// Q3: the asking port's counters, then one line per (class, stage) with
+// samples. Continued a line at a time: more_state[0] is the next
+// (class, stage), or UINT32_MAX for the counters.
+static bool query_cmd_stats_more(void *ctx, tcode_port_t *port) {
+  (void)ctx;
+  g_port = port;
+  uint32_t *next = &port->more_state[0];
+  if (*next == UINT32_MAX) {
+    const tcode_session_stats_t *ls = &port->session.stats;
+    reply("data: PORT=%s LINES=%lu CHECKSUM_ERR=%lu PARSE_ERR=%lu "
+          "OVERFLOW=%lu LINE_ERR=%lu TX_WAITS=%lu TX_DROPPED=%lu\n",
+          port->transport.name, (unsigned long)ls->lines,
+          (unsigned long)ls->checksum_errors, (unsigned long)ls->parse_errors,
+          (unsigned long)ls->overflows, (unsigned long)ls->line_number_errors,
+          (unsigned long)port->tx_waits, (unsigned long)port->tx_dropped);
+    *next = 0;
+  }
+  for (; *next < CMD_CLASS_COUNT * CMD_STAGE_COUNT; ++*next) {
+    int c = (int)(*next / CMD_STAGE_COUNT);
+    int st = (int)(*next % CMD_STAGE_COUNT);
+    const log2_hist_t *h = &g_cmd_stats.hist[c][st];
+    if (h->count == 0)
+      continue;
+    reply("data: CLASS=%s STAGE=%s ", CMD_CLASS_NAMES[c], CMD_STAGE_NAMES[st]);
+    print_log2_hist(h);
+    ++*next;
     return false;
-  for (const char *p = s; *p; ++p) {
-    if (*p < '0' || *p > '9')
-      return false;
   }
   return true;
 }
 
-static void process_tcode_line(char *line) {
-  int line_number = 0;
+static void query_cmd_stats(void) {
+  g_port->more_state[0] = UINT32_MAX;
+  tcode_port_continue(g_port, query_cmd_stats_more);
+}
+
+// Q4: sim control-loop timing (period, jitter, execution time).
+static void query_loop_stats(void) {
+  static loop_monitor_t mon; // copied out of the sim task
+  sim_thermo_system_get_loop_stats(&mon);
 
-  tcode_parsed_line_t parsed;
-  tcode_status_t st = tcode_parse_inplace(line, &parsed);
-  if (st != TCODE_OK) {
-    if (st == TCODE_ERR_CHECKSUM_MISMATCH) {
-      printf("ERROR: Wrong checksum! (got %02X, expected %02X)\n",
-             parsed.calculated_checksum, parsed.given_checksum);
-    } else if (st != TCODE_ERR_EMPTY) {
-      printf("ERROR: Parse error (%s)\n", tcode_status_str(st));
-    }
-    return;
+  reply("data: TICKS=%lu NOMINAL_US=%lu MISSES=%lu OVERRUNS=%lu "
+        "MEASURED_DT=%s\n",
+        (unsigned long)mon.ticks, (unsigned long)mon.nominal_period_us,
+        (unsigned long)mon.deadline_misses, (unsigned long)mon.overruns,
+        sim_thermo_system_get_measured_dt() ? "true" : "false");
+  reply("data: METRIC=PERIOD ");
+  print_log2_hist(&mon.period);
+  reply("data: METRIC=JITTER ");
+  print_log2_hist(&mon.jitter);
+  reply("data: METRIC=EXEC ");
+  print_log2_hist(&mon.exec);
+}
+
+// Q5: active controller, PID output and gains, last autotune result.
+static void query_controller(void) {
+  static const char *const CTRL_NAMES[] = {"HYSTERESIS", "PID", "AUTOTUNE"};
+  static const char *const TUNE_NAMES[] = {"NONE", "RUNNING", "DONE",
+                                           "FAILED"};
+  sim_thermo_controller_status_t st;
+  sim_thermo_system_get_controller_status(&st);
+
+  reply("data: CTRL=%s OUTPUT=%.3f KP=%.4f KI=%.6f KD=%.3f TUNE=%s "
+        "KU=%.3f PU_S=%.1f\n",
+        CTRL_NAMES[st.controller], Q16_TO_FLOAT(st.output),
+        Q16_TO_FLOAT(st.gains.kp), Q16_TO_FLOAT(st.gains.ki),
+        Q16_TO_FLOAT(st.gains.kd), TUNE_NAMES[st.tune_state], st.tune_ku,
+        st.tune_pu_s);
+}
+
+// Q6: the journal records not read yet, one per line as hex in exported
+// form (see event_journal.h). tcode_replay reads a capture of these.
+// Continued a record at a time, so a long backlog goes out as the port
+// drains; only one port reads the journal at a time.
+static bool query_journal_more(void *ctx, tcode_port_t *port) {
+  (void)ctx;
+  static const char HEX[] = "0123456789ABCDEF";
+  static uint8_t rec[EVENT_JOURNAL_MAX_RECORD];
+  static char hex[2 * EVENT_JOURNAL_MAX_RECORD + 1];
+  size_t n = sim_thermo_system_journal_read(rec, sizeof(rec));
+  if (n == 0)
+    return true;
+  for (size_t i = 0; i < n; ++i) {
+    hex[2 * i] = HEX[rec[i] >> 4];
+    hex[2 * i + 1] = HEX[rec[i] & 0xF];
   }
+  hex[2 * n] = '\n';
+  tcode_port_write(port, "data: J=", 8);
+  tcode_port_write(port, hex, 2 * n + 1);
+  return false;
+}
 
-  char **segments = parsed.tokens;
-  int segment_count = (int)parsed.token_count;
-  int cur_segment = 0;
-
-  // Line number (optional, N123)
-  if (segment_count > 0 && segments[cur_segment][0] == 'N') {
-    char *ptr = segments[0] + 1;
-    if (*ptr)
-      line_number = atoi(ptr);
-    (void)line_number;
-    cur_segment++;
-  }
-
-  // Setpoint commands: T15/H55 (implicit zone) or Z0 T15/Z0 H55 (explicit zone)
-  if (segment_count > 0) {
-    const char *cmd = segments[cur_segment];
-    if (cmd && (cmd[0] == 'T' || cmd[0] == 'H' || cmd[0] == 'Z')) {
-      int zone = 0;
-      const char *th = NULL;
-
-      if (cmd[0] == 'Z') {
-        const char *zone_str = cmd[1] ? (cmd + 1) : NULL;
-        if (!zone_str) {
-          printf("Error: expected Z0 T15\n");
-        } else if (!is_unsigned_int_token(zone_str)) {
-          printf("Error: bad zone\n");
-        } else if (cur_segment + 1 >= segment_count) {
-          printf("Error: expected T/H after Z\n");
-        } else {
-          zone = atoi(zone_str);
-          th = segments[cur_segment + 1];
-        }
-      } else {
-        th = cmd;
-      }
-
-      if (th) {
-        if (!(th[0] == 'T' || th[0] == 'H') || th[1] == '\0') {
-          printf("Error: bad setpoint\n");
-        } else if (zone != 0) {
-          printf("Error: zone not supported\n");
-        } else {
-          int value = atoi(th + 1);
-          if (th[0] == 'T') {
-            if (value < -45 || value > 90)
-              printf("Error: temp out of range\n");
-            else
-              current_temperature_setpoint = (float)value;
-          } else {
-            if (value < 0 || value > 100)
-              printf("Error: humidity out of range\n");
-            else
-              current_humidity_setpoint = (float)value;
-          }
-        }
-      }
+static void query_journal(void) {
+  for (int i = 0; i < TCODE_MUX_MAX_PORTS; ++i) {
+    if (g_mux.ports[i].open && g_mux.ports[i].more == query_journal_more) {
+      reply("error:BUSY Q6 on %s\n", g_mux.ports[i].transport.name);
+      return;
     }
   }
+  tcode_port_continue(g_port, query_journal_more);
+}
 
-  // M (machine) command
-  if (segment_count > 0 && segments[cur_segment][0] == 'M') {
-    const char *marg = NULL;
-    if (segments[cur_segment][1] != '\0') {
-      marg = segments[cur_segment] + 1;
-    } else if (cur_segment + 1 < segment_count) {
-      marg = segments[cur_segment + 1];
-    }
-    if (marg) {
-      printf("Machine command: %s\n", marg);
-    } else {
-      printf("Error: Missing M command argument\n");
+// Q2: FreeRTOS runtime stats, one summary line then one line per task.
+static void query_runtime_stats(void) {
+  static rtos_stats_snapshot_t snap; // too big for the serial task stack
+  rtos_stats_snapshot(&snap);
+
+  reply("data: UPTIME_US=%llu HEAP_TOTAL=%lu HEAP_FREE=%lu HEAP_MIN=%lu "
+        "SWITCHES=%lu TASKS=%u\n",
+        (unsigned long long)snap.uptime_us, (unsigned long)snap.heap_total,
+        (unsigned long)snap.heap_free, (unsigned long)snap.heap_min_free,
+        (unsigned long)snap.switches_total, (unsigned)snap.task_count);
+  for (uint8_t i = 0; i < snap.task_count; ++i) {
+    const rtos_stats_task_t *t = &snap.tasks[i];
+    reply("data: TASK=%s PRIO=%lu CPU=%lu.%lu STACK_HWM=%lu SWITCHES=%lu\n",
+          t->name, (unsigned long)t->priority,
+          (unsigned long)(t->cpu_permille / 10),
+          (unsigned long)(t->cpu_permille % 10),
+          (unsigned long)t->stack_hwm_words, (unsigned long)t->switches);
+  }
+}
+
+// A response line built in place and sent with one write: Q0 formats its
+// numbers as integer fixed point (no float printf) and a line costs one
+// port write whatever fields it has.
+typedef struct tx_line {
+  char buf[128];
+  size_t len;
+} tx_line_t;
+
+static void tx_add(tx_line_t *l, const char *s) {
+  size_t n = strlen(s);
+  size_t room = sizeof(l->buf) - 1 - l->len; // keep one byte for '\n'
+  if (n > room)
+    n = room;
+  memcpy(l->buf + l->len, s, n);
+  l->len += n;
+}
+
+static void tx_add_fixed(tx_line_t *l, int32_t value, uint8_t decimals) {
+  char s[16];
+  tcode_format_fixed(s, sizeof(s), value, decimals);
+  tx_add(l, s);
+}
+
+static void tx_send(tx_line_t *l) {
+  l->buf[l->len++] = '\n';
+  tcode_port_write(g_port, l->buf, l->len);
+  l->len = 0;
+}
+
+// Tenths, rounded half away from zero: 21.25 -> 213.
+static int32_t to_tenths(float v) {
+  return (int32_t)(v * 10.0f + (v < 0.0f ? -0.5f : 0.5f));
+}
+
+static const char *state_name(int state) {
+  switch (state) {
+  case 0:
+    return "IDLE";
+  case 1:
+    return "RUN";
+  case 2:
+    return "STOP";
+  case 3:
+    return "FAULT";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+// Q0: status of the fields in F (all by default), of zone 0 or, with Z, one
+// line per zone of the range prefixed with ZONE=. Fields are always in the
+// order of tcode_status_field_t. Without Z, STATE and ALARM are the whole
+// chamber's (the worst zone); with Z, each zone's own. Continued a zone at a
+// time: more_state holds the fields, the next zone, the last and whether Z
+// was given.
+static bool query_status_more(void *ctx, tcode_port_t *port) {
+  (void)ctx;
+  g_port = port;
+  uint32_t fields = port->more_state[0];
+  int32_t z = (int32_t)port->more_state[1]++;
+  int32_t last = (int32_t)port->more_state[2];
+  bool by_zone = port->more_state[3] != 0;
+
+  tx_line_t line = {.len = 0};
+  sim_thermo_zone_status_t zs;
+  sim_thermo_system_get_zone((uint8_t)z, &zs);
+  bool faulted = by_zone ? zs.faulted : current_state == 3;
+  int alarm = by_zone ? zs.alarm : alarm_state;
+  tx_add(&line, "data:");
+  if (by_zone) {
+    tx_add(&line, " ZONE=");
+    tx_add_fixed(&line, z, 0);
+  }
+  for (int f = 0; f < TCODE_STATUS_FIELD_COUNT; ++f) {
+    if (!(fields & (1u << f)))
+      continue;
+    tx_add(&line, " ");
+    tx_add(&line, tcode_status_field_name((tcode_status_field_t)f));
+    tx_add(&line, "=");
+    switch ((tcode_status_field_t)f) {
+    case TCODE_STATUS_TEMP:
+      tx_add_fixed(&line, to_tenths(zs.temperature_c), 1);
+      break;
+    case TCODE_STATUS_RH:
+      tx_add_fixed(&line, to_tenths(zs.humidity), 1);
+      break;
+    case TCODE_STATUS_HEAT:
+      tx_add(&line, zs.mode == THERMO_SIM_MODE_HEAT ? "true" : "false");
+      break;
+    case TCODE_STATUS_COOL:
+      tx_add(&line, zs.mode == THERMO_SIM_MODE_COOL ? "true" : "false");
+      break;
+    case TCODE_STATUS_STATE:
+      if (faulted)
+        tx_add(&line, state_name(3));
+      else
+        tx_add(&line, state_name(zs.mode == THERMO_SIM_MODE_IDLE ? 0 : 1));
+      break;
+    case TCODE_STATUS_SET_TEMP:
+      tx_add_fixed(&line, to_tenths(zs.setpoint_c), 1);
+      break;
+    case TCODE_STATUS_SET_RH:
+      tx_add_fixed(&line, to_tenths(zs.setpoint_rh), 1);
+      break;
+    case TCODE_STATUS_ALARM:
+      tx_add_fixed(&line, alarm, 0);
+      break;
+    default:
+      break;
     }
   }
+  tx_send(&line);
+  return z >= last;
+}
 
-  // Q (query) command
-  if (segment_count > 0 && segments[cur_segment][0] == 'Q') {
-    const char *qarg = segments[cur_segment] + 1;
+static void query_status(const tcode_command_t *cmd) {
+  uint32_t fields = (1u << TCODE_STATUS_FIELD_COUNT) - 1;
+  if (cmd->present & TCODE_FIELD_BIT('F'))
+    fields = (uint32_t)cmd->value['F' - 'A'];
+  bool by_zone = cmd->present & TCODE_FIELD_BIT('Z');
+  int32_t first = by_zone ? cmd->value['Z' - 'A'] : 0;
+  int32_t last = by_zone ? cmd->range_last : 0;
+  if (last >= sim_thermo_system_zone_count()) {
+    reply("error:UNSUPPORTED Z%ld\n", (long)last);
+    return;
+  }
+
+  uint32_t *state = g_port->more_state;
+  state[0] = fields;
+  state[1] = (uint32_t)first;
+  state[2] = (uint32_t)last;
+  state[3] = by_zone;
+  tcode_port_continue(g_port, query_status_more);
+}
 
-    if (!qarg || *qarg == '\0' || !is_unsigned_int_token(qarg)) {
-      printf("Error: bad Q\n");
+// Q1: machine information.
+static void query_info(tcode_info_key_t key) {
+  const char *value = "";
+  switch (key) {
+  case TCODE_INFO_BUILD:
+    value = TCODE_BUILD_GIT_DESCRIBE;
+    break;
+  case TCODE_INFO_BUILDER:
+    value = TCODE_BUILD_BUILDER;
+    break;
+  case TCODE_INFO_BUILD_DATE:
+    value = TCODE_BUILD_DATE_UNIX;
+    break;
+  default:
+    break;
+  }
+  reply("data: %s=%s\n", tcode_info_key_name(key), value);
+}
+
+// -------------------------
+// Settings (M20/M21/M22)
+// -------------------------
+//
+// Values are exchanged in the grammar's fixed point: the decimals and range
+// of each setting come from tcode_setting_info().
+
+static const serial_task_config_t *g_serial_cfg;
+
+static int32_t pow10_i32(uint8_t n) {
+  int32_t p = 1;
+  while (n--)
+    p *= 10;
+  return p;
+}
+
+static int32_t q16_to_setting(q16_t q, uint8_t decimals) {
+  return (int32_t)(((int64_t)q * pow10_i32(decimals) + 32768) >> 16);
+}
+
+static q16_t setting_to_q16(int32_t v, uint8_t decimals) {
+  return (q16_t)(((int64_t)v << 16) / pow10_i32(decimals));
+}
+
+static int32_t setting_get(void *ctx, tcode_port_t *port, tcode_setting_t s) {
+  (void)ctx;
+  (void)port;
+  const tcode_setting_info_t *info = tcode_setting_info(s);
+  sim_thermo_controller_status_t st;
+  sim_thermo_system_get_controller_status(&st);
+
+  switch (s) {
+  case TCODE_SETTING_ECHO:
+    return g_serial_cfg && g_serial_cfg->enable_echo &&
+           *g_serial_cfg->enable_echo;
+  case TCODE_SETTING_MEASURED_DT:
+    return sim_thermo_system_get_measured_dt();
+  case TCODE_SETTING_CTRL:
+    return (int32_t)st.controller;
+  case TCODE_SETTING_KP:
+    return q16_to_setting(st.gains.kp, info->decimals);
+  case TCODE_SETTING_KI:
+    return q16_to_setting(st.gains.ki, info->decimals);
+  case TCODE_SETTING_KD:
+    return q16_to_setting(st.gains.kd, info->decimals);
+  default:
+    return 0;
+  }
+}
+
+// `v` has already been range checked by the grammar.
+static void setting_set(void *ctx, tcode_port_t *port, tcode_setting_t s,
+                        int32_t v) {
+  (void)ctx;
+  g_port = port;
+  const tcode_setting_info_t *info = tcode_setting_info(s);
+  sim_thermo_controller_status_t st;
+
+  switch (s) {
+  case TCODE_SETTING_ECHO:
+    if (g_serial_cfg && g_serial_cfg->enable_echo)
+      *g_serial_cfg->enable_echo = v != 0;
+    else
+      reply("error:UNSUPPORTED %s\n", info->key);
+    break;
+  case TCODE_SETTING_MEASURED_DT:
+    sim_thermo_system_set_measured_dt(v != 0);
+    break;
+  case TCODE_SETTING_CTRL:
+    sim_thermo_system_set_controller((thermo_system_ctrl_t)v);
+    break;
+  case TCODE_SETTING_KP:
+  case TCODE_SETTING_KI:
+  case TCODE_SETTING_KD:
+    sim_thermo_system_get_controller_status(&st);
+    if (s == TCODE_SETTING_KP)
+      st.gains.kp = setting_to_q16(v, info->decimals);
+    else if (s == TCODE_SETTING_KI)
+      st.gains.ki = setting_to_q16(v, info->decimals);
+    else
+      st.gains.kd = setting_to_q16(v, info->decimals);
+    sim_thermo_system_set_pid_gains(&st.gains);
+    break;
+  default:
+    break;
+  }
+}
+
+// Every zone group of the line is committed in one update, or none is.
+static void apply_setpoints(const tcode_command_t *cmd) {
+  sim_thermo_setpoint_t changes[TCODE_MAX_GROUPS];
+  uint8_t zones = sim_thermo_system_zone_count();
+  for (uint8_t i = 0; i < cmd->group_count; ++i) {
+    const tcode_group_t *g = &cmd->group[i];
+    int32_t zone = g->value[TCODE_ZONE_Z];
+    if (zone >= zones) {
+      reply("error:UNSUPPORTED Z%ld\n", (long)zone);
       return;
     }
+    sim_thermo_setpoint_t *c = &changes[i];
+    c->zone = (uint8_t)zone;
+    c->set_temperature = (g->present & TCODE_FIELD_BIT('T')) != 0;
+    c->set_humidity = (g->present & TCODE_FIELD_BIT('H')) != 0;
+    c->temperature_c =
+        c->set_temperature ? (float)g->value[TCODE_ZONE_T] / 100.0f : 0.0f;
+    c->humidity =
+        c->set_humidity ? (float)g->value[TCODE_ZONE_H] / 10.0f : 0.0f;
+  }
+  sim_thermo_system_commit_setpoints(changes, cmd->group_count);
+}
 
-    if (strcmp(qarg, "0") == 0) {
-      const char *state_str = "UNKNOWN";
-      switch (current_state) {
-      case 0:
-        state_str = "IDLE";
-        break;
-      case 1:
-        state_str = "RUN";
-        break;
-      case 2:
-        state_str = "STOP";
-        break;
-      case 3:
-        state_str = "FAULT";
-        break;
-      }
-      printf("data: TEMP=%.1f RH=%.1f HEAT=%s COOL=%s STATE=%s SET_TEMP=%.1f "
-             "SET_RH=%.1f ALARM=%d\n",
-             current_temperature, current_humidity,
-             heater_on ? "true" : "false",
-             compressor_on ? "true" : "false",
-             state_str,
-             current_temperature_setpoint, current_humidity_setpoint,
-             alarm_state);
-    } else if (strcmp(qarg, "1") == 0) {
-      const char *q1_arg = NULL;
-      if (cur_segment + 1 < segment_count)
-        q1_arg = segments[cur_segment + 1];
-
-      if (q1_arg && strcmp(q1_arg, "BUILD") == 0) {
-        printf("data: BUILD=%s\n", TCODE_BUILD_GIT_DESCRIBE);
-      } else if (q1_arg && strcmp(q1_arg, "BUILDER") == 0) {
-        printf("data: BUILDER=%s\n", TCODE_BUILD_BUILDER);
-      } else if (q1_arg && strcmp(q1_arg, "BUILD_DATE") == 0) {
-        printf("data: BUILD_DATE=%s\n", TCODE_BUILD_DATE_UNIX);
-      } else {
-        printf("error:UNKNOWN_KEY %s\n", q1_arg ? q1_arg : "(missing)");
-      }
-    } else {
-      printf("Error: %s not a valid query command\n", qarg ? qarg : "(missing)");
-    }
+static cmd_class_t cmd_class_of(tcode_cmd_t cmd) {
+  switch (cmd) {
+  case TCODE_CMD_SETPOINT:
+    return CMD_CLASS_SETPOINT;
+  case TCODE_CMD_Q0:
+    return CMD_CLASS_Q0;
+  case TCODE_CMD_Q1:
+    return CMD_CLASS_Q1;
+  case TCODE_CMD_Q2:
+  case TCODE_CMD_Q3:
+  case TCODE_CMD_Q4:
+  case TCODE_CMD_Q5:
+  case TCODE_CMD_Q6:
+    return CMD_CLASS_Q_OTHER;
+  default:
+    return CMD_CLASS_M;
+  }
+}
+
+// Executes one command for the session. The line has been parsed, checked
+// and decoded by then: field syntax and ranges are checked by the generated
+// decoder (see tcode_grammar.hpp), so its values are known to be valid.
+static void serial_execute(void *ctx, tcode_port_t *port,
+                           const tcode_command_t *cmd) {
+  (void)ctx;
+  g_port = port;
+  const int32_t *v = cmd->value;
+  switch (cmd->cmd) {
+  case TCODE_CMD_SETPOINT:
+    apply_setpoints(cmd);
+    break;
+  case TCODE_CMD_Q0:
+    query_status(cmd);
+    break;
+  case TCODE_CMD_Q1:
+    query_info((tcode_info_key_t)cmd->key);
+    break;
+  case TCODE_CMD_Q2:
+    query_runtime_stats();
+    break;
+  case TCODE_CMD_Q3:
+    query_cmd_stats();
+    break;
+  case TCODE_CMD_Q4:
+    query_loop_stats();
+    break;
+  case TCODE_CMD_Q5:
+    query_controller();
+    break;
+  case TCODE_CMD_Q6:
+    query_journal();
+    break;
+  case TCODE_CMD_M30:
+    cmd_stats_reset();
+    break;
+  case TCODE_CMD_M31:
+    sim_thermo_system_reset_loop_stats();
+    break;
+  case TCODE_CMD_M32:
+    sim_thermo_system_set_measured_dt(v['S' - 'A'] != 0);
+    break;
+  case TCODE_CMD_M33:
+    sim_thermo_system_set_controller((thermo_system_ctrl_t)v['S' - 'A']);
+    break;
+  case TCODE_CMD_M999:
+    sim_thermo_system_clear_fault();
+    break;
+  default:
+    break;
   }
 }
 
@@ -178,42 +572,272 @@ static void process_tcode_line(char *line) {
 // Serial task
 // -----------
 
-static void serial_task(void *pvParameters) {
-  const serial_task_config_t *cfg = (const serial_task_config_t *)pvParameters;
+#define SERIAL_TASK_STACK_WORDS 1024
 
-  char line_buffer[256];
-  int line_index = 0;
+// Task notification bits.
+#define SERIAL_NOTIFY_RX (1u << 0) // a transport reported new RX bytes
+#define SERIAL_NOTIFY_TX (1u << 1) // a line was posted to g_posted
+#define SERIAL_NOTIFY_TX_ROOM (1u << 2) // a transport took bytes off its FIFO
 
-  while (true) {
+// The task sleeps until notified, also while responses wait for a transport
+// (the transport notifies when it has room again); this is only a safety net
+// in case a notification is ever lost.
+#define SERIAL_IDLE_FALLBACK_TICKS pdMS_TO_TICKS(1000)
+
+#define SERIAL_POSTED_BYTES 256
+#define SERIAL_UART_RX_BYTES 256
+
+TASK_ALLOC_STORAGE(serial, SERIAL_TASK_STACK_WORDS);
+
+static TaskHandle_t g_serial_handle;
+static StreamBufferHandle_t g_posted;
+static StreamBufferHandle_t g_uart_rx;
+#if configSUPPORT_STATIC_ALLOCATION
+static uint8_t g_posted_storage[SERIAL_POSTED_BYTES + 1];
+static StaticStreamBuffer_t g_posted_buf;
+static uint8_t g_uart_rx_storage[SERIAL_UART_RX_BYTES + 1];
+static StaticStreamBuffer_t g_uart_rx_buf;
+#endif
+
+static void notify_from_isr(uint32_t bits) {
+  BaseType_t woken = pdFALSE;
+  if (g_serial_handle)
+    xTaskNotifyFromISR(g_serial_handle, bits, eSetBits, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+// --- USB CDC, through pico stdio ---
+
+// stdio "chars available" callback, called from the USB IRQ.
+static void usb_chars_available(void *param) {
+  (void)param;
+  notify_from_isr(SERIAL_NOTIFY_RX);
+}
+
+// TinyUSB callback, from the USB IRQ, when the host has read a packet: a
+// response left waiting for CDC FIFO room can go on. A host that stops
+// reading never calls it, so the task sleeps instead of retrying.
+void tud_cdc_tx_complete_cb(uint8_t itf) {
+  (void)itf;
+  notify_from_isr(SERIAL_NOTIFY_TX_ROOM);
+}
+
+static int usb_read(void *ctx, char *buf, size_t size) {
+  (void)ctx;
+  size_t n = 0;
+  while (n < size) {
     int c = getchar_timeout_us(0);
+    if (c == PICO_ERROR_TIMEOUT)
+      break;
+    buf[n++] = (char)c;
+  }
+  return (int)n;
+}
 
-    if (c == PICO_ERROR_TIMEOUT) {
-      vTaskDelay(pdMS_TO_TICKS(1));
-      continue;
-    }
+// Only as much as the CDC FIFO has room for (stdio sends each LF as CRLF), so
+// stdio never blocks on a host that stopped reading. With no host attached
+// the bytes are discarded, as stdio would.
+static int usb_write(void *ctx, const char *buf, size_t len) {
+  (void)ctx;
+  if (!tud_cdc_connected())
+    return (int)len;
+  uint32_t room = tud_cdc_write_available();
+  size_t n = 0;
+  uint32_t need = 0;
+  while (n < len && (need += buf[n] == '\n' ? 2 : 1) <= room)
+    ++n;
+  if (n > 0) {
+    fwrite(buf, 1, n, stdout);
+    fflush(stdout);
+  }
+  return (int)n;
+}
 
-    if (cfg && cfg->enable_echo && *(cfg->enable_echo)) {
-      putchar(c);
-      fflush(stdout);
-    }
+// --- UART, driven directly (PICO_STDIO_UART is off) ---
 
-    if (c == '\n' || c == '\r') {
-      if (line_index > 0) {
-        line_buffer[line_index] = '\0';
-        process_tcode_line(line_buffer);
-        printf("ok\n");
-        fflush(stdout);
-        line_index = 0;
-      }
-    } else if (line_index < (int)sizeof(line_buffer) - 1) {
-      line_buffer[line_index++] = (char)c;
-    }
+static uart_inst_t *g_uart;
+static volatile bool g_uart_tx_irq; // TX IRQ armed by uart_write
+
+// RX: moves bytes into g_uart_rx. TX: only armed while uart_write left bytes
+// unsent; fires once the FIFO drains, disarms itself and wakes the task.
+static void uart_irq(void) {
+  BaseType_t woken = pdFALSE;
+  uint32_t bits = 0;
+  while (uart_is_readable(g_uart)) {
+    char c = (char)uart_getc(g_uart);
+    xStreamBufferSendFromISR(g_uart_rx, &c, 1, &woken); // dropped when full
+    bits = SERIAL_NOTIFY_RX;
+  }
+  if (g_uart_tx_irq && uart_is_writable(g_uart)) {
+    g_uart_tx_irq = false;
+    uart_set_irq_enables(g_uart, true, false);
+    bits |= SERIAL_NOTIFY_TX_ROOM;
+  }
+  if (bits && g_serial_handle)
+    xTaskNotifyFromISR(g_serial_handle, bits, eSetBits, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+static int uart_read(void *ctx, char *buf, size_t size) {
+  (void)ctx;
+  return (int)xStreamBufferReceive(g_uart_rx, buf, size, 0);
+}
+
+// Fills the TX FIFO and returns. When bytes are left over it arms the TX
+// IRQ, which wakes the task once the FIFO has drained.
+static int uart_write(void *ctx, const char *buf, size_t len) {
+  (void)ctx;
+  size_t n = 0;
+  while (n < len && uart_is_writable(g_uart))
+    uart_putc_raw(g_uart, buf[n++]);
+  if (n < len && !g_uart_tx_irq) {
+    g_uart_tx_irq = true;
+    uart_set_irq_enables(g_uart, true, true);
+    // The FIFO may have drained past the IRQ level before it was armed.
+    if (uart_is_writable(g_uart))
+      xTaskNotify(g_serial_handle, SERIAL_NOTIFY_TX_ROOM, eSetBits);
+  }
+  return (int)n;
+}
+
+static bool uart_start(const serial_task_config_t *cfg) {
+#if configSUPPORT_STATIC_ALLOCATION
+  g_uart_rx = xStreamBufferCreateStatic(SERIAL_UART_RX_BYTES, 1,
+                                        g_uart_rx_storage, &g_uart_rx_buf);
+#else
+  g_uart_rx = xStreamBufferCreate(SERIAL_UART_RX_BYTES, 1);
+#endif
+  if (!g_uart_rx)
+    return false;
+  g_uart = cfg->uart;
+  uart_init(g_uart, cfg->uart_baud);
+  gpio_set_function(cfg->uart_tx_pin, GPIO_FUNC_UART);
+  gpio_set_function(cfg->uart_rx_pin, GPIO_FUNC_UART);
+  uart_set_fifo_enabled(g_uart, true);
+  return true;
+}
+
+// After the task handle exists, so the first IRQ can notify it.
+static void uart_enable_irq(void) {
+  int irq = g_uart == uart0 ? UART0_IRQ : UART1_IRQ;
+  irq_set_exclusive_handler(irq, uart_irq);
+  irq_set_enabled(irq, true);
+  uart_set_irq_enables(g_uart, true, false);
+}
+
+// --- Dispatcher ---
+
+bool serial_task_post_line(const char *line) {
+  if (!g_posted || !line)
+    return false;
+  size_t len = strlen(line);
+  size_t sent = 0;
+
+  // Several tasks may post; the stream buffer only supports one writer.
+  vTaskSuspendAll();
+  if (xStreamBufferSpacesAvailable(g_posted) >= len)
+    sent = xStreamBufferSend(g_posted, line, len, 0);
+  xTaskResumeAll();
+
+  if (sent && g_serial_handle)
+    xTaskNotify(g_serial_handle, SERIAL_NOTIFY_TX, eSetBits);
+  return sent == len;
+}
+
+// Queue posted lines on every port. Only called between polls, so they never
+// land inside a line, though they may between the lines of a continued
+// response (Q6).
+static void serial_flush_posted(void) {
+  char chunk[64];
+  size_t n;
+  while ((n = xStreamBufferReceive(g_posted, chunk, sizeof(chunk), 0)) > 0)
+    tcode_mux_broadcast(&g_mux, chunk, n);
+}
+
+static void serial_received(void *ctx, tcode_port_t *port, const char *data,
+                            size_t len) {
+  (void)ctx;
+  if (g_serial_cfg && g_serial_cfg->enable_echo && *g_serial_cfg->enable_echo)
+    tcode_port_write(port, data, len);
+}
+
+// The stages of a line that ran, from the port's own timestamps: when the
+// chunk that completed it arrived, and when the session parsed and ran it.
+static void serial_line_done(void *ctx, tcode_port_t *port,
+                             const tcode_command_t *cmd) {
+  (void)ctx;
+  if (cmd)
+    cmd_stats_record(cmd_class_of(cmd->cmd), port->rx_time,
+                     port->session.t_parsed, port->session.t_dispatched,
+                     time_us_32());
+}
+
+static uint32_t serial_clock(void *ctx) {
+  (void)ctx;
+  return time_us_32();
+}
+
+static const tcode_mux_ops_t SERIAL_MUX_OPS = {
+    .execute = serial_execute,
+    .setting_get = setting_get,
+    .setting_set = setting_set,
+    .line_done = serial_line_done,
+    .received = serial_received,
+    .clock = serial_clock,
+};
+
+static const tcode_transport_t USB_TRANSPORT = {
+    .name = "USB",
+    .read = usb_read,
+    .write = usb_write,
+};
+
+static const tcode_transport_t UART_TRANSPORT = {
+    .name = "UART",
+    .read = uart_read,
+    .write = uart_write,
+};
+
+static void serial_task(void *pvParameters) {
+  (void)pvParameters;
+
+  tcode_mux_open(&g_mux, &USB_TRANSPORT);
+  stdio_set_chars_available_callback(usb_chars_available, NULL);
+  if (g_uart) {
+    tcode_mux_open(&g_mux, &UART_TRANSPORT);
+    uart_enable_irq();
+  }
+
+  while (true) {
+    serial_flush_posted();
+    if (tcode_mux_poll(&g_mux))
+      continue;
+    // Nothing moved: sleep until new bytes arrive, a line is posted or a
+    // transport that was full takes more.
+    xTaskNotifyWait(0, UINT32_MAX, NULL, SERIAL_IDLE_FALLBACK_TICKS);
   }
 }
 
 BaseType_t serial_task_create(const serial_task_config_t *cfg,
                               UBaseType_t priority, TaskHandle_t *out_handle) {
-  return xTaskCreate(serial_task, "serial", 1024, (void *)cfg, priority,
-                     out_handle);
-}
+#if configSUPPORT_STATIC_ALLOCATION
+  g_posted = xStreamBufferCreateStatic(SERIAL_POSTED_BYTES, 1, g_posted_storage,
+                                       &g_posted_buf);
+#else
+  g_posted = xStreamBufferCreate(SERIAL_POSTED_BYTES, 1);
+#endif
+  if (!g_posted)
+    return pdFAIL;
+  g_serial_cfg = cfg;
+  if (cfg && cfg->uart && !uart_start(cfg))
+    return pdFAIL;
+  tcode_mux_init(&g_mux, &SERIAL_MUX_OPS, NULL);
+  cmd_stats_reset();
 
+  BaseType_t rc = task_alloc_create(
+      serial_task, "serial", SERIAL_TASK_STACK_WORDS, (void *)cfg, priority,
+      TASK_ALLOC_STACK(serial), TASK_ALLOC_TCB(serial), &g_serial_handle);
+  if (out_handle)
+    *out_handle = g_serial_handle;
+  return rc;
+}
@@ -2,13 +2,26 @@
 
 #include "FreeRTOS.h"
 #include "task.h"
+#include "hardware/uart.h"
 #include <stdbool.h>
 
+// T-Code is served on USB CDC (pico stdio) and, if `uart` is set, on that
+// UART too. Each has its own session (see tcode_mux.h).
 typedef struct serial_task_config {
   bool *enable_echo; // optional; if NULL, echo is disabled
+  uart_inst_t *uart; // optional second port; NULL for USB only
+  uint uart_tx_pin;
+  uint uart_rx_pin;
+  uint uart_baud;
 } serial_task_config_t;
 
 // Create the serial task. `cfg` must remain valid for the lifetime of the task.
 BaseType_t serial_task_create(const serial_task_config_t *cfg,
                               UBaseType_t priority, TaskHandle_t *out_handle);
 
+// Queue an unsolicited line (e.g. ".\n" keepalives) for the serial task to
+// write to every port between command responses. `line` should include its
+// trailing '\n'. Callable from any task; returns false if the line did not
+// fit.
+bool serial_task_post_line(const char *line);
+
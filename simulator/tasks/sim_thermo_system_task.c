@@ -1,11 +1,13 @@
 #include "sim_thermo_system_task.h"
 
-#include <math.h>
+#include "pico/time.h"
+#include "serial_task.h"
+#include "task_alloc.h"
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 
 // Shared simulator state (defined in main.c)
-extern float current_temperature_setpoint;
-extern float current_humidity_setpoint;
 extern float current_temperature;
 extern float current_humidity;
 extern bool heater_on;
@@ -13,21 +15,56 @@ extern bool compressor_on;
 extern int current_state;
 extern int alarm_state;
 
-// Clamps a float between lo and hi
-static float clampf(float x, float lo, float hi) {
-  if (x < lo)
-    return lo;
-  if (x > hi)
-    return hi;
-  return x;
-}
+#define SIM_THERMO_TASK_STACK_WORDS 512
+
+TASK_ALLOC_STORAGE(sim_thermo, SIM_THERMO_TASK_STACK_WORDS);
+
+static TaskHandle_t g_sim_handle;
+
+// Zones, controllers and alarm rules (see thermo_system.h), owned by the
+// sim task. Static: the RC models are too big for the stack.
+static thermo_system_t g_system;
+static uint8_t g_zone_count = 1;
+
+// Committed setpoints. Other tasks write them in one critical section per
+// commit and the sim task copies the table in one per tick, so the changes
+// of a commit are seen together.
+static thermo_system_setpoint_t g_setpoints[SIM_THERMO_MAX_ZONES];
+
+// Readings of every zone, published by the sim task once per tick for other
+// tasks (Q0 Z).
+typedef struct zone_reading {
+  float temperature_c;
+  float humidity;
+  thermo_sim_mode_t mode;
+  bool faulted;
+  uint16_t alarm;
+} zone_reading_t;
+
+static zone_reading_t g_readings[SIM_THERMO_MAX_ZONES];
+
+// Control-loop timing, shared with the serial task (Q4/M31/M32).
+static loop_monitor_t g_loop_monitor;
+static volatile bool g_integrate_measured_dt;
+
+// Controller requests from other tasks, handed to g_system on the next tick,
+// and the status published back after it.
+static volatile thermo_system_ctrl_t g_requested_ctrl;
+static volatile bool g_ctrl_request_pending;
+static thermo_pid_gains_t g_requested_gains;
+static volatile bool g_gains_request_pending;
+static volatile bool g_clear_fault_requested;
+static sim_thermo_controller_status_t g_ctrl_status;
+
+// Event journal: the sim task appends (inside a critical section, see
+// journal_lock) and Q6 reads through g_journal_cursor.
+static uint32_t g_journal_buf[SIM_THERMO_JOURNAL_BYTES / sizeof(uint32_t)];
+static event_journal_t g_journal;
+static event_journal_cursor_t g_journal_cursor;
 
-// Enum for the different simulation modes
-typedef enum sim_mode {
-  SIM_MODE_IDLE = 0,
-  SIM_MODE_HEAT = 1,
-  SIM_MODE_COOL = 2,
-} sim_mode_t;
+// A measured period longer than this many nominal periods (debugger halt,
+// starvation) is clamped so one tick can't throw the model off.
+#define MAX_DT_PERIODS 10
 
 // Checks if a tick has reached a target
 static bool tick_reached(TickType_t now, TickType_t target) {
@@ -35,49 +72,121 @@ static bool tick_reached(TickType_t now, TickType_t target) {
   return (TickType_t)(now - target) < (TickType_t)0x80000000u;
 }
 
-// Determines the desired mode based on the current temperature, setpoint, and hysteresis
-static sim_mode_t desired_mode(const sim_thermo_system_config_t *cfg, float t,
-                               float sp, sim_mode_t current) {
-  float h = cfg->temp_hysteresis_c;
-  if (t < sp - h)
-    return SIM_MODE_HEAT;
-  if (cfg->enable_active_cooling && t > sp + h)
-    return SIM_MODE_COOL;
-  // stay in current mode inside band, otherwise idle
-  if (t >= sp - h && t <= sp + h)
-    return current;
-  return SIM_MODE_IDLE;
-}
-
-
-// Calculates the delay before a transition can occur
-static TickType_t transition_delay_ticks(const sim_thermo_system_config_t *cfg,
-                                        sim_mode_t from, sim_mode_t to) {
-  if (from == to)
-    return 0;
-  if (to == SIM_MODE_HEAT)
-    return cfg->heat_on_delay_ticks;
-  if (to == SIM_MODE_COOL)
-    return cfg->cool_on_delay_ticks;
-  // to IDLE
-  if (from == SIM_MODE_HEAT)
-    return cfg->heat_off_delay_ticks;
-  if (from == SIM_MODE_COOL)
-    return cfg->cool_off_delay_ticks;
-  return 0;
+static uint32_t ticks_to_us(TickType_t ticks) {
+  return (uint32_t)(((uint64_t)ticks * 1000000u) / configTICK_RATE_HZ);
+}
+
+// Sleeps until `*last + period`, or earlier if sim_thermo_system_wake() is
+// called. Like vTaskDelayUntil, a late wakeup keeps the original phase.
+// Advances `*last` and returns the number of ticks that were simulated.
+static TickType_t wait_next_tick(TickType_t *last, TickType_t period) {
+  TickType_t due = *last + period;
+  TickType_t now = xTaskGetTickCount();
+  if (!tick_reached(now, due)) {
+    ulTaskNotifyTake(pdTRUE, due - now);
+    now = xTaskGetTickCount();
+  }
+  TickType_t woke = tick_reached(now, due) ? due : now;
+  TickType_t elapsed = woke - *last;
+  *last = woke;
+  return elapsed;
 }
 
 // Sets the status color based on the current mode
 static void set_status_color(const sim_thermo_system_config_t *cfg,
-                             sim_mode_t mode) {
-  if (!cfg->status_pixel)
+                             thermo_sim_mode_t mode) {
+  if (!cfg->status_strip)
     return;
   const uint8_t *rgb = cfg->color_idle;
-  if (mode == SIM_MODE_HEAT)
+  if (mode == THERMO_SIM_MODE_HEAT)
     rgb = cfg->color_heat;
-  else if (mode == SIM_MODE_COOL)
+  else if (mode == THERMO_SIM_MODE_COOL)
     rgb = cfg->color_cool;
-  neopixel_ws2812_put_rgb(cfg->status_pixel, rgb[0], rgb[1], rgb[2]);
+  neopixel_strip_fill_rgb(cfg->status_strip, cfg->status_first,
+                          cfg->status_count, rgb[0], rgb[1], rgb[2]);
+  // Clean frames cost nothing; a busy strip retries on the next tick.
+  neopixel_strip_commit(cfg->status_strip);
+}
+
+static void journal_lock(void) { taskENTER_CRITICAL(); }
+
+static void journal_unlock(void) { taskEXIT_CRITICAL(); }
+
+// Hands everything other tasks requested since the last tick to g_system,
+// all taken in one critical section so the journal records them in the
+// order the tick saw them.
+static void take_inputs(void) {
+  thermo_system_setpoint_t sp[SIM_THERMO_MAX_ZONES];
+  taskENTER_CRITICAL();
+  memcpy(sp, g_setpoints, g_zone_count * sizeof(sp[0]));
+  bool new_ctrl = g_ctrl_request_pending;
+  thermo_system_ctrl_t ctrl = g_requested_ctrl;
+  g_ctrl_request_pending = false;
+  bool new_gains = g_gains_request_pending;
+  thermo_pid_gains_t gains = g_requested_gains;
+  g_gains_request_pending = false;
+  bool clear_fault = g_clear_fault_requested;
+  g_clear_fault_requested = false;
+  taskEXIT_CRITICAL();
+
+  thermo_system_set_setpoints(&g_system, sp);
+  if (new_gains)
+    thermo_system_set_pid_gains(&g_system, &gains);
+  if (new_ctrl)
+    thermo_system_set_controller(&g_system, ctrl);
+  if (clear_fault)
+    thermo_system_clear_fault(&g_system);
+}
+
+// Copies the readings and controller status for other tasks.
+static void publish_state(void) {
+  zone_reading_t r[SIM_THERMO_MAX_ZONES];
+  for (uint8_t z = 0; z < g_zone_count; ++z) {
+    r[z].temperature_c = g_system.zones[z].temperature_c;
+    r[z].humidity = g_system.zones[z].humidity;
+    r[z].mode = g_system.zones[z].mode;
+    thermo_system_alarm_t alarm = thermo_system_alarm(&g_system, z);
+    r[z].faulted = alarm.faulted;
+    r[z].alarm = alarm.code;
+  }
+  taskENTER_CRITICAL();
+  memcpy(g_readings, r, g_zone_count * sizeof(r[0]));
+  g_ctrl_status.controller = g_system.ctrl;
+  g_ctrl_status.output = g_system.pid.output;
+  g_ctrl_status.gains = g_system.pid.gains;
+  g_ctrl_status.tune_state = g_system.autotune.state;
+  g_ctrl_status.tune_ku = g_system.autotune.ku;
+  g_ctrl_status.tune_pu_s = g_system.autotune.pu_s;
+  taskEXIT_CRITICAL();
+}
+
+// Reports the alarms raised on this tick, each with its zone.
+static void post_alarms(void) {
+  // Strings only on the (rare) raise events.
+  alarm_event_t ev;
+  uint8_t z;
+  while (thermo_system_pop_alarm_event(&g_system, &z, &ev)) {
+    if (!ev.raised)
+      continue;
+    const alarm_rule_spec_t *spec = alarm_rules_spec(&g_system.alarms[z],
+                                                     ev.rule);
+    char line[64];
+    snprintf(line, sizeof(line), "error:%s %u %s Z%u\n",
+             spec->severity == ALARM_SEVERITY_FAULT ? "FAULT" : "ALARM",
+             (unsigned)spec->code, spec->name ? spec->name : "",
+             (unsigned)z);
+    serial_task_post_line(line);
+  }
+  unsigned dropped = 0;
+  for (z = 0; z < g_system.zone_count; ++z) {
+    dropped += g_system.alarms[z].events_dropped;
+    g_system.alarms[z].events_dropped = 0;
+  }
+  if (dropped) {
+    char line[48];
+    snprintf(line, sizeof(line), "error:ALARM_OVERFLOW %u\n", dropped);
+    serial_task_post_line(line);
+  }
 }
 
 // Main task function for the simulator thermo system
@@ -91,107 +200,223 @@ static void sim_thermo_system_task(void *pvParameters) {
 
   // Initialize simulated readings if unset.
   if (current_temperature == 0.0f)
-    current_temperature = cfg->ambient_temp_c;
+    current_temperature = cfg->system.sim.ambient_temp_c;
   if (current_humidity == 0.0f)
-    current_humidity = cfg->ambient_rh;
+    current_humidity = cfg->system.sim.ambient_rh;
 
-  sim_mode_t mode = SIM_MODE_IDLE;
+  thermo_sim_mode_t initial_mode = THERMO_SIM_MODE_IDLE;
   if (heater_on)
-    mode = SIM_MODE_HEAT;
+    initial_mode = THERMO_SIM_MODE_HEAT;
   if (compressor_on)
-    mode = SIM_MODE_COOL;
-
-  bool pending = false;
-  sim_mode_t pending_mode = SIM_MODE_IDLE;
-  TickType_t pending_until = 0;
-
-  // When cooling undershoots to sp - h/2, we stop and rest until drift to sp + h/2
-  bool cooling_rest = false;
+    initial_mode = THERMO_SIM_MODE_COOL;
 
+  if (!thermo_system_init(&g_system, &cfg->system, current_temperature,
+                          initial_mode)) {
+    vTaskDelete(NULL);
+    return;
+  }
   TickType_t last = xTaskGetTickCount();
-  float h = cfg->temp_hysteresis_c;
+  g_system.now_ticks = (uint32_t)last;
+  thermo_system_attach_journal(&g_system, &g_journal,
+                               cfg->journal_checkpoint_ticks);
+  publish_state();
+
+  TickType_t period = cfg->update_period_ticks;
 
   // Main loop
   while (true) {
-    vTaskDelayUntil(&last, cfg->update_period_ticks);
+    TickType_t elapsed = wait_next_tick(&last, period);
+    uint32_t nominal_period_us = ticks_to_us(elapsed);
 
-    float sp = current_temperature_setpoint;
-    float t = current_temperature;
-    TickType_t now = xTaskGetTickCount();
+    taskENTER_CRITICAL();
+    loop_monitor_set_period(&g_loop_monitor, nominal_period_us);
+    uint32_t period_us = loop_monitor_begin(&g_loop_monitor, time_us_32());
+    taskEXIT_CRITICAL();
 
-    // Cooling undershoot: when cooling drops temp to sp - h/2, stop and rest
-    // until we passively drift up to sp + h/2
-    if (mode == SIM_MODE_COOL && t <= sp - h / 2.0f)
-      cooling_rest = true;
-    if (cooling_rest && t >= sp + h / 2.0f)
-      cooling_rest = false;
+    float dt_s = (float)elapsed / (float)configTICK_RATE_HZ;
+    if (g_integrate_measured_dt && period_us > 0) {
+      if (period_us > MAX_DT_PERIODS * nominal_period_us)
+        period_us = MAX_DT_PERIODS * nominal_period_us;
+      dt_s = (float)period_us / 1000000.0f;
+    }
 
-    sim_mode_t want = cooling_rest ? SIM_MODE_IDLE : desired_mode(cfg, t, sp, mode);
+    take_inputs();
+    thermo_system_step(&g_system, (uint32_t)last, dt_s);
+    post_alarms();
 
-    if (!pending && want != mode) {
-      pending = true;
-      pending_mode = want;
-      pending_until = now + transition_delay_ticks(cfg, mode, want);
-    }
-    if (pending && tick_reached(now, pending_until)) {
-      mode = pending_mode;
-      pending = false;
-    }
+    const thermo_sim_t *z0 = &g_system.zones[0];
+    heater_on = (z0->mode == THERMO_SIM_MODE_HEAT);
+    compressor_on = (z0->mode == THERMO_SIM_MODE_COOL);
+    set_status_color(cfg, z0->mode);
 
-    heater_on = (mode == SIM_MODE_HEAT);
-    compressor_on = (mode == SIM_MODE_COOL);
-    set_status_color(cfg, mode);
-
-    current_state = (mode == SIM_MODE_IDLE) ? 0 : 1;
-    alarm_state = 0;
-
-    // Update temperature.
-    float dt_s =
-        ((float)cfg->update_period_ticks) / (float)configTICK_RATE_HZ;
-    if (mode == SIM_MODE_HEAT) {
-      current_temperature += cfg->heat_ramp_c_per_s * dt_s;
-    } else if (mode == SIM_MODE_COOL) {
-      current_temperature -= cfg->cool_ramp_c_per_s * dt_s;
-    } else {
-      // drift toward ambient
-      float step = cfg->passive_ramp_c_per_s * dt_s;
-      if (current_temperature < cfg->ambient_temp_c) {
-        current_temperature += step;
-        if (current_temperature > cfg->ambient_temp_c)
-          current_temperature = cfg->ambient_temp_c;
-      } else if (current_temperature > cfg->ambient_temp_c) {
-        current_temperature -= step;
-        if (current_temperature < cfg->ambient_temp_c)
-          current_temperature = cfg->ambient_temp_c;
-      }
-    }
-    current_temperature = clampf(current_temperature, cfg->min_temp_c,
-                                 cfg->max_temp_c);
-
-    // Humidity mapping (log-based): 
-    // At 0°C => 100%, at >=20°C => ~50%, falling quickly from 0 to 20°C.
-    // Uses a natural log profile.
-    if (current_temperature <= 0.0f) {
-        current_humidity = 100.0f;
-    } else if (current_temperature >= 20.0f) {
-        current_humidity = 50.0f;
-    } else {
-        // Scale so log curve passes through (0,100) and (20,50)
-        // ln(temp + 1) is always defined for temp >= 0
-        float min_hum = 50.0f, max_hum = 100.0f, t_cutoff = 20.0f;
-        float log_min = logf(1.0f);            // ln(1) = 0
-        float log_max = logf(t_cutoff + 1.0f); // ln(21)
-        float factor = (max_hum - min_hum) / (log_max - log_min);
-        float humidity = max_hum - factor * (logf(current_temperature + 1.0f) - log_min);
-        current_humidity = clampf(humidity, 50.0f, 100.0f);
-    }
+    // The chamber as a whole: faulted if any zone is.
+    thermo_system_alarm_t alarm =
+        thermo_system_alarm(&g_system, THERMO_SYSTEM_ALL_ZONES);
+    if (alarm.faulted)
+      current_state = 3;
+    else
+      current_state = (z0->mode == THERMO_SIM_MODE_IDLE) ? 0 : 1;
+    alarm_state = alarm.code;
+
+    current_temperature = z0->temperature_c;
+    current_humidity = z0->humidity;
+    publish_state();
+
+    // Adaptive rate: once idle with nothing pending the plant only drifts
+    // slowly, so tick at the idle rate. Setpoint changes wake us early.
+    // PID/autotune run the faster inner loop instead.
+    period = thermo_system_next_period(&g_system, cfg->update_period_ticks,
+                                       cfg->idle_update_period_ticks,
+                                       cfg->control_period_ticks);
+
+    taskENTER_CRITICAL();
+    loop_monitor_end(&g_loop_monitor, time_us_32());
+    taskEXIT_CRITICAL();
+  }
+}
+
+void sim_thermo_system_wake(void) {
+  if (g_sim_handle)
+    xTaskNotifyGive(g_sim_handle);
+}
+
+bool sim_thermo_system_commit_setpoints(const sim_thermo_setpoint_t *changes,
+                                        uint8_t count) {
+  if (count && !changes)
+    return false;
+  for (uint8_t i = 0; i < count; ++i) {
+    if (changes[i].zone >= g_zone_count)
+      return false;
+  }
+  taskENTER_CRITICAL();
+  for (uint8_t i = 0; i < count; ++i) {
+    thermo_system_setpoint_t *sp = &g_setpoints[changes[i].zone];
+    if (changes[i].set_temperature)
+      sp->temperature_c = changes[i].temperature_c;
+    if (changes[i].set_humidity)
+      sp->humidity = changes[i].humidity;
   }
+  taskEXIT_CRITICAL();
+  sim_thermo_system_wake();
+  return true;
+}
+
+bool sim_thermo_system_get_zone(uint8_t zone, sim_thermo_zone_status_t *out) {
+  if (zone >= g_zone_count || !out)
+    return false;
+  taskENTER_CRITICAL();
+  zone_reading_t r = g_readings[zone];
+  thermo_system_setpoint_t sp = g_setpoints[zone];
+  taskEXIT_CRITICAL();
+  out->temperature_c = r.temperature_c;
+  out->humidity = r.humidity;
+  out->mode = r.mode;
+  out->faulted = r.faulted;
+  out->alarm = r.alarm;
+  out->setpoint_c = sp.temperature_c;
+  out->setpoint_rh = sp.humidity;
+  return true;
+}
+
+uint8_t sim_thermo_system_zone_count(void) { return g_zone_count; }
+
+void sim_thermo_system_get_loop_stats(loop_monitor_t *out) {
+  if (!out)
+    return;
+  taskENTER_CRITICAL();
+  *out = g_loop_monitor;
+  taskEXIT_CRITICAL();
+}
+
+void sim_thermo_system_reset_loop_stats(void) {
+  taskENTER_CRITICAL();
+  loop_monitor_reset(&g_loop_monitor);
+  taskEXIT_CRITICAL();
+}
+
+void sim_thermo_system_set_measured_dt(bool enable) {
+  g_integrate_measured_dt = enable;
+}
+
+bool sim_thermo_system_get_measured_dt(void) { return g_integrate_measured_dt; }
+
+void sim_thermo_system_set_controller(thermo_system_ctrl_t ctrl) {
+  taskENTER_CRITICAL();
+  g_requested_ctrl = ctrl;
+  g_ctrl_request_pending = true;
+  taskEXIT_CRITICAL();
+  sim_thermo_system_wake();
+}
+
+void sim_thermo_system_set_pid_gains(const thermo_pid_gains_t *gains) {
+  if (!gains)
+    return;
+  taskENTER_CRITICAL();
+  g_requested_gains = *gains;
+  g_gains_request_pending = true;
+  g_ctrl_status.gains = *gains;
+  taskEXIT_CRITICAL();
+  sim_thermo_system_wake();
+}
+
+void sim_thermo_system_clear_fault(void) {
+  g_clear_fault_requested = true;
+  sim_thermo_system_wake();
+}
+
+void sim_thermo_system_get_controller_status(
+    sim_thermo_controller_status_t *out) {
+  if (!out)
+    return;
+  taskENTER_CRITICAL();
+  *out = g_ctrl_status;
+  taskEXIT_CRITICAL();
+}
+
+size_t sim_thermo_system_journal_read(void *buf, size_t size) {
+  event_journal_record_t rec;
+  size_t n = 0;
+  taskENTER_CRITICAL();
+  if (event_journal_next(&g_journal, &g_journal_cursor, &rec))
+    n = event_journal_export(&rec, buf, size);
+  taskEXIT_CRITICAL();
+  return n;
 }
 
 BaseType_t sim_thermo_system_task_create(const sim_thermo_system_config_t *cfg,
                                         UBaseType_t priority,
                                         TaskHandle_t *out_handle) {
-  return xTaskCreate(sim_thermo_system_task, "sim_thermo", 512, (void *)cfg,
-                     priority, out_handle);
+  if (cfg) {
+    uint32_t period_us =
+        (uint32_t)(((uint64_t)cfg->update_period_ticks * 1000000u) /
+                   configTICK_RATE_HZ);
+    uint32_t tolerance_us = cfg->deadline_tolerance_us
+                                ? cfg->deadline_tolerance_us
+                                : period_us / 10u;
+    loop_monitor_init(&g_loop_monitor, period_us, tolerance_us);
+    g_integrate_measured_dt = cfg->integrate_measured_dt;
+
+    const thermo_system_config_t *sys = &cfg->system;
+    g_zone_count = sys->zone_count == 0 ? 1
+                   : sys->zone_count > SIM_THERMO_MAX_ZONES
+                       ? SIM_THERMO_MAX_ZONES
+                       : sys->zone_count;
+    for (uint8_t z = 0; z < SIM_THERMO_MAX_ZONES; ++z) {
+      g_setpoints[z].temperature_c = sys->setpoint_c;
+      g_setpoints[z].humidity = sys->setpoint_rh;
+    }
+  }
+  event_journal_init(&g_journal, g_journal_buf, sizeof(g_journal_buf));
+  g_journal.lock = journal_lock;
+  g_journal.unlock = journal_unlock;
+  event_journal_cursor_init(&g_journal, &g_journal_cursor);
+
+  BaseType_t rc = task_alloc_create(
+      sim_thermo_system_task, "sim_thermo", SIM_THERMO_TASK_STACK_WORDS,
+      (void *)cfg, priority, TASK_ALLOC_STACK(sim_thermo),
+      TASK_ALLOC_TCB(sim_thermo), &g_sim_handle);
+  if (out_handle)
+    *out_handle = g_sim_handle;
+  return rc;
 }
 
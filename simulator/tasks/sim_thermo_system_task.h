@@ -1,48 +1,142 @@
 #pragma once
 
 #include "FreeRTOS.h"
-#include "neopixel_ws2812.h"
+#include "alarm_rules.h"
+#include "loop_monitor.h"
+#include "neopixel_strip.h"
 #include "task.h"
+#include "thermo_system.h"
 #include <stdbool.h>
 
-typedef struct sim_thermo_system_config {
-  float ambient_temp_c;
-  float ambient_rh;
-
-  float heat_ramp_c_per_s; // temperature rise rate when heater is on
-  float passive_ramp_c_per_s; // drift rate toward ambient when idle
-  float cool_ramp_c_per_s; // temperature fall rate when compressor is on
-
-  TickType_t heat_on_delay_ticks;   // delay before heater turns on after request
-  TickType_t heat_off_delay_ticks;  // delay before heater turns off after request
+#define SIM_THERMO_MAX_ZONES THERMO_SYSTEM_MAX_ZONES
 
-  TickType_t cool_on_delay_ticks;  // delay before compressor turns on
-  TickType_t cool_off_delay_ticks; // delay before compressor turns off
-  bool enable_active_cooling;
+// Size of the event journal ring (Q6), a power of two.
+#ifndef SIM_THERMO_JOURNAL_BYTES
+#define SIM_THERMO_JOURNAL_BYTES 16384
+#endif
 
-  float temp_hysteresis_c; // bang-bang hysteresis around setpoint
-
-  float min_temp_c;
-  float max_temp_c;
+typedef struct sim_thermo_system_config {
+  // Zones, plant, controllers and alarm rules (see thermo_system.h). Delays
+  // are in FreeRTOS ticks.
+  thermo_system_config_t system;
 
-  // Optional: if set, task will set a solid status color.
-  neopixel_ws2812_t *status_pixel;
+  // Optional: if set, the task shows its mode colour on pixels
+  // [status_first, status_first + status_count) of this strip. Only changed
+  // frames are sent, and sending never blocks the control loop.
+  neopixel_strip_t *status_strip;
+  uint16_t status_first;
+  uint16_t status_count;
   uint8_t color_idle[3];
   uint8_t color_heat[3];
   uint8_t color_cool[3];
 
   TickType_t update_period_ticks;
+  // Slower period used while idle with no transition pending (0 = always use
+  // update_period_ticks). Setpoint changes wake the task immediately.
+  TickType_t idle_update_period_ticks;
+
+  // Control-loop timing monitor (Q4). Wakeups later than the period plus
+  // this tolerance count as deadline misses.
+  uint32_t deadline_tolerance_us;
+  // Integrate with the measured tick period instead of update_period_ticks.
+  // Can be toggled at runtime with sim_thermo_system_set_measured_dt().
+  bool integrate_measured_dt;
+
+  // PID and autotune (M33) tick at control_period_ticks (0 =
+  // update_period_ticks): an inner loop faster than the plant, which still
+  // updates every system.sim.model_dt_s.
+  TickType_t control_period_ticks;
+
+  // Every input and tick of the sim is recorded in a RAM journal, drained
+  // with Q6 (see thermo_system.h), with a state checkpoint this often (0 =
+  // none).
+  TickType_t journal_checkpoint_ticks;
 } sim_thermo_system_config_t;
 
+typedef struct sim_thermo_controller_status {
+  thermo_system_ctrl_t controller;
+  q16_t output; // PID output, -1..1
+  thermo_pid_gains_t gains; // gains in use
+  thermo_autotune_state_t tune_state; // of the last autotune run
+  float tune_ku;
+  float tune_pu_s;
+} sim_thermo_controller_status_t;
+
+// A setpoint change for one zone.
+typedef struct sim_thermo_setpoint {
+  uint8_t zone;
+  bool set_temperature;
+  bool set_humidity;
+  float temperature_c;
+  float humidity;
+} sim_thermo_setpoint_t;
+
+// Readings, alarm state and committed setpoints of one zone.
+typedef struct sim_thermo_zone_status {
+  float temperature_c;
+  float humidity;
+  thermo_sim_mode_t mode;
+  bool faulted;   // one of the zone's FAULT rules latched
+  uint16_t alarm; // see thermo_system_alarm_t
+  float setpoint_c;
+  float setpoint_rh;
+} sim_thermo_zone_status_t;
+
 // Creates the simulator thermo system task.
-// The task updates:
+// The task updates, for zone 0:
 // - current_temperature / current_humidity
 // - heater_on (simulated output)
 // - compressor_on (simulated output)
-// - current_state (0=IDLE, 1=RUN)
+// - current_state (0=IDLE, 1=RUN, 3=FAULT if any zone is faulted)
+// - alarm_state (alarm code of the worst zone, 0 = none)
 //
-// It uses current_temperature_setpoint / current_humidity_setpoint as inputs.
+// Setpoints are inputs through sim_thermo_system_commit_setpoints().
 BaseType_t sim_thermo_system_task_create(const sim_thermo_system_config_t *cfg,
                                         UBaseType_t priority,
                                         TaskHandle_t *out_handle);
 
+
+// Wake the sim task early, e.g. after a setpoint change.
+void sim_thermo_system_wake(void);
+
+// Apply setpoint changes, for any number of zones, as one update: the sim
+// task uses all of them from the same tick on. Returns false and changes
+// nothing if a zone is not simulated. Wakes the sim task.
+bool sim_thermo_system_commit_setpoints(const sim_thermo_setpoint_t *changes,
+                                        uint8_t count);
+
+// State of `zone` as of the last sim tick. Returns false if it is not
+// simulated.
+bool sim_thermo_system_get_zone(uint8_t zone, sim_thermo_zone_status_t *out);
+
+uint8_t sim_thermo_system_zone_count(void);
+
+// Copy the control-loop timing statistics. Safe to call from other tasks.
+void sim_thermo_system_get_loop_stats(loop_monitor_t *out);
+
+// Clear the control-loop timing statistics.
+void sim_thermo_system_reset_loop_stats(void);
+
+// Select measured (true) or nominal (false) dt for the thermal integration.
+void sim_thermo_system_set_measured_dt(bool enable);
+bool sim_thermo_system_get_measured_dt(void);
+
+// Switch controllers; applied on the next tick. Selecting autotune starts a
+// new run, which switches to PID with the tuned gains when it completes (or
+// back to hysteresis if it fails).
+void sim_thermo_system_set_controller(thermo_system_ctrl_t ctrl);
+void sim_thermo_system_get_controller_status(
+    sim_thermo_controller_status_t *out);
+
+// Replace the PID gains (M22 K=KP/KI/KD); applied on the next tick. The
+// controller status reports them right away.
+void sim_thermo_system_set_pid_gains(const thermo_pid_gains_t *gains);
+
+// Acknowledge a latched fault (M999); applied on the next tick. The fault
+// stays latched while a FAULT rule is still active.
+void sim_thermo_system_clear_fault(void);
+
+// Copy the oldest journal record not read yet into `buf`, in exported form
+// (see event_journal.h; at least EVENT_JOURNAL_MAX_RECORD bytes). Returns
+// its length, or 0 once caught up. There is one read position (Q6).
+size_t sim_thermo_system_journal_read(void *buf, size_t size);
@@ -3,38 +3,65 @@
 #include "hardware/gpio.h"
 #include "pico/stdio_usb.h"
 #include "pindefs.h"
+#include "task_alloc.h"
+#include "timers.h"
+#include <stdbool.h>
 
-static void status_led_task(void *pvParameters) {
-  (void)pvParameters;
+// Blink pattern, repeating every 800 ms:
+//   alive:     on 100, off 100
+//   connected: on 100, off 100   (only while USB is connected)
+//   idle:      off for the rest of the cycle
+//
+// Driven by a one-shot software timer that is re-armed for the next edge, so
+// the CPU only wakes when the LED actually changes.
 
-  // Loop Start
-  while (true) {
-    // Default Status Blink, always running if system is alive.
-    gpio_put(STAT_LED_PIN, 1);
-    vTaskDelay(pdMS_TO_TICKS(100));
-    gpio_put(STAT_LED_PIN, 0);
-    vTaskDelay(pdMS_TO_TICKS(100));
+#define STATUS_LED_CYCLE_MS 800
+#define STATUS_LED_BLINK_MS 100
 
-    
-    // User Connected Status, Only blinks if user is connected
-    if (stdio_usb_connected()) {
-      gpio_put(STAT_LED_PIN, 1);
-      vTaskDelay(pdMS_TO_TICKS(100));
-      gpio_put(STAT_LED_PIN, 0);
-      vTaskDelay(pdMS_TO_TICKS(100));
-    }else{
-      gpio_put(STAT_LED_PIN, 0);
-      vTaskDelay(pdMS_TO_TICKS(200));
-    }
+TIMER_ALLOC_STORAGE(status_led);
 
-    // Work Status, Blinks if work is in progress
-    vTaskDelay(pdMS_TO_TICKS(200));
+static uint8_t g_step;
 
-    // TODO: Add checks for Error and other statuses
+static void status_led_timer_cb(TimerHandle_t timer) {
+  bool on = false;
+  uint32_t hold_ms = 0;
+
+  switch (g_step) {
+  case 0: // alive blink
+    on = true;
+    hold_ms = STATUS_LED_BLINK_MS;
+    g_step = 1;
+    break;
+  case 1:
+    hold_ms = STATUS_LED_BLINK_MS;
+    g_step = 2;
+    break;
+  case 2: // user connected blink
+    if (stdio_usb_connected()) {
+      on = true;
+      hold_ms = STATUS_LED_BLINK_MS;
+      g_step = 3;
+    } else {
+      hold_ms = STATUS_LED_CYCLE_MS - 2 * STATUS_LED_BLINK_MS;
+      g_step = 0;
+    }
+    break;
+  default: // rest of the cycle
+    hold_ms = STATUS_LED_CYCLE_MS - 3 * STATUS_LED_BLINK_MS;
+    g_step = 0;
+    break;
   }
-}
 
-BaseType_t status_led_task_create(UBaseType_t priority, TaskHandle_t *out_handle) {
-  return xTaskCreate(status_led_task, "status", 256, NULL, priority, out_handle);
+  // TODO: Add patterns for Error and other statuses
+  gpio_put(STAT_LED_PIN, on);
+  xTimerChangePeriod(timer, pdMS_TO_TICKS(hold_ms), 0);
 }
 
+BaseType_t status_led_start(void) {
+  TimerHandle_t timer =
+      timer_alloc_create("status", pdMS_TO_TICKS(STATUS_LED_BLINK_MS), pdFALSE,
+                         NULL, status_led_timer_cb, TIMER_ALLOC_BUF(status_led));
+  if (!timer)
+    return pdFAIL;
+  return xTimerStart(timer, 0);
+}
@@ -3,6 +3,6 @@
 #include "FreeRTOS.h"
 #include "task.h"
 
-// Create a task that mirrors USB connected state on STAT_LED_PIN.
-BaseType_t status_led_task_create(UBaseType_t priority, TaskHandle_t *out_handle);
-
+// Start blinking STAT_LED_PIN; an extra blink per cycle shows that USB is
+// connected. Runs from a software timer, so it needs no task of its own.
+BaseType_t status_led_start(void);
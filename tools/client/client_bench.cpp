@@ -0,0 +1,481 @@
+// Drives many chambers from one thread with the tcode_client SDK.
+//
+// Each chamber gets one Client and one Task, which keeps a window of lines
+// pipelined: setpoints and queries, every reply checked.
+//
+// Against running devices, e.g. tcode_sim_server instances:
+//
+//   tcode_client_bench [-c clients] [-n lines] [-w window] [-z zones] [-C]
+//                      host:port...
+//
+// -L runs the same load against in-process chambers instead: tcode_mux
+// devices on another thread, one socketpair per chamber, with -e damaging
+// that fraction of the bytes the chambers receive. A chamber checks that it
+// runs every setpoint once and in order, and answers Q0 with how many lines
+// it ran, which the client checks. Exits 1 unless every line got its reply.
+//
+// Only the direction to the device is damaged: a damaged "ok" cannot be
+// paired with its line, which the client handles by timing out and closing.
+// At most one byte per line is damaged, since two flips of the same bit
+// cancel out of the XOR checksum.
+
+#include "tcode_client.hpp"
+
+#include "tcode_mux.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  int clients = 1;
+  uint32_t lines = 10000;
+  unsigned window = 8;
+  int zones = 4;
+  bool crc = false;
+  int loopback = 0; // chambers, with -L
+  double error_rate = 0.0;
+};
+
+// ----------------------
+// -L: in-process chambers
+// ----------------------
+
+struct Chamber {
+  int fd = -1;
+  uint64_t rng = 0;
+  uint32_t damage_threshold = 0; // of 2^32
+  bool line_damaged = false;
+
+  // Device thread only, read after it stops.
+  uint32_t executed = 0;
+  uint32_t out_of_order = 0;
+  uint64_t damaged = 0;
+  tcode_session_stats_t session{};
+};
+
+uint64_t xorshift64(uint64_t *s) {
+  uint64_t x = *s;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *s = x;
+}
+
+bool framing_byte(char c) {
+  return c == '\n' || c == '\r' || c == '*' || c == '\0';
+}
+
+// Flips one random bit of some of the bytes, never into or out of the
+// framing: the damage the checksums have to catch.
+void damage(Chamber *ch, char *buf, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    if (buf[i] == '\n') {
+      ch->line_damaged = false;
+      continue;
+    }
+    if (ch->line_damaged || framing_byte(buf[i]) ||
+        (uint32_t)xorshift64(&ch->rng) >= ch->damage_threshold)
+      continue;
+    char c = (char)(buf[i] ^ (1 << (xorshift64(&ch->rng) % 7)));
+    if (framing_byte(c))
+      continue;
+    buf[i] = c;
+    ch->line_damaged = true;
+    ch->damaged++;
+  }
+}
+
+int chamber_read(void *ctx, char *buf, size_t size) {
+  Chamber *ch = (Chamber *)ctx;
+  ssize_t n = recv(ch->fd, buf, size, MSG_DONTWAIT);
+  if (n > 0) {
+    if (ch->damage_threshold)
+      damage(ch, buf, (size_t)n);
+    return (int)n;
+  }
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    return 0;
+  return -1;
+}
+
+int chamber_write(void *ctx, const char *buf, size_t len) {
+  Chamber *ch = (Chamber *)ctx;
+  ssize_t n = send(ch->fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+  if (n >= 0)
+    return (int)n;
+  if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+    return 0;
+  return -1;
+}
+
+// Line j (from 0) of every chamber sets T to j % 50 degrees, or is a Q0.
+void chamber_execute(void *ctx, tcode_port_t *port,
+                     const tcode_command_t *cmd) {
+  (void)ctx;
+  Chamber *ch = (Chamber *)port->transport.ctx;
+  uint32_t j = ch->executed++;
+  switch (cmd->cmd) {
+  case TCODE_CMD_SETPOINT:
+    if (cmd->group[0].value[TCODE_ZONE_T] != (int32_t)(j % 50) * 100)
+      ch->out_of_order++;
+    break;
+  case TCODE_CMD_Q0:
+    tcode_port_printf(port, "data: SEQ=%lu\n", (unsigned long)j + 1);
+    break;
+  default:
+    tcode_port_printf(port, "error:UNSUPPORTED %s\n",
+                      tcode_cmd_name(cmd->cmd));
+    break;
+  }
+}
+
+void chamber_closed(void *ctx, tcode_port_t *port) {
+  (void)ctx;
+  Chamber *ch = (Chamber *)port->transport.ctx;
+  ch->session = port->session.stats;
+  close(ch->fd);
+}
+
+const tcode_mux_ops_t CHAMBER_MUX_OPS = {
+    .execute = chamber_execute,
+    .closed = chamber_closed,
+};
+
+// Every chamber, on one thread, as sim_server serves its clients.
+void run_chambers(tcode_mux_t *muxes, size_t count,
+                  const std::atomic<bool> &stop) {
+  auto next_keepalive = Clock::now();
+  std::vector<pollfd> fds;
+  while (!stop.load(std::memory_order_relaxed)) {
+    if (Clock::now() >= next_keepalive) {
+      for (size_t m = 0; m < count; ++m)
+        tcode_mux_broadcast(&muxes[m], ".\n", 2);
+      next_keepalive += std::chrono::milliseconds(100);
+    }
+    bool moved = false;
+    for (size_t m = 0; m < count; ++m)
+      moved |= tcode_mux_poll(&muxes[m]);
+    if (moved)
+      continue;
+
+    fds.clear();
+    for (size_t m = 0; m < count; ++m) {
+      for (const tcode_port_t &p : muxes[m].ports) {
+        if (!p.open)
+          continue;
+        uint32_t queued = tcode_port_tx_queued(&p);
+        short events = tcode_port_tx_full(&p) ? 0 : POLLIN;
+        if (queued > 0)
+          events |= POLLOUT;
+        fds.push_back({((Chamber *)p.transport.ctx)->fd, events, 0});
+      }
+    }
+    poll(fds.data(), fds.size(), 10);
+  }
+  for (size_t m = 0; m < count; ++m)
+    for (tcode_port_t &p : muxes[m].ports)
+      tcode_mux_close(&p);
+}
+
+// ---------
+// Clients
+// ---------
+
+struct Driver {
+  std::unique_ptr<tcode::Client> client;
+  int zone = 0;
+  bool done = false;
+  uint32_t replies = 0;
+  uint32_t failures = 0;
+  uint32_t keepalives = 0;
+  std::string first_failure;
+};
+
+// Line j of a chamber. In-process chambers check the setpoints themselves.
+std::string line_text(const Options &o, const Driver &d, uint32_t j) {
+  char buf[48];
+  if (o.loopback)
+    snprintf(buf, sizeof(buf), (j & 1) ? "Q0" : "T%lu",
+             (unsigned long)(j % 50));
+  else if (j & 1)
+    snprintf(buf, sizeof(buf), "Q0 F=TEMP Z%d", d.zone);
+  else
+    snprintf(buf, sizeof(buf), "Z%d T%lu", d.zone,
+             20 + (unsigned long)(j / 2 % 20));
+  return buf;
+}
+
+void check(const Options &o, Driver &d, uint32_t j, const tcode::Reply &r) {
+  d.replies++;
+  std::string why;
+  if (!r.ok()) {
+    why = tcode::reply_status_str(r.status);
+    if (!r.errors.empty())
+      why += " " + r.errors.back();
+  } else if (j & 1) {
+    auto field = r.field(o.loopback ? "SEQ" : "TEMP");
+    if (!field)
+      why = "no data";
+    else if (o.loopback && std::stoul(std::string(*field)) != j + 1)
+      why = "SEQ=" + std::string(*field) + ", expected " +
+            std::to_string(j + 1);
+  }
+  if (!why.empty() && d.failures++ == 0)
+    d.first_failure = "line " + std::to_string(j) + ": " + why;
+}
+
+tcode::Task drive(const Options &o, Driver &d) {
+  tcode::Client &c = *d.client;
+  if (o.crc) {
+    tcode::Reply r = co_await c.send("M22 K=CRC V1");
+    if (!r.ok()) {
+      d.failures++;
+      d.first_failure = "M22 K=CRC: " + std::string(tcode::reply_status_str(
+                                            r.status));
+      d.done = true;
+      co_return;
+    }
+  }
+
+  // Twice the client's window queued, so a reply always has a line behind
+  // it ready to go.
+  std::deque<std::pair<uint32_t, tcode::Request>> pending;
+  for (uint32_t j = 0; j < o.lines; ++j) {
+    pending.emplace_back(j, c.send(line_text(o, d, j)));
+    if (pending.size() >= 2 * o.window) {
+      auto [k, request] = std::move(pending.front());
+      pending.pop_front();
+      check(o, d, k, co_await request);
+    }
+  }
+  while (!pending.empty()) {
+    auto [k, request] = std::move(pending.front());
+    pending.pop_front();
+    check(o, d, k, co_await request);
+  }
+  d.done = true;
+}
+
+bool parse_address(const char *arg, std::string *host, uint16_t *port) {
+  const char *colon = strrchr(arg, ':');
+  if (!colon || colon == arg)
+    return false;
+  long p = strtol(colon + 1, nullptr, 10);
+  if (p <= 0 || p > 65535)
+    return false;
+  host->assign(arg, (size_t)(colon - arg));
+  *port = (uint16_t)p;
+  return true;
+}
+
+int run(const Options &o, const std::vector<std::string> &addresses) {
+  const size_t per_mux = TCODE_MUX_MAX_PORTS;
+  const int clients = o.loopback ? o.loopback : o.clients;
+
+  std::vector<Chamber> chambers(o.loopback ? (size_t)clients : 0);
+  size_t mux_count = (chambers.size() + per_mux - 1) / per_mux;
+  std::unique_ptr<tcode_mux_t[]> muxes(new tcode_mux_t[mux_count]);
+  for (size_t m = 0; m < mux_count; ++m)
+    tcode_mux_init(&muxes[m], &CHAMBER_MUX_OPS, nullptr);
+
+  tcode::ClientOptions copts;
+  copts.checksum = o.crc ? tcode::Checksum::Crc16 : tcode::Checksum::Xor;
+  copts.max_in_flight = o.window;
+  copts.max_attempts = 8;
+
+  tcode::Loop loop;
+  std::vector<Driver> drivers((size_t)clients);
+  for (int i = 0; i < clients; ++i) {
+    Driver &d = drivers[(size_t)i];
+    d.client = std::make_unique<tcode::Client>(loop, copts);
+    d.zone = i % o.zones;
+    if (o.loopback) {
+      int sv[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        return 2;
+      }
+      Chamber &ch = chambers[(size_t)i];
+      ch.fd = sv[1];
+      ch.rng = 0x9E3779B97F4A7C15ull * (uint64_t)(i + 1);
+      ch.damage_threshold = (uint32_t)(o.error_rate * 4294967296.0);
+      tcode_transport_t t = {"PAIR", chamber_read, chamber_write, &ch};
+      tcode_mux_open(&muxes[(size_t)i / per_mux], &t);
+      d.client->attach(sv[0]);
+    } else {
+      std::string host;
+      uint16_t port = 0;
+      parse_address(addresses[(size_t)i % addresses.size()].c_str(), &host,
+                    &port);
+      if (!d.client->connect_tcp(host, port)) {
+        fprintf(stderr, "%s:%u: cannot connect\n", host.c_str(),
+                (unsigned)port);
+        return 2;
+      }
+    }
+    d.client->subscribe([&d](std::string_view line) {
+      if (line == ".")
+        d.keepalives++;
+    });
+  }
+
+  std::atomic<bool> stop{false};
+  std::thread device;
+  if (o.loopback)
+    device = std::thread(run_chambers, muxes.get(), mux_count, std::cref(stop));
+
+  auto t0 = Clock::now();
+  for (Driver &d : drivers)
+    drive(o, d);
+  loop.run_until([&] {
+    for (const Driver &d : drivers)
+      if (!d.done)
+        return false;
+    return true;
+  });
+  double wall_s = std::chrono::duration<double>(Clock::now() - t0).count();
+
+  tcode::Client::Stats total{};
+  for (Driver &d : drivers) {
+    const tcode::Client::Stats &s = d.client->stats();
+    total.lines_sent += s.lines_sent;
+    total.resends += s.resends;
+    total.replies += s.replies;
+    total.unsolicited += s.unsolicited;
+    total.stray_oks += s.stray_oks;
+    d.client->close();
+  }
+  if (o.loopback) {
+    stop = true;
+    device.join();
+  }
+
+  bool ok = true;
+  uint64_t replies = 0, keepalives = 0;
+  for (size_t i = 0; i < drivers.size(); ++i) {
+    const Driver &d = drivers[i];
+    replies += d.replies;
+    keepalives += d.keepalives;
+    bool good = d.done && d.failures == 0 && d.replies == o.lines;
+    if (o.loopback)
+      good = good && chambers[i].executed == o.lines &&
+             chambers[i].out_of_order == 0;
+    if (!good) {
+      printf("chamber %zu: FAIL replies=%lu failures=%lu%s%s", i,
+             (unsigned long)d.replies, (unsigned long)d.failures,
+             d.failures ? " first: " : "", d.first_failure.c_str());
+      if (o.loopback)
+        printf(" executed=%lu out_of_order=%lu",
+               (unsigned long)chambers[i].executed,
+               (unsigned long)chambers[i].out_of_order);
+      printf("\n");
+      ok = false;
+    }
+  }
+
+  printf("chambers=%d lines=%llu wall=%.3fs lines_per_s=%.0f window=%u %s\n",
+         clients, (unsigned long long)replies, wall_s,
+         wall_s > 0 ? (double)replies / wall_s : 0.0, o.window,
+         o.crc ? "CRC-16" : "XOR");
+  printf("sent=%llu resends=%llu stray_oks=%llu keepalives=%llu\n",
+         (unsigned long long)total.lines_sent,
+         (unsigned long long)total.resends,
+         (unsigned long long)total.stray_oks,
+         (unsigned long long)keepalives);
+  if (o.loopback) {
+    uint64_t damaged = 0, checksum = 0, parse = 0, line_number = 0;
+    uint64_t out_of_order = 0;
+    for (const Chamber &ch : chambers) {
+      damaged += ch.damaged;
+      checksum += ch.session.checksum_errors;
+      parse += ch.session.parse_errors;
+      line_number += ch.session.line_number_errors;
+      out_of_order += ch.out_of_order;
+    }
+    printf("damaged_bytes=%llu checksum_err=%llu parse_err=%llu "
+           "line_err=%llu out_of_order=%llu\n",
+           (unsigned long long)damaged, (unsigned long long)checksum,
+           (unsigned long long)parse, (unsigned long long)line_number,
+           (unsigned long long)out_of_order);
+  }
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-c clients] [-n lines] [-w window] [-z zones] [-C] "
+          "host:port...\n"
+          "       %s -L chambers [-e error_rate] [-n lines] [-w window] "
+          "[-C]\n",
+          argv0, argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options o;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:n:w:z:CL:e:h")) != -1) {
+    switch (opt) {
+    case 'c':
+      o.clients = atoi(optarg);
+      break;
+    case 'n':
+      o.lines = (uint32_t)strtoul(optarg, nullptr, 0);
+      break;
+    case 'w':
+      o.window = (unsigned)atoi(optarg);
+      break;
+    case 'z':
+      o.zones = atoi(optarg);
+      break;
+    case 'C':
+      o.crc = true;
+      break;
+    case 'L':
+      o.loopback = atoi(optarg);
+      break;
+    case 'e':
+      o.error_rate = atof(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 2;
+    }
+  }
+
+  std::vector<std::string> addresses(argv + optind, argv + argc);
+  bool valid = o.clients > 0 && o.window > 0 && o.zones > 0 &&
+               o.loopback >= 0 && o.error_rate >= 0.0 && o.error_rate < 1.0;
+  if (o.loopback)
+    valid = valid && addresses.empty();
+  else
+    valid = valid && !addresses.empty();
+  for (const std::string &a : addresses) {
+    std::string host;
+    uint16_t port;
+    valid = valid && parse_address(a.c_str(), &host, &port);
+  }
+  if (!valid) {
+    usage(argv[0]);
+    return 2;
+  }
+  return run(o, addresses);
+}
@@ -0,0 +1,574 @@
+#include "tcode_client.hpp"
+
+#include "tcode_grammar.h"
+#include "tcode_protocol.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+#include <utility>
+
+namespace tcode {
+
+namespace detail {
+
+struct Op {
+  Loop *loop = nullptr;
+  std::string command;
+  std::string line; // framed with N and checksum, at each send
+  bool retry = false; // the device did not run the last send
+  bool done = false;
+  std::chrono::steady_clock::time_point sent_at;
+  Reply reply;
+
+  // The one waiter, if any.
+  std::coroutine_handle<> coroutine;
+  std::function<void(const Reply &)> callback;
+};
+
+} // namespace detail
+
+namespace {
+
+// Line numbers start over at N1 past this, which the device accepts in any
+// state.
+constexpr int32_t MAX_LINE_NUMBER = 99999999;
+
+bool starts_with(std::string_view s, std::string_view prefix) {
+  return s.substr(0, prefix.size()) == prefix;
+}
+
+// For "error:LINE_NUMBER expected N<k>" and "resend:<k>", k; else -1.
+int32_t wanted_line_number(std::string_view line) {
+  size_t at = line.find_last_not_of("0123456789");
+  if (at == std::string_view::npos || at + 1 == line.size())
+    return -1;
+  return (int32_t)std::strtol(std::string(line.substr(at + 1)).c_str(),
+                              nullptr, 10);
+}
+
+// True if `line`, in answer to line number `n`, says the device did not run
+// it and it is worth sending again.
+bool asks_resend(std::string_view line, int32_t n) {
+  if (starts_with(line, "ERROR: Wrong checksum") ||
+      starts_with(line, "ERROR: Parse error") ||
+      starts_with(line, "error:CRC_REQUIRED"))
+    return true; // damaged on the way
+  if (starts_with(line, "error:LINE_NUMBER") || starts_with(line, "resend:")) {
+    // Out of sequence. A wanted number past this line means the device
+    // already ran it: nothing to resend.
+    int32_t k = wanted_line_number(line);
+    return k >= 0 && k <= n;
+  }
+  return false;
+}
+
+bool set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+speed_t baud_constant(unsigned baud) {
+  switch (baud) {
+  case 9600:
+    return B9600;
+  case 19200:
+    return B19200;
+  case 38400:
+    return B38400;
+  case 57600:
+    return B57600;
+  case 115200:
+    return B115200;
+  case 230400:
+    return B230400;
+  case 460800:
+    return B460800;
+  case 921600:
+    return B921600;
+  default:
+    return B0;
+  }
+}
+
+} // namespace
+
+// ---------
+// Reply
+// ---------
+
+std::optional<std::string_view> Reply::field(std::string_view key,
+                                             size_t line) const {
+  if (line >= data.size())
+    return std::nullopt;
+  std::string_view s = data[line];
+  size_t pos = 0;
+  while (pos < s.size()) {
+    size_t end = s.find(' ', pos);
+    if (end == std::string_view::npos)
+      end = s.size();
+    std::string_view token = s.substr(pos, end - pos);
+    if (token.size() > key.size() && starts_with(token, key) &&
+        token[key.size()] == '=')
+      return token.substr(key.size() + 1);
+    pos = end + 1;
+  }
+  return std::nullopt;
+}
+
+const char *reply_status_str(Reply::Status status) {
+  switch (status) {
+  case Reply::Status::Ok:
+    return "OK";
+  case Reply::Status::Error:
+    return "ERROR";
+  case Reply::Status::Invalid:
+    return "INVALID";
+  case Reply::Status::Undeliverable:
+    return "UNDELIVERABLE";
+  case Reply::Status::Timeout:
+    return "TIMEOUT";
+  case Reply::Status::Closed:
+    return "CLOSED";
+  }
+  return "?";
+}
+
+// ---------
+// Request
+// ---------
+
+bool Request::ready() const { return op_->done; }
+
+const Reply &Request::reply() const { return op_->reply; }
+
+void Request::then(std::function<void(const Reply &)> fn) {
+  op_->callback = std::move(fn);
+  if (op_->done)
+    op_->loop->ready(op_);
+}
+
+bool Request::await_ready() const noexcept { return op_->done; }
+
+void Request::await_suspend(std::coroutine_handle<> waiter) noexcept {
+  op_->coroutine = waiter;
+}
+
+Reply Request::await_resume() { return std::move(op_->reply); }
+
+// ---------
+// Loop
+// ---------
+
+void Loop::add(Client *client) { clients_.push_back(client); }
+
+void Loop::remove(Client *client) {
+  clients_.erase(std::remove(clients_.begin(), clients_.end(), client),
+                 clients_.end());
+  lines_.erase(std::remove_if(lines_.begin(), lines_.end(),
+                              [client](const Unsolicited &u) {
+                                return u.client == client;
+                              }),
+               lines_.end());
+}
+
+void Loop::ready(std::shared_ptr<detail::Op> op) {
+  ready_.push_back(std::move(op));
+}
+
+// Resumed code may send, complete or subscribe again, so this runs until
+// nothing new is left.
+void Loop::run_ready() {
+  std::vector<std::shared_ptr<detail::Op>> ops;
+  std::vector<Unsolicited> lines;
+  while (!ready_.empty() || !lines_.empty()) {
+    ops.swap(ready_);
+    lines.swap(lines_);
+    for (Unsolicited &u : lines) {
+      // The handlers may unsubscribe, or close the client, while they run.
+      auto subscribers = u.client->subscribers_;
+      for (auto &s : subscribers)
+        s.second(u.line);
+    }
+    for (auto &op : ops) {
+      if (op->coroutine)
+        std::exchange(op->coroutine, nullptr).resume();
+      else if (op->callback)
+        std::exchange(op->callback, nullptr)(op->reply);
+    }
+    ops.clear();
+    lines.clear();
+  }
+}
+
+bool Loop::poll(int timeout_ms) {
+  run_ready();
+
+  std::vector<pollfd> fds;
+  std::vector<Client *> polled;
+  auto now = Client::Clock::now();
+  for (Client *c : clients_) {
+    if (!c->is_open())
+      continue;
+    fds.push_back(pollfd{c->fd_, c->poll_events(), 0});
+    polled.push_back(c);
+    if (auto deadline = c->deadline()) {
+      auto left = std::chrono::ceil<std::chrono::milliseconds>(*deadline - now);
+      int ms = (int)std::max<int64_t>(0, left.count());
+      if (timeout_ms < 0 || ms < timeout_ms)
+        timeout_ms = ms;
+    }
+  }
+  if (fds.empty())
+    return false;
+
+  if (::poll(fds.data(), fds.size(), timeout_ms) > 0) {
+    for (size_t i = 0; i < fds.size(); ++i) {
+      if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+        polled[i]->on_readable();
+      if ((fds[i].revents & POLLOUT) && polled[i]->is_open())
+        polled[i]->flush();
+    }
+  }
+
+  now = Client::Clock::now();
+  for (Client *c : clients_) {
+    auto deadline = c->deadline();
+    if (deadline && now >= *deadline)
+      c->close_with(Reply::Status::Timeout);
+  }
+  run_ready();
+  return true;
+}
+
+void Loop::run_until(const std::function<bool()> &done) {
+  while (!done() && poll())
+    ;
+}
+
+// ---------
+// Client
+// ---------
+
+Client::Client(Loop &loop, ClientOptions options)
+    : loop_(loop), options_(options) {
+  options_.max_in_flight = std::max(1u, options_.max_in_flight);
+  options_.max_attempts = std::max(1u, options_.max_attempts);
+  loop_.add(this);
+}
+
+Client::~Client() {
+  close();
+  loop_.remove(this);
+}
+
+void Client::attach(int fd) {
+  close();
+  set_nonblocking(fd);
+  fd_ = fd;
+  next_line_number_ = 1;
+  synced_ = false;
+  wanted_ = 0;
+  rx_.clear();
+}
+
+bool Client::connect_tcp(const std::string &host, uint16_t port) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *res = nullptr;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res))
+    return false;
+  int fd = -1;
+  for (addrinfo *ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0)
+      continue;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      break;
+    ::close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd < 0)
+    return false;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  attach(fd);
+  return true;
+}
+
+bool Client::open_serial(const std::string &path, unsigned baud) {
+  speed_t speed = baud_constant(baud);
+  if (speed == B0)
+    return false;
+  int fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0)
+    return false;
+  termios tio{};
+  if (tcgetattr(fd, &tio) != 0) {
+    ::close(fd);
+    return false;
+  }
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+    ::close(fd);
+    return false;
+  }
+  attach(fd);
+  return true;
+}
+
+void Client::close() { close_with(Reply::Status::Closed); }
+
+void Client::close_with(Reply::Status status) {
+  if (fd_ >= 0)
+    ::close(fd_);
+  fd_ = -1;
+  tx_.clear();
+  tx_sent_ = 0;
+  // In the order they were sent.
+  for (auto *q : {&in_flight_, &resend_, &queued_}) {
+    for (auto &op : *q)
+      finish(op, status);
+    q->clear();
+  }
+}
+
+Request Client::send(std::string_view command) {
+  auto op = std::make_shared<detail::Op>();
+  op->loop = &loop_;
+  op->command = command;
+  Request request(op);
+
+  if (options_.validate) {
+    std::string copy(command);
+    tcode_parsed_line_t parsed;
+    tcode_command_t cmd;
+    tcode_status_t st = tcode_parse_inplace(copy.data(), &parsed);
+    if (st != TCODE_OK) {
+      op->reply.errors.push_back(std::string("error:") + tcode_status_str(st));
+    } else if (parsed.has_checksum) {
+      op->reply.errors.push_back("error:CHECKSUM added by the client");
+    } else {
+      tcode_decode_status_t dst = tcode_decode(&parsed, &cmd);
+      if (dst != TCODE_DECODE_OK) {
+        op->reply.errors.push_back(
+            std::string("error:") + tcode_decode_status_str(dst) + " " +
+            (cmd.error_token ? cmd.error_token : ""));
+      } else if (cmd.has_line_number) {
+        op->reply.errors.push_back("error:N added by the client");
+      }
+    }
+    if (!op->reply.errors.empty()) {
+      finish(op, Reply::Status::Invalid);
+      return request;
+    }
+  }
+  if (!is_open()) {
+    finish(op, Reply::Status::Closed);
+    return request;
+  }
+  queued_.push_back(std::move(op));
+  pump();
+  return request;
+}
+
+int Client::subscribe(LineHandler fn) {
+  subscribers_.emplace_back(next_subscriber_, std::move(fn));
+  return next_subscriber_++;
+}
+
+void Client::unsubscribe(int id) {
+  subscribers_.erase(std::remove_if(subscribers_.begin(), subscribers_.end(),
+                                    [id](const auto &s) {
+                                      return s.first == id;
+                                    }),
+                     subscribers_.end());
+}
+
+short Client::poll_events() const {
+  return (short)(POLLIN | (tx_sent_ < tx_.size() ? POLLOUT : 0));
+}
+
+std::optional<Client::Clock::time_point> Client::deadline() const {
+  if (in_flight_.empty())
+    return std::nullopt;
+  return in_flight_.front()->sent_at + options_.timeout;
+}
+
+void Client::frame(detail::Op &op) {
+  std::string body = "N";
+  body += std::to_string(next_line_number_);
+  body += ' ';
+  body += op.command;
+  char sum[8];
+  if (options_.checksum == Checksum::Crc16)
+    snprintf(sum, sizeof(sum), "*%04X\n", tcode_checksum_crc16(body.c_str()));
+  else
+    snprintf(sum, sizeof(sum), "*%02X\n", tcode_checksum_xor(body.c_str()));
+  op.line = body + sum;
+  op.reply.line_number = next_line_number_++;
+}
+
+// Sends queued lines while the window has room. Nothing new goes out while
+// rejected lines wait to be sent again.
+void Client::pump() {
+  if (!is_open())
+    return;
+  size_t window = synced_ ? options_.max_in_flight : 1;
+  while (resend_.empty() && in_flight_.size() < window && !queued_.empty()) {
+    OpPtr op = queued_.front();
+    // Start over at N1 only with nothing in flight: a line sent again after
+    // N1 would be out of sequence.
+    if (next_line_number_ > MAX_LINE_NUMBER) {
+      if (!in_flight_.empty())
+        break;
+      next_line_number_ = 1;
+      synced_ = false;
+      window = 1;
+    }
+    frame(*op);
+    queued_.pop_front();
+    tx_ += op->line;
+    op->reply.attempts++;
+    op->sent_at = Clock::now();
+    in_flight_.push_back(std::move(op));
+    stats_.lines_sent++;
+  }
+  flush();
+}
+
+void Client::flush() {
+  while (tx_sent_ < tx_.size()) {
+    ssize_t n = ::write(fd_, tx_.data() + tx_sent_, tx_.size() - tx_sent_);
+    if (n > 0) {
+      tx_sent_ += (size_t)n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else {
+      close();
+      return;
+    }
+  }
+  if (tx_sent_ == tx_.size()) {
+    tx_.clear();
+    tx_sent_ = 0;
+  }
+}
+
+void Client::on_readable() {
+  char buf[4096];
+  while (is_open()) {
+    ssize_t n = ::read(fd_, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (n <= 0) {
+      close();
+      break;
+    }
+
+    rx_.append(buf, (size_t)n);
+    size_t start = 0, end;
+    while (is_open() && (end = rx_.find('\n', start)) != std::string::npos) {
+      std::string_view line(rx_.data() + start, end - start);
+      if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+      on_line(line);
+      start = end + 1;
+    }
+    rx_.erase(0, start);
+  }
+  pump();
+}
+
+void Client::on_line(std::string_view line) {
+  if (line.empty())
+    return;
+  if (line == "ok") {
+    on_ok();
+    return;
+  }
+  bool answer = !in_flight_.empty() && line != ".";
+  if (answer && starts_with(line, "data:")) {
+    line.remove_prefix(5);
+    while (!line.empty() && line.front() == ' ')
+      line.remove_prefix(1);
+    in_flight_.front()->reply.data.emplace_back(line);
+  } else if (answer && (starts_with(line, "error:") ||
+                        starts_with(line, "ERROR") ||
+                        starts_with(line, "resend:"))) {
+    detail::Op &op = *in_flight_.front();
+    op.reply.errors.emplace_back(line);
+    if (asks_resend(line, op.reply.line_number)) {
+      op.retry = true;
+      int32_t k = wanted_line_number(line);
+      if (k > 0)
+        wanted_ = k;
+    }
+  } else {
+    stats_.unsolicited++;
+    if (!subscribers_.empty())
+      loop_.lines_.push_back({this, std::string(line)});
+  }
+}
+
+void Client::on_ok() {
+  if (in_flight_.empty()) {
+    stats_.stray_oks++;
+    return;
+  }
+  OpPtr op = std::move(in_flight_.front());
+  in_flight_.pop_front();
+  stats_.replies++;
+
+  if (!op->retry) {
+    synced_ = true;
+    finish(op, op->reply.errors.empty() ? Reply::Status::Ok
+                                        : Reply::Status::Error);
+  } else if (op->reply.attempts >= options_.max_attempts) {
+    finish(op, Reply::Status::Undeliverable);
+  } else {
+    op->retry = false;
+    op->reply.data.clear();
+    op->reply.errors.clear();
+    resend_.push_back(std::move(op));
+    stats_.resends++;
+  }
+
+  // Every line sent after the first rejected one has been answered (and
+  // rejected): send them all again, in order, before anything new. None of
+  // them ran, so they take new numbers from the one the device expects: a
+  // line it rejected without counting (a decode error) leaves a gap.
+  if (in_flight_.empty() && !resend_.empty()) {
+    next_line_number_ = wanted_ ? wanted_ : resend_.front()->reply.line_number;
+    wanted_ = 0;
+    queued_.insert(queued_.begin(), resend_.begin(), resend_.end());
+    resend_.clear();
+  }
+}
+
+void Client::finish(const OpPtr &op, Reply::Status status) {
+  op->reply.status = status;
+  op->done = true;
+  if (op->coroutine || op->callback)
+    loop_.ready(op);
+}
+
+} // namespace tcode
@@ -0,0 +1,246 @@
+#pragma once
+
+// T-Code host client: the other end of tcode_session.
+//
+// A Client talks to one device (a chamber) over a byte stream: a TCP socket,
+// a serial port, or any fd. send() frames each command with the next line
+// number and a checksum, and keeps up to ClientOptions::max_in_flight lines
+// on the wire. The device answers every line with exactly one "ok", in
+// order, so the "data:" and "error:" lines before each "ok" belong to the
+// oldest line still waiting.
+//
+// A line the device did not run because it arrived damaged (wrong checksum,
+// parse error, CRC_REQUIRED) or out of sequence (LINE_NUMBER, resend:) is
+// sent again. First the lines already sent after it are let through; the
+// device rejects them as out of sequence. Then they all go again, in order,
+// numbered from the N the device expects. One line is sent at most
+// max_attempts times.
+//
+// Each send() returns a Request: a future for the Reply that a Task can
+// co_await, or that takes a callback. Keepalives (".") and lines that no
+// command is waiting for go to subscribe() callbacks. While a command is
+// waiting, a "data:" line is taken as its answer.
+//
+// Everything runs on the thread that calls Loop::poll(), and one Loop
+// drives any number of Clients. Callbacks and coroutines resume from
+// poll(), never from inside send().
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tcode {
+
+class Client;
+class Loop;
+
+enum class Checksum {
+  Xor,   // *XX, understood by every device
+  Crc16, // *XXXX, once the device has shown it knows it (M21 K=CRC)
+};
+
+struct ClientOptions {
+  Checksum checksum = Checksum::Xor;
+  // Lines sent whose "ok" has not come back yet. The device runs lines one
+  // at a time, so this only has to cover the link's round trip.
+  unsigned max_in_flight = 8;
+  // Sends of one line, the first included, before it fails Undeliverable.
+  unsigned max_attempts = 4;
+  // Longest wait for the oldest line's "ok". Past it the answers can no
+  // longer be paired with their lines, so the client closes.
+  std::chrono::milliseconds timeout{2000};
+  // Decode each command with the device's grammar (tcode_grammar.h) before
+  // sending it, so a command the device would reject fails without a round
+  // trip.
+  bool validate = true;
+};
+
+struct Reply {
+  enum class Status {
+    Ok,            // "ok" with no error line before it
+    Error,         // "ok" after an error line: see errors
+    Invalid,       // rejected by the local decoder, never sent
+    Undeliverable, // max_attempts sends, none run
+    Timeout,       // no "ok" in ClientOptions::timeout
+    Closed,        // the connection closed first
+  };
+
+  Status status = Status::Closed;
+  int32_t line_number = 0; // N of the last send, 0 if never sent
+  unsigned attempts = 0;
+  std::vector<std::string> data;   // "data:" lines, without the "data: "
+  std::vector<std::string> errors; // error lines as received
+
+  bool ok() const { return status == Status::Ok; }
+
+  // The value of KEY=value in data line `line`.
+  std::optional<std::string_view> field(std::string_view key,
+                                        size_t line = 0) const;
+};
+
+const char *reply_status_str(Reply::Status status);
+
+namespace detail {
+struct Op;
+} // namespace detail
+
+// The future result of one send(). Wait for it in one way only: co_await
+// it, or give it a callback with then().
+class Request {
+public:
+  bool ready() const;
+  // Only once ready(), and not after co_await has taken it.
+  const Reply &reply() const;
+  // Runs `fn` from Loop::poll() once the reply is in, or at the next poll()
+  // if it already is.
+  void then(std::function<void(const Reply &)> fn);
+
+  // co_await yields the Reply, moved out of the request.
+  bool await_ready() const noexcept;
+  void await_suspend(std::coroutine_handle<> waiter) noexcept;
+  Reply await_resume();
+
+private:
+  friend class Client;
+  explicit Request(std::shared_ptr<detail::Op> op) : op_(std::move(op)) {}
+  std::shared_ptr<detail::Op> op_;
+};
+
+// A coroutine that starts when called, and is resumed by Loop::poll() each
+// time a Request it awaits comes in. Nothing waits for it: it frees itself
+// when it returns.
+struct Task {
+  struct promise_type {
+    Task get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+class Loop {
+public:
+  Loop() = default;
+  Loop(const Loop &) = delete;
+  Loop &operator=(const Loop &) = delete;
+
+  // Waits up to `timeout_ms` (-1 for as long as it takes) for any client
+  // to be readable or writable, or for the oldest line to time out. Then it
+  // handles what came in and runs the callbacks and coroutines whose replies
+  // did. Returns false, without waiting, if no client is open.
+  bool poll(int timeout_ms = -1);
+
+  // poll() until `done()` is true or no client is open.
+  void run_until(const std::function<bool()> &done);
+
+private:
+  friend class Client;
+  friend class Request;
+
+  struct Unsolicited {
+    Client *client;
+    std::string line;
+  };
+
+  void add(Client *client);
+  void remove(Client *client);
+  void ready(std::shared_ptr<detail::Op> op);
+  void run_ready();
+
+  std::vector<Client *> clients_;
+  std::vector<std::shared_ptr<detail::Op>> ready_;
+  std::vector<Unsolicited> lines_;
+};
+
+class Client {
+public:
+  using LineHandler = std::function<void(std::string_view line)>;
+
+  struct Stats {
+    uint64_t lines_sent = 0; // resends included
+    uint64_t resends = 0;
+    uint64_t replies = 0;     // requests answered with "ok"
+    uint64_t unsolicited = 0; // lines handed to subscribers
+    uint64_t stray_oks = 0;   // "ok" with nothing waiting
+  };
+
+  explicit Client(Loop &loop, ClientOptions options = {});
+  // Requests still waiting end Closed.
+  ~Client();
+  Client(const Client &) = delete;
+  Client &operator=(const Client &) = delete;
+
+  // Talks over `fd` from now on, and closes it when done. Line numbers
+  // start again at N1, which also restarts the device's count. Until N1
+  // has run, the window is one line.
+  void attach(int fd);
+  bool connect_tcp(const std::string &host, uint16_t port);
+  // Raw 8N1 at `baud`.
+  bool open_serial(const std::string &path, unsigned baud);
+  // Requests still waiting end Closed.
+  void close();
+  bool is_open() const { return fd_ >= 0; }
+
+  // Queues one command, without N or checksum: "Z1 T25", "Q0 F=TEMP". It
+  // goes out as soon as fewer than max_in_flight lines are waiting.
+  Request send(std::string_view command);
+  // send() for a Q command: its answer is in the reply's data lines.
+  Request query(std::string_view command) { return send(command); }
+
+  // `fn` gets every line no command is waiting for, keepalives included.
+  // Returns an id for unsubscribe().
+  int subscribe(LineHandler fn);
+  void unsubscribe(int id);
+
+  const Stats &stats() const { return stats_; }
+  size_t in_flight() const { return in_flight_.size(); }
+  size_t queued() const { return queued_.size() + resend_.size(); }
+
+private:
+  friend class Loop;
+  using Clock = std::chrono::steady_clock;
+  using OpPtr = std::shared_ptr<detail::Op>;
+
+  short poll_events() const;
+  std::optional<Clock::time_point> deadline() const;
+  void on_readable();
+  void on_line(std::string_view line);
+  void on_ok();
+  void pump();
+  void flush();
+  void frame(detail::Op &op);
+  void finish(const OpPtr &op, Reply::Status status);
+  void close_with(Reply::Status status);
+
+  Loop &loop_;
+  ClientOptions options_;
+  int fd_ = -1;
+  int32_t next_line_number_ = 1;
+  // False until a line numbered from N1 has run. Until then the device may
+  // take N2 without N1, so one line at a time goes out.
+  bool synced_ = false;
+  // The N the device last asked for, to number the lines sent again.
+  int32_t wanted_ = 0;
+
+  std::deque<OpPtr> queued_;    // not sent yet
+  std::deque<OpPtr> in_flight_; // sent, oldest first
+  std::deque<OpPtr> resend_;    // rejected unrun, sent again once drained
+
+  std::string rx_;
+  std::string tx_;
+  size_t tx_sent_ = 0;
+
+  std::vector<std::pair<int, LineHandler>> subscribers_;
+  int next_subscriber_ = 1;
+  Stats stats_;
+};
+
+} // namespace tcode
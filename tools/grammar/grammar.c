@@ -0,0 +1,738 @@
+// T-Code grammar tool.
+//
+// Prints the command reference generated from the grammar in
+// simulator/lib/tcode_protocol/tcode_grammar.hpp (-r), decodes single lines
+// (-d), benchmarks the generated decoder against the hand-written parser it
+// replaced in the firmware's serial task (-b), and compares the XOR and
+// CRC-16 line checksums for speed and for the corruption they catch (-c).
+
+#include "tcode_grammar.h"
+#include "tcode_protocol.h"
+#include "tcode_session.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// -------------------------
+// Hand-written reference
+// -------------------------
+//
+// The decision logic of the serial task's process_tcode_line() before the
+// grammar, with the side effects replaced by filling in a result. Kept only
+// as the benchmark baseline.
+
+typedef enum legacy_kind {
+  LEGACY_NONE = 0, // nothing executed (error or empty)
+  LEGACY_SETPOINT,
+  LEGACY_M,
+  LEGACY_Q,
+} legacy_kind_t;
+
+typedef struct legacy_result {
+  legacy_kind_t kind;
+  char letter; // T/H for setpoints
+  int value;   // setpoint, M number or Q number
+  int arg;     // M32/M33 S, Q1 key index; -1 if none
+} legacy_result_t;
+
+static bool is_unsigned_int_token(const char *s) {
+  if (!s || !*s)
+    return false;
+  for (const char *p = s; *p; ++p) {
+    if (*p < '0' || *p > '9')
+      return false;
+  }
+  return true;
+}
+
+static const char *find_arg(char **segments, int segment_count, int start,
+                            char letter) {
+  for (int i = start; i < segment_count; ++i) {
+    const char *seg = segments[i];
+    if (seg[0] == letter)
+      return seg[1] == '=' ? seg + 2 : seg + 1;
+  }
+  return NULL;
+}
+
+static void legacy_decode(char *line, legacy_result_t *r) {
+  memset(r, 0, sizeof(*r));
+  r->arg = -1;
+
+  tcode_parsed_line_t parsed;
+  if (tcode_parse_inplace(line, &parsed) != TCODE_OK)
+    return;
+  char **segments = parsed.tokens;
+  int segment_count = (int)parsed.token_count;
+  int cur_segment = 0;
+
+  if (segment_count > 0 && segments[cur_segment][0] == 'N') {
+    char *ptr = segments[0] + 1;
+    if (*ptr)
+      (void)atoi(ptr);
+    cur_segment++;
+  }
+  if (cur_segment >= segment_count)
+    return;
+
+  const char *cmd = segments[cur_segment];
+  if (cmd[0] == 'T' || cmd[0] == 'H' || cmd[0] == 'Z') {
+    int zone = 0;
+    const char *th = NULL;
+    if (cmd[0] == 'Z') {
+      const char *zone_str = cmd[1] ? (cmd + 1) : NULL;
+      if (zone_str && is_unsigned_int_token(zone_str) &&
+          cur_segment + 1 < segment_count) {
+        zone = atoi(zone_str);
+        th = segments[cur_segment + 1];
+      }
+    } else {
+      th = cmd;
+    }
+    if (th && (th[0] == 'T' || th[0] == 'H') && th[1] != '\0' && zone == 0) {
+      int value = atoi(th + 1);
+      bool ok = th[0] == 'T' ? (value >= -45 && value <= 90)
+                             : (value >= 0 && value <= 100);
+      if (ok) {
+        r->kind = LEGACY_SETPOINT;
+        r->letter = th[0];
+        r->value = value;
+      }
+    }
+  } else if (cmd[0] == 'M') {
+    const char *marg = NULL;
+    int arg_segment = cur_segment + 1;
+    if (cmd[1] != '\0') {
+      marg = cmd + 1;
+    } else if (cur_segment + 1 < segment_count) {
+      marg = segments[cur_segment + 1];
+      arg_segment++;
+    }
+    if (marg && (strcmp(marg, "30") == 0 || strcmp(marg, "31") == 0 ||
+                 strcmp(marg, "999") == 0)) {
+      r->kind = LEGACY_M;
+      r->value = atoi(marg);
+    } else if (marg && strcmp(marg, "32") == 0) {
+      const char *sarg = find_arg(segments, segment_count, arg_segment, 'S');
+      if (sarg && (strcmp(sarg, "0") == 0 || strcmp(sarg, "1") == 0)) {
+        r->kind = LEGACY_M;
+        r->value = 32;
+        r->arg = sarg[0] - '0';
+      }
+    } else if (marg && strcmp(marg, "33") == 0) {
+      const char *sarg = find_arg(segments, segment_count, arg_segment, 'S');
+      if (sarg && sarg[1] == '\0' && sarg[0] >= '0' && sarg[0] <= '2') {
+        r->kind = LEGACY_M;
+        r->value = 33;
+        r->arg = sarg[0] - '0';
+      }
+    }
+  } else if (cmd[0] == 'Q') {
+    const char *qarg = cmd + 1;
+    if (!is_unsigned_int_token(qarg))
+      return;
+    if (strcmp(qarg, "1") == 0) {
+      const char *q1_arg =
+          cur_segment + 1 < segment_count ? segments[cur_segment + 1] : NULL;
+      if (q1_arg && strcmp(q1_arg, "BUILD") == 0)
+        r->arg = 0;
+      else if (q1_arg && strcmp(q1_arg, "BUILDER") == 0)
+        r->arg = 1;
+      else if (q1_arg && strcmp(q1_arg, "BUILD_DATE") == 0)
+        r->arg = 2;
+      else
+        return;
+    } else if (strcmp(qarg, "0") != 0 && strcmp(qarg, "2") != 0 &&
+               strcmp(qarg, "3") != 0 && strcmp(qarg, "4") != 0 &&
+               strcmp(qarg, "5") != 0) {
+      return;
+    }
+    r->kind = LEGACY_Q;
+    r->value = atoi(qarg);
+  }
+}
+
+// Same questions asked of the grammar decoder.
+static void grammar_result(tcode_decode_status_t st, const tcode_command_t *c,
+                           legacy_result_t *r) {
+  memset(r, 0, sizeof(*r));
+  r->arg = -1;
+  if (st != TCODE_DECODE_OK)
+    return;
+  switch (c->cmd) {
+  case TCODE_CMD_SETPOINT: {
+    const tcode_group_t *g = &c->group[0];
+    if (c->group_count != 1 || g->value[TCODE_ZONE_Z] != 0)
+      return; // the hand-written parser only had zone 0
+    r->kind = LEGACY_SETPOINT;
+    if (g->present & TCODE_FIELD_BIT('T')) {
+      r->letter = 'T';
+      r->value = g->value[TCODE_ZONE_T] / 100;
+    } else {
+      r->letter = 'H';
+      r->value = g->value[TCODE_ZONE_H] / 10;
+    }
+    break;
+  }
+  case TCODE_CMD_Q0:
+  case TCODE_CMD_Q1:
+  case TCODE_CMD_Q2:
+  case TCODE_CMD_Q3:
+  case TCODE_CMD_Q4:
+  case TCODE_CMD_Q5:
+    r->kind = LEGACY_Q;
+    r->value = c->cmd - TCODE_CMD_Q0;
+    r->arg = c->key;
+    break;
+  default:
+    r->kind = LEGACY_M;
+    r->value = atoi(tcode_cmd_name(c->cmd) + 1);
+    if (c->present & TCODE_FIELD_BIT('S'))
+      r->arg = c->value['S' - 'A'];
+    break;
+  }
+}
+
+// -------------------------
+// Benchmark
+// -------------------------
+
+// The traffic a host sends, plus the malformed lines both parsers reject.
+// Only lines both parsers define the same way, so the results can be
+// compared one to one.
+static const char *const BENCH_LINES[] = {
+    "Q0",         "Q0",          "Q0",          "Q0",         "T-10",
+    "H35",        "N12 T25",     "Z0 T25",      "Z0 H50",     "Q1 BUILD",
+    "Q1 BUILDER", "Q2",          "Q3",          "Q4",         "Q5",
+    "M30",        "M 31",        "M32 S1",      "M33 S=2",    "M999",
+    "T120",       "H-5",         "Z1 T5",       "Q9",         "Q1 NOPE",
+    "M33 S7",     "M32",         "Qx",          "N100 Q0*44",
+};
+#define BENCH_LINE_COUNT (int)(sizeof(BENCH_LINES) / sizeof(BENCH_LINES[0]))
+
+// -------------------------
+// Session
+// -------------------------
+//
+// The whole receive path of a device: bytes fed to a tcode_session, which
+// hands the commands it accepts to a device that only records them.
+
+typedef struct bench_device {
+  legacy_result_t last; // of the last line
+  size_t out_bytes;
+} bench_device_t;
+
+static void dev_write(void *ctx, const char *text, size_t len) {
+  (void)text;
+  ((bench_device_t *)ctx)->out_bytes += len;
+}
+
+static void dev_execute(void *ctx, const tcode_command_t *cmd) {
+  grammar_result(TCODE_DECODE_OK, cmd, &((bench_device_t *)ctx)->last);
+}
+
+static void dev_line_done(void *ctx, const tcode_command_t *cmd) {
+  if (!cmd)
+    grammar_result(TCODE_DECODE_BAD_VALUE, NULL,
+                   &((bench_device_t *)ctx)->last);
+}
+
+static const tcode_session_ops_t DEV_OPS = {
+    .write = dev_write,
+    .execute = dev_execute,
+    .line_done = dev_line_done,
+};
+
+static char g_session_buf[256];
+
+// Every benchmark line, newline terminated, as a host would send them.
+// A bench line with its "*XX" checksum and room to spare.
+#define BENCH_LINE_BYTES 72
+
+static char g_transcript[BENCH_LINE_COUNT * BENCH_LINE_BYTES];
+static size_t g_transcript_len;
+
+// Checksums are filled in at startup so the lines exercise that path too.
+static char g_lines[BENCH_LINE_COUNT][BENCH_LINE_BYTES];
+
+static void prepare_lines(void) {
+  for (int i = 0; i < BENCH_LINE_COUNT; ++i) {
+    const char *src = BENCH_LINES[i];
+    const char *star = strchr(src, '*');
+    if (star) {
+      char body[64];
+      size_t n = (size_t)(star - src);
+      memcpy(body, src, n);
+      body[n] = '\0';
+      snprintf(g_lines[i], sizeof(g_lines[i]), "%s*%02X", body,
+               tcode_checksum_xor(body));
+    } else {
+      snprintf(g_lines[i], sizeof(g_lines[i]), "%s", src);
+    }
+    int n = snprintf(g_transcript + g_transcript_len,
+                     sizeof(g_transcript) - g_transcript_len, "%s\n",
+                     g_lines[i]);
+    if (n > 0 && (size_t)n < sizeof(g_transcript) - g_transcript_len)
+      g_transcript_len += (size_t)n;
+  }
+}
+
+static int check_agreement(void) {
+  int mismatches = 0;
+  for (int i = 0; i < BENCH_LINE_COUNT; ++i) {
+    char a[BENCH_LINE_BYTES], b[BENCH_LINE_BYTES];
+    memcpy(a, g_lines[i], sizeof(a));
+    memcpy(b, g_lines[i], sizeof(b));
+
+    legacy_result_t want, got;
+    legacy_decode(a, &want);
+
+    tcode_parsed_line_t parsed;
+    tcode_command_t cmd;
+    tcode_decode_status_t st = TCODE_DECODE_BAD_VALUE;
+    if (tcode_parse_inplace(b, &parsed) == TCODE_OK)
+      st = tcode_decode(&parsed, &cmd);
+    grammar_result(st, &cmd, &got);
+
+    // A device running the session must execute the same command.
+    bench_device_t dev = {.out_bytes = 0};
+    tcode_session_t session;
+    tcode_session_init(&session, g_session_buf, sizeof(g_session_buf),
+                       &DEV_OPS, &dev);
+    tcode_session_feed(&session, g_lines[i], strlen(g_lines[i]));
+    tcode_session_feed(&session, "\n", 1);
+    if (memcmp(&got, &dev.last, sizeof(got)) != 0) {
+      printf("mismatch: \"%s\" grammar kind=%d value=%d arg=%d, session "
+             "kind=%d value=%d arg=%d\n",
+             g_lines[i], got.kind, got.value, got.arg, dev.last.kind,
+             dev.last.value, dev.last.arg);
+      mismatches++;
+    }
+
+    if (memcmp(&want, &got, sizeof(want)) != 0) {
+      printf("mismatch: \"%s\" legacy kind=%d value=%d arg=%d, grammar "
+             "kind=%d value=%d arg=%d (%s)\n",
+             g_lines[i], want.kind, want.value, want.arg, got.kind, got.value,
+             got.arg, tcode_decode_status_str(st));
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+typedef enum bench_path {
+  PATH_TOKENIZE = 0, // tcode_parse_inplace only
+  PATH_LEGACY,
+  PATH_GRAMMAR,
+  PATH_SESSION, // tcode_session_feed of the whole transcript at once
+  PATH_COUNT,
+} bench_path_t;
+
+static const char *const PATH_NAMES[PATH_COUNT] = {"tokenize", "hand-written",
+                                                   "grammar", "session"};
+
+#define BENCH_REPS 7
+
+static double bench_path(bench_path_t path, long iterations) {
+  char buf[64];
+  uint32_t sink = 0;
+  bench_device_t dev = {.out_bytes = 0};
+  tcode_session_t session;
+  tcode_session_init(&session, g_session_buf, sizeof(g_session_buf), &DEV_OPS,
+                     &dev);
+  double start = now_s();
+  for (long it = 0; it < iterations; ++it) {
+    if (path == PATH_SESSION) {
+      tcode_session_feed(&session, g_transcript, g_transcript_len);
+      sink += (uint32_t)dev.out_bytes;
+      continue;
+    }
+    for (int i = 0; i < BENCH_LINE_COUNT; ++i) {
+      // Every parser tokenizes in place, so each pass needs a fresh copy.
+      memcpy(buf, g_lines[i], sizeof(buf));
+      if (path == PATH_TOKENIZE) {
+        tcode_parsed_line_t parsed;
+        sink += (uint32_t)tcode_parse_inplace(buf, &parsed);
+      } else if (path == PATH_LEGACY) {
+        legacy_result_t r;
+        legacy_decode(buf, &r);
+        sink += (uint32_t)r.kind;
+      } else {
+        tcode_parsed_line_t parsed;
+        tcode_command_t cmd;
+        if (tcode_parse_inplace(buf, &parsed) == TCODE_OK)
+          sink += (uint32_t)tcode_decode(&parsed, &cmd);
+      }
+    }
+  }
+  double ns = (now_s() - start) * 1e9 / ((double)iterations * BENCH_LINE_COUNT);
+  if (sink == 0xFFFFFFFFu) // keep the loop alive
+    printf("\n");
+  return ns;
+}
+
+static int bench(long iterations) {
+  int mismatches = check_agreement();
+  printf("lines=%d mismatches=%d\n", BENCH_LINE_COUNT, mismatches);
+
+  // Best of several interleaved runs, so frequency scaling and other load
+  // hit every path alike.
+  double ns[PATH_COUNT];
+  for (int rep = 0; rep < BENCH_REPS; ++rep) {
+    for (int p = 0; p < PATH_COUNT; ++p) {
+      double t = bench_path((bench_path_t)p, iterations);
+      if (rep == 0 || t < ns[p])
+        ns[p] = t;
+    }
+  }
+
+  printf("%-14s %10s %14s\n", "path", "ns/line", "ns/line-tok");
+  for (int p = 0; p < PATH_COUNT; ++p)
+    printf("%-14s %10.1f %14.1f\n", PATH_NAMES[p], ns[p],
+           ns[p] - ns[PATH_TOKENIZE]);
+  return mismatches ? 1 : 0;
+}
+
+// -------------------------
+// Checksums
+// -------------------------
+
+#define CSUM_TEXT_BYTES 65536
+
+static uint64_t g_rng = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rng_next(void) {
+  g_rng ^= g_rng << 13;
+  g_rng ^= g_rng >> 7;
+  g_rng ^= g_rng << 17;
+  return (uint32_t)(g_rng >> 32);
+}
+
+static uint32_t rng_below(uint32_t n) { return rng_next() % n; }
+
+typedef enum csum_path {
+  CSUM_XOR = 0,    // tcode_checksum_xor
+  CSUM_CRC_STREAM, // tcode_line_sum_feed, a byte at a time as received
+  CSUM_CRC_BULK,   // tcode_crc16_update over the whole text
+  CSUM_PATH_COUNT,
+} csum_path_t;
+
+static const char *const CSUM_PATH_NAMES[CSUM_PATH_COUNT] = {
+    "xor", "crc16 stream", "crc16 bulk"};
+
+static double csum_path(csum_path_t path, const char *text, size_t len,
+                        long iterations) {
+  uint32_t sink = 0;
+  double start = now_s();
+  for (long it = 0; it < iterations; ++it) {
+    if (path == CSUM_XOR) {
+      sink += tcode_checksum_xor(text);
+    } else if (path == CSUM_CRC_STREAM) {
+      tcode_line_sum_t sum;
+      tcode_line_sum_reset(&sum);
+      for (size_t i = 0; i < len; ++i)
+        tcode_line_sum_feed(&sum, text[i]);
+      sink += sum.crc;
+    } else {
+      sink += tcode_crc16_update(TCODE_CRC16_INIT, text, len);
+    }
+  }
+  double ns = (now_s() - start) * 1e9 / ((double)iterations * (double)len);
+  if (sink == 0xFFFFFFFFu) // keep the loop alive
+    printf("\n");
+  return ns;
+}
+
+typedef enum corruption {
+  CORRUPT_BIT = 0,    // one bit flipped
+  CORRUPT_TWO_BITS,   // two bits flipped anywhere in the line
+  CORRUPT_SWAP,       // two adjacent, different bytes swapped
+  CORRUPT_BURST,      // two adjacent bytes replaced
+  CORRUPT_FOUR_BYTES, // four bytes anywhere replaced
+  CORRUPT_COUNT,
+} corruption_t;
+
+static const char *const CORRUPT_NAMES[CORRUPT_COUNT] = {
+    "1 bit", "2 bits", "swap adjacent", "2-byte burst", "4 random bytes"};
+
+// Any byte but NUL (which would end the line early) and `old`.
+static char other_byte(char old) {
+  char c;
+  do {
+    c = (char)(1 + rng_below(255));
+  } while (c == old);
+  return c;
+}
+
+static void flip_bit(char *line, size_t len) {
+  size_t i = rng_below((uint32_t)len);
+  char c;
+  do {
+    c = (char)(line[i] ^ (1 << rng_below(8)));
+  } while (c == '\0');
+  line[i] = c;
+}
+
+// Corrupts `line` (of `len` bytes) in place. Returns false if this try left
+// it unchanged.
+static bool corrupt(char *line, size_t len, corruption_t kind) {
+  size_t i = rng_below((uint32_t)len);
+  switch (kind) {
+  case CORRUPT_BIT:
+    flip_bit(line, len);
+    break;
+  case CORRUPT_TWO_BITS:
+    flip_bit(line, len);
+    flip_bit(line, len);
+    break;
+  case CORRUPT_SWAP: {
+    if (i + 1 >= len || line[i] == line[i + 1])
+      return false;
+    char c = line[i];
+    line[i] = line[i + 1];
+    line[i + 1] = c;
+    break;
+  }
+  case CORRUPT_BURST:
+    if (i + 1 >= len)
+      return false;
+    line[i] = other_byte(line[i]);
+    line[i + 1] = other_byte(line[i + 1]);
+    break;
+  default:
+    for (int n = 0; n < 4; ++n) {
+      i = rng_below((uint32_t)len);
+      line[i] = other_byte(line[i]);
+    }
+    break;
+  }
+  return true;
+}
+
+// True if a receiver that expects `kind` would execute `line` as something
+// else than `body`. Corruption that leaves the body intact (say, a hex digit
+// of the checksum changing case) is harmless.
+static bool missed(const char *line, const char *body,
+                   tcode_checksum_kind_t kind) {
+  size_t n = strlen(body);
+  if (strncmp(line, body, n) == 0 && line[n] == '*')
+    return false;
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%s", line);
+  tcode_parsed_line_t parsed;
+  return tcode_parse_inplace(buf, &parsed) == TCODE_OK &&
+         parsed.checksum_kind == kind;
+}
+
+static int csum_bench(long iterations) {
+  int failures = 0;
+  uint16_t check = tcode_checksum_crc16("123456789");
+  printf("crc16(\"123456789\")=%04X%s\n", check,
+         check == 0x29B1 ? "" : " (expected 29B1)");
+  failures += check != 0x29B1;
+
+  // The incremental sums must agree with the one-shot ones.
+  static char text[CSUM_TEXT_BYTES + 64];
+  size_t len = 0;
+  for (int i = 0; len < CSUM_TEXT_BYTES; i = (i + 1) % BENCH_LINE_COUNT) {
+    char body[64];
+    snprintf(body, sizeof(body), "%s", BENCH_LINES[i]);
+    char *star = strchr(body, '*');
+    if (star)
+      *star = '\0';
+
+    char line[sizeof(body) + 8]; // room for "*XXXX"
+    snprintf(line, sizeof(line), "%s*%04X", body, tcode_checksum_crc16(body));
+    tcode_line_sum_t sum;
+    tcode_line_sum_reset(&sum);
+    for (const char *p = line; *p; ++p)
+      tcode_line_sum_feed(&sum, *p);
+    tcode_parsed_line_t parsed;
+    if (tcode_parse_inplace_summed(line, &sum, &parsed) != TCODE_OK ||
+        sum.xor_at_star != tcode_checksum_xor(body)) {
+      printf("incremental checksum mismatch: \"%s\"\n", body);
+      failures++;
+    }
+    len += (size_t)sprintf(text + len, "%s ", body);
+  }
+
+  double ns[CSUM_PATH_COUNT];
+  for (int rep = 0; rep < BENCH_REPS; ++rep) {
+    for (int p = 0; p < CSUM_PATH_COUNT; ++p) {
+      double t = csum_path((csum_path_t)p, text, len, iterations / 500 + 1);
+      if (rep == 0 || t < ns[p])
+        ns[p] = t;
+    }
+  }
+  printf("%-14s %10s %10s\n", "checksum", "ns/byte", "vs xor");
+  for (int p = 0; p < CSUM_PATH_COUNT; ++p)
+    printf("%-14s %10.2f %9.1fx\n", CSUM_PATH_NAMES[p], ns[p],
+           ns[p] / ns[CSUM_XOR]);
+
+  // Inject corruption into checksummed lines and count the ones that would
+  // still be executed. A receiver expecting a checksum rejects a line that
+  // lost its '*'.
+  printf("%-16s %10s %12s %12s\n", "corruption", "trials", "xor missed",
+         "crc16 missed");
+  for (int k = 0; k < CORRUPT_COUNT; ++k) {
+    long trials = 0, misses[2] = {0, 0};
+    while (trials < iterations) {
+      char body[64];
+      snprintf(body, sizeof(body), "%s",
+               BENCH_LINES[rng_below(BENCH_LINE_COUNT)]);
+      char *star = strchr(body, '*');
+      if (star)
+        *star = '\0';
+
+      uint64_t seed = g_rng;
+      bool changed = true;
+      for (int c = 0; c < 2; ++c) {
+        char line[sizeof(body) + 8]; // room for "*XXXX"
+        tcode_checksum_kind_t kind =
+            c ? TCODE_CHECKSUM_CRC16 : TCODE_CHECKSUM_XOR;
+        if (c)
+          snprintf(line, sizeof(line), "%s*%04X", body,
+                   tcode_checksum_crc16(body));
+        else
+          snprintf(line, sizeof(line), "%s*%02X", body,
+                   tcode_checksum_xor(body));
+        // Same positions in the body for both checksums.
+        g_rng = seed;
+        size_t n = strlen(line);
+        char orig[sizeof(line)];
+        memcpy(orig, line, n + 1);
+        changed = corrupt(line, n, (corruption_t)k) && strcmp(line, orig);
+        if (changed && missed(line, body, kind))
+          misses[c]++;
+      }
+      trials += changed;
+    }
+    printf("%-16s %10ld %12ld %12ld\n", CORRUPT_NAMES[k], trials, misses[0],
+           misses[1]);
+  }
+  return failures ? 1 : 0;
+}
+
+// -------------------------
+// Reference and decode
+// -------------------------
+
+static void emit_line(void *ctx, const char *line) {
+  (void)ctx;
+  printf("%s\n", line);
+}
+
+static const char ZONE_FIELD_LETTERS[TCODE_ZONE_FIELD_COUNT] = {'Z', 'T',
+                                                                'H'};
+
+static int decode_one(const char *text) {
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%s", text);
+
+  tcode_parsed_line_t parsed;
+  tcode_status_t pst = tcode_parse_inplace(buf, &parsed);
+  if (pst != TCODE_OK) {
+    printf("parse: %s\n", tcode_status_str(pst));
+    return 1;
+  }
+  tcode_command_t cmd;
+  tcode_decode_status_t st = tcode_decode(&parsed, &cmd);
+  printf("status: %s\n", tcode_decode_status_str(st));
+  if (st != TCODE_DECODE_OK) {
+    if (cmd.error_token)
+      printf("token: %s\n", cmd.error_token);
+    if (st == TCODE_DECODE_RANGE) {
+      char lo[16], hi[16];
+      tcode_format_fixed(lo, sizeof(lo), cmd.error_min, cmd.error_decimals);
+      tcode_format_fixed(hi, sizeof(hi), cmd.error_max, cmd.error_decimals);
+      printf("range: %s..%s\n", lo, hi);
+    }
+    return st == TCODE_DECODE_EMPTY ? 0 : 1;
+  }
+
+  printf("command: %s\n", tcode_cmd_name(cmd.cmd));
+  if (cmd.has_line_number)
+    printf("N: %ld\n", (long)cmd.line_number);
+  for (int l = 0; l < 26; ++l) {
+    if (cmd.present & (1u << l))
+      printf("%c: %ld\n", 'A' + l, (long)cmd.value[l]);
+  }
+  if (cmd.key >= 0)
+    printf("key: %d\n", cmd.key);
+  if (cmd.range_last)
+    printf("range_last: %ld\n", (long)cmd.range_last);
+  for (int g = 0; g < cmd.group_count; ++g) {
+    printf("group %d:", g);
+    for (int f = 0; f < TCODE_ZONE_FIELD_COUNT; ++f) {
+      char letter = ZONE_FIELD_LETTERS[f];
+      if (f == TCODE_ZONE_Z || cmd.group[g].present & TCODE_FIELD_BIT(letter))
+        printf(" %c=%ld", letter, (long)cmd.group[g].value[f]);
+    }
+    printf("\n");
+  }
+  return 0;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s -r               print the command reference\n"
+          "       %s -d \"line\"        decode one line\n"
+          "       %s -b [-n iters]    benchmark against the hand-written "
+          "parser\n"
+          "       %s -c [-n trials]   XOR and CRC-16 checksum speed and "
+          "error detection\n",
+          argv0, argv0, argv0, argv0);
+}
+
+int main(int argc, char **argv) {
+  long iterations = 50000;
+  int opt;
+  char mode = 0;
+  const char *line = NULL;
+  while ((opt = getopt(argc, argv, "rbcd:n:h")) != -1) {
+    switch (opt) {
+    case 'r':
+    case 'b':
+    case 'c':
+      mode = (char)opt;
+      break;
+    case 'd':
+      mode = 'd';
+      line = optarg;
+      break;
+    case 'n':
+      iterations = atol(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 2;
+    }
+  }
+
+  prepare_lines();
+  switch (mode) {
+  case 'r':
+    tcode_help(emit_line, NULL);
+    return 0;
+  case 'd':
+    return decode_one(line);
+  case 'b':
+    return bench(iterations > 0 ? iterations : 1);
+  case 'c':
+    return csum_bench(iterations > 0 ? iterations : 1);
+  default:
+    usage(argv[0]);
+    return 2;
+  }
+}
@@ -0,0 +1,1182 @@
+// T-Code session log analyzer.
+//
+// Memory-maps a raw serial log (host commands, `ok`, `data:`/`error:` lines,
+// `.` keepalives), splits it at line boundaries into chunks and scans them on
+// all cores. Each command is paired with the responses up to its `ok`,
+// command checksums are verified with tcode_protocol, and the `data:`
+// key/values can be written out as columns (-o, binary) or CSV (-c).
+//
+// Two passes over the mapping:
+// 1. Per chunk: line counts, command/response pairing, and which data keys
+//    occur with which value types. The chunks are then stitched in order (a
+//    chunk may open with the responses to the previous chunk's last
+//    command) and their keys merged into one column schema.
+// 2. Only with -o/-c: every chunk parses its data lines again and writes
+//    them straight into the preallocated columns at its own row offset.
+//
+// -G writes a synthetic session log, for benchmarking.
+
+#include "tcode_grammar.h"
+#include "tcode_protocol.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_LINE 256 // the firmware's receive buffer, including the NUL
+#define MIN_CHUNK_BYTES (1u << 20)
+#define CHUNKS_PER_THREAD 8
+
+// Command classes: tcode_cmd_t, plus one for lines the grammar rejects.
+#define CMD_REJECTED TCODE_CMD_COUNT
+#define CMD_CLASSES (TCODE_CMD_COUNT + 1)
+#define CMD_NONE (-1)
+
+#define KEY_HINTS 32
+
+#define MISSING_U32 0xFFFFFFFFu
+#define MISSING_BOOL 0xFFu
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void *xrealloc(void *p, size_t n) {
+  p = realloc(p, n);
+  if (!p && n) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  return p;
+}
+
+static const char *class_name(int cls) {
+  return cls == CMD_REJECTED ? "?" : tcode_cmd_name((tcode_cmd_t)cls);
+}
+
+// -------------------------
+// String table
+// -------------------------
+//
+// Open-addressing intern table. Entries point into the mapping (or at
+// static strings), so nothing is copied.
+
+typedef struct strtab {
+  uint32_t *slots; // entry + 1, 0 = empty
+  uint32_t cap;    // power of two
+  uint32_t count;
+  uint32_t entry_cap;
+  const char **text;
+  uint32_t *len;
+  uint32_t *hash;
+} strtab_t;
+
+static uint32_t fnv1a(const char *s, uint32_t len) {
+  uint32_t h = 2166136261u;
+  for (uint32_t i = 0; i < len; ++i)
+    h = (h ^ (uint8_t)s[i]) * 16777619u;
+  return h;
+}
+
+static void strtab_grow(strtab_t *t) {
+  uint32_t cap = t->cap ? t->cap * 2 : 64;
+  uint32_t *slots = calloc(cap, sizeof(*slots));
+  if (!slots) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  for (uint32_t e = 0; e < t->count; ++e) {
+    uint32_t i = t->hash[e] & (cap - 1);
+    while (slots[i])
+      i = (i + 1) & (cap - 1);
+    slots[i] = e + 1;
+  }
+  free(t->slots);
+  t->slots = slots;
+  t->cap = cap;
+}
+
+static uint32_t strtab_intern(strtab_t *t, const char *s, uint32_t len) {
+  if ((t->count + 1) * 2 > t->cap)
+    strtab_grow(t);
+  uint32_t h = fnv1a(s, len);
+  uint32_t mask = t->cap - 1;
+  for (uint32_t i = h & mask;; i = (i + 1) & mask) {
+    uint32_t e = t->slots[i];
+    if (e == 0) {
+      if (t->count == t->entry_cap) {
+        t->entry_cap = t->entry_cap ? t->entry_cap * 2 : 32;
+        t->text = xrealloc(t->text, t->entry_cap * sizeof(*t->text));
+        t->len = xrealloc(t->len, t->entry_cap * sizeof(*t->len));
+        t->hash = xrealloc(t->hash, t->entry_cap * sizeof(*t->hash));
+      }
+      e = t->count++;
+      t->text[e] = s;
+      t->len[e] = len;
+      t->hash[e] = h;
+      t->slots[i] = e + 1;
+      return e;
+    }
+    e--;
+    if (t->hash[e] == h && t->len[e] == len && memcmp(t->text[e], s, len) == 0)
+      return e;
+  }
+}
+
+static void strtab_free(strtab_t *t) {
+  free(t->slots);
+  free(t->text);
+  free(t->len);
+  free(t->hash);
+  memset(t, 0, sizeof(*t));
+}
+
+// -------------------------
+// Lines
+// -------------------------
+
+typedef enum line_kind {
+  LINE_EMPTY = 0,
+  LINE_KEEPALIVE,
+  LINE_OK,
+  LINE_DATA,
+  LINE_ERROR, // error:, ERROR: and resend: lines
+  LINE_COMMAND,
+} line_kind_t;
+
+static bool starts_with(const char *s, const char *e, const char *prefix) {
+  size_t n = strlen(prefix);
+  return (size_t)(e - s) >= n && memcmp(s, prefix, n) == 0;
+}
+
+// Trims the line (CR, blanks, "< "/"> " direction marks) and classifies it.
+static line_kind_t classify(const char **ps, const char **pe) {
+  const char *s = *ps;
+  const char *e = *pe;
+  if (e > s && e[-1] == '\r')
+    e--;
+  if (e - s >= 2 && (s[0] == '<' || s[0] == '>') && s[1] == ' ')
+    s += 2;
+  while (s < e && *s == ' ')
+    s++;
+  while (e > s && e[-1] == ' ')
+    e--;
+  *ps = s;
+  *pe = e;
+
+  size_t n = (size_t)(e - s);
+  if (n == 0)
+    return LINE_EMPTY;
+  if (n == 1 && s[0] == '.')
+    return LINE_KEEPALIVE;
+  if (n == 2 && s[0] == 'o' && s[1] == 'k')
+    return LINE_OK;
+  if (starts_with(s, e, "data:"))
+    return LINE_DATA;
+  if (starts_with(s, e, "error:") || starts_with(s, e, "ERROR:") ||
+      starts_with(s, e, "Error:") || starts_with(s, e, "resend:"))
+    return LINE_ERROR;
+  return LINE_COMMAND;
+}
+
+typedef struct line_stats {
+  uint64_t checksum_errors;
+  uint64_t parse_errors; // tokenizer or grammar
+  uint64_t overflows;    // longer than the firmware accepts
+} line_stats_t;
+
+// Command class of a host line, via the same tokenizer and grammar as the
+// firmware. `st` may be NULL (second pass).
+static int command_class(const char *s, const char *e, line_stats_t *st) {
+  char buf[MAX_LINE];
+  size_t n = (size_t)(e - s);
+  if (n >= sizeof(buf)) {
+    if (st)
+      st->overflows++;
+    return CMD_REJECTED;
+  }
+  memcpy(buf, s, n);
+  buf[n] = '\0';
+
+  tcode_parsed_line_t parsed;
+  tcode_status_t pst = tcode_parse_inplace(buf, &parsed);
+  if (pst != TCODE_OK) {
+    if (st && (pst == TCODE_ERR_CHECKSUM_MISMATCH ||
+               pst == TCODE_ERR_CHECKSUM_FORMAT))
+      st->checksum_errors++;
+    else if (st)
+      st->parse_errors++;
+    return CMD_REJECTED;
+  }
+  tcode_command_t cmd;
+  tcode_decode_status_t dst = tcode_decode(&parsed, &cmd);
+  if (dst == TCODE_DECODE_OK)
+    return (int)cmd.cmd;
+  if (st)
+    st->parse_errors++;
+  // Rejected by the grammar, but still attributable to a known command.
+  return cmd.error_cmd ? (int)cmd.cmd : CMD_REJECTED;
+}
+
+// Next KEY=VALUE token of a data line. Tokens without '=' are skipped and
+// counted in `*malformed`.
+static bool next_pair(const char **ps, const char *e, const char **k,
+                      uint32_t *klen, const char **v, uint32_t *vlen,
+                      uint64_t *malformed) {
+  const char *s = *ps;
+  for (;;) {
+    while (s < e && *s == ' ')
+      s++;
+    if (s >= e) {
+      *ps = s;
+      return false;
+    }
+    const char *tok = s;
+    while (s < e && *s != ' ')
+      s++;
+    const char *eq = memchr(tok, '=', (size_t)(s - tok));
+    if (!eq || eq == tok) {
+      (*malformed)++;
+      continue;
+    }
+    *k = tok;
+    *klen = (uint32_t)(eq - tok);
+    *v = eq + 1;
+    *vlen = (uint32_t)(s - eq - 1);
+    *ps = s;
+    return true;
+  }
+}
+
+// -------------------------
+// Values
+// -------------------------
+
+#define TYPE_NUM 1u
+#define TYPE_BOOL 2u
+#define TYPE_STR 4u
+
+// What the values of one key looked like, over all its occurrences.
+typedef struct key_stats {
+  uint8_t types;    // TYPE_* seen
+  uint8_t decimals; // most fractional digits
+  uint64_t max_int; // largest integer part
+} key_stats_t;
+
+static const uint64_t POW10[] = {1ull,
+                                 10ull,
+                                 100ull,
+                                 1000ull,
+                                 10000ull,
+                                 100000ull,
+                                 1000000ull,
+                                 10000000ull,
+                                 100000000ull,
+                                 1000000000ull,
+                                 10000000000ull,
+                                 100000000000ull,
+                                 1000000000000ull,
+                                 10000000000000ull,
+                                 100000000000000ull,
+                                 1000000000000000ull,
+                                 10000000000000000ull,
+                                 100000000000000000ull,
+                                 1000000000000000000ull};
+
+// [+-]digits[.digits], up to 18 digits, as a mantissa and its fractional
+// digit count. No strtod: the text is not NUL terminated and this is the
+// hot path.
+static bool parse_decimal(const char *s, uint32_t len, int64_t *mant,
+                          int *frac_digits) {
+  uint32_t i = 0;
+  bool neg = false;
+  if (len && (s[0] == '-' || s[0] == '+')) {
+    neg = s[0] == '-';
+    i++;
+  }
+  uint64_t m = 0;
+  int digits = 0;
+  int frac = -1;
+  for (; i < len; ++i) {
+    char c = s[i];
+    if (c >= '0' && c <= '9') {
+      if (++digits > 18)
+        return false;
+      m = m * 10 + (uint64_t)(c - '0');
+      if (frac >= 0)
+        frac++;
+    } else if (c == '.' && frac < 0) {
+      frac = 0;
+    } else {
+      return false;
+    }
+  }
+  if (digits == 0)
+    return false;
+  *mant = neg ? -(int64_t)m : (int64_t)m;
+  *frac_digits = frac > 0 ? frac : 0;
+  return true;
+}
+
+static int parse_bool(const char *s, uint32_t len) {
+  if (len == 4 && memcmp(s, "true", 4) == 0)
+    return 1;
+  if (len == 5 && memcmp(s, "false", 5) == 0)
+    return 0;
+  return -1;
+}
+
+static void note_value(key_stats_t *k, const char *v, uint32_t len) {
+  int64_t m;
+  int frac;
+  if (parse_bool(v, len) >= 0) {
+    k->types |= TYPE_BOOL;
+  } else if (parse_decimal(v, len, &m, &frac)) {
+    uint64_t ip = (uint64_t)(m < 0 ? -m : m) / POW10[frac];
+    k->types |= TYPE_NUM;
+    if (frac > k->decimals)
+      k->decimals = (uint8_t)frac;
+    if (ip > k->max_int)
+      k->max_int = ip;
+  } else {
+    k->types |= TYPE_STR;
+  }
+}
+
+static void merge_stats(key_stats_t *into, const key_stats_t *k) {
+  into->types |= k->types;
+  if (k->decimals > into->decimals)
+    into->decimals = k->decimals;
+  if (k->max_int > into->max_int)
+    into->max_int = k->max_int;
+}
+
+// Stats slot for a key id, growing the array as keys appear.
+static key_stats_t *stats_at(key_stats_t **stats, uint32_t *cap,
+                             uint32_t id) {
+  if (id >= *cap) {
+    uint32_t n = *cap ? *cap * 2 : 32;
+    while (n <= id)
+      n *= 2;
+    *stats = xrealloc(*stats, n * sizeof(**stats));
+    memset(*stats + *cap, 0, (n - *cap) * sizeof(**stats));
+    *cap = n;
+  }
+  return &(*stats)[id];
+}
+
+// -------------------------
+// Chunks and columns
+// -------------------------
+
+typedef struct cmd_counts {
+  uint64_t sent;
+  uint64_t ok;
+  uint64_t errors;
+  uint64_t data;
+  uint64_t unanswered; // followed by another command, or EOF, before `ok`
+} cmd_counts_t;
+
+typedef struct chunk {
+  const char *begin;
+  const char *end;
+
+  // Pass 1
+  uint64_t lines;
+  uint64_t data_rows;
+  uint64_t keepalives;
+  uint64_t orphans; // responses with no command to pair with
+  uint64_t malformed;
+  line_stats_t line_stats;
+  cmd_counts_t cmd[CMD_CLASSES];
+  strtab_t keys;
+  key_stats_t *key_stats;
+  uint32_t key_stats_cap;
+  uint32_t key_hint[KEY_HINTS];
+
+  // Pairing across the chunk start: responses before the first command
+  // belong to the previous chunk's open command, up to the first `ok`.
+  bool has_command;
+  bool lead_closed; // an `ok` came before the first command
+  uint64_t lead_data;
+  uint64_t lead_errors;
+  int open_cmd; // still waiting for `ok` at the chunk end
+
+  // From stitching
+  int entry_open;
+  uint64_t line_base;
+  uint64_t row_base;
+  uint32_t *key_column; // local key -> column
+
+  // Pass 2
+  strtab_t strings;
+  uint32_t *string_global;
+  char *csv;
+  size_t csv_len;
+} chunk_t;
+
+typedef enum col_type {
+  COL_U64 = 0,  // line number
+  COL_F64 = 1,  // NaN = missing
+  COL_BOOL = 2, // 0, 1, 0xFF = missing
+  COL_STR = 3,  // index into the string table, 0xFFFFFFFF = missing
+  COL_FIXED = 4, // int32 with the column's decimals, INT32_MIN = missing
+} col_type_t;
+
+static const uint8_t COL_SIZE[] = {8, 8, 1, 4, 4};
+
+typedef struct column {
+  const char *name;
+  uint32_t name_len;
+  col_type_t type;
+  uint8_t decimals; // COL_FIXED
+  void *data;
+} column_t;
+
+#define COL_LINE 0
+#define COL_CMD 1
+#define COL_FIRST_KEY 2
+
+typedef struct analysis {
+  const char *map;
+  size_t size;
+  int threads;
+  chunk_t *chunks;
+  int chunk_count;
+
+  // Totals after stitching
+  uint64_t lines;
+  uint64_t rows;
+  uint64_t keepalives;
+  uint64_t orphans;
+  uint64_t malformed;
+  line_stats_t line_stats;
+  cmd_counts_t cmd[CMD_CLASSES];
+
+  strtab_t keys; // global
+  key_stats_t *key_stats;
+  uint32_t key_stats_cap;
+  column_t *cols;
+  uint32_t col_count;
+  strtab_t strings; // command names first, then string values
+} analysis_t;
+
+// Splits the mapping into chunks that end just after a newline.
+static void make_chunks(analysis_t *a) {
+  size_t want = (size_t)a->threads * CHUNKS_PER_THREAD;
+  size_t target = a->size / (want ? want : 1);
+  if (target < MIN_CHUNK_BYTES)
+    target = MIN_CHUNK_BYTES;
+
+  a->chunks = NULL;
+  a->chunk_count = 0;
+  const char *p = a->map;
+  const char *end = a->map + a->size;
+  while (p < end) {
+    const char *q = (size_t)(end - p) > target ? p + target : end;
+    if (q < end) {
+      const char *nl = memchr(q, '\n', (size_t)(end - q));
+      q = nl ? nl + 1 : end;
+    }
+    a->chunks = xrealloc(a->chunks, (size_t)(a->chunk_count + 1) *
+                                        sizeof(*a->chunks));
+    chunk_t *c = &a->chunks[a->chunk_count++];
+    memset(c, 0, sizeof(*c));
+    c->begin = p;
+    c->end = q;
+    p = q;
+  }
+}
+
+typedef void (*chunk_fn)(analysis_t *a, chunk_t *c);
+
+typedef struct worker {
+  analysis_t *a;
+  chunk_fn fn;
+  atomic_int *next;
+} worker_t;
+
+static void *worker_main(void *arg) {
+  worker_t *w = (worker_t *)arg;
+  for (;;) {
+    int i = atomic_fetch_add(w->next, 1);
+    if (i >= w->a->chunk_count)
+      return NULL;
+    w->fn(w->a, &w->a->chunks[i]);
+  }
+}
+
+// Runs `fn` on every chunk, chunks handed out to threads as they free up.
+static void run_parallel(analysis_t *a, chunk_fn fn) {
+  atomic_int next = 0;
+  worker_t w = {a, fn, &next};
+  int n = a->threads < a->chunk_count ? a->threads : a->chunk_count;
+  pthread_t *tids = calloc((size_t)(n > 1 ? n - 1 : 1), sizeof(*tids));
+  int started = 0;
+  for (int i = 0; i < n - 1; ++i) {
+    if (pthread_create(&tids[i], NULL, worker_main, &w) != 0)
+      break;
+    started++;
+  }
+  worker_main(&w);
+  for (int i = 0; i < started; ++i)
+    pthread_join(tids[i], NULL);
+  free(tids);
+}
+
+// Next line of the chunk: `*s`..`*e` is the trimmed line, and the return
+// value its class. Returns false at the chunk end.
+static bool next_line(const char **p, const char *end, const char **s,
+                      const char **e, line_kind_t *kind) {
+  if (*p >= end)
+    return false;
+  const char *nl = memchr(*p, '\n', (size_t)(end - *p));
+  *s = *p;
+  *e = nl ? nl : end;
+  *p = nl ? nl + 1 : end;
+  *kind = classify(s, e);
+  return true;
+}
+
+// -------------------------
+// Pass 1: pairing and schema
+// -------------------------
+
+// Data lines mostly repeat the keys of the previous line of their kind, in
+// the same order, so the key last seen at this position is checked before
+// hashing.
+static uint32_t chunk_key(chunk_t *c, uint32_t pos, const char *k,
+                          uint32_t len) {
+  if (pos < KEY_HINTS) {
+    uint32_t id = c->key_hint[pos];
+    if (id < c->keys.count && c->keys.len[id] == len &&
+        memcmp(c->keys.text[id], k, len) == 0)
+      return id;
+  }
+  uint32_t id = strtab_intern(&c->keys, k, len);
+  if (pos < KEY_HINTS)
+    c->key_hint[pos] = id;
+  return id;
+}
+
+static void pass1(analysis_t *a, chunk_t *c) {
+  (void)a;
+  int open = CMD_NONE;
+  c->open_cmd = CMD_NONE;
+
+  const char *p = c->begin;
+  const char *s, *e;
+  line_kind_t kind;
+  while (next_line(&p, c->end, &s, &e, &kind)) {
+    c->lines++;
+    switch (kind) {
+    case LINE_EMPTY:
+      break;
+    case LINE_KEEPALIVE:
+      c->keepalives++;
+      break;
+    case LINE_OK:
+      if (open != CMD_NONE) {
+        c->cmd[open].ok++;
+        open = CMD_NONE;
+      } else if (!c->has_command && !c->lead_closed) {
+        c->lead_closed = true;
+      } else {
+        c->orphans++;
+      }
+      break;
+    case LINE_DATA: {
+      c->data_rows++;
+      if (open != CMD_NONE)
+        c->cmd[open].data++;
+      else if (!c->has_command && !c->lead_closed)
+        c->lead_data++;
+      else
+        c->orphans++;
+
+      const char *q = s + 5;
+      const char *k, *v;
+      uint32_t klen, vlen;
+      uint32_t pos = 0;
+      while (next_pair(&q, e, &k, &klen, &v, &vlen, &c->malformed)) {
+        uint32_t id = chunk_key(c, pos++, k, klen);
+        note_value(stats_at(&c->key_stats, &c->key_stats_cap, id), v, vlen);
+      }
+      break;
+    }
+    case LINE_ERROR:
+      if (open != CMD_NONE)
+        c->cmd[open].errors++;
+      else if (!c->has_command && !c->lead_closed)
+        c->lead_errors++;
+      else
+        c->orphans++;
+      break;
+    case LINE_COMMAND: {
+      int cls = command_class(s, e, &c->line_stats);
+      if (open != CMD_NONE)
+        c->cmd[open].unanswered++;
+      c->cmd[cls].sent++;
+      c->has_command = true;
+      open = cls;
+      break;
+    }
+    }
+  }
+  c->open_cmd = open;
+}
+
+// Joins the chunks in file order: pairing across chunk starts, totals, line
+// and row offsets, and the column schema.
+static void stitch(analysis_t *a) {
+  int open = CMD_NONE;
+  for (int i = 0; i < a->chunk_count; ++i) {
+    chunk_t *c = &a->chunks[i];
+    c->entry_open = open;
+    c->line_base = a->lines;
+    c->row_base = a->rows;
+
+    if (open != CMD_NONE) {
+      a->cmd[open].data += c->lead_data;
+      a->cmd[open].errors += c->lead_errors;
+      if (c->lead_closed)
+        a->cmd[open].ok++;
+      else if (c->has_command)
+        a->cmd[open].unanswered++;
+    } else {
+      a->orphans += c->lead_data + c->lead_errors + (c->lead_closed ? 1 : 0);
+    }
+    if (c->has_command)
+      open = c->open_cmd;
+    else if (c->lead_closed)
+      open = CMD_NONE;
+
+    a->lines += c->lines;
+    a->rows += c->data_rows;
+    a->keepalives += c->keepalives;
+    a->orphans += c->orphans;
+    a->malformed += c->malformed;
+    a->line_stats.checksum_errors += c->line_stats.checksum_errors;
+    a->line_stats.parse_errors += c->line_stats.parse_errors;
+    a->line_stats.overflows += c->line_stats.overflows;
+    for (int k = 0; k < CMD_CLASSES; ++k) {
+      a->cmd[k].sent += c->cmd[k].sent;
+      a->cmd[k].ok += c->cmd[k].ok;
+      a->cmd[k].errors += c->cmd[k].errors;
+      a->cmd[k].data += c->cmd[k].data;
+      a->cmd[k].unanswered += c->cmd[k].unanswered;
+    }
+
+    c->key_column = xrealloc(NULL, (c->keys.count + 1) * sizeof(uint32_t));
+    for (uint32_t k = 0; k < c->keys.count; ++k) {
+      uint32_t g = strtab_intern(&a->keys, c->keys.text[k], c->keys.len[k]);
+      merge_stats(stats_at(&a->key_stats, &a->key_stats_cap, g),
+                  &c->key_stats[k]);
+      c->key_column[k] = COL_FIRST_KEY + g;
+    }
+  }
+  if (open != CMD_NONE)
+    a->cmd[open].unanswered++; // still waiting at EOF
+}
+
+// -------------------------
+// Pass 2: columns
+// -------------------------
+
+// Exact fixed point where every value fits an int32 at the key's widest
+// decimals, like T-Code itself; doubles otherwise.
+static col_type_t column_type(const key_stats_t *k) {
+  if (k->types == TYPE_BOOL)
+    return COL_BOOL;
+  if (k->types != TYPE_NUM)
+    return COL_STR;
+  if (k->decimals <= 9 && k->max_int < INT32_MAX &&
+      (k->max_int + 1) * POW10[k->decimals] <= INT32_MAX)
+    return COL_FIXED;
+  return COL_F64;
+}
+
+static void alloc_columns(analysis_t *a) {
+  a->col_count = COL_FIRST_KEY + a->keys.count;
+  a->cols = calloc(a->col_count, sizeof(*a->cols));
+  a->cols[COL_LINE] = (column_t){"line", 4, COL_U64, 0, NULL};
+  a->cols[COL_CMD] = (column_t){"cmd", 3, COL_STR, 0, NULL};
+  for (uint32_t k = 0; k < a->keys.count; ++k) {
+    const key_stats_t *ks = &a->key_stats[k];
+    column_t *col = &a->cols[COL_FIRST_KEY + k];
+    col->name = a->keys.text[k];
+    col->name_len = a->keys.len[k];
+    col->type = column_type(ks);
+    col->decimals = col->type == COL_FIXED ? ks->decimals : 0;
+  }
+  for (uint32_t i = 0; i < a->col_count; ++i) {
+    column_t *col = &a->cols[i];
+    col->data = malloc((a->rows ? a->rows : 1) * COL_SIZE[col->type]);
+    if (!col->data) {
+      fprintf(stderr, "out of memory for %llu rows\n",
+              (unsigned long long)a->rows);
+      exit(1);
+    }
+  }
+
+  // Command names are the first strings, so `cmd` cells need no remap.
+  for (int k = 0; k < CMD_CLASSES; ++k) {
+    const char *name = class_name(k);
+    strtab_intern(&a->strings, name, (uint32_t)strlen(name));
+  }
+}
+
+static void pass2(analysis_t *a, chunk_t *c) {
+  // Missing cells first, for this chunk's rows only.
+  for (uint32_t i = COL_FIRST_KEY; i < a->col_count; ++i) {
+    column_t *col = &a->cols[i];
+    for (uint64_t r = c->row_base; r < c->row_base + c->data_rows; ++r) {
+      if (col->type == COL_F64)
+        ((double *)col->data)[r] = NAN;
+      else if (col->type == COL_FIXED)
+        ((int32_t *)col->data)[r] = INT32_MIN;
+      else if (col->type == COL_BOOL)
+        ((uint8_t *)col->data)[r] = MISSING_BOOL;
+      else
+        ((uint32_t *)col->data)[r] = MISSING_U32;
+    }
+  }
+
+  uint64_t *line_col = a->cols[COL_LINE].data;
+  uint32_t *cmd_col = a->cols[COL_CMD].data;
+  int open = c->entry_open;
+  uint64_t line = c->line_base;
+  uint64_t row = c->row_base;
+  uint64_t malformed = 0;
+
+  const char *p = c->begin;
+  const char *s, *e;
+  line_kind_t kind;
+  while (next_line(&p, c->end, &s, &e, &kind)) {
+    line++;
+    if (kind == LINE_OK) {
+      open = CMD_NONE;
+    } else if (kind == LINE_COMMAND) {
+      open = command_class(s, e, NULL);
+    } else if (kind == LINE_DATA) {
+      line_col[row] = line;
+      cmd_col[row] = open == CMD_NONE ? MISSING_U32 : (uint32_t)open;
+
+      const char *q = s + 5;
+      const char *k, *v;
+      uint32_t klen, vlen;
+      uint32_t pos = 0;
+      while (next_pair(&q, e, &k, &klen, &v, &vlen, &malformed)) {
+        column_t *col = &a->cols[c->key_column[chunk_key(c, pos++, k, klen)]];
+        int64_t m;
+        int frac;
+        switch (col->type) {
+        case COL_FIXED:
+          if (parse_decimal(v, vlen, &m, &frac))
+            ((int32_t *)col->data)[row] =
+                (int32_t)(m * (int64_t)POW10[col->decimals - frac]);
+          break;
+        case COL_F64:
+          ((double *)col->data)[row] = parse_decimal(v, vlen, &m, &frac)
+                                           ? (double)m / (double)POW10[frac]
+                                           : NAN;
+          break;
+        case COL_BOOL:
+          ((uint8_t *)col->data)[row] = (uint8_t)parse_bool(v, vlen);
+          break;
+        default: // local string id, remapped after the pass
+          ((uint32_t *)col->data)[row] = strtab_intern(&c->strings, v, vlen);
+          break;
+        }
+      }
+      row++;
+    }
+  }
+}
+
+// Local string ids -> global ones, for this chunk's rows.
+static void remap_strings(analysis_t *a, chunk_t *c) {
+  for (uint32_t i = COL_FIRST_KEY; i < a->col_count; ++i) {
+    column_t *col = &a->cols[i];
+    if (col->type != COL_STR)
+      continue;
+    uint32_t *cells = col->data;
+    for (uint64_t r = c->row_base; r < c->row_base + c->data_rows; ++r) {
+      if (cells[r] != MISSING_U32)
+        cells[r] = c->string_global[cells[r]];
+    }
+  }
+}
+
+static void merge_strings(analysis_t *a) {
+  for (int i = 0; i < a->chunk_count; ++i) {
+    chunk_t *c = &a->chunks[i];
+    c->string_global =
+        xrealloc(NULL, (c->strings.count + 1) * sizeof(uint32_t));
+    for (uint32_t s = 0; s < c->strings.count; ++s)
+      c->string_global[s] =
+          strtab_intern(&a->strings, c->strings.text[s], c->strings.len[s]);
+  }
+}
+
+// -------------------------
+// Output
+// -------------------------
+
+typedef struct buf {
+  char *p;
+  size_t len;
+  size_t cap;
+} buf_t;
+
+static void buf_reserve(buf_t *b, size_t n) {
+  if (b->len + n <= b->cap)
+    return;
+  b->cap = (b->cap + n) * 2;
+  b->p = xrealloc(b->p, b->cap);
+}
+
+static void buf_add(buf_t *b, const char *s, size_t n) {
+  buf_reserve(b, n);
+  memcpy(b->p + b->len, s, n);
+  b->len += n;
+}
+
+// CSV-quotes strings containing a comma or quote.
+static void buf_add_csv_str(buf_t *b, const char *s, size_t n) {
+  if (!memchr(s, ',', n) && !memchr(s, '"', n)) {
+    buf_add(b, s, n);
+    return;
+  }
+  buf_add(b, "\"", 1);
+  for (size_t i = 0; i < n; ++i) {
+    if (s[i] == '"')
+      buf_add(b, "\"", 1);
+    buf_add(b, &s[i], 1);
+  }
+  buf_add(b, "\"", 1);
+}
+
+static void format_csv(analysis_t *a, chunk_t *c) {
+  buf_t b = {0};
+  char num[32];
+  for (uint64_t r = c->row_base; r < c->row_base + c->data_rows; ++r) {
+    for (uint32_t i = 0; i < a->col_count; ++i) {
+      const column_t *col = &a->cols[i];
+      if (i)
+        buf_add(&b, ",", 1);
+      switch (col->type) {
+      case COL_U64: {
+        int n = snprintf(num, sizeof(num), "%llu",
+                         (unsigned long long)((uint64_t *)col->data)[r]);
+        buf_add(&b, num, (size_t)n);
+        break;
+      }
+      case COL_F64: {
+        double d = ((double *)col->data)[r];
+        if (!isnan(d)) {
+          int n = snprintf(num, sizeof(num), "%.15g", d);
+          buf_add(&b, num, (size_t)n);
+        }
+        break;
+      }
+      case COL_FIXED: {
+        int32_t v = ((int32_t *)col->data)[r];
+        if (v != INT32_MIN) {
+          int n = tcode_format_fixed(num, sizeof(num), v, col->decimals);
+          buf_add(&b, num, (size_t)n);
+        }
+        break;
+      }
+      case COL_BOOL: {
+        uint8_t v = ((uint8_t *)col->data)[r];
+        if (v != MISSING_BOOL)
+          buf_add(&b, v ? "true" : "false", v ? 4 : 5);
+        break;
+      }
+      case COL_STR: {
+        uint32_t id = ((uint32_t *)col->data)[r];
+        if (id != MISSING_U32)
+          buf_add_csv_str(&b, a->strings.text[id], a->strings.len[id]);
+        break;
+      }
+      }
+    }
+    buf_add(&b, "\n", 1);
+  }
+  c->csv = b.p;
+  c->csv_len = b.len;
+}
+
+static int write_csv(analysis_t *a, const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return 1;
+  }
+  for (uint32_t i = 0; i < a->col_count; ++i)
+    fprintf(f, "%s%.*s", i ? "," : "", (int)a->cols[i].name_len,
+            a->cols[i].name);
+  fputc('\n', f);
+  run_parallel(a, format_csv);
+  for (int i = 0; i < a->chunk_count; ++i) {
+    fwrite(a->chunks[i].csv, 1, a->chunks[i].csv_len, f);
+    free(a->chunks[i].csv);
+  }
+  return fclose(f) == 0 ? 0 : 1;
+}
+
+// Columnar binary file, host byte order:
+//   "TCOL", u32 version (1), u64 rows, u32 columns
+//   per column: u8 type, u8 decimals, u16 name length, name
+//   u32 strings, per string: u16 length, bytes
+//   per column: rows cells (u64, f64, u8, u32 or i32, see col_type_t)
+static int write_columns(analysis_t *a, const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return 1;
+  }
+  const uint32_t version = 1;
+  fwrite("TCOL", 1, 4, f);
+  fwrite(&version, 4, 1, f);
+  fwrite(&a->rows, 8, 1, f);
+  fwrite(&a->col_count, 4, 1, f);
+  for (uint32_t i = 0; i < a->col_count; ++i) {
+    const column_t *col = &a->cols[i];
+    uint8_t hdr[2] = {(uint8_t)col->type, col->decimals};
+    uint16_t len = (uint16_t)col->name_len;
+    fwrite(hdr, 1, 2, f);
+    fwrite(&len, 2, 1, f);
+    fwrite(col->name, 1, len, f);
+  }
+  fwrite(&a->strings.count, 4, 1, f);
+  for (uint32_t s = 0; s < a->strings.count; ++s) {
+    uint16_t len = (uint16_t)a->strings.len[s];
+    fwrite(&len, 2, 1, f);
+    fwrite(a->strings.text[s], 1, len, f);
+  }
+  for (uint32_t i = 0; i < a->col_count; ++i)
+    fwrite(a->cols[i].data, COL_SIZE[a->cols[i].type], a->rows, f);
+  return fclose(f) == 0 ? 0 : 1;
+}
+
+static void print_summary(const analysis_t *a, double wall_s) {
+  uint64_t sent = 0, ok = 0, errors = 0, unanswered = 0;
+  for (int k = 0; k < CMD_CLASSES; ++k) {
+    sent += a->cmd[k].sent;
+    ok += a->cmd[k].ok;
+    errors += a->cmd[k].errors;
+    unanswered += a->cmd[k].unanswered;
+  }
+  printf("bytes=%zu lines=%llu chunks=%d threads=%d wall=%.3fs "
+         "throughput=%.0fMB/s\n",
+         a->size, (unsigned long long)a->lines, a->chunk_count, a->threads,
+         wall_s, wall_s > 0 ? (double)a->size / wall_s / 1e6 : 0.0);
+  printf("commands=%llu ok=%llu errors=%llu unanswered=%llu orphans=%llu "
+         "keepalives=%llu checksum_errors=%llu parse_errors=%llu "
+         "overflows=%llu\n",
+         (unsigned long long)sent, (unsigned long long)ok,
+         (unsigned long long)errors, (unsigned long long)unanswered,
+         (unsigned long long)a->orphans, (unsigned long long)a->keepalives,
+         (unsigned long long)a->line_stats.checksum_errors,
+         (unsigned long long)a->line_stats.parse_errors,
+         (unsigned long long)a->line_stats.overflows);
+  printf("%-6s %12s %12s %10s %12s %10s\n", "cmd", "sent", "ok", "errors",
+         "data", "unanswered");
+  for (int k = 0; k < CMD_CLASSES; ++k) {
+    const cmd_counts_t *c = &a->cmd[k];
+    if (c->sent == 0)
+      continue;
+    printf("%-6s %12llu %12llu %10llu %12llu %10llu\n", class_name(k),
+           (unsigned long long)c->sent, (unsigned long long)c->ok,
+           (unsigned long long)c->errors, (unsigned long long)c->data,
+           (unsigned long long)c->unanswered);
+  }
+  printf("data_rows=%llu keys=%u malformed=%llu\n",
+         (unsigned long long)a->rows, a->keys.count,
+         (unsigned long long)a->malformed);
+}
+
+// -------------------------
+// Synthetic log
+// -------------------------
+
+// A chamber session as the host sees it: mostly Q0 polls, setpoint changes
+// with checksums, keepalives, the odd Q2 and a corrupted line now and then.
+static int generate(const char *path, double megabytes) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return 1;
+  }
+  const uint64_t target = (uint64_t)(megabytes * 1e6);
+  uint64_t written = 0;
+  uint32_t seed = 12345;
+  float temp = 22.0f, setpoint = -10.0f;
+  char line[256];
+  for (uint64_t i = 0; written < target; ++i) {
+    int n = 0;
+    seed = seed * 1103515245u + 12345u;
+    int noise = (int)((seed >> 16) % 21) - 10;
+    temp += (setpoint - temp) * 0.01f + (float)noise * 0.01f;
+
+    if (i % 50 == 0) {
+      char body[64];
+      setpoint = (float)((int)((seed >> 8) % 120) - 40);
+      snprintf(body, sizeof(body), "N%llu T%.1f", (unsigned long long)i,
+               (double)setpoint);
+      n += fprintf(f, "%s*%02X\nok\n", body, tcode_checksum_xor(body));
+    }
+    if (i % 997 == 0) {
+      char body[64];
+      snprintf(body, sizeof(body), "N%llu T20", (unsigned long long)i);
+      uint8_t good = tcode_checksum_xor(body);
+      uint8_t bad = good ^ 0x5A;
+      n += fprintf(f, "%s*%02X\nERROR: Wrong checksum! (got %02X, expected "
+                      "%02X)\nok\n",
+                   body, bad, bad, good);
+    }
+    if (i % 500 == 0)
+      n += fprintf(f, "Q2\ndata: UPTIME_US=%llu HEAP_TOTAL=65536 "
+                      "HEAP_FREE=48200 HEAP_MIN=48112 SWITCHES=%llu TASKS=2\n"
+                      "data: TASK=serial PRIO=2 CPU=0.8 STACK_HWM=790 "
+                      "SWITCHES=130\ndata: TASK=IDLE PRIO=0 CPU=99.0 "
+                      "STACK_HWM=230 SWITCHES=702\nok\n",
+                   (unsigned long long)i * 100000u,
+                   (unsigned long long)i * 7u);
+    if (i % 10 == 0)
+      n += fprintf(f, ".\n");
+
+    bool heat = temp < setpoint;
+    snprintf(line, sizeof(line),
+             "Q0\ndata: TEMP=%.1f RH=%.1f HEAT=%s COOL=%s STATE=RUN "
+             "SET_TEMP=%.1f SET_RH=0.0 ALARM=0\nok\n",
+             (double)temp, 45.0, heat ? "true" : "false",
+             heat ? "false" : "true", (double)setpoint);
+    n += fputs(line, f) >= 0 ? (int)strlen(line) : 0;
+    written += (uint64_t)n;
+  }
+  return fclose(f) == 0 ? 0 : 1;
+}
+
+// -------------------------
+// main
+// -------------------------
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-j threads] [-o out.tcol] [-c out.csv] session.log\n"
+          "       %s -G out.log [-S megabytes]\n",
+          argv0, argv0);
+}
+
+int main(int argc, char **argv) {
+  int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  const char *col_path = NULL;
+  const char *csv_path = NULL;
+  const char *gen_path = NULL;
+  double gen_mb = 100.0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "j:o:c:G:S:h")) != -1) {
+    switch (opt) {
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 'o':
+      col_path = optarg;
+      break;
+    case 'c':
+      csv_path = optarg;
+      break;
+    case 'G':
+      gen_path = optarg;
+      break;
+    case 'S':
+      gen_mb = atof(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (gen_path)
+    return generate(gen_path, gen_mb);
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 2;
+  }
+  const char *path = argv[optind];
+
+  analysis_t a;
+  memset(&a, 0, sizeof(a));
+  a.threads = threads > 0 ? threads : 1;
+
+  double start = now_s();
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return 1;
+  }
+  a.size = (size_t)st.st_size;
+  if (a.size > 0) {
+    void *map = mmap(NULL, a.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      fprintf(stderr, "%s: mmap: %s\n", path, strerror(errno));
+      return 1;
+    }
+    madvise(map, a.size, MADV_WILLNEED);
+    a.map = map;
+  }
+  close(fd);
+
+  make_chunks(&a);
+  run_parallel(&a, pass1);
+  stitch(&a);
+
+  int rc = 0;
+  if (col_path || csv_path) {
+    alloc_columns(&a);
+    run_parallel(&a, pass2);
+    merge_strings(&a);
+    run_parallel(&a, remap_strings);
+    if (col_path)
+      rc |= write_columns(&a, col_path);
+    if (csv_path)
+      rc |= write_csv(&a, csv_path);
+  }
+  print_summary(&a, now_s() - start);
+
+  for (int i = 0; i < a.chunk_count; ++i) {
+    strtab_free(&a.chunks[i].keys);
+    free(a.chunks[i].key_stats);
+    strtab_free(&a.chunks[i].strings);
+    free(a.chunks[i].key_column);
+    free(a.chunks[i].string_global);
+  }
+  for (uint32_t i = 0; i < a.col_count; ++i)
+    free(a.cols[i].data);
+  free(a.cols);
+  free(a.chunks);
+  strtab_free(&a.keys);
+  free(a.key_stats);
+  strtab_free(&a.strings);
+  if (a.map)
+    munmap((void *)a.map, a.size);
+  return rc;
+}
@@ -0,0 +1,52 @@
+cmake_minimum_required(VERSION 3.13)
+
+# Analyzes one log on one thread and on THREADS threads, which splits it into
+# different chunks, and checks that both give byte-identical CSV, columns and
+# summary, and that the summary's counts line is EXPECT.
+#
+# Inputs (passed via -D):
+# - ANALYZER: tcode_log_analyzer
+# - LOG: the session log
+# - THREADS
+# - EXPECT: the summary's commands=... line
+
+foreach(_var ANALYZER LOG THREADS EXPECT)
+  if(NOT DEFINED ${_var} OR "${${_var}}" STREQUAL "")
+    message(FATAL_ERROR "${_var} not set")
+  endif()
+endforeach()
+
+foreach(_j 1 ${THREADS})
+  execute_process(
+    COMMAND "${ANALYZER}" -j ${_j} -c "j${_j}.csv" -o "j${_j}.tcol" "${LOG}"
+    OUTPUT_VARIABLE _out
+    RESULT_VARIABLE _res
+  )
+  if(NOT _res EQUAL 0)
+    message(FATAL_ERROR "-j ${_j} failed (${_res}):\n${_out}")
+  endif()
+  # The first line has the chunk and thread counts and the timing.
+  string(FIND "${_out}" "\n" _nl)
+  string(SUBSTRING "${_out}" 0 ${_nl} _head)
+  math(EXPR _nl "${_nl} + 1")
+  string(SUBSTRING "${_out}" ${_nl} -1 _summary_${_j})
+  message(STATUS "-j ${_j}: ${_head}")
+endforeach()
+
+if(NOT _summary_1 STREQUAL _summary_${THREADS})
+  message(FATAL_ERROR "summaries differ\n-j 1:\n${_summary_1}\n"
+                      "-j ${THREADS}:\n${_summary_${THREADS}}")
+endif()
+foreach(_ext csv tcol)
+  file(SHA256 "j1.${_ext}" _a)
+  file(SHA256 "j${THREADS}.${_ext}" _b)
+  if(NOT _a STREQUAL _b)
+    message(FATAL_ERROR "j1.${_ext} and j${THREADS}.${_ext} differ")
+  endif()
+endforeach()
+
+string(FIND "${_summary_1}" "\n" _nl)
+string(SUBSTRING "${_summary_1}" 0 ${_nl} _counts)
+if(NOT _counts STREQUAL EXPECT)
+  message(FATAL_ERROR "counts\n  got:  ${_counts}\n  want: ${EXPECT}")
+endif()
@@ -0,0 +1,538 @@
+// Event journal recorder and replayer.
+//
+// The firmware records every input and tick of its simulator in a binary
+// journal (see thermo_system.h and event_journal.h), drained with Q6. This
+// tool replays such a journal through the same code (thermo_system, built
+// for the host) as fast as the host allows, and checks the replayed state
+// against the checkpoints in the journal. Exits 1 on any divergence, so it
+// can drive `git bisect run`. A journal that does not go back to boot (the
+// ring wrapped before it was read) replays from its oldest whole checkpoint.
+//
+// The journal is a journal file (-o of this tool) or a serial capture that
+// contains the Q6 `data: J=<hex>` lines. -G records a synthetic session
+// (random setpoint and controller changes, ticked like the firmware's sim
+// task) into a journal file, with -R only what a firmware-sized ring still
+// holds at the end; -B times journal appends.
+
+#include "event_journal.h"
+#include "thermo_system.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TICK_RATE_HZ 1000u // matches configTICK_RATE_HZ
+#define JOURNAL_MAGIC "TJNL"
+#define JOURNAL_VERSION 2u
+
+// The firmware's configuration (thermo_system_bench_config), set in main().
+static thermo_system_config_t g_config;
+
+// Its sim task periods (at 1 kHz, ms are ticks).
+#define UPDATE_PERIOD_TICKS THERMO_SYSTEM_BENCH_UPDATE_MS
+#define IDLE_PERIOD_TICKS THERMO_SYSTEM_BENCH_IDLE_UPDATE_MS
+#define CONTROL_PERIOD_TICKS THERMO_SYSTEM_BENCH_CONTROL_MS
+#define CHECKPOINT_TICKS THERMO_SYSTEM_BENCH_CHECKPOINT_MS
+
+// Alarms are not reported here; empty the zones' event queues.
+static void drop_alarm_events(thermo_system_t *sys) {
+  alarm_event_t ev;
+  while (thermo_system_pop_alarm_event(sys, NULL, &ev))
+    ;
+}
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// -----------------------------------------
+// Journal files: a RAM ring drained to disk
+// -----------------------------------------
+
+typedef struct journal_file {
+  event_journal_t ring;
+  event_journal_cursor_t cur;
+  FILE *f;
+  uint64_t records;
+  uint64_t bytes;
+  uint32_t first_tick, last_tick; // of the records written
+} journal_file_t;
+
+static uint32_t g_file_ring[(64u << 10) / sizeof(uint32_t)];
+
+// `ring_bytes` (a power of two, 0 = the whole buffer) sizes the ring.
+static bool journal_file_open(journal_file_t *jf, const char *path,
+                              uint32_t ring_bytes) {
+  memset(jf, 0, sizeof(*jf));
+  jf->f = fopen(path, "wb");
+  if (!jf->f) {
+    perror(path);
+    return false;
+  }
+  uint32_t version = JOURNAL_VERSION;
+  fwrite(JOURNAL_MAGIC, 1, 4, jf->f);
+  fwrite(&version, sizeof(version), 1, jf->f);
+  if (!ring_bytes || ring_bytes > sizeof(g_file_ring))
+    ring_bytes = sizeof(g_file_ring);
+  if (!event_journal_init(&jf->ring, g_file_ring, ring_bytes)) {
+    fprintf(stderr, "invalid ring size %u\n", (unsigned)ring_bytes);
+    fclose(jf->f);
+    return false;
+  }
+  event_journal_cursor_init(&jf->ring, &jf->cur);
+  return true;
+}
+
+// Writes out the records appended since the last call.
+static void journal_file_drain(journal_file_t *jf) {
+  event_journal_record_t rec;
+  uint8_t buf[EVENT_JOURNAL_MAX_RECORD];
+  while (event_journal_next(&jf->ring, &jf->cur, &rec)) {
+    size_t n = event_journal_export(&rec, buf, sizeof(buf));
+    fwrite(buf, 1, n, jf->f);
+    if (!jf->records)
+      jf->first_tick = rec.hdr.tick;
+    jf->last_tick = rec.hdr.tick;
+    jf->records++;
+    jf->bytes += n;
+  }
+}
+
+// With `wrapped`, records the ring dropped before they were written are
+// expected.
+static bool journal_file_close(journal_file_t *jf, bool wrapped) {
+  journal_file_drain(jf);
+  bool ok = !ferror(jf->f) && (wrapped || jf->cur.lost == 0);
+  return fclose(jf->f) == 0 && ok;
+}
+
+// ------------------------------------
+// Loading: journal file or Q6 capture
+// ------------------------------------
+
+static int hex_digit(int c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  c = toupper(c);
+  return c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+}
+
+// Reads `path` into `*out` as exported records back to back.
+static bool load_journal(const char *path, uint8_t **out, size_t *out_len) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  size_t cap = 1u << 20, len = 0;
+  uint8_t *data = malloc(cap);
+  size_t n;
+  while (data && (n = fread(data + len, 1, cap - len, f)) > 0) {
+    len += n;
+    if (len == cap)
+      data = realloc(data, cap *= 2);
+  }
+  fclose(f);
+  if (!data)
+    return false;
+
+  if (len >= 8 && memcmp(data, JOURNAL_MAGIC, 4) == 0) {
+    uint32_t version;
+    memcpy(&version, data + 4, sizeof(version));
+    if (version != JOURNAL_VERSION) {
+      fprintf(stderr, "%s: journal version %u, expected %u\n", path,
+              (unsigned)version, JOURNAL_VERSION);
+      free(data);
+      return false;
+    }
+    memmove(data, data + 8, len - 8);
+    *out = data;
+    *out_len = len - 8;
+    return true;
+  }
+
+  // A capture: decode the hex of every "J=" field in place (the output
+  // never overtakes the input).
+  size_t w = 0;
+  for (size_t i = 0; i + 1 < len; ++i) {
+    if (data[i] != 'J' || data[i + 1] != '=' ||
+        (i > 0 && !isspace(data[i - 1])))
+      continue;
+    for (i += 2; i + 1 < len; i += 2) {
+      int hi = hex_digit(data[i]), lo = hex_digit(data[i + 1]);
+      if (hi < 0 || lo < 0)
+        break;
+      data[w++] = (uint8_t)(hi << 4 | lo);
+    }
+  }
+  *out = data;
+  *out_len = w;
+  return true;
+}
+
+// ---------
+// Replay
+// ---------
+
+typedef struct replay_options {
+  float tolerance; // allowed |difference| in degC and %RH
+  bool verbose;
+  const char *out_path;
+} replay_options_t;
+
+// Compares the replayed state with a recorded checkpoint. Prints the
+// differences when `report` is set; returns true if they match.
+static bool check(const thermo_system_t *sys, const event_journal_record_t *rec,
+                  float tol, bool report) {
+  thermo_system_checkpoint_t want, got;
+  if (!thermo_system_decode_checkpoint(rec, &want)) {
+    if (report)
+      printf("tick %u: malformed checkpoint\n", (unsigned)rec->hdr.tick);
+    return false;
+  }
+  thermo_system_checkpoint(sys, &got);
+  bool ok = want.zone_count == got.zone_count &&
+            want.alarm_code == got.alarm_code &&
+            want.fault_latched == got.fault_latched;
+  if (!ok && report)
+    printf("tick %u: zones %u/%u alarm %u/%u fault %d/%d (recorded/replayed)\n",
+           (unsigned)rec->hdr.tick, want.zone_count, got.zone_count,
+           want.alarm_code, got.alarm_code, want.fault_latched,
+           got.fault_latched);
+  for (uint8_t z = 0; z < want.zone_count && z < got.zone_count; ++z) {
+    float dt = fabsf(want.zone[z].temperature_c - got.zone[z].temperature_c);
+    float dh = fabsf(want.zone[z].humidity - got.zone[z].humidity);
+    if (dt <= tol && dh <= tol && want.zone[z].mode == got.zone[z].mode)
+      continue;
+    ok = false;
+    if (report)
+      printf("tick %u zone %u: temp %.4f/%.4f rh %.4f/%.4f mode %d/%d "
+             "(recorded/replayed)\n",
+             (unsigned)rec->hdr.tick, z, want.zone[z].temperature_c,
+             got.zone[z].temperature_c, want.zone[z].humidity,
+             got.zone[z].humidity, want.zone[z].mode, got.zone[z].mode);
+  }
+  return ok;
+}
+
+static int replay(const char *path, const replay_options_t *opt) {
+  uint8_t *data;
+  size_t len;
+  if (!load_journal(path, &data, &len))
+    return 2;
+
+  static thermo_system_t sys;
+  static journal_file_t out;
+  if (opt->out_path && !journal_file_open(&out, opt->out_path, 0)) {
+    free(data);
+    return 2;
+  }
+
+  // Until an INIT, the first whole checkpoint is where the replay starts.
+  static uint8_t state[1u << 16];
+  thermo_system_restore_t restore;
+  bool restoring = false, restored = false;
+
+  bool started = false;
+  uint64_t records = 0, steps = 0, lost = 0, unknown = 0;
+  uint64_t checkpoints = 0, diverged = 0;
+  uint32_t first_tick = 0, last_tick = 0, diverged_at = 0;
+  uint16_t next_seq = 0;
+  double wall_start = now_s();
+
+  event_journal_record_t rec;
+  size_t n;
+  for (size_t pos = 0; (n = event_journal_import(data + pos, len - pos, &rec));
+       pos += n) {
+    if (records++ && rec.hdr.seq != next_seq) {
+      uint16_t gap = (uint16_t)(rec.hdr.seq - next_seq);
+      lost += gap;
+      printf("seq %u: %u records missing\n", (unsigned)next_seq,
+             (unsigned)gap);
+    }
+    next_seq = (uint16_t)(rec.hdr.seq + 1u);
+
+    if (rec.hdr.type == THERMO_SYSTEM_REC_INIT) {
+      thermo_system_init_record_t init;
+      if (!thermo_system_decode_init(&rec, &init)) {
+        fprintf(stderr, "seq %u: malformed INIT\n", (unsigned)rec.hdr.seq);
+        break;
+      }
+      if (started)
+        thermo_system_flush_journal(&sys); // the run before the reboot
+      g_config.zone_count = init.zone_count;
+      g_config.controller = init.controller;
+      g_config.setpoint_c = init.setpoint_c;
+      g_config.setpoint_rh = init.setpoint_rh;
+      if (!thermo_system_init(&sys, &g_config, init.initial_c,
+                              init.initial_mode)) {
+        fprintf(stderr, "invalid simulator config\n");
+        break;
+      }
+      sys.now_ticks = rec.hdr.tick;
+      if (opt->out_path)
+        thermo_system_attach_journal(&sys, &out.ring, CHECKPOINT_TICKS);
+      if (!started)
+        first_tick = rec.hdr.tick;
+      started = true;
+      continue;
+    }
+    if (!started) {
+      int r = restoring ? thermo_system_restore_add(&restore, &rec) : -1;
+      if (r < 0)
+        restoring = thermo_system_restore_begin(&restore, state,
+                                                sizeof(state), &rec);
+      if (r <= 0)
+        continue;
+      restoring = false;
+      g_config.zone_count = restore.zone_count;
+      if (!thermo_system_restore(&sys, &g_config, &restore)) {
+        fprintf(stderr, "seq %u: checkpoint does not fit the simulator "
+                        "config\n",
+                (unsigned)rec.hdr.seq);
+        continue;
+      }
+      if (opt->out_path)
+        thermo_system_attach_journal(&sys, &out.ring, CHECKPOINT_TICKS);
+      first_tick = restore.tick;
+      started = restored = true;
+      continue;
+    }
+
+    last_tick = rec.hdr.tick;
+    if (rec.hdr.type == THERMO_SYSTEM_REC_CHECKPOINT) {
+      checkpoints++;
+      bool report = opt->verbose || diverged == 0;
+      if (!check(&sys, &rec, opt->tolerance, report) && diverged++ == 0)
+        diverged_at = rec.hdr.tick;
+    } else if (rec.hdr.type == THERMO_SYSTEM_REC_CHECKPOINT_STATE) {
+      // Only needed to start from.
+    } else if (thermo_system_replay(&sys, &rec)) {
+      if (rec.hdr.type == THERMO_SYSTEM_REC_STEP)
+        steps += (uint64_t)(rec.payload[0] | rec.payload[1] << 8);
+      drop_alarm_events(&sys);
+    } else {
+      unknown++;
+    }
+    if (opt->out_path)
+      journal_file_drain(&out);
+  }
+  double wall_s = now_s() - wall_start;
+  free(data);
+
+  if (!started) {
+    fprintf(stderr, "%s: no INIT record and no whole checkpoint to start "
+                    "from\n",
+            path);
+    return 2;
+  }
+  if (started)
+    thermo_system_flush_journal(&sys);
+  if (opt->out_path && !journal_file_close(&out, false)) {
+    fprintf(stderr, "%s: write failed\n", opt->out_path);
+    return 2;
+  }
+
+  double sim_s = (double)(uint32_t)(last_tick - first_tick) / TICK_RATE_HZ;
+  if (restored)
+    printf("started from the checkpoint at tick %u\n", (unsigned)first_tick);
+  printf("records=%llu steps=%llu lost=%llu unknown=%llu\n",
+         (unsigned long long)records, (unsigned long long)steps,
+         (unsigned long long)lost, (unsigned long long)unknown);
+  printf("simulated=%.0fs wall=%.3fs speedup=%.0fx\n", sim_s, wall_s,
+         wall_s > 0 ? sim_s / wall_s : 0.0);
+  printf("checkpoints=%llu diverged=%llu", (unsigned long long)checkpoints,
+         (unsigned long long)diverged);
+  if (diverged)
+    printf(" first_divergence_tick=%u", (unsigned)diverged_at);
+  printf("\n");
+  return diverged || lost ? 1 : 0;
+}
+
+// ----------------------------
+// -G: record a synthetic session
+// ----------------------------
+
+static uint64_t g_rng = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rng_next(void) {
+  g_rng ^= g_rng << 13;
+  g_rng ^= g_rng >> 7;
+  g_rng ^= g_rng << 17;
+  return (uint32_t)(g_rng >> 32);
+}
+
+static float rng_range(float lo, float hi) {
+  return lo + (hi - lo) * (float)(rng_next() & 0xFFFFFF) / (float)0x1000000;
+}
+
+// What an operator might send: mostly setpoint lines for a few zones, now
+// and then a controller switch, a gains change or a fault clear.
+static void random_command(thermo_system_t *sys) {
+  uint32_t r = rng_next() % 100;
+  if (r < 80) {
+    thermo_system_setpoint_t sp[THERMO_SYSTEM_MAX_ZONES];
+    memcpy(sp, sys->setpoints, sizeof(sp));
+    int groups = 1 + (int)(rng_next() % 4);
+    for (int i = 0; i < groups; ++i) {
+      thermo_system_setpoint_t *s = &sp[rng_next() % sys->zone_count];
+      s->temperature_c = (float)(int)rng_range(-20.0f, 60.0f);
+      if (rng_next() & 1)
+        s->humidity = (float)(int)rng_range(20.0f, 90.0f);
+    }
+    thermo_system_set_setpoints(sys, sp);
+  } else if (r < 92) {
+    thermo_system_set_controller(sys, (thermo_system_ctrl_t)(rng_next() % 3));
+  } else if (r < 96) {
+    thermo_pid_gains_t g = sys->pid.gains;
+    g.kp = Q16_FROM_FLOAT(rng_range(0.5f, 2.0f));
+    thermo_system_set_pid_gains(sys, &g);
+  } else {
+    thermo_system_clear_fault(sys);
+  }
+}
+
+static int generate(double hours, int zones, const char *out_path,
+                    uint32_t ring_bytes) {
+  static thermo_system_t sys;
+  static journal_file_t out;
+  g_config.zone_count = (uint8_t)zones;
+  if (!thermo_system_init(&sys, &g_config, g_config.sim.ambient_temp_c,
+                          THERMO_SIM_MODE_IDLE)) {
+    fprintf(stderr, "invalid simulator config\n");
+    return 2;
+  }
+  if (!journal_file_open(&out, out_path, ring_bytes))
+    return 2;
+  thermo_system_attach_journal(&sys, &out.ring, CHECKPOINT_TICKS);
+
+  const uint32_t end = (uint32_t)(hours * 3600.0 * TICK_RATE_HZ);
+  uint32_t now = 0, period = UPDATE_PERIOD_TICKS;
+  uint32_t next_cmd = 60u * TICK_RATE_HZ;
+  uint64_t steps = 0;
+  double wall_start = now_s();
+  while (now < end) {
+    now += period;
+    if (now >= next_cmd) {
+      random_command(&sys);
+      next_cmd = now + (uint32_t)rng_range(60.0f, 1200.0f) * TICK_RATE_HZ;
+    }
+    thermo_system_step(&sys, now, (float)period / (float)TICK_RATE_HZ);
+    drop_alarm_events(&sys);
+    steps++;
+    if (!ring_bytes)
+      journal_file_drain(&out);
+
+    period = thermo_system_next_period(&sys, UPDATE_PERIOD_TICKS,
+                                       IDLE_PERIOD_TICKS,
+                                       CONTROL_PERIOD_TICKS);
+  }
+  double wall_s = now_s() - wall_start;
+  thermo_system_flush_journal(&sys);
+  uint32_t dropped = out.ring.dropped;
+  if (!journal_file_close(&out, ring_bytes != 0)) {
+    fprintf(stderr, "%s: write failed\n", out_path);
+    return 2;
+  }
+  // The rate is over what the file covers: with -R, the ring's last stretch.
+  double span_s = (double)(out.last_tick - out.first_tick) / TICK_RATE_HZ;
+  if (ring_bytes)
+    printf("ring=%u dropped=%u holds=%.0fs ", (unsigned)ring_bytes,
+           (unsigned)dropped, span_s);
+  printf("zones=%d simulated=%.0fs steps=%llu records=%llu bytes=%llu "
+         "(%.1f bytes/s) wall=%.3fs\n",
+         zones, (double)end / TICK_RATE_HZ, (unsigned long long)steps,
+         (unsigned long long)out.records, (unsigned long long)out.bytes,
+         span_s > 0 ? (double)out.bytes / span_s : 0.0, wall_s);
+  return 0;
+}
+
+// -B: cost of one append (a STEP record) into a firmware-sized ring.
+static int bench(void) {
+  static uint32_t buf[16384 / sizeof(uint32_t)];
+  event_journal_t j;
+  event_journal_init(&j, buf, sizeof(buf));
+  const uint32_t n = 20000000;
+  uint8_t step[10] = {1, 0, 100, 0, 0, 0, 0xCD, 0xCC, 0xCC, 0x3D};
+  double t0 = now_s();
+  for (uint32_t i = 0; i < n; ++i)
+    event_journal_append(&j, THERMO_SYSTEM_REC_STEP, i, step, sizeof(step));
+  double wall_s = now_s() - t0;
+  printf("appends=%u ns_per_append=%.2f dropped=%u\n", (unsigned)n,
+         wall_s * 1e9 / n, (unsigned)j.dropped);
+  return 0;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-t tolerance] [-o out.tjl] [-v] journal\n"
+          "       %s -G hours [-z zones] [-S seed] [-R ring_bytes] "
+          "-o out.tjl\n"
+          "       %s -B\n",
+          argv0, argv0, argv0);
+}
+
+int main(int argc, char **argv) {
+  replay_options_t ropt = {0};
+  double gen_hours = 0.0;
+  int zones = THERMO_SYSTEM_MAX_ZONES;
+  uint32_t ring_bytes = 0;
+  bool do_bench = false;
+  thermo_system_bench_config(&g_config, TICK_RATE_HZ);
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:o:vG:z:S:R:Bh")) != -1) {
+    switch (opt) {
+    case 't':
+      ropt.tolerance = strtof(optarg, NULL);
+      break;
+    case 'o':
+      ropt.out_path = optarg;
+      break;
+    case 'v':
+      ropt.verbose = true;
+      break;
+    case 'G':
+      gen_hours = strtod(optarg, NULL);
+      break;
+    case 'z':
+      zones = atoi(optarg);
+      break;
+    case 'S':
+      g_rng = strtoull(optarg, NULL, 0) | 1u;
+      break;
+    case 'R':
+      ring_bytes = (uint32_t)strtoul(optarg, NULL, 0);
+      break;
+    case 'B':
+      do_bench = true;
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 2;
+    }
+  }
+
+  if (do_bench)
+    return bench();
+  if (gen_hours > 0.0) {
+    if (!ropt.out_path || zones < 1 || zones > THERMO_SYSTEM_MAX_ZONES) {
+      usage(argv[0]);
+      return 2;
+    }
+    return generate(gen_hours, zones, ropt.out_path, ring_bytes);
+  }
+  if (optind != argc - 1 || ropt.tolerance < 0.0f) {
+    usage(argv[0]);
+    return 2;
+  }
+  return replay(argv[optind], &ropt);
+}
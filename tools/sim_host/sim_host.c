@@ -0,0 +1,906 @@
+// Accelerated-time host runner for the simulator core.
+//
+// Steps thermo_sim (the same code the firmware's sim task runs) as fast as the
+// host allows and reports how the chamber responded and how much faster than
+// real time it ran.
+//
+// -C selects the controller (hysteresis, PID, or relay autotune followed by
+// PID with the tuned gains); -B runs a fixed setpoint-step scenario with each
+// of them and compares settling time, overshoot and actuator cycling.
+// The firmware's alarm rules run alongside, so false alarms show up too;
+// -A times the rule engine alone as the rule count grows. Each zone also
+// drives one pixel of a status strip on the mock PIO/DMA backend, like the
+// firmware's status pixel.
+//
+// Readings come through the firmware's simulated probes and filters
+// (sensor_pipeline); -N reports the plant's exact values instead. -F checks
+// the filters, compares the chamber on clean, raw and filtered readings,
+// and times each filter per sample.
+
+#include "alarm_rules.h"
+#include "neopixel_mock.h"
+#include "neopixel_strip.h"
+#include "sensor_pipeline.h"
+#include "thermo_control.h"
+#include "thermo_sim.h"
+#include "thermo_system.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#define TICK_RATE_HZ 1000u // matches configTICK_RATE_HZ
+#define MAX_ZONES 64
+
+typedef enum ctrl_kind {
+  CTRL_HYST = 0,
+  CTRL_PID,
+  CTRL_TUNE, // relay autotune, then PID with the tuned gains
+} ctrl_kind_t;
+
+static const char *const CTRL_NAMES[] = {"hyst", "pid", "tune"};
+
+typedef struct zone {
+  thermo_sim_t sim;
+  ctrl_kind_t ctrl;
+  thermo_pid_t pid;
+  thermo_autotune_t tune;
+  alarm_rules_t alarms;
+} zone_t;
+
+// The firmware's configuration (thermo_system_bench_config), set in main().
+static thermo_system_config_t g_bench;
+
+static thermo_sim_config_t default_config(bool use_rc_model, bool use_sensor) {
+  thermo_sim_config_t cfg = g_bench.sim;
+  if (!use_rc_model)
+    cfg.model = NULL;
+  if (!use_sensor)
+    cfg.sensor = NULL;
+  return cfg;
+}
+
+// The firmware's; -g, -w and -O override the gains, the proportioning window
+// and the anti-short-cycle lockouts.
+static thermo_pid_config_t g_pid_config;
+
+#define ALARM_RULES THERMO_SYSTEM_BENCH_ALARM_RULES
+#define ALARM_RULE_COUNT ((int)THERMO_SYSTEM_BENCH_ALARM_RULE_COUNT)
+
+static void zone_set_controller(zone_t *z, ctrl_kind_t kind) {
+  z->ctrl = kind;
+  switch (kind) {
+  case CTRL_PID:
+    thermo_pid_init(&z->pid, &g_pid_config);
+    thermo_sim_set_controller(&z->sim, &THERMO_PID_OPS, &z->pid);
+    break;
+  case CTRL_TUNE:
+    thermo_autotune_init(&z->tune, &g_bench.autotune);
+    thermo_sim_set_controller(&z->sim, &THERMO_AUTOTUNE_OPS, &z->tune);
+    break;
+  default:
+    thermo_sim_set_controller(&z->sim, NULL, NULL);
+    break;
+  }
+}
+
+// Once autotune finishes, hand over to PID with the measured gains (like the
+// firmware does). Returns true on the step where that happened.
+static bool zone_after_step(zone_t *z) {
+  if (z->ctrl != CTRL_TUNE || !thermo_autotune_finished(&z->tune))
+    return false;
+  zone_set_controller(z, CTRL_PID);
+  if (z->tune.state == THERMO_AUTOTUNE_DONE)
+    thermo_pid_set_gains(&z->pid, &z->tune.gains);
+  return true;
+}
+
+static bool parse_ctrl(const char *s, ctrl_kind_t *out) {
+  for (int i = 0; i < 3; ++i) {
+    if (strcmp(s, CTRL_NAMES[i]) == 0) {
+      *out = (ctrl_kind_t)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// One setpoint step of a scenario and what zone 0 did during it.
+typedef struct step_result {
+  float setpoint;
+  double duration_s;
+  double settle_s; // last time outside the band, relative to the step
+  float overshoot; // worst excursion past the setpoint, in degC
+  float mean_abs_err; // over the second half of the step
+  uint32_t heat_cycles;
+  uint32_t cool_cycles;
+  uint32_t alarms; // raised during the step
+} step_result_t;
+
+typedef struct run_options {
+  const thermo_sim_config_t *cfg;
+  ctrl_kind_t ctrl;
+  uint32_t tick_ms;
+  int zones;
+  float band_c; // settling band around the setpoint
+  FILE *csv;
+  double csv_interval_s;
+  bool verbose;
+} run_options_t;
+
+typedef struct run_result {
+  neopixel_mock_t strip_backend;
+  neopixel_strip_stats_t strip;
+  double sim_s;
+  double wall_s;
+  uint64_t zone_ticks;
+  float min_temp;
+  float max_temp;
+  float final_temp;
+} run_result_t;
+
+// Status pixel colours by mode, as in main.c.
+static const uint8_t STATUS_COLORS[3][3] = {
+    {2, 2, 2},  // idle
+    {16, 2, 0}, // heat
+    {0, 2, 16}, // cool
+};
+
+// Runs the alarm rules like the firmware's sim task, including turning the
+// actuators off on a fault. Counts (and optionally prints) raised alarms.
+static void zone_eval_alarms(zone_t *z, uint32_t now_ticks, float sp,
+                             step_result_t *r, bool verbose) {
+  alarm_inputs_t in = {
+      .now_ms = (uint32_t)((uint64_t)now_ticks * 1000u / TICK_RATE_HZ),
+      .temperature_c = thermo_sim_probe_temperature(&z->sim),
+      .humidity = thermo_sim_probe_humidity(&z->sim),
+      .setpoint_c = sp,
+      .heater_on = z->sim.mode == THERMO_SIM_MODE_HEAT,
+      .cooler_on = z->sim.mode == THERMO_SIM_MODE_COOL,
+  };
+  alarm_rules_eval(&z->alarms, &in);
+  alarm_event_t ev;
+  while (alarm_rules_pop_event(&z->alarms, &ev)) {
+    if (!ev.raised || !r)
+      continue;
+    r->alarms++;
+    if (verbose) {
+      const alarm_rule_spec_t *spec = alarm_rules_spec(&z->alarms, ev.rule);
+      printf("alarm %u %s at %.1fs, temp=%.2f\n", (unsigned)spec->code,
+             spec->name, in.now_ms / 1000.0, in.temperature_c);
+    }
+  }
+  z->sim.inhibit = z->alarms.fault_latched;
+}
+
+// Runs `nsteps` setpoint steps back to back from ambient.
+static bool run(const run_options_t *opt, step_result_t *steps, int nsteps,
+                run_result_t *out) {
+  static zone_t zones[MAX_ZONES];
+  const thermo_sim_config_t *cfg = opt->cfg;
+  for (int z = 0; z < opt->zones; ++z) {
+    if (!thermo_sim_init(&zones[z].sim, cfg, cfg->ambient_temp_c,
+                         THERMO_SIM_MODE_IDLE) ||
+        alarm_rules_compile(&zones[z].alarms, ALARM_RULES, ALARM_RULE_COUNT) >=
+            0)
+      return false;
+    thermo_sim_seed_sensor(&zones[z].sim, (uint32_t)z);
+    zone_set_controller(&zones[z], opt->ctrl);
+  }
+
+  memset(out, 0, sizeof(*out));
+  static neopixel_strip_t strip;
+  neopixel_mock_init(&out->strip_backend, 800000.0f, false);
+  neopixel_strip_init(&strip, &NEOPIXEL_MOCK_OPS, &out->strip_backend,
+                      (uint16_t)opt->zones);
+
+  const uint32_t tick_ticks = opt->tick_ms * TICK_RATE_HZ / 1000u;
+  const float dt_s = (float)opt->tick_ms / 1000.0f;
+  const uint64_t csv_every =
+      opt->csv_interval_s > 0
+          ? (uint64_t)(opt->csv_interval_s * 1000.0 / opt->tick_ms)
+          : 0;
+
+  out->min_temp = out->max_temp = cfg->ambient_temp_c;
+  thermo_sim_mode_t prev_mode = THERMO_SIM_MODE_IDLE;
+  uint32_t now_ticks = 0;
+  uint64_t tick = 0;
+  double wall_start = now_s();
+
+  for (int k = 0; k < nsteps; ++k) {
+    step_result_t *r = &steps[k];
+    float sp = r->setpoint;
+    float start_temp = zones[0].sim.temperature_c;
+    bool rising = sp > start_temp;
+    uint64_t n = (uint64_t)(r->duration_s * 1000.0 / opt->tick_ms);
+    double err_sum = 0.0;
+    uint64_t err_n = 0;
+    r->settle_s = 0.0;
+    r->overshoot = 0.0f;
+    r->heat_cycles = r->cool_cycles = 0;
+    r->alarms = 0;
+
+    for (uint64_t i = 0; i < n; ++i, ++tick) {
+      now_ticks += tick_ticks;
+      for (int z = 0; z < opt->zones; ++z) {
+        thermo_sim_step(&zones[z].sim, now_ticks, dt_s, sp);
+        zone_eval_alarms(&zones[z], now_ticks, sp,
+                         z == 0 ? r : NULL, opt->verbose);
+        if (zone_after_step(&zones[z]) && z == 0 && opt->verbose) {
+          const thermo_autotune_t *at = &zones[0].tune;
+          printf("autotune %s at %.0fs: ku=%.3f pu=%.0fs kp=%.4f ki=%.6f "
+                 "kd=%.3f\n",
+                 at->state == THERMO_AUTOTUNE_DONE ? "done" : "failed",
+                 (double)tick * dt_s, at->ku, at->pu_s,
+                 Q16_TO_FLOAT(at->gains.kp), Q16_TO_FLOAT(at->gains.ki),
+                 Q16_TO_FLOAT(at->gains.kd));
+        }
+        const uint8_t *rgb = STATUS_COLORS[zones[z].sim.mode];
+        neopixel_strip_set_rgb(&strip, (uint16_t)z, rgb[0], rgb[1], rgb[2]);
+      }
+      out->strip_backend.now_us = (uint64_t)now_ticks * 1000000u / TICK_RATE_HZ;
+      neopixel_strip_commit(&strip);
+
+      const thermo_sim_t *s = &zones[0].sim;
+      float t = s->temperature_c;
+      double t_step = (double)(i + 1) * dt_s;
+      if (t < out->min_temp)
+        out->min_temp = t;
+      if (t > out->max_temp)
+        out->max_temp = t;
+      if (t < sp - opt->band_c || t > sp + opt->band_c)
+        r->settle_s = t_step;
+      float past = rising ? t - sp : sp - t;
+      if (past > r->overshoot)
+        r->overshoot = past;
+      if (i >= n / 2) {
+        err_sum += t > sp ? t - sp : sp - t;
+        err_n++;
+      }
+      if (s->mode != prev_mode) {
+        if (s->mode == THERMO_SIM_MODE_HEAT)
+          r->heat_cycles++;
+        else if (s->mode == THERMO_SIM_MODE_COOL)
+          r->cool_cycles++;
+        prev_mode = s->mode;
+      }
+      if (opt->csv && csv_every && (tick % csv_every) == 0)
+        fprintf(opt->csv, "%.1f,%.3f,%.1f,%d,%d\n", (double)tick * dt_s, t,
+                s->humidity, s->mode == THERMO_SIM_MODE_HEAT,
+                s->mode == THERMO_SIM_MODE_COOL);
+    }
+    r->mean_abs_err = err_n ? (float)(err_sum / (double)err_n) : 0.0f;
+  }
+
+  out->wall_s = now_s() - wall_start;
+  out->sim_s = (double)tick * dt_s;
+  out->zone_ticks = tick * (uint64_t)opt->zones;
+  out->final_temp = zones[0].sim.temperature_c;
+  out->strip = strip.stats;
+  return true;
+}
+
+// -B: the same setpoint steps under each controller. The band is tighter
+// than the bang-bang hysteresis on purpose; that is what PID buys. Exits 1
+// if PID (tuned or not) starts the heater or the compressor more often over
+// the whole run than bang-bang does.
+static int bench(const thermo_sim_config_t *cfg, uint32_t hyst_tick_ms,
+                 uint32_t pid_tick_ms) {
+  static const float SETPOINTS[] = {-10.0f, 4.0f, 40.0f, 25.0f};
+  const int nsteps = (int)(sizeof(SETPOINTS) / sizeof(SETPOINTS[0]));
+  const double step_s = 3.0 * 3600.0;
+  uint32_t heat[3] = {0}, cool[3] = {0};
+
+  printf("%-5s %7s %6s %9s %9s %8s %6s %6s %6s %10s\n", "ctrl", "tick_ms",
+         "sp", "settle_s", "overshoot", "mae", "heat", "cool", "alarms",
+         "ns/tick");
+  for (int c = 0; c < 3; ++c) {
+    step_result_t steps[sizeof(SETPOINTS) / sizeof(SETPOINTS[0])];
+    // Autotune needs a first step to tune on; it hands over to PID after.
+    for (int k = 0; k < nsteps; ++k) {
+      steps[k].setpoint = SETPOINTS[k];
+      steps[k].duration_s = step_s;
+    }
+    run_options_t opt = {
+        .cfg = cfg,
+        .ctrl = (ctrl_kind_t)c,
+        .tick_ms = c == CTRL_HYST ? hyst_tick_ms : pid_tick_ms,
+        .zones = 1,
+        .band_c = 0.5f,
+    };
+    run_result_t res;
+    if (!run(&opt, steps, nsteps, &res))
+      return 1;
+    double ns = res.wall_s * 1e9 / (double)res.zone_ticks;
+    for (int k = 0; k < nsteps; ++k) {
+      printf("%-5s %7u %6.1f %9.0f %9.2f %8.3f %6u %6u %6u %10.1f\n",
+             CTRL_NAMES[c], opt.tick_ms, steps[k].setpoint, steps[k].settle_s,
+             steps[k].overshoot, steps[k].mean_abs_err, steps[k].heat_cycles,
+             steps[k].cool_cycles, steps[k].alarms, ns);
+      heat[c] += steps[k].heat_cycles;
+      cool[c] += steps[k].cool_cycles;
+    }
+  }
+
+  // Actuator wear: starts per hour over the whole run, against bang-bang.
+  double hours = step_s * nsteps / 3600.0;
+  bool ok = true;
+  printf("\n%-5s %11s %11s\n", "ctrl", "heat_per_h", "cool_per_h");
+  for (int c = 0; c < 3; ++c) {
+    bool more = heat[c] > heat[CTRL_HYST] || cool[c] > cool[CTRL_HYST];
+    printf("%-5s %11.1f %11.1f%s\n", CTRL_NAMES[c], heat[c] / hours,
+           cool[c] / hours, more ? "  more than hyst" : "");
+    ok = ok && !more;
+  }
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+// -A: time alarm_rules_eval() alone on a recorded trace, with the default
+// rules repeated up to ALARM_RULES_MAX. Cost should grow linearly.
+static int bench_alarms(const thermo_sim_config_t *cfg) {
+  enum { TRACE_LEN = 36000 }; // 1 h at 100 ms
+  static alarm_inputs_t trace[TRACE_LEN];
+  static alarm_rule_spec_t specs[ALARM_RULES_MAX];
+  static thermo_sim_t sim;
+  static alarm_rules_t ar;
+
+  // Record a setpoint step so the rules see heating, cooling and edges.
+  if (!thermo_sim_init(&sim, cfg, cfg->ambient_temp_c, THERMO_SIM_MODE_IDLE))
+    return 1;
+  for (int i = 0; i < TRACE_LEN; ++i) {
+    uint32_t now = (uint32_t)(i + 1) * 100u;
+    float sp = i < TRACE_LEN / 2 ? -10.0f : 40.0f;
+    thermo_sim_step(&sim, now, 0.1f, sp);
+    trace[i] = (alarm_inputs_t){
+        .now_ms = now,
+        .temperature_c = thermo_sim_probe_temperature(&sim),
+        .humidity = thermo_sim_probe_humidity(&sim),
+        .setpoint_c = sp,
+        .heater_on = sim.mode == THERMO_SIM_MODE_HEAT,
+        .cooler_on = sim.mode == THERMO_SIM_MODE_COOL,
+    };
+  }
+  for (int i = 0; i < ALARM_RULES_MAX; ++i)
+    specs[i] = ALARM_RULES[i % ALARM_RULE_COUNT];
+
+  printf("%6s %12s %12s\n", "rules", "ns/eval", "ns/rule");
+  for (int n = ALARM_RULE_COUNT; n <= ALARM_RULES_MAX; n *= 2) {
+    if (alarm_rules_compile(&ar, specs, n) >= 0)
+      return 1;
+    const int reps = 20;
+    uint32_t sink = 0;
+    double start = now_s();
+    for (int rep = 0; rep < reps; ++rep) {
+      for (int i = 0; i < TRACE_LEN; ++i)
+        alarm_rules_eval(&ar, &trace[i]);
+      sink += ar.active_count;
+      ar.primed = false;
+    }
+    double ns = (now_s() - start) * 1e9 / ((double)reps * TRACE_LEN);
+    printf("%6d %12.1f %12.2f\n", n, ns, ns / n);
+    if (sink == 0xFFFFFFFFu) // keep the loop alive
+      printf("\n");
+  }
+  return 0;
+}
+
+// ------------------------
+// -F: sensor pipeline
+// ------------------------
+
+static bool report(bool pass, const char *what) {
+  printf("%s %s\n", pass ? "PASS" : "FAIL", what);
+  return pass;
+}
+
+static int cmp_milli(const void *a, const void *b) {
+  sensor_milli_t x = *(const sensor_milli_t *)a, y = *(const sensor_milli_t *)b;
+  return (x > y) - (x < y);
+}
+
+// The filters alone, against what they should compute.
+static bool check_filters(void) {
+  bool ok = true;
+
+  // Median: random input against sorting the window outright.
+  static const uint8_t WINDOWS[] = {1, 3, 5, 9};
+  uint32_t rng = 12345;
+  bool same = true;
+  for (size_t w = 0; w < sizeof(WINDOWS); ++w) {
+    sensor_median_t m;
+    sensor_median_init(&m, WINDOWS[w]);
+    sensor_milli_t hist[20000];
+    for (int i = 0; i < 20000; ++i) {
+      rng = rng * 1103515245u + 12345u;
+      hist[i] = (sensor_milli_t)(rng >> 16) % 2000 - 1000;
+      sensor_milli_t got = sensor_median_update(&m, hist[i]);
+      int n = i + 1 < WINDOWS[w] ? i + 1 : WINDOWS[w];
+      sensor_milli_t win[SENSOR_MEDIAN_MAX];
+      memcpy(win, &hist[i + 1 - n], (size_t)n * sizeof(win[0]));
+      qsort(win, (size_t)n, sizeof(win[0]), cmp_milli);
+      same = same && got == win[n / 2];
+    }
+  }
+  ok &= report(same, "median matches a sorted window (1, 3, 5, 9)");
+
+  // Median 5: single and paired spikes never get through.
+  sensor_median_t m;
+  sensor_median_init(&m, 5);
+  bool clean = true;
+  for (int i = 0; i < 1000; ++i) {
+    sensor_milli_t x = 20000;
+    if (i % 7 == 3)
+      x += 5000;
+    else if (i % 7 == 4)
+      x -= 8000;
+    clean = clean && sensor_median_update(&m, x) == 20000;
+  }
+  ok &= report(clean, "median 5 removes spikes up to two samples long");
+
+  // IIR: a step against the closed form of the same recurrence, then
+  // settling on the exact input.
+  sensor_iir_t f;
+  sensor_iir_init(&f, 2000);
+  sensor_iir_update(&f, 0, 100);
+  double worst = 0.0;
+  sensor_milli_t y = 0;
+  for (int i = 1; i <= 2000; ++i) {
+    y = sensor_iir_update(&f, 10000, 100);
+    double want = 10000.0 * (1.0 - pow(2000.0 / 2100.0, i));
+    if (fabs(y - want) > worst)
+      worst = fabs(y - want);
+  }
+  ok &= report(worst <= 2.0 && y == 10000,
+               "IIR step within 2 milli-units of y += (x - y) dt/(tau + dt)");
+
+  // Rate limit: never more than the step, and there in the time it takes.
+  sensor_rate_limit_t r;
+  sensor_rate_limit_init(&r, 1000);
+  sensor_milli_t prev = sensor_rate_limit_update(&r, 0, 100, NULL);
+  bool bounded = true;
+  int reached = -1;
+  for (int i = 1; i <= 200; ++i) {
+    sensor_milli_t v = sensor_rate_limit_update(&r, 10000, 100, NULL);
+    bounded = bounded && abs(v - prev) <= 100;
+    if (v == 10000 && reached < 0)
+      reached = i;
+    prev = v;
+  }
+  ok &= report(bounded && reached == 100,
+               "rate limit 1/s moves 0.1 per 100 ms, arrives in 10 s");
+  return ok;
+}
+
+typedef struct sensor_case {
+  const char *name;
+  const thermo_sim_config_t *cfg;
+  ctrl_kind_t ctrl;
+  uint32_t tick_ms;
+
+  uint32_t switches;   // actuator changes
+  double mae;          // reported vs setpoint, last half hour of each step
+  double plant_mae;    // plant vs setpoint, same window
+  double jitter;       // RMS change of the reading per tick, when idle
+  double lag_err;      // mean |reported - plant|
+  sensor_channel_stats_t stats;
+} sensor_case_t;
+
+// Heats to 40 C, then cools to 25 C, an hour each, on one zone.
+static bool run_sensor_case(sensor_case_t *c) {
+  static const float SETPOINTS[] = {40.0f, 25.0f};
+  static zone_t z;
+  if (!thermo_sim_init(&z.sim, c->cfg, c->cfg->ambient_temp_c,
+                       THERMO_SIM_MODE_IDLE))
+    return false;
+  zone_set_controller(&z, c->ctrl);
+
+  const uint32_t tick_ticks = c->tick_ms * TICK_RATE_HZ / 1000u;
+  const float dt_s = (float)c->tick_ms / 1000.0f;
+  const uint32_t n = 3600u * 1000u / c->tick_ms;
+  uint32_t now = 0;
+  thermo_sim_mode_t mode = z.sim.mode;
+  float prev = z.sim.temperature_c;
+  double err = 0.0, plant_err = 0.0, lag = 0.0, diff2 = 0.0;
+  uint64_t err_n = 0, lag_n = 0, idle_n = 0;
+  c->switches = 0;
+  for (size_t k = 0; k < sizeof(SETPOINTS) / sizeof(SETPOINTS[0]); ++k) {
+    for (uint32_t i = 0; i < n; ++i) {
+      now += tick_ticks;
+      thermo_sim_step(&z.sim, now, dt_s, SETPOINTS[k]);
+      zone_after_step(&z);
+      const thermo_sim_t *s = &z.sim;
+      if (s->mode != mode) {
+        c->switches++;
+        mode = s->mode;
+      }
+      if (i >= n / 2) {
+        err += fabsf(s->temperature_c - SETPOINTS[k]);
+        plant_err += fabsf(s->plant_c - SETPOINTS[k]);
+        err_n++;
+      }
+      lag += fabsf(s->temperature_c - s->plant_c);
+      lag_n++;
+      if (s->mode == THERMO_SIM_MODE_IDLE) {
+        double d = s->temperature_c - prev;
+        diff2 += d * d;
+        idle_n++;
+      }
+      prev = s->temperature_c;
+    }
+  }
+  c->mae = err / (double)err_n;
+  c->plant_mae = plant_err / (double)err_n;
+  c->lag_err = lag / (double)lag_n;
+  c->jitter = idle_n ? sqrt(diff2 / (double)idle_n) : 0.0;
+  c->stats = z.sim.temperature_sensor.stats;
+  return true;
+}
+
+// Timestamp counter, for costs in cycles of the host.
+#if HAVE_TSC
+static uint64_t tsc(void) { return __rdtsc(); }
+#else
+static uint64_t tsc(void) { return 0; }
+#endif
+
+enum { COST_SAMPLES = 1 << 20 };
+
+typedef enum cost_stage {
+  COST_MEDIAN3,
+  COST_MEDIAN5,
+  COST_MEDIAN9,
+  COST_IIR,
+  COST_RATE,
+  COST_CHANNEL, // injection and all three filters
+  COST_STAGES,
+} cost_stage_t;
+
+static const char *const COST_NAMES[] = {
+    "median 3", "median 5", "median 9", "iir", "rate limit", "channel",
+};
+
+// One pass of `stage` over `trace`. Returns a checksum to keep it alive.
+static int64_t cost_pass(cost_stage_t stage, const sensor_milli_t *trace,
+                         const float *plant) {
+  int64_t sum = 0;
+  switch (stage) {
+  case COST_MEDIAN3:
+  case COST_MEDIAN5:
+  case COST_MEDIAN9: {
+    static const uint8_t W[] = {3, 5, 9};
+    sensor_median_t m;
+    sensor_median_init(&m, W[stage - COST_MEDIAN3]);
+    for (int i = 0; i < COST_SAMPLES; ++i)
+      sum += sensor_median_update(&m, trace[i]);
+    break;
+  }
+  case COST_IIR: {
+    sensor_iir_t f;
+    sensor_iir_init(&f, 2000);
+    for (int i = 0; i < COST_SAMPLES; ++i)
+      sum += sensor_iir_update(&f, trace[i], 100);
+    break;
+  }
+  case COST_RATE: {
+    sensor_rate_limit_t f;
+    sensor_rate_limit_init(&f, 1000);
+    for (int i = 0; i < COST_SAMPLES; ++i)
+      sum += sensor_rate_limit_update(&f, trace[i], 100, NULL);
+    break;
+  }
+  default: {
+    sensor_channel_t ch;
+    sensor_channel_init(&ch, &SENSOR_PIPELINE_BENCH_CHAMBER.temperature, 1,
+                        plant[0]);
+    for (int i = 0; i < COST_SAMPLES; ++i)
+      sum += (int64_t)sensor_channel_sample(&ch, plant[i], 0.1f);
+    break;
+  }
+  }
+  return sum;
+}
+
+// A probe that suddenly reads 3 C/s (a fault, or a probe against the heater)
+// must trip TEMP_RATE (110: over 2 C/s for 5 s), though the filtered reading
+// the controller sees is held to 1 C/s.
+static bool check_rate_alarm(void) {
+  thermo_sim_config_t cfg = default_config(false, true);
+  static zone_t z;
+  if (!thermo_sim_init(&z.sim, &cfg, 40.0f, THERMO_SIM_MODE_IDLE) ||
+      alarm_rules_compile(&z.alarms, ALARM_RULES, ALARM_RULE_COUNT) >= 0)
+    return report(false, "rate alarm: config");
+  zone_set_controller(&z, CTRL_HYST);
+
+  bool tripped = false;
+  float filtered_rate = 0.0f, prev = z.sim.temperature_c;
+  for (uint32_t t = 100; t <= 30000; t += 100) {
+    if (t > 5000 && t <= 15000)
+      z.sim.plant_c += 0.3f;
+    thermo_sim_step(&z.sim, t, 0.1f, 40.0f);
+    zone_eval_alarms(&z, t, 40.0f, NULL, false);
+    tripped |= z.alarms.alarm_code == 110;
+    filtered_rate = fmaxf(filtered_rate, (z.sim.temperature_c - prev) / 0.1f);
+    prev = z.sim.temperature_c;
+  }
+  printf("rate alarm: filtered reading rose at most %.2f C/s\n",
+         filtered_rate);
+  return report(tripped && filtered_rate < 1.01f,
+                "TEMP_RATE trips on a 3 C/s probe, the filtered reading "
+                "stays at 1 C/s");
+}
+
+static int bench_sensor(bool use_rc) {
+  bool ok = check_filters();
+  ok &= check_rate_alarm();
+
+  // The chamber on exact readings, on the raw probe, and on the filtered
+  // probe.
+  thermo_sim_config_t clean = default_config(use_rc, false);
+  thermo_sim_config_t filtered = default_config(use_rc, true);
+  sensor_pipeline_config_t raw_probe = SENSOR_PIPELINE_BENCH_CHAMBER;
+  raw_probe.temperature.median_window = 1;
+  raw_probe.temperature.iir_tau_s = 0.0f;
+  raw_probe.temperature.max_rate_per_s = 0.0f;
+  thermo_sim_config_t raw = filtered;
+  raw.sensor = &raw_probe;
+
+  sensor_case_t cases[] = {
+      {"clean", &clean, CTRL_HYST, 100},
+      {"raw", &raw, CTRL_HYST, 100},
+      {"filtered", &filtered, CTRL_HYST, 100},
+      {"clean", &clean, CTRL_PID, 20},
+      {"raw", &raw, CTRL_PID, 20},
+      {"filtered", &filtered, CTRL_PID, 20},
+  };
+  const int ncases = (int)(sizeof(cases) / sizeof(cases[0]));
+  printf("\n%-5s %-9s %8s %8s %10s %8s %8s %9s\n", "ctrl", "sensor",
+         "switches", "mae", "plant_mae", "jitter", "lag_err", "dropouts");
+  for (int i = 0; i < ncases; ++i) {
+    sensor_case_t *c = &cases[i];
+    if (!run_sensor_case(c))
+      return 1;
+    printf("%-5s %-9s %8u %8.3f %10.3f %8.4f %8.3f %9u\n",
+           CTRL_NAMES[c->ctrl], c->name, c->switches, c->mae, c->plant_mae,
+           c->jitter, c->lag_err, c->stats.dropouts);
+  }
+  printf("\n");
+  for (int i = 0; i < ncases; i += 3) {
+    const sensor_case_t *r = &cases[i + 1], *f = &cases[i + 2];
+    char what[96];
+    snprintf(what, sizeof(what), "%s: filtered jitter under a third of raw",
+             CTRL_NAMES[f->ctrl]);
+    ok &= report(f->jitter < r->jitter / 3.0, what);
+    snprintf(what, sizeof(what),
+             "%s: filters lag the plant under 0.4 C more than the probe",
+             CTRL_NAMES[f->ctrl]);
+    ok &= report(f->lag_err - r->lag_err < 0.4, what);
+    double expected = SENSOR_PIPELINE_BENCH_CHAMBER.temperature.dropout_rate *
+                      (double)f->stats.samples;
+    snprintf(what, sizeof(what), "%s: dropouts within 20%% of the rate",
+             CTRL_NAMES[f->ctrl]);
+    ok &= report(fabs((double)f->stats.dropouts - expected) < 0.2 * expected,
+                 what);
+  }
+
+  // Per-sample cost on a noisy reading of a slow sine.
+  static sensor_milli_t trace[COST_SAMPLES];
+  static float plant[COST_SAMPLES];
+  sensor_channel_t probe;
+  sensor_channel_init(&probe, &raw_probe.temperature, 7, 20.0f);
+  for (int i = 0; i < COST_SAMPLES; ++i) {
+    plant[i] = 20.0f + 10.0f * sinf((float)i * 1e-4f);
+    sensor_channel_sample(&probe, plant[i], 0.1f);
+    trace[i] = probe.raw;
+  }
+  printf("\n%-10s %10s %12s\n", "stage", "ns/sample",
+         HAVE_TSC ? "tsc/sample" : "");
+  int64_t sink = 0;
+  for (int s = 0; s < COST_STAGES; ++s) {
+    const int reps = 8;
+    double start = now_s();
+    uint64_t t0 = tsc();
+    for (int rep = 0; rep < reps; ++rep)
+      sink += cost_pass((cost_stage_t)s, trace, plant);
+    uint64_t ticks = tsc() - t0;
+    double n = (double)reps * COST_SAMPLES;
+    printf("%-10s %10.2f", COST_NAMES[s], (now_s() - start) * 1e9 / n);
+    if (HAVE_TSC)
+      printf(" %12.1f", (double)ticks / n);
+    printf("\n");
+  }
+  if (sink == INT64_MIN) // keep the passes alive
+    printf("\n");
+
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-m ramp|rc] [-C hyst|pid|tune] [-g kp:ki:kd]\n"
+          "          [-w window_ms] [-O heat_off_ms:cool_off_ms]"
+          " [-s setpoint_c]\n"
+          "          [-H hours] [-t tick_ms] [-z zones] [-c out.csv]"
+          " [-i csv_interval_s] [-N]\n"
+          "       %s -B [-m ramp|rc] [-g kp:ki:kd] [-w window_ms]"
+          " [-O heat_off_ms:cool_off_ms]\n"
+          "          [-t hyst_tick_ms] [-p pid_tick_ms] [-N]\n"
+          "       %s -A\n"
+          "       %s -F [-m ramp|rc]\n",
+          argv0, argv0, argv0, argv0);
+}
+
+int main(int argc, char **argv) {
+  bool use_rc = true;
+  bool do_bench = false;
+  bool do_alarm_bench = false;
+  bool do_sensor_bench = false;
+  bool use_sensor = true;
+  ctrl_kind_t ctrl = CTRL_HYST;
+  float setpoint = -10.0f;
+  double hours = 2.0;
+  uint32_t tick_ms = THERMO_SYSTEM_BENCH_UPDATE_MS;
+  uint32_t pid_tick_ms = THERMO_SYSTEM_BENCH_CONTROL_MS;
+  int zones = 1;
+  const char *csv_path = NULL;
+  double csv_interval_s = 10.0;
+  thermo_system_bench_config(&g_bench, TICK_RATE_HZ);
+  g_pid_config = g_bench.pid;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "m:C:ABFNg:w:O:s:H:t:p:z:c:i:h")) != -1) {
+    switch (opt) {
+    case 'm':
+      use_rc = strcmp(optarg, "ramp") != 0;
+      break;
+    case 'C':
+      if (!parse_ctrl(optarg, &ctrl)) {
+        usage(argv[0]);
+        return 2;
+      }
+      break;
+    case 'A':
+      do_alarm_bench = true;
+      break;
+    case 'B':
+      do_bench = true;
+      break;
+    case 'F':
+      do_sensor_bench = true;
+      break;
+    case 'N':
+      use_sensor = false;
+      break;
+    case 'g': {
+      float kp, ki, kd;
+      if (sscanf(optarg, "%f:%f:%f", &kp, &ki, &kd) != 3) {
+        usage(argv[0]);
+        return 2;
+      }
+      g_pid_config.gains.kp = Q16_FROM_FLOAT(kp);
+      g_pid_config.gains.ki = Q16_FROM_FLOAT(ki);
+      g_pid_config.gains.kd = Q16_FROM_FLOAT(kd);
+      break;
+    }
+    case 'w':
+      g_pid_config.window_ticks =
+          (uint32_t)strtoul(optarg, NULL, 10) * TICK_RATE_HZ / 1000u;
+      break;
+    case 'O': {
+      unsigned long heat_ms, cool_ms;
+      if (sscanf(optarg, "%lu:%lu", &heat_ms, &cool_ms) != 2) {
+        usage(argv[0]);
+        return 2;
+      }
+      g_pid_config.min_heat_off_ticks =
+          (uint32_t)(heat_ms * TICK_RATE_HZ / 1000u);
+      g_pid_config.min_cool_off_ticks =
+          (uint32_t)(cool_ms * TICK_RATE_HZ / 1000u);
+      break;
+    }
+    case 's':
+      setpoint = strtof(optarg, NULL);
+      break;
+    case 'H':
+      hours = strtod(optarg, NULL);
+      break;
+    case 't':
+      tick_ms = (uint32_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'p':
+      pid_tick_ms = (uint32_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'z':
+      zones = atoi(optarg);
+      break;
+    case 'c':
+      csv_path = optarg;
+      break;
+    case 'i':
+      csv_interval_s = strtod(optarg, NULL);
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (tick_ms == 0 || pid_tick_ms == 0 || zones < 1 || zones > MAX_ZONES ||
+      hours <= 0.0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  if (do_sensor_bench)
+    return bench_sensor(use_rc);
+  thermo_sim_config_t cfg = default_config(use_rc, use_sensor);
+  if (do_alarm_bench)
+    return bench_alarms(&cfg);
+  if (do_bench)
+    return bench(&cfg, tick_ms, pid_tick_ms);
+
+  FILE *csv = NULL;
+  if (csv_path) {
+    csv = fopen(csv_path, "w");
+    if (!csv) {
+      perror(csv_path);
+      return 1;
+    }
+    fprintf(csv, "time_s,temp_c,rh,heat,cool\n");
+  }
+
+  step_result_t step = {.setpoint = setpoint, .duration_s = hours * 3600.0};
+  run_options_t ropt = {
+      .cfg = &cfg,
+      .ctrl = ctrl,
+      .tick_ms = tick_ms,
+      .zones = zones,
+      .band_c = cfg.temp_hysteresis_c,
+      .csv = csv,
+      .csv_interval_s = csv_interval_s,
+      .verbose = true,
+  };
+  run_result_t res;
+  bool ok = run(&ropt, &step, 1, &res);
+  if (csv)
+    fclose(csv);
+  if (!ok) {
+    fprintf(stderr, "invalid simulator config\n");
+    return 1;
+  }
+
+  printf("model=%s ctrl=%s zones=%d tick_ms=%u setpoint=%.1f\n",
+         use_rc ? "rc" : "ramp", CTRL_NAMES[ctrl], zones, tick_ms, setpoint);
+  printf("simulated=%.0fs wall=%.3fs speedup=%.0fx ns_per_zone_tick=%.1f\n",
+         res.sim_s, res.wall_s, res.wall_s > 0 ? res.sim_s / res.wall_s : 0.0,
+         res.wall_s * 1e9 / (double)res.zone_ticks);
+  printf("final_temp=%.2f min=%.2f max=%.2f settled_after=%.0fs "
+         "overshoot=%.2f heat_cycles=%u cool_cycles=%u alarms=%u\n",
+         res.final_temp, res.min_temp, res.max_temp, step.settle_s,
+         step.overshoot, step.heat_cycles, step.cool_cycles, step.alarms);
+  printf("strip: pixels=%d sent=%u clean=%u busy=%u dma_starts=%u "
+         "words=%llu overlapped=%u\n",
+         zones, res.strip.sent, res.strip.clean, res.strip.busy,
+         res.strip_backend.dma_starts,
+         (unsigned long long)res.strip_backend.words_sent,
+         res.strip_backend.overlapped_starts);
+  return 0;
+}
@@ -0,0 +1,950 @@
+// T-Code over TCP: the simulator served to several clients at once.
+//
+// Runs thermo_system (the firmware's simulator, built for the host) in real
+// time, and serves every TCP client its own T-Code session through
+// tcode_mux, the same dispatcher the firmware's serial task runs for USB and
+// UART. One thread polls everything: a client that stops reading only fills
+// its own TX ring, and the others go on being served.
+//
+// The device answers setpoints, Q0, Q3 (the asking connection's counters),
+// M33, M999 and the CTRL/KP/KI/KD settings; anything else gets
+// error:UNSUPPORTED. Every client also gets the firmware's "." keepalive.
+//
+// -T runs a self-test against an in-process server: several clients send
+// numbered, checksummed lines as fast as the server answers them while one
+// more client pipelines Q0s of every zone and never reads. Exits 1 unless
+// every line got exactly its expected answers in time, and the stalled
+// client was sent only whole lines.
+//
+// -W measures the server thread idling with one connected client that sends
+// nothing: how often it wakes and how much CPU it burns, once polling every
+// tick as the firmware's serial task once did and once event-driven.
+
+#include "tcode_mux.h"
+#include "thermo_system.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TICK_RATE_HZ 1000u // matches configTICK_RATE_HZ
+#define DEFAULT_PORT 7070
+
+// The firmware's configuration (thermo_system_bench_config), set in main().
+static thermo_system_config_t g_config;
+
+// Its sim task periods (at 1 kHz, ms are ticks).
+#define UPDATE_PERIOD_TICKS THERMO_SYSTEM_BENCH_UPDATE_MS
+#define IDLE_PERIOD_TICKS THERMO_SYSTEM_BENCH_IDLE_UPDATE_MS
+#define CONTROL_PERIOD_TICKS THERMO_SYSTEM_BENCH_CONTROL_MS
+#define KEEPALIVE_TICKS 5000
+
+// Alarms are not reported here; empty the zones' event queues.
+static void drop_alarm_events(thermo_system_t *sys) {
+  alarm_event_t ev;
+  while (thermo_system_pop_alarm_event(sys, NULL, &ev))
+    ;
+}
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void sleep_ms(long ms) {
+  struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+  nanosleep(&ts, NULL);
+}
+
+// ---------
+// Server
+// ---------
+
+typedef struct server {
+  int listen_fd;
+  bool verbose;
+  tcode_mux_t mux;
+  thermo_system_t sys;
+  double start_s;
+  uint32_t next_step;
+  uint32_t next_keepalive;
+  uint32_t keepalive_ticks;
+  uint32_t clients;  // connections accepted
+  uint32_t rejected; // turned away with every port taken
+
+  // -W: wake every tick and step the sim at a fixed rate, as the firmware's
+  // serial and sim tasks did before they became event-driven.
+  bool polled;
+  uint32_t wakeups; // returns from poll()
+  uint32_t steps;   // sim steps
+  double run_s;     // wall and thread CPU time of server_run()
+  double cpu_s;
+} server_t;
+
+static atomic_bool g_stop;
+static int g_stop_pipe[2] = {-1, -1}; // wakes server_wait() to stop
+
+// Async-signal-safe.
+static void server_stop(void) {
+  atomic_store(&g_stop, true);
+  ssize_t n = write(g_stop_pipe[1], "", 1); // fails only if one is pending
+  (void)n;
+}
+
+static void on_signal(int sig) {
+  (void)sig;
+  server_stop();
+}
+
+// --- The device ---
+
+// Tenths, rounded half away from zero: 21.25 -> 213.
+static int32_t to_tenths(float v) {
+  return (int32_t)(v * 10.0f + (v < 0.0f ? -0.5f : 0.5f));
+}
+
+static void add(char *line, size_t size, const char *key, const char *value) {
+  size_t len = strlen(line);
+  snprintf(line + len, size - len, " %s=%s", key, value);
+}
+
+static void add_fixed(char *line, size_t size, const char *key, int32_t v,
+                      uint8_t decimals) {
+  char value[16];
+  tcode_format_fixed(value, sizeof(value), v, decimals);
+  add(line, size, key, value);
+}
+
+// Q0: as the firmware's, fields in F of zone 0 or of the zones in Z. Without
+// Z, STATE and ALARM are the worst zone's. Continued a zone at a time, with
+// the fields, the next zone, the last and whether Z was given in more_state.
+static bool query_status_more(void *ctx, tcode_port_t *port) {
+  const thermo_system_t *sys = &((server_t *)ctx)->sys;
+  uint32_t fields = port->more_state[0];
+  int32_t z = (int32_t)port->more_state[1]++;
+  int32_t last = (int32_t)port->more_state[2];
+  bool by_zone = port->more_state[3] != 0;
+
+  const thermo_sim_t *zs = &sys->zones[z];
+  thermo_system_alarm_t alarm =
+      thermo_system_alarm(sys, by_zone ? z : THERMO_SYSTEM_ALL_ZONES);
+  bool faulted = alarm.faulted;
+  char line[160] = "data:";
+  if (by_zone)
+    add_fixed(line, sizeof(line), "ZONE", z, 0);
+  for (int f = 0; f < TCODE_STATUS_FIELD_COUNT; ++f) {
+    if (!(fields & ((uint32_t)1 << f)))
+      continue;
+    const char *key = tcode_status_field_name((tcode_status_field_t)f);
+    switch ((tcode_status_field_t)f) {
+    case TCODE_STATUS_TEMP:
+      add_fixed(line, sizeof(line), key, to_tenths(zs->temperature_c), 1);
+      break;
+    case TCODE_STATUS_RH:
+      add_fixed(line, sizeof(line), key, to_tenths(zs->humidity), 1);
+      break;
+    case TCODE_STATUS_HEAT:
+      add(line, sizeof(line), key,
+          zs->mode == THERMO_SIM_MODE_HEAT ? "true" : "false");
+      break;
+    case TCODE_STATUS_COOL:
+      add(line, sizeof(line), key,
+          zs->mode == THERMO_SIM_MODE_COOL ? "true" : "false");
+      break;
+    case TCODE_STATUS_STATE:
+      add(line, sizeof(line), key,
+          faulted                            ? "FAULT"
+          : zs->mode == THERMO_SIM_MODE_IDLE ? "IDLE"
+                                             : "RUN");
+      break;
+    case TCODE_STATUS_SET_TEMP:
+      add_fixed(line, sizeof(line), key,
+                to_tenths(sys->setpoints[z].temperature_c), 1);
+      break;
+    case TCODE_STATUS_SET_RH:
+      add_fixed(line, sizeof(line), key,
+                to_tenths(sys->setpoints[z].humidity), 1);
+      break;
+    case TCODE_STATUS_ALARM:
+      add_fixed(line, sizeof(line), key, alarm.code, 0);
+      break;
+    default:
+      break;
+    }
+  }
+  tcode_port_printf(port, "%s\n", line);
+  return z >= last;
+}
+
+static void query_status(server_t *srv, tcode_port_t *port,
+                         const tcode_command_t *cmd) {
+  uint32_t fields = ((uint32_t)1 << TCODE_STATUS_FIELD_COUNT) - 1;
+  if (cmd->present & TCODE_FIELD_BIT('F'))
+    fields = (uint32_t)cmd->value['F' - 'A'];
+  bool by_zone = cmd->present & TCODE_FIELD_BIT('Z');
+  int32_t first = by_zone ? cmd->value['Z' - 'A'] : 0;
+  int32_t last = by_zone ? cmd->range_last : 0;
+  if (last >= srv->sys.zone_count) {
+    tcode_port_printf(port, "error:UNSUPPORTED Z%ld\n", (long)last);
+    return;
+  }
+  port->more_state[0] = fields;
+  port->more_state[1] = (uint32_t)first;
+  port->more_state[2] = (uint32_t)last;
+  port->more_state[3] = by_zone;
+  tcode_port_continue(port, query_status_more);
+}
+
+// Q3: the counters of the connection that asks.
+static void query_port(const tcode_port_t *port) {
+  const tcode_session_stats_t *ls = &port->session.stats;
+  tcode_port_printf((tcode_port_t *)port,
+                    "data: PORT=%s LINES=%lu CHECKSUM_ERR=%lu PARSE_ERR=%lu "
+                    "OVERFLOW=%lu LINE_ERR=%lu TX_WAITS=%lu TX_DROPPED=%lu\n",
+                    port->transport.name, (unsigned long)ls->lines,
+                    (unsigned long)ls->checksum_errors,
+                    (unsigned long)ls->parse_errors,
+                    (unsigned long)ls->overflows,
+                    (unsigned long)ls->line_number_errors,
+                    (unsigned long)port->tx_waits,
+                    (unsigned long)port->tx_dropped);
+}
+
+// Every zone group of the line is applied, or none is.
+static void apply_setpoints(server_t *srv, tcode_port_t *port,
+                            const tcode_command_t *cmd) {
+  thermo_system_setpoint_t sp[THERMO_SYSTEM_MAX_ZONES];
+  memcpy(sp, srv->sys.setpoints, sizeof(sp));
+  for (uint8_t i = 0; i < cmd->group_count; ++i) {
+    const tcode_group_t *g = &cmd->group[i];
+    int32_t zone = g->value[TCODE_ZONE_Z];
+    if (zone >= srv->sys.zone_count) {
+      tcode_port_printf(port, "error:UNSUPPORTED Z%ld\n", (long)zone);
+      return;
+    }
+    if (g->present & TCODE_FIELD_BIT('T'))
+      sp[zone].temperature_c = (float)g->value[TCODE_ZONE_T] / 100.0f;
+    if (g->present & TCODE_FIELD_BIT('H'))
+      sp[zone].humidity = (float)g->value[TCODE_ZONE_H] / 10.0f;
+  }
+  thermo_system_set_setpoints(&srv->sys, sp);
+}
+
+static void execute(void *ctx, tcode_port_t *port, const tcode_command_t *cmd) {
+  server_t *srv = (server_t *)ctx;
+  switch (cmd->cmd) {
+  case TCODE_CMD_SETPOINT:
+    apply_setpoints(srv, port, cmd);
+    break;
+  case TCODE_CMD_Q0:
+    query_status(srv, port, cmd);
+    break;
+  case TCODE_CMD_Q3:
+    query_port(port);
+    break;
+  case TCODE_CMD_M33:
+    thermo_system_set_controller(&srv->sys,
+                                 (thermo_system_ctrl_t)cmd->value['S' - 'A']);
+    break;
+  case TCODE_CMD_M999:
+    thermo_system_clear_fault(&srv->sys);
+    break;
+  default:
+    tcode_port_printf(port, "error:UNSUPPORTED %s\n",
+                      tcode_cmd_name(cmd->cmd));
+    break;
+  }
+}
+
+static int32_t pow10_i32(uint8_t n) {
+  int32_t p = 1;
+  while (n--)
+    p *= 10;
+  return p;
+}
+
+static int32_t setting_get(void *ctx, tcode_port_t *port, tcode_setting_t s) {
+  (void)port;
+  const server_t *srv = (const server_t *)ctx;
+  const thermo_pid_gains_t *g = &srv->sys.pid.gains;
+  int64_t scale = pow10_i32(tcode_setting_info(s)->decimals);
+  switch (s) {
+  case TCODE_SETTING_CTRL:
+    return (int32_t)srv->sys.ctrl;
+  case TCODE_SETTING_KP:
+    return (int32_t)(((int64_t)g->kp * scale + 32768) >> 16);
+  case TCODE_SETTING_KI:
+    return (int32_t)(((int64_t)g->ki * scale + 32768) >> 16);
+  case TCODE_SETTING_KD:
+    return (int32_t)(((int64_t)g->kd * scale + 32768) >> 16);
+  default:
+    return 0;
+  }
+}
+
+static void setting_set(void *ctx, tcode_port_t *port, tcode_setting_t s,
+                        int32_t v) {
+  server_t *srv = (server_t *)ctx;
+  thermo_pid_gains_t g = srv->sys.pid.gains;
+  q16_t q = (q16_t)(((int64_t)v << 16) /
+                    pow10_i32(tcode_setting_info(s)->decimals));
+  switch (s) {
+  case TCODE_SETTING_CTRL:
+    thermo_system_set_controller(&srv->sys, (thermo_system_ctrl_t)v);
+    return;
+  case TCODE_SETTING_KP:
+    g.kp = q;
+    break;
+  case TCODE_SETTING_KI:
+    g.ki = q;
+    break;
+  case TCODE_SETTING_KD:
+    g.kd = q;
+    break;
+  default:
+    tcode_port_printf(port, "error:UNSUPPORTED %s\n",
+                      tcode_setting_info(s)->key);
+    return;
+  }
+  thermo_system_set_pid_gains(&srv->sys, &g);
+}
+
+// --- TCP transport ---
+
+static int sock_fd(const tcode_port_t *port) {
+  return (int)(intptr_t)port->transport.ctx;
+}
+
+static int sock_read(void *ctx, char *buf, size_t size) {
+  ssize_t n = recv((int)(intptr_t)ctx, buf, size, MSG_DONTWAIT);
+  if (n > 0)
+    return (int)n;
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    return 0;
+  return -1; // closed by the peer, or failed
+}
+
+static int sock_write(void *ctx, const char *buf, size_t len) {
+  ssize_t n = send((int)(intptr_t)ctx, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+  if (n >= 0)
+    return (int)n;
+  if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+    return 0;
+  return -1;
+}
+
+static void on_closed(void *ctx, tcode_port_t *port) {
+  const server_t *srv = (const server_t *)ctx;
+  if (srv->verbose)
+    fprintf(stderr, "client %d: closed after %lu lines\n", sock_fd(port),
+            (unsigned long)port->session.stats.lines);
+  close(sock_fd(port));
+}
+
+static const tcode_mux_ops_t SERVER_MUX_OPS = {
+    .execute = execute,
+    .setting_get = setting_get,
+    .setting_set = setting_set,
+    .closed = on_closed,
+};
+
+static void accept_clients(server_t *srv) {
+  int fd;
+  while ((fd = accept(srv->listen_fd, NULL, NULL)) >= 0) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    tcode_transport_t t = {"TCP", sock_read, sock_write, (void *)(intptr_t)fd};
+    if (!tcode_mux_open(&srv->mux, &t)) {
+      static const char BUSY[] = "error:BUSY\n";
+      send(fd, BUSY, sizeof(BUSY) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+      close(fd);
+      srv->rejected++;
+      continue;
+    }
+    srv->clients++;
+    if (srv->verbose)
+      fprintf(stderr, "client %d: connected\n", fd);
+  }
+}
+
+static uint32_t server_ticks(const server_t *srv) {
+  return (uint32_t)((now_s() - srv->start_s) * TICK_RATE_HZ);
+}
+
+// Steps the sim when its period is due, at the sim task's adaptive rate, and
+// sends the keepalive.
+static void server_tick(server_t *srv) {
+  uint32_t now = server_ticks(srv);
+  if ((int32_t)(now - srv->next_step) >= 0) {
+    float dt_s = (float)(now - srv->sys.now_ticks) / (float)TICK_RATE_HZ;
+    thermo_system_step(&srv->sys, now, dt_s);
+    drop_alarm_events(&srv->sys);
+    srv->steps++;
+    srv->next_step =
+        now + (srv->polled ? UPDATE_PERIOD_TICKS
+                           : thermo_system_next_period(
+                                 &srv->sys, UPDATE_PERIOD_TICKS,
+                                 IDLE_PERIOD_TICKS, CONTROL_PERIOD_TICKS));
+  }
+  if ((int32_t)(now - srv->next_keepalive) >= 0) {
+    tcode_mux_broadcast(&srv->mux, ".\n", 2);
+    srv->next_keepalive = now + srv->keepalive_ticks;
+  }
+}
+
+// Sleeps until a client can be read or written, a client connects, the next
+// sim step or keepalive is due, or server_stop() is called.
+static void server_wait(server_t *srv) {
+  struct pollfd fds[2 + TCODE_MUX_MAX_PORTS];
+  nfds_t n = 0;
+  fds[n++] = (struct pollfd){.fd = srv->listen_fd, .events = POLLIN};
+  fds[n++] = (struct pollfd){.fd = g_stop_pipe[0], .events = POLLIN};
+  for (int i = 0; i < TCODE_MUX_MAX_PORTS; ++i) {
+    const tcode_port_t *p = &srv->mux.ports[i];
+    if (!p->open)
+      continue;
+    uint32_t queued = tcode_port_tx_queued(p);
+    short events = 0;
+    if (!tcode_port_tx_full(p))
+      events |= POLLIN;
+    if (queued > 0)
+      events |= POLLOUT;
+    fds[n++] = (struct pollfd){.fd = sock_fd(p), .events = events};
+  }
+
+  uint32_t now = server_ticks(srv);
+  int32_t due = (int32_t)(srv->next_step - now);
+  int32_t keepalive = (int32_t)(srv->next_keepalive - now);
+  if (keepalive < due)
+    due = keepalive;
+  if (srv->polled && due > 1)
+    due = 1;
+  poll(fds, n, due > 0 ? (int)due : 0);
+  srv->wakeups++;
+  if (fds[0].revents & POLLIN)
+    accept_clients(srv);
+}
+
+static double thread_cpu_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void server_run(server_t *srv) {
+  double t0 = now_s(), cpu0 = thread_cpu_s();
+  while (!atomic_load(&g_stop)) {
+    server_tick(srv);
+    if (!tcode_mux_poll(&srv->mux))
+      server_wait(srv);
+  }
+  srv->run_s = now_s() - t0;
+  srv->cpu_s = thread_cpu_s() - cpu0;
+  for (int i = 0; i < TCODE_MUX_MAX_PORTS; ++i)
+    tcode_mux_close(&srv->mux.ports[i]);
+}
+
+// Clears a stop left by an earlier server.
+static bool stop_init(void) {
+  if (g_stop_pipe[0] < 0 && pipe(g_stop_pipe) < 0) {
+    perror("pipe");
+    return false;
+  }
+  for (int i = 0; i < 2; ++i)
+    fcntl(g_stop_pipe[i], F_SETFL, O_NONBLOCK);
+  char buf[16];
+  while (read(g_stop_pipe[0], buf, sizeof(buf)) > 0)
+    ;
+  atomic_store(&g_stop, false);
+  return true;
+}
+
+// Listens on 127.0.0.1:`port` (0 picks a free one). Returns the port, or -1.
+static int server_init(server_t *srv, int port, int zones, bool verbose) {
+  memset(srv, 0, sizeof(*srv));
+  srv->verbose = verbose;
+  srv->keepalive_ticks = KEEPALIVE_TICKS;
+  if (!stop_init())
+    return -1;
+  g_config.zone_count = (uint8_t)zones;
+  if (!thermo_system_init(&srv->sys, &g_config, g_config.sim.ambient_temp_c,
+                          THERMO_SIM_MODE_IDLE)) {
+    fprintf(stderr, "invalid simulator config\n");
+    return -1;
+  }
+  tcode_mux_init(&srv->mux, &SERVER_MUX_OPS, srv);
+
+  srv->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (srv->listen_fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  int one = 1;
+  setsockopt(srv->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr = {
+      .sin_family = AF_INET,
+      .sin_port = htons((uint16_t)port),
+      .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  socklen_t len = sizeof(addr);
+  if (bind(srv->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(srv->listen_fd, 16) < 0 ||
+      getsockname(srv->listen_fd, (struct sockaddr *)&addr, &len) < 0) {
+    perror("listen");
+    close(srv->listen_fd);
+    return -1;
+  }
+  srv->start_s = now_s();
+  return ntohs(addr.sin_port);
+}
+
+static void *server_thread(void *arg) {
+  server_run((server_t *)arg);
+  return NULL;
+}
+
+// ---------------
+// -T: self-test
+// ---------------
+
+// Lines in flight per client: enough to keep the server busy without
+// queueing more than a TX ring of answers.
+#define CLIENT_WINDOW 16
+
+typedef struct client {
+  int index;
+  int port;
+  uint32_t lines;
+  int zones;
+
+  uint32_t oks;
+  uint32_t data_lines;
+  uint32_t line_number_errors;
+  uint32_t other_errors;
+  char first_error[96];
+  double latency_sum_s;
+  double latency_max_s;
+  bool failed; // connect or I/O error
+} client_t;
+
+static int client_connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  struct sockaddr_in addr = {
+      .sin_family = AF_INET,
+      .sin_port = htons((uint16_t)port),
+      .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Line `n` (from 1) of client `c`: its zone's setpoint, then a Q0 of it, with
+// the XOR checksum. Past the last line comes one numbered out of sequence.
+static int client_line(const client_t *c, uint32_t n, char *buf, size_t size) {
+  char body[64];
+  int zone = c->index % c->zones;
+  if (n > c->lines)
+    snprintf(body, sizeof(body), "N%lu M999", (unsigned long)n + 5);
+  else if (n & 1)
+    snprintf(body, sizeof(body), "N%lu Z%d T%d", (unsigned long)n, zone,
+             20 + (int)(n % 20));
+  else
+    snprintf(body, sizeof(body), "N%lu Q0 F=TEMP,SET_TEMP Z%d",
+             (unsigned long)n, zone);
+  return snprintf(buf, size, "%s*%02X\n", body, tcode_checksum_xor(body));
+}
+
+static void client_count(client_t *c, const char *line) {
+  if (strcmp(line, "ok") == 0) {
+    c->oks++;
+  } else if (strncmp(line, "data:", 5) == 0) {
+    c->data_lines++;
+  } else if (strncmp(line, "error:LINE_NUMBER", 17) == 0) {
+    c->line_number_errors++;
+  } else if (strcmp(line, ".") != 0) {
+    if (c->other_errors++ == 0)
+      snprintf(c->first_error, sizeof(c->first_error), "%.*s",
+               (int)sizeof(c->first_error) - 1, line); // may be cut
+  }
+}
+
+static void *client_thread(void *arg) {
+  client_t *c = (client_t *)arg;
+  int fd = client_connect(c->port);
+  if (fd < 0) {
+    c->failed = true;
+    return NULL;
+  }
+
+  const uint32_t total = c->lines + 1; // with the out-of-sequence line
+  double sent_at[CLIENT_WINDOW];
+  uint32_t sent = 0;
+  char rx[4096], line[256];
+  size_t line_len = 0;
+  while (c->oks < total) {
+    // Top the window up with one write.
+    char tx[CLIENT_WINDOW * 64];
+    size_t tx_len = 0;
+    double t = now_s();
+    while (sent < total && sent - c->oks < CLIENT_WINDOW) {
+      sent_at[sent % CLIENT_WINDOW] = t;
+      sent++;
+      tx_len += (size_t)client_line(c, sent, tx + tx_len, sizeof(tx) - tx_len);
+    }
+    if (tx_len && send(fd, tx, tx_len, MSG_NOSIGNAL) != (ssize_t)tx_len)
+      break;
+
+    ssize_t n = recv(fd, rx, sizeof(rx), 0);
+    if (n <= 0)
+      break;
+    t = now_s();
+    for (ssize_t i = 0; i < n; ++i) {
+      if (rx[i] != '\n') {
+        if (line_len < sizeof(line) - 1)
+          line[line_len++] = rx[i];
+        continue;
+      }
+      line[line_len] = '\0';
+      line_len = 0;
+      if (strcmp(line, "ok") == 0) {
+        double lat = t - sent_at[c->oks % CLIENT_WINDOW];
+        c->latency_sum_s += lat;
+        if (lat > c->latency_max_s)
+          c->latency_max_s = lat;
+      }
+      client_count(c, line);
+    }
+  }
+  c->failed = c->oks < total;
+  close(fd);
+  return NULL;
+}
+
+// Connects and pipelines up to STALL_LINES Q0s of every zone until the
+// server stops reading them, without ever reading an answer. Returns the
+// socket, or -1.
+#define STALL_LINES 5000
+
+static int stall_client(int port, int zones, uint32_t *lines) {
+  int fd = client_connect(port);
+  if (fd < 0)
+    return -1;
+  char line[32];
+  int len = snprintf(line, sizeof(line), "Q0 Z0-%d\n", zones - 1);
+  char buf[64 * sizeof(line)];
+  size_t size = 0;
+  while (size + (size_t)len <= sizeof(buf)) {
+    memcpy(buf + size, line, (size_t)len);
+    size += (size_t)len;
+  }
+
+  uint64_t sent = 0;
+  const uint64_t total = (uint64_t)STALL_LINES * (uint64_t)len;
+  for (int idle = 0; idle < 20 && sent < total;) {
+    size_t off = (size_t)(sent % size);
+    size_t n = size - off;
+    if (n > total - sent)
+      n = (size_t)(total - sent);
+    ssize_t w = send(fd, buf + off, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (w > 0) {
+      sent += (uint64_t)w;
+      idle = 0;
+    } else {
+      idle++;
+      sleep_ms(10);
+    }
+  }
+  *lines = (uint32_t)(sent / (uint64_t)len);
+  return fd;
+}
+
+// What the stalled client got, read once the server has closed it.
+typedef struct stall_result {
+  uint32_t oks;
+  uint32_t data_lines;
+  uint32_t keepalives;
+  uint32_t bad_lines; // cut short or garbled
+} stall_result_t;
+
+// Reads everything the server sent the stalled client. Every line must be
+// whole: an ok, a keepalive or a Q0 line ending with its ALARM field. Only
+// the text after the last '\n', cut off by the close, may be partial.
+static stall_result_t stall_drain(int fd) {
+  stall_result_t r = {0};
+  char rx[65536], line[256];
+  size_t line_len = 0;
+  ssize_t n;
+  while ((n = recv(fd, rx, sizeof(rx), 0)) > 0) {
+    for (ssize_t i = 0; i < n; ++i) {
+      if (rx[i] != '\n') {
+        if (line_len < sizeof(line) - 1)
+          line[line_len++] = rx[i];
+        continue;
+      }
+      line[line_len] = '\0';
+      line_len = 0;
+      const char *alarm = strstr(line, " ALARM=");
+      if (strcmp(line, "ok") == 0)
+        r.oks++;
+      else if (strcmp(line, ".") == 0)
+        r.keepalives++;
+      else if (strncmp(line, "data: ZONE=", 11) == 0 && alarm &&
+               alarm[7] != '\0' && strspn(alarm + 7, "0123456789") ==
+                                       strlen(alarm + 7))
+        r.data_lines++;
+      else
+        r.bad_lines++;
+    }
+  }
+  return r;
+}
+
+// The clients' answers must not wait on the stalled one: a mux that blocked
+// on its full ring would hold every answer up for as long.
+#define LATENCY_BOUND_S 0.5
+
+static int self_test(int clients, uint32_t lines, int zones) {
+  static server_t srv;
+  int port = server_init(&srv, 0, zones, false);
+  if (port < 0)
+    return 2;
+  // Keepalives every tick, so the stalled client's ring overflows with them.
+  srv.keepalive_ticks = 1;
+  pthread_t server;
+  pthread_create(&server, NULL, server_thread, &srv);
+
+  uint32_t stalled_lines = 0;
+  int stalled = stall_client(port, zones, &stalled_lines);
+
+  client_t *c = calloc((size_t)clients, sizeof(*c));
+  pthread_t *threads = calloc((size_t)clients, sizeof(*threads));
+  double t0 = now_s();
+  for (int i = 0; i < clients; ++i) {
+    c[i] = (client_t){.index = i, .port = port, .lines = lines,
+                      .zones = zones};
+    pthread_create(&threads[i], NULL, client_thread, &c[i]);
+  }
+  for (int i = 0; i < clients; ++i)
+    pthread_join(threads[i], NULL);
+  double wall_s = now_s() - t0;
+
+  // Give the keepalives time to fill what room the stalled ring has left.
+  sleep_ms(1000);
+  server_stop();
+  pthread_join(server, NULL);
+  stall_result_t sr = {0};
+  if (stalled >= 0) {
+    sr = stall_drain(stalled);
+    close(stalled);
+  }
+  close(srv.listen_fd);
+  const tcode_port_t *sp = &srv.mux.ports[0]; // the first to connect
+
+  // Each client: an ok per line, a data line per Q0, and only the one
+  // LINE_NUMBER error, whatever the other clients' numbering. The stalled
+  // one: only whole lines, and every ok after its Q0's zones (the last
+  // answer may be cut off by the close).
+  bool ok = stalled >= 0 && sr.bad_lines == 0 &&
+            sr.data_lines >= sr.oks * (uint32_t)zones &&
+            sr.data_lines <= (sr.oks + 1) * (uint32_t)zones;
+  uint64_t total_lines = 0;
+  double latency_sum_s = 0.0, latency_max_s = 0.0;
+  for (int i = 0; i < clients; ++i) {
+    const client_t *ci = &c[i];
+    bool good = !ci->failed && ci->oks == lines + 1 &&
+                ci->data_lines == lines / 2 && ci->line_number_errors == 1 &&
+                ci->other_errors == 0;
+    if (!good) {
+      printf("client %d: FAIL ok=%lu data=%lu line_number_errors=%lu "
+             "other_errors=%lu%s%s\n",
+             i, (unsigned long)ci->oks, (unsigned long)ci->data_lines,
+             (unsigned long)ci->line_number_errors,
+             (unsigned long)ci->other_errors,
+             ci->other_errors ? " first: " : "", ci->first_error);
+      ok = false;
+    }
+    total_lines += ci->oks;
+    latency_sum_s += ci->latency_sum_s;
+    if (ci->latency_max_s > latency_max_s)
+      latency_max_s = ci->latency_max_s;
+  }
+  printf("clients=%d lines=%llu wall=%.3fs lines_per_s=%.0f "
+         "latency_us mean=%.1f max=%.1f\n",
+         clients, (unsigned long long)total_lines, wall_s,
+         wall_s > 0 ? (double)total_lines / wall_s : 0.0,
+         total_lines ? latency_sum_s * 1e6 / (double)total_lines : 0.0,
+         latency_max_s * 1e6);
+  printf("stalled client: %lu Q0 Z0-%d sent, never read; then read back "
+         "ok=%lu data=%lu keepalives=%lu bad=%lu, dropped=%lu lines\n",
+         (unsigned long)stalled_lines, zones - 1, (unsigned long)sr.oks,
+         (unsigned long)sr.data_lines, (unsigned long)sr.keepalives,
+         (unsigned long)sr.bad_lines, (unsigned long)sp->tx_dropped);
+  if (latency_max_s > LATENCY_BOUND_S) {
+    printf("latency: FAIL max %.1f ms over %.0f ms\n", latency_max_s * 1e3,
+           LATENCY_BOUND_S * 1e3);
+    ok = false;
+  }
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  free(c);
+  free(threads);
+  return ok ? 0 : 1;
+}
+
+// ------------------------
+// -W: wakeups when idle
+// ------------------------
+
+// The server holds a setpoint, reached first in simulated time, for
+// `seconds` of real time with one client connected that sends nothing and
+// reads nothing. Counts the server thread's wakeups (returns from poll())
+// and its CPU time, polled and event-driven. Exits 1 unless event-driven
+// wakes at least ten times less often.
+static int wakeups(int seconds, int zones) {
+  static const struct {
+    const char *name;
+    float setpoint_c;
+  } cases[] = {{"ambient", 22.0f}, {"hold40", 40.0f}};
+  static server_t srv;
+  bool ok = true;
+
+  printf("%-8s %-6s %9s %7s %9s %6s\n", "setpoint", "loop", "wakeups/s",
+         "steps/s", "cpu_us/s", "cpu%");
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+    double polled_per_s = 0.0;
+    for (int polled = 1; polled >= 0; --polled) {
+      g_config.setpoint_c = cases[c].setpoint_c;
+      int port = server_init(&srv, 0, zones, false);
+      if (port < 0)
+        return 2;
+      srv.polled = polled;
+      // Reach the setpoint first: an hour at the update rate.
+      for (uint32_t t = UPDATE_PERIOD_TICKS; t <= 3600u * TICK_RATE_HZ;
+           t += UPDATE_PERIOD_TICKS)
+        thermo_system_step(&srv.sys, t,
+                           (float)UPDATE_PERIOD_TICKS / TICK_RATE_HZ);
+      drop_alarm_events(&srv.sys);
+      srv.start_s = now_s() - (double)srv.sys.now_ticks / TICK_RATE_HZ;
+      srv.next_step = srv.sys.now_ticks;
+      srv.next_keepalive = srv.sys.now_ticks + srv.keepalive_ticks;
+
+      int idle = client_connect(port);
+      pthread_t server;
+      pthread_create(&server, NULL, server_thread, &srv);
+      sleep_ms(seconds * 1000L);
+      server_stop();
+      pthread_join(server, NULL);
+      if (idle >= 0)
+        close(idle);
+      close(srv.listen_fd);
+      if (idle < 0 || srv.clients != 1) {
+        printf("idle client did not connect\n");
+        return 1;
+      }
+
+      double per_s = srv.wakeups / srv.run_s;
+      double cpu_us = srv.cpu_s * 1e6 / srv.run_s;
+      printf("%-8s %-6s %9.1f %7.1f %9.1f %6.3f\n", cases[c].name,
+             polled ? "polled" : "event", per_s, srv.steps / srv.run_s,
+             cpu_us, cpu_us * 1e-4);
+      if (polled)
+        polled_per_s = per_s;
+      else if (per_s * 10.0 > polled_per_s)
+        ok = false;
+    }
+  }
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-p port] [-z zones] [-v]\n"
+          "       %s -T clients [-n lines] [-z zones]\n"
+          "       %s -W seconds [-z zones]\n",
+          argv0, argv0, argv0);
+}
+
+int main(int argc, char **argv) {
+  int port = DEFAULT_PORT;
+  int zones = 4;
+  int test_clients = 0;
+  int wake_seconds = 0;
+  uint32_t lines = 20000;
+  bool verbose = false;
+  thermo_system_bench_config(&g_config, TICK_RATE_HZ);
+
+  int opt;
+  while ((opt = getopt(argc, argv, "p:z:vT:n:W:h")) != -1) {
+    switch (opt) {
+    case 'p':
+      port = atoi(optarg);
+      break;
+    case 'z':
+      zones = atoi(optarg);
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    case 'T':
+      test_clients = atoi(optarg);
+      break;
+    case 'n':
+      lines = (uint32_t)strtoul(optarg, NULL, 0);
+      break;
+    case 'W':
+      wake_seconds = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (optind != argc || zones < 1 || zones > THERMO_SYSTEM_MAX_ZONES ||
+      port < 0 || port > 65535 || test_clients < 0 ||
+      test_clients >= TCODE_MUX_MAX_PORTS || wake_seconds < 0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  if (test_clients > 0)
+    return self_test(test_clients, lines, zones);
+  if (wake_seconds > 0)
+    return wakeups(wake_seconds, zones);
+
+  static server_t srv;
+  port = server_init(&srv, port, zones, verbose);
+  if (port < 0)
+    return 2;
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  printf("T-Code on 127.0.0.1:%d, %d zones, up to %d clients\n", port, zones,
+         TCODE_MUX_MAX_PORTS);
+  fflush(stdout);
+  server_run(&srv);
+  close(srv.listen_fd);
+  printf("clients=%lu rejected=%lu\n", (unsigned long)srv.clients,
+         (unsigned long)srv.rejected);
+  return 0;
+}